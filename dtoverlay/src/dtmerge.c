@@ -27,6 +27,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "libfdt.h"
 
 #include "dtoverlay.h"
@@ -38,12 +41,95 @@ static void usage(void)
    printf("        to apply a parameter to the base dtb (like dtparam)\n");
    printf("    dtmerge [<options] <base dtb> <merged dtb> <overlay dtb> [param=value] ...\n");
    printf("        to apply an overlay with parameters (like dtoverlay)\n");
+   printf("    dtmerge -a <base dtb> <overlay dtb|directory> ...\n");
+   printf("        to report conflicts of the overlays, nothing is merged\n");
    printf("  where <options> is any of:\n");
    printf("    -d      Enable debug output\n");
+   printf("    -w      Walk the tree for every lookup instead of indexing it\n");
+   printf("    -a      Analyse the overlays for conflicts and unresolved symbols\n");
+   printf("    -c <dir>    Cache merged dtbs in <dir>, reusing them for the same inputs\n");
+   printf("    -s <kB>     Evict the least recently used ones above this size (1024)\n");
+   printf("    -V      Merge on cache hits as well and check the cached dtb\n");
    printf("    -h      Show this help message\n");
    exit(1);
 }
 
+static int dtbo_filter(const struct dirent *entry)
+{
+   int len = strlen(entry->d_name);
+
+   return (len > 5) && (strcmp(entry->d_name + len - 5, ".dtbo") == 0);
+}
+
+static int analyse_file(struct dtoverlay_analysis *an, const char *file,
+                        int max_dtb_size)
+{
+   DTBLOB_T *overlay_dtb;
+   int err;
+
+   overlay_dtb = dtoverlay_load_dtb(file, max_dtb_size);
+   if (!overlay_dtb)
+   {
+      printf("* failed to load '%s'\n", file);
+      return -1;
+   }
+   err = dtoverlay_analyse_add(an, overlay_dtb->fdt, file);
+   dtoverlay_free_dtb(overlay_dtb);
+   return err;
+}
+
+/* Lays the overlays - directories stand for the .dtbo files in them - over
+   the base and reports what collides. Returns the number of conflicts and
+   unresolved references */
+static int analyse(const char *base_file, int argc, char **argv, int max_dtb_size)
+{
+   struct dtoverlay_analysis *an;
+   struct dirent **entries;
+   DTBLOB_T *base_dtb;
+   struct stat st;
+   char path[512];
+   int err = 0, argn, i, n;
+
+   base_dtb = dtoverlay_load_dtb(base_file, max_dtb_size);
+   if (!base_dtb)
+   {
+      printf("* failed to load '%s'\n", base_file);
+      return -1;
+   }
+   an = dtoverlay_analyse_begin(base_dtb->fdt, stdout);
+   if (!an)
+   {
+      dtoverlay_free_dtb(base_dtb);
+      return -1;
+   }
+
+   for (argn = 0; !err && (argn < argc); argn++)
+   {
+      if ((stat(argv[argn], &st) == 0) && S_ISDIR(st.st_mode))
+      {
+         n = scandir(argv[argn], &entries, dtbo_filter, alphasort);
+         for (i = 0; i < n; i++)
+         {
+            snprintf(path, sizeof(path), "%s/%s", argv[argn], entries[i]->d_name);
+            if (!err)
+               err = analyse_file(an, path, max_dtb_size);
+            free(entries[i]);
+         }
+         if (n > 0)
+            free(entries);
+      }
+      else
+         err = analyse_file(an, argv[argn], max_dtb_size);
+   }
+
+   if (err)
+      dtoverlay_analyse_end(an);
+   else
+      err = dtoverlay_analyse_end(an);
+   dtoverlay_free_dtb(base_dtb);
+   return err;
+}
+
 int main(int argc, char **argv)
 {
    const char *base_file;
@@ -54,13 +140,37 @@ int main(int argc, char **argv)
    int err;
    int argn = 1;
    int max_dtb_size = 100000;
+   int use_index = 1;
+   int analysis = 0;
+   int debug = 0;
+   const char *cache_dir = NULL;
+   long cache_size = 1024;
+   int verify = 0;
+   struct dtoverlay_cache *cache = NULL;
 
    while ((argn < argc) && (argv[argn][0] == '-'))
    {
       const char *arg = argv[argn++];
       if ((strcmp(arg, "-d") == 0) ||
           (strcmp(arg, "--debug") == 0))
+      {
          dtoverlay_enable_debug(1);
+         debug = 1;
+      }
+      else if ((strcmp(arg, "-w") == 0) ||
+          (strcmp(arg, "--walk") == 0))
+         use_index = 0;
+      else if ((strcmp(arg, "-a") == 0) ||
+          (strcmp(arg, "--analyse") == 0))
+         analysis = 1;
+      else if (((strcmp(arg, "-c") == 0) ||
+          (strcmp(arg, "--cache") == 0)) && (argn < argc))
+         cache_dir = argv[argn++];
+      else if ((strcmp(arg, "-s") == 0) && (argn < argc))
+         cache_size = strtol(argv[argn++], NULL, 10);
+      else if ((strcmp(arg, "-V") == 0) ||
+          (strcmp(arg, "--verify") == 0))
+         verify = 1;
       else if ((strcmp(arg, "-h") == 0) ||
           (strcmp(arg, "--help") == 0))
          usage();
@@ -71,6 +181,16 @@ int main(int argc, char **argv)
       }
    }
 
+   if (analysis)
+   {
+      if (argc < (argn + 2))
+         usage();
+      err = analyse(argv[argn], argc - argn - 1, argv + argn + 1, max_dtb_size);
+      if (err < 0)
+         printf("* Exiting with error code %d\n", err);
+      return (err != 0);
+   }
+
    if (argc < (argn + 3))
    {
       usage();
@@ -80,12 +200,37 @@ int main(int argc, char **argv)
    merged_file = argv[argn++];
    overlay_file = argv[argn++];
 
+   if (cache_dir)
+   {
+      /* The parameters are taken apart below, they go into the key first */
+      cache = dtoverlay_cache_begin(cache_dir, cache_size * 1024, verify);
+      if (cache &&
+          ((dtoverlay_cache_add(cache, "dtmerge", 7) != 0) ||
+           (dtoverlay_cache_add_file(cache, base_file) != 0) ||
+           (((strcmp(overlay_file, "-") == 0) ?
+             dtoverlay_cache_add(cache, "-", 1) :
+             dtoverlay_cache_add_file(cache, overlay_file)) != 0) ||
+           (dtoverlay_cache_add_params(cache, argc - argn,
+                                       (const char **)argv + argn) != 0)))
+      {
+         dtoverlay_cache_end(cache, NULL);
+         cache = NULL;
+      }
+      if (cache && (dtoverlay_cache_fetch(cache, merged_file) == 1))
+      {
+         dtoverlay_cache_end(cache, debug ? stdout : NULL);
+         return 0;
+      }
+   }
+
    base_dtb = dtoverlay_load_dtb(base_file, max_dtb_size);
    if (!base_dtb)
    {
        printf("* failed to load '%s'\n", base_file);
        return -1;
    }
+   if (use_index)
+      fdt_index_enable(base_dtb->fdt);
 
    err = dtoverlay_set_synonym(base_dtb, "i2c", "i2c0");
    err = dtoverlay_set_synonym(base_dtb, "i2c_arm", "i2c0");
@@ -102,7 +247,11 @@ int main(int argc, char **argv)
    {
       overlay_dtb = dtoverlay_load_dtb(overlay_file, max_dtb_size);
       if (overlay_dtb)
+      {
+	  if (use_index)
+	     fdt_index_enable(overlay_dtb->fdt);
 	  err = dtoverlay_fixup_overlay(base_dtb, overlay_dtb);
+      }
       else
 	  err = -1;
    }
@@ -152,8 +301,9 @@ int main(int argc, char **argv)
 
    if (!err && (overlay_dtb != base_dtb))
    {
-      err = dtoverlay_merge_overlay(base_dtb, overlay_dtb);
+      err = dtoverlay_edit_merge_overlay(base_dtb, overlay_dtb);
 
+      fdt_index_disable(overlay_dtb->fdt);
       dtoverlay_free_dtb(overlay_dtb);
    }
 
@@ -163,8 +313,19 @@ int main(int argc, char **argv)
       err = dtoverlay_save_dtb(base_dtb, merged_file);
    }
 
+   fdt_index_disable(base_dtb->fdt);
    dtoverlay_free_dtb(base_dtb);
 
+   if (cache)
+   {
+      if (!err && (dtoverlay_cache_store(cache, merged_file) == 1))
+      {
+         printf("* cached '%s' differed from the merged one, replaced\n", merged_file);
+         err = 1;
+      }
+      dtoverlay_cache_end(cache, debug ? stdout : NULL);
+   }
+
    if (err != 0)
       printf("* Exiting with error code %d\n", err);
 
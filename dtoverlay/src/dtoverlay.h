@@ -97,6 +97,59 @@ int dtoverlay_fixup_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb);
 
 int dtoverlay_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb);
 
+struct fdt_edit;
+
+/* Edit transactions, see fdt_edit_begin(). Return values: -ve = fatal error */
+struct fdt_edit *dtoverlay_edit_begin(DTBLOB_T *dtb);
+
+void dtoverlay_edit_abort(struct fdt_edit *edit);
+
+int dtoverlay_edit_commit(DTBLOB_T *dtb, struct fdt_edit *edit);
+
+int dtoverlay_edit_merge(struct fdt_edit *edit, int target_off,
+                         DTBLOB_T *overlay_dtb, int overlay_off, int depth);
+
+int dtoverlay_edit_merge_fragments(struct fdt_edit *edit, DTBLOB_T *base_dtb,
+                                   DTBLOB_T *overlay_dtb);
+
+/* dtoverlay_merge_overlay through one edit transaction */
+int dtoverlay_edit_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb);
+
+/* Adds an overlay, parameters applied, to a combined overlay. Returns
+   1 if it can't be combined with the overlays already there */
+int dtoverlay_combine(DTBLOB_T *combined, DTBLOB_T *overlay_dtb);
+
+struct dtoverlay_analysis;
+
+/* Conflict and resource analysis of a base DTB and overlays, without
+   merging them. dtoverlay_analyse_end() returns the number of conflicts
+   and unresolved references, -ve = fatal error */
+struct dtoverlay_analysis *dtoverlay_analyse_begin(const void *base_fdt, FILE *out);
+
+int dtoverlay_analyse_add(struct dtoverlay_analysis *an, const void *overlay_fdt,
+                          const char *name);
+
+int dtoverlay_analyse_end(struct dtoverlay_analysis *an);
+
+struct dtoverlay_cache;
+
+/* Merged DTBs cached by the hash of the blobs and parameters that went
+   into them. fetch returns 1 on a hit, store 1 if verification found a
+   different result. Return values: -ve = error */
+struct dtoverlay_cache *dtoverlay_cache_begin(const char *dir, long max_size, int verify);
+
+int dtoverlay_cache_add(struct dtoverlay_cache *cache, const void *data, int len);
+
+int dtoverlay_cache_add_file(struct dtoverlay_cache *cache, const char *filename);
+
+int dtoverlay_cache_add_params(struct dtoverlay_cache *cache, int argc, const char **argv);
+
+int dtoverlay_cache_fetch(struct dtoverlay_cache *cache, const char *filename);
+
+int dtoverlay_cache_store(struct dtoverlay_cache *cache, const char *filename);
+
+void dtoverlay_cache_end(struct dtoverlay_cache *cache, FILE *debug);
+
 int dtoverlay_merge_params(DTBLOB_T *dtb, const DTOVERLAY_PARAM_T *params,
                            unsigned int num_params);
 
@@ -137,6 +190,9 @@ DTBLOB_T *dtoverlay_load_dtb(const char *filename, int max_size);
 
 DTBLOB_T *dtoverlay_import_fdt(void *fdt, int max_size);
 
+/* Reads a device tree filesystem (/proc/device-tree) into a malloced DTB */
+void *dtoverlay_fs_to_fdt(const char *dirname, int max_size);
+
 int dtoverlay_save_dtb(const DTBLOB_T *dtb, const char *filename);
 
 int dtoverlay_extend_dtb(DTBLOB_T *dtb, int new_size);
@@ -0,0 +1,1115 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * conflict and resource analysis of a base DTB and a set of overlays,
+ * without merging them: the nodes are kept in a table hashed by path,
+ * the overlays are laid over it the way they would be applied (phandles
+ * renumbered, fixups resolved through the hashed symbol table) and
+ * overridden properties and unresolved symbols are reported on the way.
+ * A last pass over the enabled nodes collects the resources they claim -
+ * reg ranges on their bus, pins of their pinctrl groups, gpios and gpio
+ * interrupts - and reports the ones claimed twice
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "libfdt.h"
+
+#include "dtoverlay.h"
+
+#define AN_PATH_MAX		256
+#define AN_CHUNK_SIZE		(64 * 1024)
+#define AN_INITIAL_SLOTS	1024
+
+typedef struct an_prop_struct
+{
+   const char *name;
+   const void *value;
+   int len;
+   int owner;			/* overlay index, -1 for the base */
+   struct an_prop_struct *next;
+} AN_PROP_T;
+
+typedef struct an_node_struct
+{
+   const char *path;
+   uint32_t phandle;
+   int owner;			/* last overlay setting a property, or -1 */
+   int enabled;			/* -1 not known yet */
+   AN_PROP_T *props;
+   struct an_node_struct *next;	/* all nodes, in the order they came */
+} AN_NODE_T;
+
+typedef struct an_slot_struct
+{
+   const char *key;
+   void *value;
+} AN_SLOT_T;
+
+typedef struct an_hash_struct
+{
+   AN_SLOT_T *slots;
+   unsigned int mask;
+   int used;
+} AN_HASH_T;
+
+typedef struct an_reg_struct
+{
+   AN_NODE_T *bus;
+   AN_NODE_T *node;
+   uint64_t start, end;		/* end is exclusive */
+} AN_REG_T;
+
+typedef struct an_claim_struct
+{
+   AN_NODE_T *node;
+   const char *prop;
+} AN_CLAIM_T;
+
+struct dtoverlay_analysis
+{
+   FILE *out;
+   char **chunks;
+   int num_chunks;
+   int chunk_used;
+   AN_HASH_T nodes;		/* path -> AN_NODE_T */
+   AN_HASH_T phandles;		/* "%x" -> AN_NODE_T */
+   AN_HASH_T symbols;		/* name -> path */
+   AN_HASH_T claims;		/* "<controller>:<pin>" -> AN_CLAIM_T */
+   AN_NODE_T *first, *last;
+   uint32_t max_phandle;
+   const char **names;		/* of the overlays */
+   int num_overlays;
+   AN_REG_T *regs;
+   int num_regs, max_regs;
+   int errors;
+   int warnings;
+};
+
+typedef struct dtoverlay_analysis AN_T;
+
+/* Memory lives until the analysis ends */
+static void *an_alloc(AN_T *an, int size)
+{
+   char **chunks;
+   void *p;
+
+   size = (size + 7) & ~7;
+   if (size > AN_CHUNK_SIZE)
+      return NULL;
+   if (!an->num_chunks || (an->chunk_used + size > AN_CHUNK_SIZE))
+   {
+      chunks = realloc(an->chunks, (an->num_chunks + 1) * sizeof(char *));
+      if (!chunks)
+         return NULL;
+      an->chunks = chunks;
+      an->chunks[an->num_chunks] = malloc(AN_CHUNK_SIZE);
+      if (!an->chunks[an->num_chunks])
+         return NULL;
+      an->num_chunks++;
+      an->chunk_used = 0;
+   }
+   p = an->chunks[an->num_chunks - 1] + an->chunk_used;
+   an->chunk_used += size;
+   return p;
+}
+
+static char *an_strdup(AN_T *an, const char *s, int len)
+{
+   char *p = an_alloc(an, len + 1);
+
+   if (p)
+   {
+      memcpy(p, s, len);
+      p[len] = '\0';
+   }
+   return p;
+}
+
+static unsigned int an_hash(const char *s)
+{
+   unsigned int hash = 2166136261u;
+
+   while (*s)
+      hash = (hash ^ (unsigned char)*s++) * 16777619u;
+   return hash;
+}
+
+static void *an_find(AN_HASH_T *hash, const char *key)
+{
+   unsigned int i;
+
+   if (!hash->slots)
+      return NULL;
+   for (i = an_hash(key) & hash->mask; hash->slots[i].key; i = (i + 1) & hash->mask)
+      if (strcmp(hash->slots[i].key, key) == 0)
+         return hash->slots[i].value;
+   return NULL;
+}
+
+// Sets the value of the key, which has to stay valid. Returns 0 or <0.
+static int an_insert(AN_HASH_T *hash, const char *key, void *value)
+{
+   AN_SLOT_T *slots;
+   unsigned int i, j, mask;
+
+   if ((hash->used + 1) * 2 > (int)hash->mask)
+   {
+      mask = hash->slots ? hash->mask * 2 + 1 : AN_INITIAL_SLOTS - 1;
+      slots = calloc(mask + 1, sizeof(AN_SLOT_T));
+      if (!slots)
+         return -FDT_ERR_NOSPACE;
+      for (i = 0; hash->slots && (i <= hash->mask); i++)
+      {
+         if (!hash->slots[i].key)
+            continue;
+         for (j = an_hash(hash->slots[i].key) & mask; slots[j].key; j = (j + 1) & mask)
+            ;
+         slots[j] = hash->slots[i];
+      }
+      free(hash->slots);
+      hash->slots = slots;
+      hash->mask = mask;
+   }
+
+   for (i = an_hash(key) & hash->mask; hash->slots[i].key; i = (i + 1) & hash->mask)
+   {
+      if (strcmp(hash->slots[i].key, key) == 0)
+      {
+         hash->slots[i].value = value;
+         return 0;
+      }
+   }
+   hash->slots[i].key = key;
+   hash->slots[i].value = value;
+   hash->used++;
+   return 0;
+}
+
+static const char *an_owner(AN_T *an, int owner)
+{
+   return (owner < 0) ? "base" : an->names[owner];
+}
+
+static void an_report(AN_T *an, int is_error, const char *fmt, ...)
+{
+   va_list ap;
+
+   if (is_error)
+      an->errors++;
+   else
+      an->warnings++;
+   if (!an->out)
+      return;
+   va_start(ap, fmt);
+   vfprintf(an->out, fmt, ap);
+   va_end(ap);
+   fputc('\n', an->out);
+}
+
+static AN_NODE_T *an_node(AN_T *an, const char *path)
+{
+   return an_find(&an->nodes, path);
+}
+
+static AN_NODE_T *an_add_node(AN_T *an, const char *path, int owner)
+{
+   AN_NODE_T *node = an_node(an, path);
+
+   if (node)
+      return node;
+   node = an_alloc(an, sizeof(AN_NODE_T));
+   if (!node)
+      return NULL;
+   memset(node, 0, sizeof(*node));
+   node->path = an_strdup(an, path, strlen(path));
+   node->owner = owner;
+   node->enabled = -1;
+   if (!node->path || an_insert(&an->nodes, node->path, node))
+      return NULL;
+   if (an->last)
+      an->last->next = node;
+   else
+      an->first = node;
+   an->last = node;
+   return node;
+}
+
+static AN_PROP_T *an_prop(AN_NODE_T *node, const char *name)
+{
+   AN_PROP_T *prop;
+
+   for (prop = node->props; prop; prop = prop->next)
+      if (strcmp(prop->name, name) == 0)
+         return prop;
+   return NULL;
+}
+
+static int an_set_phandle(AN_T *an, AN_NODE_T *node, uint32_t phandle)
+{
+   char key[12], *p;
+
+   node->phandle = phandle;
+   if (phandle > an->max_phandle)
+      an->max_phandle = phandle;
+   snprintf(key, sizeof(key), "%x", phandle);
+   p = an_strdup(an, key, strlen(key));
+   return p ? an_insert(&an->phandles, p, node) : -FDT_ERR_NOSPACE;
+}
+
+static AN_NODE_T *an_phandle_node(AN_T *an, uint32_t phandle)
+{
+   char key[12];
+
+   snprintf(key, sizeof(key), "%x", phandle);
+   return an_find(&an->phandles, key);
+}
+
+static uint32_t an_cell(const void *value, int index)
+{
+   fdt32_t cell;
+
+   memcpy(&cell, (const char *)value + 4 * index, 4);
+   return fdt32_to_cpu(cell);
+}
+
+#define AN_DEPTH_MAX	32
+
+// All nodes of the base in one walk, the properties left in the blob
+static int an_load_base(AN_T *an, const void *fdt)
+{
+   char path[AN_PATH_MAX];
+   int lens[AN_DEPTH_MAX];
+   AN_NODE_T *node;
+   AN_PROP_T *prop, **tail;
+   const char *name;
+   uint32_t phandle;
+   int node_off, prop_off, depth = 0, len, name_len, err;
+
+   for (node_off = 0; (node_off >= 0) && (depth >= 0);
+        node_off = fdt_next_node(fdt, node_off, &depth))
+   {
+      if (depth >= AN_DEPTH_MAX)
+         return -FDT_ERR_BADSTRUCTURE;
+      if (depth == 0)
+      {
+         strcpy(path, "/");
+         len = 0;
+      }
+      else
+      {
+         name = fdt_get_name(fdt, node_off, &name_len);
+         len = lens[depth - 1];
+         if (len + name_len + 2 > AN_PATH_MAX)
+            return -FDT_ERR_NOSPACE;
+         path[len] = '/';
+         memcpy(path + len + 1, name, name_len + 1);
+         len += 1 + name_len;
+      }
+      lens[depth] = len;
+
+      node = an_add_node(an, path, -1);
+      if (!node)
+         return -FDT_ERR_NOSPACE;
+      tail = &node->props;
+      for (prop_off = fdt_first_property_offset(fdt, node_off); prop_off >= 0;
+           prop_off = fdt_next_property_offset(fdt, prop_off))
+      {
+         prop = an_alloc(an, sizeof(AN_PROP_T));
+         if (!prop)
+            return -FDT_ERR_NOSPACE;
+         prop->value = fdt_getprop_by_offset(fdt, prop_off, &prop->name, &prop->len);
+         prop->owner = -1;
+         prop->next = NULL;
+         *tail = prop;
+         tail = &prop->next;
+         if ((prop->len == 4) && !node->phandle &&
+             ((strcmp(prop->name, "phandle") == 0) || (strcmp(prop->name, "linux,phandle") == 0)))
+         {
+            phandle = an_cell(prop->value, 0);
+            if (phandle && (phandle != (uint32_t)-1) && (err = an_set_phandle(an, node, phandle)))
+               return err;
+         }
+      }
+   }
+   return 0;
+}
+
+typedef struct an_fragment_struct
+{
+   const char *name;
+   const char *target;		/* path, NULL if it did not resolve */
+} AN_FRAGMENT_T;
+
+typedef struct an_fixup_struct
+{
+   const char *sym;		/* NULL for a local fixup */
+   uint32_t off;
+   struct an_fixup_struct *next;
+} AN_FIXUP_T;
+
+typedef struct an_overlay_struct
+{
+   const void *fdt;
+   int index;
+   uint32_t delta;
+   const char *frag_name;		/* of the fragment being added */
+   const char *target;		/* its target path */
+   AN_FRAGMENT_T *frags;
+   int num_frags;
+   AN_HASH_T fixups;		/* "path:prop" -> AN_FIXUP_T, both kinds */
+} AN_OVERLAY_T;
+
+static const char *an_rewrite(AN_OVERLAY_T *ovl, const char *value, char *path);
+
+// The symbols of the base, or of the overlay with their paths below the targets
+static int an_add_symbols(AN_T *an, const void *fdt, AN_OVERLAY_T *ovl)
+{
+   int owner = ovl ? ovl->index : -1;
+   int symbols_off = fdt_path_offset(fdt, "/__symbols__");
+   char path[AN_PATH_MAX];
+   const char *name, *value, *old;
+   char *key, *copy;
+   int prop_off, len;
+
+   for (prop_off = fdt_first_property_offset(fdt, symbols_off); prop_off >= 0;
+        prop_off = fdt_next_property_offset(fdt, prop_off))
+   {
+      value = fdt_getprop_by_offset(fdt, prop_off, &name, &len);
+      if ((len < 1) || value[len - 1])
+         continue;
+      if (ovl)
+         value = an_rewrite(ovl, value, path);
+      if (!value)
+         continue;
+      old = an_find(&an->symbols, name);
+      if (old && strcmp(old, value))
+         an_report(an, 0, "%s: symbol '%s' moves from %s to %s",
+                   an_owner(an, owner), name, old, value);
+      key = an_strdup(an, name, strlen(name));
+      copy = an_strdup(an, value, strlen(value));
+      if (!key || !copy || an_insert(&an->symbols, key, copy))
+         return -FDT_ERR_NOSPACE;
+   }
+   return 0;
+}
+
+// Starts the analysis of overlays for the base DTB, which has to stay
+// around until dtoverlay_analyse_end(). Findings go to out, if not NULL.
+struct dtoverlay_analysis *dtoverlay_analyse_begin(const void *base_fdt, FILE *out)
+{
+   AN_T *an;
+
+   an = calloc(1, sizeof(AN_T));
+   if (!an)
+      return NULL;
+   an->out = out;
+   if (fdt_check_header(base_fdt) ||
+       an_load_base(an, base_fdt) ||
+       an_add_symbols(an, base_fdt, NULL))
+   {
+      dtoverlay_analyse_end(an);
+      return NULL;
+   }
+   return an;
+}
+
+// "/fragment@i/__overlay__/rel" to the path below the target of the fragment
+static const char *an_rewrite(AN_OVERLAY_T *ovl, const char *value, char *path)
+{
+   const char *rest = strstr(value, "/__overlay__");
+   int i, len;
+
+   if (!rest || (value[0] != '/'))
+      return NULL;
+   len = rest - value - 1;
+   rest += strlen("/__overlay__");
+   for (i = 0; i < ovl->num_frags; i++)
+   {
+      if (!ovl->frags[i].target || strncmp(ovl->frags[i].name, value + 1, len) ||
+          ovl->frags[i].name[len])
+         continue;
+      if (snprintf(path, AN_PATH_MAX, "%s%s", strcmp(ovl->frags[i].target, "/") ?
+                   ovl->frags[i].target : "", rest) >= AN_PATH_MAX)
+         return NULL;
+      return path[0] ? path : "/";
+   }
+   return NULL;
+}
+
+static int an_add_fixup(AN_T *an, AN_OVERLAY_T *ovl, const char *path, int path_len,
+                        const char *prop, const char *sym, uint32_t off)
+{
+   AN_FIXUP_T *fixup;
+   char *key;
+
+   key = an_alloc(an, path_len + strlen(prop) + 2);
+   fixup = an_alloc(an, sizeof(AN_FIXUP_T));
+   if (!key || !fixup)
+      return -FDT_ERR_NOSPACE;
+   sprintf(key, "%.*s:%s", path_len, path, prop);
+   fixup->sym = sym;
+   fixup->off = off;
+   fixup->next = an_find(&ovl->fixups, key);
+   return an_insert(&ovl->fixups, key, fixup);
+}
+
+static int an_load_local_fixups(AN_T *an, AN_OVERLAY_T *ovl, int node_off,
+                                char *path, int len)
+{
+   const fdt32_t *offsets;
+   const char *name;
+   int prop_off, sub_off, name_len, i, err;
+
+   for (prop_off = fdt_first_property_offset(ovl->fdt, node_off); prop_off >= 0;
+        prop_off = fdt_next_property_offset(ovl->fdt, prop_off))
+   {
+      offsets = fdt_getprop_by_offset(ovl->fdt, prop_off, &name, &name_len);
+      for (i = 0; i < name_len / 4; i++)
+         if ((err = an_add_fixup(an, ovl, path, len, name, NULL, fdt32_to_cpu(offsets[i]))))
+            return err;
+   }
+   for (sub_off = fdt_first_subnode(ovl->fdt, node_off); sub_off >= 0;
+        sub_off = fdt_next_subnode(ovl->fdt, sub_off))
+   {
+      name = fdt_get_name(ovl->fdt, sub_off, &name_len);
+      if (len + name_len + 2 > AN_PATH_MAX)
+         return -FDT_ERR_NOSPACE;
+      path[len] = '/';
+      memcpy(path + len + 1, name, name_len + 1);
+      err = an_load_local_fixups(an, ovl, sub_off, path, len + 1 + name_len);
+      path[len] = '\0';
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// Both kinds of fixups of the overlay by the path and property they patch
+static int an_load_fixups(AN_T *an, AN_OVERLAY_T *ovl)
+{
+   char path[AN_PATH_MAX] = "";
+   const char *list, *end, *sym, *prop, *colon;
+   char name[AN_PATH_MAX];
+   int prop_off, node_off, len, err;
+
+   for (prop_off = fdt_first_property_offset(ovl->fdt, fdt_path_offset(ovl->fdt, "/__fixups__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(ovl->fdt, prop_off))
+   {
+      list = fdt_getprop_by_offset(ovl->fdt, prop_off, &sym, &len);
+      for (end = list + len; list < end; list += strlen(list) + 1)
+      {
+         // "path:prop:offset"
+         prop = strchr(list, ':');
+         colon = prop ? strchr(prop + 1, ':') : NULL;
+         if (!colon || (colon - prop - 1 >= AN_PATH_MAX))
+            continue;
+         memcpy(name, prop + 1, colon - prop - 1);
+         name[colon - prop - 1] = '\0';
+         err = an_add_fixup(an, ovl, list, prop - list, name, sym, strtoul(colon + 1, NULL, 10));
+         if (err)
+            return err;
+      }
+   }
+   node_off = fdt_path_offset(ovl->fdt, "/__local_fixups__");
+   return (node_off < 0) ? 0 : an_load_local_fixups(an, ovl, node_off, path, 0);
+}
+
+static AN_FIXUP_T *an_fixups(AN_OVERLAY_T *ovl, const char *path, const char *prop)
+{
+   char key[AN_PATH_MAX + 64];
+
+   if (snprintf(key, sizeof(key), "%s:%s", path, prop) >= (int)sizeof(key))
+      return NULL;
+   return an_find(&ovl->fixups, key);
+}
+
+// The node of a symbol, reporting it once per overlay if it is missing
+static AN_NODE_T *an_symbol_node(AN_T *an, AN_OVERLAY_T *ovl, const char *sym)
+{
+   const char *path = an_find(&an->symbols, sym);
+   AN_NODE_T *node = path ? an_node(an, path) : NULL;
+   char *key;
+
+   if (node)
+      return node;
+   key = an_alloc(an, strlen(sym) + 16);
+   if (!key)
+      return NULL;
+   sprintf(key, "%d:%s", ovl->index, sym);
+   if (!an_find(&an->claims, key))
+   {
+      an_insert(&an->claims, key, key);
+      an_report(an, 1, "%s: unresolved symbol '%s'", an_owner(an, ovl->index), sym);
+   }
+   return NULL;
+}
+
+// The phandle of a node, given one if it has none like the fixup would
+static uint32_t an_node_phandle(AN_T *an, AN_NODE_T *node)
+{
+   if (!node->phandle)
+      an_set_phandle(an, node, an->max_phandle + 1);
+   return node->phandle;
+}
+
+// Copies the property of the overlay node and patches the phandles in it
+static void *an_resolve(AN_T *an, AN_OVERLAY_T *ovl, const char *src_path,
+                        const char *name, const void *value, int len)
+{
+   AN_FIXUP_T *fixup;
+   AN_NODE_T *target;
+   uint32_t phandle;
+   fdt32_t cell;
+   char *copy;
+
+   copy = an_alloc(an, len ? len : 1);
+   if (!copy)
+      return NULL;
+   memcpy(copy, value, len);
+
+   if ((strcmp(name, "phandle") == 0) || (strcmp(name, "linux,phandle") == 0))
+   {
+      if (len == 4)
+      {
+         cell = cpu_to_fdt32(an_cell(copy, 0) + ovl->delta);
+         memcpy(copy, &cell, 4);
+      }
+      return copy;
+   }
+
+   for (fixup = an_fixups(ovl, src_path, name); fixup; fixup = fixup->next)
+   {
+      if (fixup->off + 4 > (uint32_t)len)
+         continue;
+      if (fixup->sym)
+      {
+         target = an_symbol_node(an, ovl, fixup->sym);
+         if (!target)
+            continue;
+         phandle = an_node_phandle(an, target);
+      }
+      else
+      {
+         phandle = an_cell(copy + fixup->off, 0) + ovl->delta;
+      }
+      cell = cpu_to_fdt32(phandle);
+      memcpy(copy + fixup->off, &cell, 4);
+   }
+   return copy;
+}
+
+static int an_add_overlay_node(AN_T *an, AN_OVERLAY_T *ovl, int src_off,
+                               char *rel, int rel_len)
+{
+   char path[AN_PATH_MAX], src_path[AN_PATH_MAX];
+   const char *name;
+   const void *value;
+   AN_PROP_T *prop;
+   AN_NODE_T *node;
+   void *copy;
+   int prop_off, sub_off, len, name_len, err;
+
+   if ((snprintf(path, sizeof(path), "%s%s", strcmp(ovl->target, "/") ? ovl->target : "",
+                 rel_len ? rel : "") >= (int)sizeof(path)) ||
+       (snprintf(src_path, sizeof(src_path), "/%s/__overlay__%s", ovl->frag_name,
+                 rel_len ? rel : "") >= (int)sizeof(src_path)))
+      return -FDT_ERR_NOSPACE;
+   node = an_add_node(an, path[0] ? path : "/", ovl->index);
+   if (!node)
+      return -FDT_ERR_NOSPACE;
+
+   for (prop_off = fdt_first_property_offset(ovl->fdt, src_off); prop_off >= 0;
+        prop_off = fdt_next_property_offset(ovl->fdt, prop_off))
+   {
+      value = fdt_getprop_by_offset(ovl->fdt, prop_off, &name, &len);
+      if (strcmp(name, "name") == 0)
+         continue;
+      copy = an_resolve(an, ovl, src_path, name, value, len);
+      if (!copy)
+         return -FDT_ERR_NOSPACE;
+
+      prop = an_prop(node, name);
+      if (prop && ((prop->len != len) || memcmp(prop->value, copy, len)))
+      {
+         if (prop->owner >= 0)
+            an_report(an, 0, "%s: %s:%s already set by %s", an_owner(an, ovl->index),
+                      node->path, name, an_owner(an, prop->owner));
+         else if (strcmp(name, "status"))
+            an_report(an, 0, "%s: %s:%s overrides the base", an_owner(an, ovl->index),
+                      node->path, name);
+      }
+      if (!prop)
+      {
+         prop = an_alloc(an, sizeof(AN_PROP_T));
+         if (!prop)
+            return -FDT_ERR_NOSPACE;
+         prop->name = an_strdup(an, name, strlen(name));
+         prop->next = node->props;
+         node->props = prop;
+      }
+      prop->value = copy;
+      prop->len = len;
+      prop->owner = ovl->index;
+      node->owner = ovl->index;
+
+      if (((strcmp(name, "phandle") == 0) || (strcmp(name, "linux,phandle") == 0)) &&
+          (len == 4))
+      {
+         err = an_set_phandle(an, node, an_cell(copy, 0));
+         if (err)
+            return err;
+      }
+   }
+
+   for (sub_off = fdt_first_subnode(ovl->fdt, src_off); sub_off >= 0;
+        sub_off = fdt_next_subnode(ovl->fdt, sub_off))
+   {
+      name = fdt_get_name(ovl->fdt, sub_off, &name_len);
+      if (rel_len + name_len + 2 > AN_PATH_MAX)
+         return -FDT_ERR_NOSPACE;
+      rel[rel_len] = '/';
+      memcpy(rel + rel_len + 1, name, name_len + 1);
+      err = an_add_overlay_node(an, ovl, sub_off, rel, rel_len + 1 + name_len);
+      rel[rel_len] = '\0';
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// The target node of a fragment, NULL if it does not resolve
+static AN_NODE_T *an_fragment_target(AN_T *an, AN_OVERLAY_T *ovl, int frag_off)
+{
+   char frag_path[AN_PATH_MAX];
+   const fdt32_t *cell;
+   AN_FIXUP_T *fixup;
+   const char *path;
+   AN_NODE_T *node;
+   int len;
+
+   path = fdt_getprop(ovl->fdt, frag_off, "target-path", &len);
+   if (path)
+   {
+      if ((len < 1) || path[len - 1])
+         return NULL;
+      if (path[0] != '/')
+      {
+         // an alias
+         AN_PROP_T *alias = NULL;
+         node = an_node(an, "/aliases");
+         if (node)
+            alias = an_prop(node, path);
+         path = alias ? alias->value : NULL;
+      }
+      node = path ? an_node(an, path) : NULL;
+      if (!node)
+         an_report(an, 1, "%s: unresolved target-path '%s'", an_owner(an, ovl->index),
+                   fdt_getprop(ovl->fdt, frag_off, "target-path", NULL));
+      return node;
+   }
+
+   cell = fdt_getprop(ovl->fdt, frag_off, "target", &len);
+   if (!cell || (len != 4))
+      return NULL;
+   snprintf(frag_path, sizeof(frag_path), "/%s", ovl->frag_name);
+   fixup = an_fixups(ovl, frag_path, "target");
+   if (fixup && fixup->sym)
+      return an_symbol_node(an, ovl, fixup->sym);
+   node = an_phandle_node(an, fdt32_to_cpu(*cell) + (fixup ? ovl->delta : 0));
+   if (!node)
+      an_report(an, 1, "%s: unresolved target of %s", an_owner(an, ovl->index), ovl->frag_name);
+   return node;
+}
+
+// Lays the overlay, parameters applied, over the tree. Returns 0 on
+// success, otherwise <0 error code.
+int dtoverlay_analyse_add(struct dtoverlay_analysis *an, const void *overlay_fdt,
+                          const char *name)
+{
+   char rel[AN_PATH_MAX] = "";
+   AN_OVERLAY_T ovl;
+   AN_FRAGMENT_T *frags;
+   AN_NODE_T *target;
+   const char **names;
+   uint32_t max;
+   int frag_off, overlay_off, node_off, err;
+
+   if (fdt_check_header(overlay_fdt))
+      return -FDT_ERR_BADMAGIC;
+   names = realloc(an->names, (an->num_overlays + 1) * sizeof(char *));
+   if (!names)
+      return -FDT_ERR_NOSPACE;
+   an->names = names;
+   an->names[an->num_overlays] = an_strdup(an, name, strlen(name));
+
+   memset(&ovl, 0, sizeof(ovl));
+   ovl.fdt = overlay_fdt;
+   ovl.index = an->num_overlays++;
+   ovl.delta = an->max_phandle;
+
+   // The phandles of the overlay go above the ones there are
+   max = an->max_phandle;
+   for (node_off = fdt_next_node(overlay_fdt, -1, NULL); node_off >= 0;
+        node_off = fdt_next_node(overlay_fdt, node_off, NULL))
+   {
+      uint32_t phandle = fdt_get_phandle(overlay_fdt, node_off);
+      if (phandle && (phandle != (uint32_t)-1) && (phandle + ovl.delta > max))
+         max = phandle + ovl.delta;
+   }
+   an->max_phandle = max;
+
+   err = an_load_fixups(an, &ovl);
+   if (err)
+   {
+      free(ovl.fixups.slots);
+      return err;
+   }
+
+   for (frag_off = fdt_first_subnode(overlay_fdt, 0); frag_off >= 0;
+        frag_off = fdt_next_subnode(overlay_fdt, frag_off))
+   {
+      overlay_off = fdt_subnode_offset(overlay_fdt, frag_off, "__overlay__");
+      if (overlay_off < 0)
+         continue;
+      ovl.frag_name = fdt_get_name(overlay_fdt, frag_off, NULL);
+      target = an_fragment_target(an, &ovl, frag_off);
+      if ((ovl.num_frags & 15) == 0)
+      {
+         frags = realloc(ovl.frags, (ovl.num_frags + 16) * sizeof(AN_FRAGMENT_T));
+         if (!frags)
+         {
+            err = -FDT_ERR_NOSPACE;
+            break;
+         }
+         ovl.frags = frags;
+      }
+      ovl.frags[ovl.num_frags].name = ovl.frag_name;
+      ovl.frags[ovl.num_frags++].target = target ? target->path : NULL;
+      if (!target)
+         continue;
+      ovl.target = target->path;
+      err = an_add_overlay_node(an, &ovl, overlay_off, rel, 0);
+      if (err)
+         break;
+   }
+
+   if (!err)
+      err = an_add_symbols(an, overlay_fdt, &ovl);
+   free(ovl.frags);
+   free(ovl.fixups.slots);
+   return err;
+}
+
+static int an_enabled(AN_T *an, AN_NODE_T *node)
+{
+   char parent[AN_PATH_MAX];
+   AN_NODE_T *up;
+   AN_PROP_T *status;
+   const char *slash;
+
+   if (node->enabled >= 0)
+      return node->enabled;
+   status = an_prop(node, "status");
+   node->enabled = !status || (status->len < 1) ||
+                   (strcmp(status->value, "okay") == 0) || (strcmp(status->value, "ok") == 0);
+   slash = strrchr(node->path, '/');
+   if (node->enabled && slash && (slash != node->path) &&
+       (slash - node->path < AN_PATH_MAX))
+   {
+      memcpy(parent, node->path, slash - node->path);
+      parent[slash - node->path] = '\0';
+      up = an_node(an, parent);
+      if (up)
+         node->enabled = an_enabled(an, up);
+   }
+   return node->enabled;
+}
+
+static AN_NODE_T *an_parent(AN_T *an, AN_NODE_T *node)
+{
+   char parent[AN_PATH_MAX];
+   const char *slash = strrchr(node->path, '/');
+
+   if (!slash || (slash - node->path >= AN_PATH_MAX))
+      return NULL;
+   if (slash == node->path)
+      return (node->path[1] ? an_node(an, "/") : NULL);
+   memcpy(parent, node->path, slash - node->path);
+   parent[slash - node->path] = '\0';
+   return an_node(an, parent);
+}
+
+static int an_cells(AN_NODE_T *node, const char *name, int def)
+{
+   AN_PROP_T *prop = node ? an_prop(node, name) : NULL;
+
+   return (prop && (prop->len == 4)) ? (int)an_cell(prop->value, 0) : def;
+}
+
+static int an_add_reg(AN_T *an, AN_NODE_T *node)
+{
+   AN_PROP_T *reg = an_prop(node, "reg");
+   AN_NODE_T *bus;
+   AN_REG_T *regs;
+   uint64_t addr, size;
+   int ac, sc, i, j;
+
+   if (!reg)
+      return 0;
+   bus = an_parent(an, node);
+   ac = an_cells(bus, "#address-cells", 2);
+   sc = an_cells(bus, "#size-cells", 1);
+   if ((ac < 1) || (ac + sc > 8) || (reg->len % (4 * (ac + sc))))
+      return 0;
+   for (i = 0; i < reg->len / 4; i += ac + sc)
+   {
+      for (j = 0, addr = 0; j < ac; j++)
+         addr = (addr << 32) | an_cell(reg->value, i + j);
+      for (j = 0, size = 0; j < sc; j++)
+         size = (size << 32) | an_cell(reg->value, i + ac + j);
+      if (an->num_regs == an->max_regs)
+      {
+         an->max_regs = an->max_regs ? an->max_regs * 2 : 256;
+         regs = realloc(an->regs, an->max_regs * sizeof(AN_REG_T));
+         if (!regs)
+            return -FDT_ERR_NOSPACE;
+         an->regs = regs;
+      }
+      an->regs[an->num_regs].bus = bus;
+      an->regs[an->num_regs].node = node;
+      an->regs[an->num_regs].start = addr;
+      an->regs[an->num_regs].end = addr + (size ? size : 1);
+      an->num_regs++;
+   }
+   return 0;
+}
+
+static int an_reg_cmp(const void *a, const void *b)
+{
+   const AN_REG_T *ra = a, *rb = b;
+
+   if (ra->bus != rb->bus)
+      return (ra->bus < rb->bus) ? -1 : 1;
+   if (ra->start != rb->start)
+      return (ra->start < rb->start) ? -1 : 1;
+   return 0;
+}
+
+// Claims the pin of the controller for the node
+static int an_claim(AN_T *an, AN_NODE_T *ctrl, const char *pin, AN_NODE_T *node,
+                    const char *prop)
+{
+   AN_CLAIM_T *claim;
+   char *key;
+
+   key = an_alloc(an, strlen(ctrl->path) + strlen(pin) + 2);
+   if (!key)
+      return -FDT_ERR_NOSPACE;
+   sprintf(key, "%s:%s", ctrl->path, pin);
+   claim = an_find(&an->claims, key);
+   if (claim)
+   {
+      if ((claim->node != node) && ((claim->node->owner >= 0) || (node->owner >= 0)))
+         an_report(an, 1, "conflict: pin %s of %s: %s (%s, %s) and %s (%s, %s)",
+                   pin, ctrl->path, claim->node->path, an_owner(an, claim->node->owner),
+                   claim->prop, node->path, an_owner(an, node->owner), prop);
+      return 0;
+   }
+   claim = an_alloc(an, sizeof(AN_CLAIM_T));
+   if (!claim)
+      return -FDT_ERR_NOSPACE;
+   claim->node = node;
+   claim->prop = prop;
+   return an_insert(&an->claims, key, claim);
+}
+
+// A gpio specifier as a pin name: bank and pin for 3 cells (sunxi, "PB22"),
+// the first cell otherwise
+static void an_pin_name(const void *value, int index, int cells, char *pin)
+{
+   if ((cells == 3) && (an_cell(value, index) < 26))
+      sprintf(pin, "P%c%u", 'A' + an_cell(value, index), an_cell(value, index + 1));
+   else
+      sprintf(pin, "%u", an_cell(value, index));
+}
+
+// The pins of the pinctrl groups the node uses
+static int an_claim_pinctrl(AN_T *an, AN_NODE_T *node, AN_PROP_T *prop)
+{
+   AN_NODE_T *group, *ctrl;
+   AN_PROP_T *pins;
+   const char *pin, *end;
+   char num[16];
+   int i, j, err;
+
+   for (i = 0; i < prop->len / 4; i++)
+   {
+      group = an_phandle_node(an, an_cell(prop->value, i));
+      ctrl = group ? an_parent(an, group) : NULL;
+      if (!ctrl)
+         continue;
+      if ((pins = an_prop(group, "pins")) || (pins = an_prop(group, "allwinner,pins")))
+      {
+         for (pin = pins->value, end = pin + pins->len; pin < end; pin += strlen(pin) + 1)
+            if ((err = an_claim(an, ctrl, pin, node, prop->name)) != 0)
+               return err;
+      }
+      else if ((pins = an_prop(group, "brcm,pins")) != NULL)
+      {
+         for (j = 0; j < pins->len / 4; j++)
+         {
+            sprintf(num, "%u", an_cell(pins->value, j));
+            if ((err = an_claim(an, ctrl, num, node, prop->name)) != 0)
+               return err;
+         }
+      }
+   }
+   return 0;
+}
+
+// gpio specifiers <&controller cells...>..., #gpio-cells of each controller
+static int an_claim_gpios(AN_T *an, AN_NODE_T *node, AN_PROP_T *prop)
+{
+   AN_NODE_T *ctrl;
+   char pin[32];
+   int i, cells, err;
+
+   for (i = 0; i < prop->len / 4; i += 1 + cells)
+   {
+      ctrl = an_phandle_node(an, an_cell(prop->value, i));
+      cells = an_cells(ctrl, "#gpio-cells", -1);
+      if (!ctrl || (cells < 1) || ((i + 1 + cells) * 4 > prop->len))
+         return 0;
+      an_pin_name(prop->value, i + 1, cells, pin);
+      err = an_claim(an, ctrl, pin, node, prop->name);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// interrupts of a gpio controller, #interrupt-cells each
+static int an_claim_irqs(AN_T *an, AN_NODE_T *node, AN_PROP_T *prop, AN_NODE_T *ctrl)
+{
+   int cells = an_cells(ctrl, "#interrupt-cells", -1);
+   char pin[32];
+   int i, err;
+
+   if ((cells < 1) || (prop->len % (4 * cells)))
+      return 0;
+   for (i = 0; i < prop->len / 4; i += cells)
+   {
+      an_pin_name(prop->value, i, cells, pin);
+      err = an_claim(an, ctrl, pin, node, prop->name);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+static int an_is_gpio_prop(const char *name)
+{
+   int len = strlen(name);
+
+   return (strcmp(name, "gpios") == 0) || (strcmp(name, "gpio") == 0) ||
+          ((len > 6) && (strcmp(name + len - 6, "-gpios") == 0)) ||
+          ((len > 5) && (strcmp(name + len - 5, "-gpio") == 0));
+}
+
+static int an_check_resources(AN_T *an)
+{
+   AN_NODE_T *node, *ctrl;
+   AN_PROP_T *prop;
+   AN_REG_T *r, *wide;
+   int i, err;
+
+   for (node = an->first; node; node = node->next)
+   {
+      if (!an_enabled(an, node) || (strncmp(node->path, "/__", 3) == 0))
+         continue;
+      err = an_add_reg(an, node);
+      for (prop = node->props; prop && !err; prop = prop->next)
+      {
+         if (strncmp(prop->name, "pinctrl-", 8) == 0)
+         {
+            if ((prop->name[8] >= '0') && (prop->name[8] <= '9'))
+               err = an_claim_pinctrl(an, node, prop);
+         }
+         else if (an_is_gpio_prop(prop->name))
+         {
+            err = an_claim_gpios(an, node, prop);
+         }
+         else if (strcmp(prop->name, "interrupts") == 0)
+         {
+            AN_PROP_T *parent = an_prop(node, "interrupt-parent");
+            ctrl = (parent && (parent->len == 4)) ?
+                   an_phandle_node(an, an_cell(parent->value, 0)) : NULL;
+            if (ctrl && an_prop(ctrl, "gpio-controller"))
+               err = an_claim_irqs(an, node, prop, ctrl);
+         }
+      }
+      if (err)
+         return err;
+   }
+
+   // reg ranges by bus, overlapping ones are reported
+   if (an->num_regs)
+      qsort(an->regs, an->num_regs, sizeof(AN_REG_T), an_reg_cmp);
+   for (i = 1, wide = an->regs; i < an->num_regs; i++)
+   {
+      r = &an->regs[i];
+      if (r->bus != wide->bus)
+      {
+         wide = r;
+         continue;
+      }
+      if ((r->start < wide->end) && (r->node != wide->node) &&
+          ((r->node->owner >= 0) || (wide->node->owner >= 0)))
+         an_report(an, 1, "conflict: reg 0x%llx of %s: %s (%s) and %s (%s)",
+                   (unsigned long long)r->start, r->bus ? r->bus->path : "/",
+                   wide->node->path, an_owner(an, wide->node->owner),
+                   r->node->path, an_owner(an, r->node->owner));
+      if (r->end > wide->end)
+         wide = r;
+   }
+   return 0;
+}
+
+// Checks the resources, frees the analysis and returns the number of
+// conflicts and unresolved references found, otherwise <0 error code.
+int dtoverlay_analyse_end(struct dtoverlay_analysis *an)
+{
+   int i, err = 0;
+
+   if (!an)
+      return -FDT_ERR_NOSPACE;
+   if (an->num_chunks)
+      err = an_check_resources(an);
+   if (!err && an->out)
+      fprintf(an->out, "%d overlays: %d conflicts or unresolved, %d overridden\n",
+              an->num_overlays, an->errors, an->warnings);
+   if (!err)
+      err = an->errors;
+
+   for (i = 0; i < an->num_chunks; i++)
+      free(an->chunks[i]);
+   free(an->chunks);
+   free(an->nodes.slots);
+   free(an->phandles.slots);
+   free(an->symbols.slots);
+   free(an->claims.slots);
+   free(an->names);
+   free(an->regs);
+   free(an);
+   return err;
+}
@@ -0,0 +1,651 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * combines overlays into one, so that a list of them goes to the kernel
+ * through a single configfs directory. Fragments with the same target are
+ * merged, the phandles of each overlay moved above the ones before it and
+ * __fixups__, __local_fixups__ and __symbols__ rewritten to the combined
+ * fragments. The kernel refuses an overlay setting a property twice, so
+ * an overlay giving a property another value, adding a node with its own
+ * phandle again or using a symbol of the combined overlay is not combined
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "libfdt.h"
+
+#include "dtoverlay.h"
+
+#define BATCH_PATH_MAX		256
+#define BATCH_MAX_FRAGMENTS	256
+
+typedef struct batch_fragment_struct
+{
+   char name[32];		/* fragment@i of the overlay */
+   char key[BATCH_PATH_MAX];	/* "&symbol", target path or "#N" */
+   int index;			/* N of fragment@N in the combined overlay */
+   int merged;			/* went into a fragment already there */
+} BATCH_FRAGMENT_T;
+
+typedef struct batch_struct
+{
+   void *fdt;			/* the combined overlay being extended */
+   void *overlay;		/* the renumbered copy of the one added */
+   BATCH_FRAGMENT_T frags[BATCH_MAX_FRAGMENTS];	/* of the combined one */
+   int num_frags;
+   BATCH_FRAGMENT_T ovl_frags[BATCH_MAX_FRAGMENTS];
+   int num_ovl_frags;
+   int next_index;
+} BATCH_T;
+
+static int batch_path(char *buf, const char *fmt, ...)
+{
+   va_list ap;
+   int len;
+
+   va_start(ap, fmt);
+   len = vsnprintf(buf, BATCH_PATH_MAX, fmt, ap);
+   va_end(ap);
+   return ((len < 0) || (len >= BATCH_PATH_MAX)) ? -FDT_ERR_NOSPACE : 0;
+}
+
+static int batch_fragment_index(const char *name)
+{
+   char *end;
+   long index;
+
+   if (strncmp(name, "fragment@", 9) != 0)
+      return -1;
+   index = strtol(name + 9, &end, 10);
+   return ((end == name + 9) || *end || (index < 0)) ? -1 : (int)index;
+}
+
+static uint32_t batch_max_phandle(const void *fdt)
+{
+   uint32_t phandle, max = 0;
+   int node;
+
+   for (node = fdt_next_node(fdt, -1, NULL); node >= 0;
+        node = fdt_next_node(fdt, node, NULL))
+   {
+      phandle = fdt_get_phandle(fdt, node);
+      if ((phandle > max) && (phandle != (uint32_t)-1))
+         max = phandle;
+   }
+   return max;
+}
+
+// Adds delta to the phandle references listed below the __local_fixups__
+// node fixup_off, path is the node of the overlay it stands for.
+static int batch_local_fixups(void *fdt, int fixup_off, char *path, int len,
+                              uint32_t delta)
+{
+   const fdt32_t *cells;
+   const char *name;
+   char *value;
+   fdt32_t cell;
+   uint32_t off;
+   int prop_off, node_off, sub_off, count, name_len, i, err;
+
+   node_off = fdt_path_offset(fdt, len ? path : "/");
+   if (node_off < 0)
+      return node_off;
+   for (prop_off = fdt_first_property_offset(fdt, fixup_off); prop_off >= 0;
+        prop_off = fdt_next_property_offset(fdt, prop_off))
+   {
+      cells = fdt_getprop_by_offset(fdt, prop_off, &name, &count);
+      value = fdt_getprop_w(fdt, node_off, name, &name_len);
+      if (!value)
+         return -FDT_ERR_BADSTRUCTURE;
+      for (i = 0; i < count / 4; i++)
+      {
+         off = fdt32_to_cpu(cells[i]);
+         if (off + 4 > (uint32_t)name_len)
+            return -FDT_ERR_BADSTRUCTURE;
+         memcpy(&cell, value + off, 4);
+         cell = cpu_to_fdt32(fdt32_to_cpu(cell) + delta);
+         memcpy(value + off, &cell, 4);
+      }
+   }
+   for (sub_off = fdt_first_subnode(fdt, fixup_off); sub_off >= 0;
+        sub_off = fdt_next_subnode(fdt, sub_off))
+   {
+      name = fdt_get_name(fdt, sub_off, &name_len);
+      if (len + name_len + 2 > BATCH_PATH_MAX)
+         return -FDT_ERR_NOSPACE;
+      path[len] = '/';
+      memcpy(path + len + 1, name, name_len + 1);
+      err = batch_local_fixups(fdt, sub_off, path, len + 1 + name_len, delta);
+      path[len] = '\0';
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// Moves the phandles of the overlay and the references to them up by delta
+static int batch_renumber(void *fdt, uint32_t delta)
+{
+   char path[BATCH_PATH_MAX] = "";
+   uint32_t phandle;
+   int node_off, err;
+
+   if (!delta)
+      return 0;
+   for (node_off = fdt_next_node(fdt, -1, NULL); node_off >= 0;
+        node_off = fdt_next_node(fdt, node_off, NULL))
+   {
+      phandle = fdt_get_phandle(fdt, node_off);
+      if (!phandle || (phandle == (uint32_t)-1))
+         continue;
+      if (fdt_getprop(fdt, node_off, "phandle", NULL))
+      {
+         err = fdt_setprop_inplace_u32(fdt, node_off, "phandle", phandle + delta);
+         if (err)
+            return err;
+      }
+      if (fdt_getprop(fdt, node_off, "linux,phandle", NULL))
+      {
+         err = fdt_setprop_inplace_u32(fdt, node_off, "linux,phandle",
+                                       phandle + delta);
+         if (err)
+            return err;
+      }
+   }
+   node_off = fdt_path_offset(fdt, "/__local_fixups__");
+   if (node_off < 0)
+      return 0;
+   return batch_local_fixups(fdt, node_off, path, 0, delta);
+}
+
+// The target of a fragment as "&symbol" or its target-path, "" for a
+// phandle of the overlay itself
+static void batch_target_key(const void *fdt, int frag_off, char *key)
+{
+   const char *path, *list, *end, *sym;
+   char want[BATCH_PATH_MAX];
+   int prop_off, len;
+
+   key[0] = '\0';
+   path = fdt_getprop(fdt, frag_off, "target-path", &len);
+   if (path)
+   {
+      if ((len > 0) && (len < BATCH_PATH_MAX) && (path[len - 1] == '\0'))
+         memcpy(key, path, len);
+      return;
+   }
+   if (!fdt_getprop(fdt, frag_off, "target", NULL) ||
+       batch_path(want, "/%s:target:0", fdt_get_name(fdt, frag_off, NULL)))
+      return;
+   for (prop_off = fdt_first_property_offset(fdt, fdt_path_offset(fdt, "/__fixups__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(fdt, prop_off))
+   {
+      list = fdt_getprop_by_offset(fdt, prop_off, &sym, &len);
+      for (end = list + len; list < end; list += strlen(list) + 1)
+      {
+         if (strcmp(list, want) == 0)
+         {
+            batch_path(key, "&%s", sym);
+            return;
+         }
+      }
+   }
+}
+
+// Whether the property of the node holds a phandle, to be resolved through
+// __fixups__ or __local_fixups__. Equal bytes are no equal value then.
+static int batch_has_fixup(const void *fdt, const char *node_path,
+                           const char *prop_name)
+{
+   char path[BATCH_PATH_MAX];
+   const char *list, *end;
+   int prop_off, len, path_len = strlen(node_path), name_len = strlen(prop_name);
+
+   if (!batch_path(path, "/__local_fixups__%s", node_path) &&
+       fdt_getprop(fdt, fdt_path_offset(fdt, path), prop_name, NULL))
+      return 1;
+   for (prop_off = fdt_first_property_offset(fdt, fdt_path_offset(fdt, "/__fixups__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(fdt, prop_off))
+   {
+      list = fdt_getprop_by_offset(fdt, prop_off, NULL, &len);
+      for (end = list + len; list < end; list += strlen(list) + 1)
+      {
+         if ((strncmp(list, node_path, path_len) == 0) && (list[path_len] == ':') &&
+             (strncmp(list + path_len + 1, prop_name, name_len) == 0) &&
+             (list[path_len + 1 + name_len] == ':'))
+            return 1;
+      }
+   }
+   return 0;
+}
+
+// Creates the missing nodes of the path, returns the offset of the last one
+static int batch_make_node(void *fdt, const char *path)
+{
+   const char *p = path, *end;
+   int node_off = 0, sub_off;
+
+   while (*p == '/')
+   {
+      p++;
+      end = strchr(p, '/');
+      if (!end)
+         end = p + strlen(p);
+      if (end == p)
+         break;
+      sub_off = fdt_subnode_offset_namelen(fdt, node_off, p, end - p);
+      if (sub_off == -FDT_ERR_NOTFOUND)
+         sub_off = fdt_add_subnode_namelen(fdt, node_off, p, end - p);
+      if (sub_off < 0)
+         return sub_off;
+      node_off = sub_off;
+      p = end;
+   }
+   return node_off;
+}
+
+// The path of the node rel below __overlay__ in the first combined fragment
+// with the key holding it. Returns 0 or -FDT_ERR_NOTFOUND.
+static int batch_landing(BATCH_T *b, const char *key, const char *rel, char *path)
+{
+   int i;
+
+   for (i = 0; i < b->num_frags; i++)
+   {
+      if (strcmp(b->frags[i].key, key))
+         continue;
+      if (batch_path(path, "/fragment@%d/__overlay__%s", b->frags[i].index, rel))
+         return -FDT_ERR_NOSPACE;
+      if (fdt_path_offset(b->fdt, path) >= 0)
+         return 0;
+   }
+   return -FDT_ERR_NOTFOUND;
+}
+
+// Merges the node rel below __overlay__ of the overlay fragment into the
+// combined fragments with the same target. Nodes already there are merged
+// into, properties they have must be plain and equal.
+// Returns 0 on success, 1 on a conflict, otherwise <0 error code.
+static int batch_merge_node(BATCH_T *b, BATCH_FRAGMENT_T *frag, const char *rel,
+                            int src_off)
+{
+   char path[BATCH_PATH_MAX], src_path[BATCH_PATH_MAX], sub_rel[BATCH_PATH_MAX];
+   const char *name, *value, *found, *fixup;
+   int prop_off, sub_off, node_off, len, found_len, fixup_len, i, err;
+
+   if (batch_path(src_path, "/%s/__overlay__%s", frag->name, rel))
+      return -FDT_ERR_NOSPACE;
+
+   for (prop_off = fdt_first_property_offset(b->overlay, src_off); prop_off >= 0;
+        prop_off = fdt_next_property_offset(b->overlay, prop_off))
+   {
+      value = fdt_getprop_by_offset(b->overlay, prop_off, &name, &len);
+      if (strcmp(name, "name") == 0)
+         continue;
+
+      found = NULL;
+      for (i = 0; (i < b->num_frags) && !found; i++)
+      {
+         if (strcmp(b->frags[i].key, frag->key))
+            continue;
+         if (batch_path(path, "/fragment@%d/__overlay__%s", b->frags[i].index, rel))
+            return -FDT_ERR_NOSPACE;
+         node_off = fdt_path_offset(b->fdt, path);
+         if (node_off < 0)
+            continue;
+         found = fdt_getprop(b->fdt, node_off, name, &found_len);
+         if (found && ((found_len != len) || memcmp(found, value, len) ||
+                       batch_has_fixup(b->overlay, src_path, name) ||
+                       batch_has_fixup(b->fdt, path, name)))
+            return 1;
+      }
+      if (found)
+         continue;
+
+      err = batch_landing(b, frag->key, rel, path);
+      if (!err)
+         err = fdt_setprop(b->fdt, fdt_path_offset(b->fdt, path), name, value, len);
+      if (err)
+         return err;
+
+      // References into the overlay itself go along with the property
+      if (batch_path(sub_rel, "/__local_fixups__%s", src_path))
+         return -FDT_ERR_NOSPACE;
+      fixup = fdt_getprop(b->overlay, fdt_path_offset(b->overlay, sub_rel),
+                          name, &fixup_len);
+      if (fixup)
+      {
+         if (batch_path(sub_rel, "/__local_fixups__%s", path))
+            return -FDT_ERR_NOSPACE;
+         node_off = batch_make_node(b->fdt, sub_rel);
+         if (node_off < 0)
+            return node_off;
+         err = fdt_setprop(b->fdt, node_off, name, fixup, fixup_len);
+         if (err)
+            return err;
+      }
+   }
+
+   for (sub_off = fdt_first_subnode(b->overlay, src_off); sub_off >= 0;
+        sub_off = fdt_next_subnode(b->overlay, sub_off))
+   {
+      name = fdt_get_name(b->overlay, sub_off, NULL);
+      if (batch_path(sub_rel, "%s/%s", rel, name))
+         return -FDT_ERR_NOSPACE;
+      err = batch_landing(b, frag->key, sub_rel, path);
+      if (err == -FDT_ERR_NOTFOUND)
+      {
+         err = batch_landing(b, frag->key, rel, path);
+         if (!err)
+         {
+            node_off = fdt_add_subnode(b->fdt, fdt_path_offset(b->fdt, path), name);
+            err = (node_off < 0) ? node_off : 0;
+         }
+      }
+      if (!err)
+         err = batch_merge_node(b, frag, sub_rel, sub_off);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+static int batch_add_fragment(BATCH_T *b, int frag_off)
+{
+   BATCH_FRAGMENT_T *frag;
+   char path[BATCH_PATH_MAX];
+   const char *name, *value;
+   int overlay_off, node_off, prop_off, len, i, err;
+
+   overlay_off = fdt_subnode_offset(b->overlay, frag_off, "__overlay__");
+   if (overlay_off < 0)
+      return 0;	/* __dormant__ */
+   if ((b->num_ovl_frags == BATCH_MAX_FRAGMENTS) ||
+       (b->num_frags == BATCH_MAX_FRAGMENTS))
+      return 1;
+
+   frag = &b->ovl_frags[b->num_ovl_frags++];
+   memset(frag, 0, sizeof(*frag));
+   snprintf(frag->name, sizeof(frag->name), "%s", fdt_get_name(b->overlay, frag_off, NULL));
+   batch_target_key(b->overlay, frag_off, frag->key);
+   if (frag->key[0] == '\0')
+      snprintf(frag->key, sizeof(frag->key), "#%d", b->next_index);
+
+   for (i = 0; i < b->num_frags; i++)
+      if (strcmp(b->frags[i].key, frag->key) == 0)
+         break;
+   frag->merged = (i < b->num_frags);
+   frag->index = frag->merged ? b->frags[i].index : b->next_index;
+
+   if (!frag->merged)
+   {
+      // A fragment of its own, with the target of the old one
+      if (batch_path(path, "fragment@%d", frag->index))
+         return -FDT_ERR_NOSPACE;
+      node_off = fdt_add_subnode(b->fdt, 0, path);
+      if (node_off < 0)
+         return node_off;
+      for (prop_off = fdt_first_property_offset(b->overlay, frag_off); prop_off >= 0;
+           prop_off = fdt_next_property_offset(b->overlay, prop_off))
+      {
+         value = fdt_getprop_by_offset(b->overlay, prop_off, &name, &len);
+         err = fdt_setprop(b->fdt, node_off, name, value, len);
+         if (err)
+            return err;
+      }
+      node_off = fdt_add_subnode(b->fdt, node_off, "__overlay__");
+      if (node_off < 0)
+         return node_off;
+
+      // A target given by a phandle of the overlay
+      if (batch_path(path, "/__local_fixups__/%s", frag->name))
+         return -FDT_ERR_NOSPACE;
+      frag_off = fdt_path_offset(b->overlay, path);
+      for (prop_off = fdt_first_property_offset(b->overlay, frag_off); prop_off >= 0;
+           prop_off = fdt_next_property_offset(b->overlay, prop_off))
+      {
+         value = fdt_getprop_by_offset(b->overlay, prop_off, &name, &len);
+         if (batch_path(path, "/__local_fixups__/fragment@%d", frag->index))
+            return -FDT_ERR_NOSPACE;
+         node_off = batch_make_node(b->fdt, path);
+         err = (node_off < 0) ? node_off : fdt_setprop(b->fdt, node_off, name, value, len);
+         if (err)
+            return err;
+      }
+
+      b->frags[b->num_frags++] = *frag;
+      b->next_index++;
+   }
+   return batch_merge_node(b, frag, "", overlay_off);
+}
+
+// Rewrites "/fragment@i..." of the overlay to its place in the combined
+// overlay. Returns 0, 1 if it has none or <0 error code.
+static int batch_rewrite_path(BATCH_T *b, const char *old_path, int len,
+                              char *new_path)
+{
+   const char *end, *rel;
+   char buf[BATCH_PATH_MAX];
+   int i;
+
+   if ((len < 2) || (len >= BATCH_PATH_MAX) || (old_path[0] != '/'))
+      return 1;
+   end = memchr(old_path + 1, '/', len - 1);
+   if (!end)
+      end = old_path + len;
+   for (i = 0; i < b->num_ovl_frags; i++)
+      if ((strlen(b->ovl_frags[i].name) == (size_t)(end - old_path - 1)) &&
+          (memcmp(b->ovl_frags[i].name, old_path + 1, end - old_path - 1) == 0))
+         break;
+   if (i == b->num_ovl_frags)
+      return 1;
+
+   // The properties of the fragment node itself only go to a new fragment
+   if (end == old_path + len)
+      return b->ovl_frags[i].merged ? 1 :
+             batch_path(new_path, "/fragment@%d", b->ovl_frags[i].index);
+
+   rel = end + 12;
+   if ((old_path + len < rel) || (strncmp(end, "/__overlay__", 12) != 0) ||
+       ((rel != old_path + len) && (*rel != '/')))
+      return 1;
+   memcpy(buf, rel, old_path + len - rel);
+   buf[old_path + len - rel] = '\0';
+   return batch_landing(b, b->ovl_frags[i].key, buf, new_path) ? 1 : 0;
+}
+
+// Carries __fixups__ over, entries are "path:property:offset"
+static int batch_add_fixups(BATCH_T *b)
+{
+   char path[BATCH_PATH_MAX], entry[BATCH_PATH_MAX];
+   const char *list, *end, *sym, *colon;
+   int prop_off, node_off, len, err;
+
+   for (prop_off = fdt_first_property_offset(b->overlay, fdt_path_offset(b->overlay, "/__fixups__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(b->overlay, prop_off))
+   {
+      list = fdt_getprop_by_offset(b->overlay, prop_off, &sym, &len);
+      for (end = list + len; list < end; list += strlen(list) + 1)
+      {
+         colon = strchr(list, ':');
+         if (!colon || batch_rewrite_path(b, list, colon - list, path))
+            continue;
+         if (batch_path(entry, "%s%s", path, colon))
+            return -FDT_ERR_NOSPACE;
+         node_off = batch_make_node(b->fdt, "/__fixups__");
+         if (node_off < 0)
+            return node_off;
+         err = fdt_appendprop(b->fdt, node_off, sym, entry, strlen(entry) + 1);
+         if (err)
+            return err;
+      }
+   }
+   return 0;
+}
+
+// Carries __symbols__ over, a symbol already there has to be the same node
+static int batch_add_symbols(BATCH_T *b)
+{
+   char path[BATCH_PATH_MAX];
+   const char *value, *sym, *found;
+   int prop_off, node_off, len, err;
+
+   for (prop_off = fdt_first_property_offset(b->overlay, fdt_path_offset(b->overlay, "/__symbols__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(b->overlay, prop_off))
+   {
+      value = fdt_getprop_by_offset(b->overlay, prop_off, &sym, &len);
+      if ((len < 1) || (value[len - 1] != '\0') ||
+          batch_rewrite_path(b, value, len - 1, path))
+         continue;
+      node_off = batch_make_node(b->fdt, "/__symbols__");
+      if (node_off < 0)
+         return node_off;
+      found = fdt_getprop(b->fdt, node_off, sym, NULL);
+      if (found)
+      {
+         if (strcmp(found, path))
+            return 1;
+         continue;
+      }
+      err = fdt_setprop_string(b->fdt, node_off, sym, path);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// Returns 0 on success, 1 if the overlay can't join, otherwise <0 error code
+static int batch_combine(BATCH_T *b)
+{
+   const char *name, *value;
+   int node_off, prop_off, symbols_off, len, index, err;
+
+   // A symbol of the combined overlay only exists once it is applied
+   symbols_off = fdt_path_offset(b->fdt, "/__symbols__");
+   for (prop_off = fdt_first_property_offset(b->overlay, fdt_path_offset(b->overlay, "/__fixups__"));
+        prop_off >= 0; prop_off = fdt_next_property_offset(b->overlay, prop_off))
+   {
+      fdt_getprop_by_offset(b->overlay, prop_off, &name, NULL);
+      if ((symbols_off >= 0) && fdt_getprop(b->fdt, symbols_off, name, NULL))
+         return 1;
+   }
+
+   err = batch_renumber(b->overlay, batch_max_phandle(b->fdt));
+   if (err)
+      return err;
+
+   b->num_frags = 0;
+   b->next_index = 0;
+   for (node_off = fdt_first_subnode(b->fdt, 0); node_off >= 0;
+        node_off = fdt_next_subnode(b->fdt, node_off))
+   {
+      index = batch_fragment_index(fdt_get_name(b->fdt, node_off, NULL));
+      if (index < 0)
+         continue;
+      if (b->num_frags == BATCH_MAX_FRAGMENTS)
+         return 1;
+      batch_target_key(b->fdt, node_off, b->frags[b->num_frags].key);
+      if (b->frags[b->num_frags].key[0] == '\0')
+         snprintf(b->frags[b->num_frags].key, BATCH_PATH_MAX, "#%d", index);
+      b->frags[b->num_frags].index = index;
+      b->num_frags++;
+      if (index >= b->next_index)
+         b->next_index = index + 1;
+   }
+
+   b->num_ovl_frags = 0;
+   for (node_off = fdt_first_subnode(b->overlay, 0); node_off >= 0;
+        node_off = fdt_next_subnode(b->overlay, node_off))
+   {
+      if (batch_fragment_index(fdt_get_name(b->overlay, node_off, NULL)) < 0)
+         continue;
+      err = batch_add_fragment(b, node_off);
+      if (err)
+         return err;
+   }
+
+   err = batch_add_fixups(b);
+   if (!err)
+      err = batch_add_symbols(b);
+   if (err)
+      return err;
+
+   // Properties of the root (compatible) come from the first one
+   for (prop_off = fdt_first_property_offset(b->overlay, 0); prop_off >= 0;
+        prop_off = fdt_next_property_offset(b->overlay, prop_off))
+   {
+      value = fdt_getprop_by_offset(b->overlay, prop_off, &name, &len);
+      if (fdt_getprop(b->fdt, 0, name, NULL))
+         continue;
+      err = fdt_setprop(b->fdt, 0, name, value, len);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+// Adds the overlay to the combined one, whose fdt is replaced by a malloced
+// one. The __overrides__ are left behind, parameters have to be applied
+// before. Neither is changed if the overlay can't join.
+// Returns 0 on success, 1 if it can't join, otherwise <0 error code.
+int dtoverlay_combine(DTBLOB_T *combined, DTBLOB_T *overlay_dtb)
+{
+   int size, overlay_size, tries, err;
+   BATCH_T *b;
+
+   b = calloc(1, sizeof(BATCH_T));
+   if (!b)
+      return -FDT_ERR_NOSPACE;
+   overlay_size = fdt_totalsize(overlay_dtb->fdt);
+   b->overlay = malloc(overlay_size);
+   size = fdt_off_dt_strings(combined->fdt) + fdt_size_dt_strings(combined->fdt) +
+          2 * overlay_size + 4096;
+
+   // Paths grow with the fragment numbers, start again with more room.
+   // Everything is looked up by path, the index saves the walks.
+   err = -FDT_ERR_NOSPACE;
+   for (tries = 0; b->overlay && (err == -FDT_ERR_NOSPACE) && (tries < 4); tries++)
+   {
+      if (b->fdt)
+         fdt_index_disable(b->fdt);
+      free(b->fdt);
+      b->fdt = malloc(size);
+      if (!b->fdt)
+         break;
+      err = fdt_open_into(combined->fdt, b->fdt, size);
+      if (!err)
+         err = fdt_open_into(overlay_dtb->fdt, b->overlay, overlay_size);
+      if (!err)
+         fdt_index_enable(b->fdt);
+      if (!err)
+         err = batch_combine(b);
+      size *= 2;
+   }
+
+   if (!err)
+      err = fdt_pack(b->fdt);
+   if (b->fdt)
+      fdt_index_disable(b->fdt);
+   if (!err)
+   {
+      if (combined->fdt_is_malloced)
+         free(combined->fdt);
+      combined->fdt = b->fdt;
+      combined->fdt_is_malloced = 1;
+      combined->max_phandle = batch_max_phandle(b->fdt);
+      b->fdt = NULL;
+   }
+   free(b->fdt);
+   free(b->overlay);
+   free(b);
+   return err;
+}
@@ -0,0 +1,475 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * content addressed cache of merged DTBs
+ *
+ * the key is the SHA-256 of everything the result depends on - the base
+ * and overlay blobs and the parameters, each with its length in front so
+ * the pieces can't run into each other. An entry is <dir>/<key>.dtb,
+ * written to a temporary file and renamed, its mtime refreshed on every
+ * hit. When the entries take more than the size limit the least recently
+ * used ones go. <dir>/stats keeps the counters across runs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "dtoverlay.h"
+
+#define CACHE_VERSION		"dtoverlay-cache-1"
+#define CACHE_KEY_LEN		64
+#define CACHE_PATH_MAX		512
+#define CACHE_MAX_ENTRIES	4096
+
+typedef struct sha256_struct
+{
+   uint32_t h[8];
+   uint8_t block[64];
+   uint64_t len;
+   int used;
+} SHA256_T;
+
+typedef struct cache_stats_struct
+{
+   long hits, misses, verified, mismatches, evicted;
+} CACHE_STATS_T;
+
+typedef struct cache_entry_struct
+{
+   char name[CACHE_KEY_LEN + 5];
+   long size;
+   time_t mtime;
+} CACHE_ENTRY_T;
+
+struct dtoverlay_cache
+{
+   const char *dir;
+   long max_size;
+   int verify;
+   SHA256_T sha;
+   char key[CACHE_KEY_LEN + 1];
+   char entry[CACHE_PATH_MAX];
+   int found;			/* the entry exists */
+   CACHE_STATS_T run;		/* of this run */
+   const char *result;		/* what happened, for the debug output */
+};
+
+static const uint32_t sha256_k[64] =
+{
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(SHA256_T *sha)
+{
+   static const uint32_t h[8] =
+   {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+
+   memcpy(sha->h, h, sizeof(h));
+   sha->len = 0;
+   sha->used = 0;
+}
+
+static void sha256_block(SHA256_T *sha, const uint8_t *p)
+{
+   uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+   int i;
+
+   for (i = 0; i < 16; i++)
+      w[i] = ((uint32_t)p[4 * i] << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+   for (; i < 64; i++)
+      w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+             w[i - 7] + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+   a = sha->h[0]; b = sha->h[1]; c = sha->h[2]; d = sha->h[3];
+   e = sha->h[4]; f = sha->h[5]; g = sha->h[6]; h = sha->h[7];
+   for (i = 0; i < 64; i++)
+   {
+      t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+   }
+   sha->h[0] += a; sha->h[1] += b; sha->h[2] += c; sha->h[3] += d;
+   sha->h[4] += e; sha->h[5] += f; sha->h[6] += g; sha->h[7] += h;
+}
+
+static void sha256_update(SHA256_T *sha, const void *data, size_t len)
+{
+   const uint8_t *p = data;
+   size_t n;
+
+   sha->len += len;
+   while (len)
+   {
+      if (!sha->used && (len >= 64))
+      {
+         sha256_block(sha, p);
+         p += 64;
+         len -= 64;
+         continue;
+      }
+      n = 64 - sha->used;
+      if (n > len)
+         n = len;
+      memcpy(sha->block + sha->used, p, n);
+      sha->used += n;
+      p += n;
+      len -= n;
+      if (sha->used == 64)
+      {
+         sha256_block(sha, sha->block);
+         sha->used = 0;
+      }
+   }
+}
+
+static void sha256_hex(SHA256_T *sha, char *hex)
+{
+   uint64_t bits = sha->len * 8;
+   uint8_t pad[72];
+   int i, n;
+
+   n = ((sha->used < 56) ? 56 : 120) - sha->used;
+   memset(pad, 0, sizeof(pad));
+   pad[0] = 0x80;
+   for (i = 0; i < 8; i++)
+      pad[n + i] = bits >> (56 - 8 * i);
+   sha256_update(sha, pad, n + 8);
+   for (i = 0; i < 8; i++)
+      sprintf(hex + 8 * i, "%08x", sha->h[i]);
+}
+
+// Starts a lookup in the cache directory, entries above max_size bytes
+// in all are evicted. With verify, hits are merged again and compared.
+struct dtoverlay_cache *dtoverlay_cache_begin(const char *dir, long max_size, int verify)
+{
+   struct dtoverlay_cache *cache;
+
+   if (!dir)
+      return NULL;
+   mkdir(dir, 0755);
+   cache = calloc(1, sizeof(*cache));
+   if (!cache)
+      return NULL;
+   cache->dir = dir;
+   cache->max_size = max_size;
+   cache->verify = verify;
+   sha256_init(&cache->sha);
+   sha256_update(&cache->sha, CACHE_VERSION, sizeof(CACHE_VERSION));
+   return cache;
+}
+
+// Adds a piece the result depends on to the key
+int dtoverlay_cache_add(struct dtoverlay_cache *cache, const void *data, int len)
+{
+   uint8_t n[4] = { BE4((uint32_t)len) };
+
+   if (cache->key[0] || (len < 0))
+      return -1;
+   sha256_update(&cache->sha, n, sizeof(n));
+   sha256_update(&cache->sha, data, len);
+   return 0;
+}
+
+static void *cache_read(const char *filename, long *len)
+{
+   struct stat st;
+   void *data;
+   FILE *fp;
+
+   fp = fopen(filename, "rb");
+   if (!fp)
+      return NULL;
+   data = NULL;
+   if ((fstat(fileno(fp), &st) == 0) && (st.st_size >= 0))
+   {
+      data = malloc(st.st_size ? st.st_size : 1);
+      if (data && (fread(data, 1, st.st_size, fp) != (size_t)st.st_size))
+      {
+         free(data);
+         data = NULL;
+      }
+      *len = st.st_size;
+   }
+   fclose(fp);
+   return data;
+}
+
+int dtoverlay_cache_add_file(struct dtoverlay_cache *cache, const char *filename)
+{
+   void *data;
+   long len;
+   int err;
+
+   data = cache_read(filename, &len);
+   if (!data)
+      return -1;
+   err = dtoverlay_cache_add(cache, data, len);
+   free(data);
+   return err;
+}
+
+// Adds the parameters to the key the way they are applied: in order, a
+// bare name meaning name=true
+int dtoverlay_cache_add_params(struct dtoverlay_cache *cache, int argc, const char **argv)
+{
+   char param[CACHE_PATH_MAX];
+   int i, len;
+
+   for (i = 0; i < argc; i++)
+   {
+      if (strchr(argv[i], '='))
+         len = snprintf(param, sizeof(param), "%s", argv[i]);
+      else
+         len = snprintf(param, sizeof(param), "%s=true", argv[i]);
+      if ((len >= (int)sizeof(param)) || dtoverlay_cache_add(cache, param, len))
+         return -1;
+   }
+   return 0;
+}
+
+static int cache_write(const char *filename, const void *data, long len)
+{
+   char tmp[CACHE_PATH_MAX];
+   FILE *fp;
+   int ok;
+
+   if (snprintf(tmp, sizeof(tmp), "%s.%d", filename, (int)getpid()) >= (int)sizeof(tmp))
+      return -1;
+   fp = fopen(tmp, "wb");
+   if (!fp)
+      return -1;
+   ok = (fwrite(data, 1, len, fp) == (size_t)len);
+   ok = (fclose(fp) == 0) && ok;
+   if (!ok || (rename(tmp, filename) != 0))
+   {
+      unlink(tmp);
+      return -1;
+   }
+   return 0;
+}
+
+// The result goes straight to its file, the way it is saved after a merge
+static int cache_copy(const char *from, const char *to)
+{
+   void *data;
+   long len;
+   FILE *fp;
+   int ok;
+
+   data = cache_read(from, &len);
+   if (!data)
+      return -1;
+   fp = fopen(to, "wb");
+   ok = fp && (fwrite(data, 1, len, fp) == (size_t)len);
+   ok = fp && (fclose(fp) == 0) && ok;
+   free(data);
+   return ok ? 0 : -1;
+}
+
+// Writes the cached result for the key to filename. Returns 1 on a hit,
+// 0 on a miss - always in verify mode - or -ve on error
+int dtoverlay_cache_fetch(struct dtoverlay_cache *cache, const char *filename)
+{
+   struct stat st;
+
+   if (!cache->key[0])
+   {
+      sha256_hex(&cache->sha, cache->key);
+      if (snprintf(cache->entry, sizeof(cache->entry), "%s/%s.dtb", cache->dir,
+                   cache->key) >= (int)sizeof(cache->entry))
+         return -1;
+   }
+   cache->found = (stat(cache->entry, &st) == 0);
+   if (!cache->found || cache->verify)
+   {
+      if (!cache->found)
+      {
+         cache->run.misses++;
+         cache->result = "miss";
+      }
+      return 0;
+   }
+   if (cache_copy(cache->entry, filename) != 0)
+      return -1;
+   utime(cache->entry, NULL);
+   cache->run.hits++;
+   cache->result = "hit";
+   return 1;
+}
+
+static int cache_entry_filter(const struct dirent *de)
+{
+   int len = strlen(de->d_name);
+
+   return (len == CACHE_KEY_LEN + 4) && (strcmp(de->d_name + CACHE_KEY_LEN, ".dtb") == 0);
+}
+
+static int cache_entry_compare(const void *a, const void *b)
+{
+   const CACHE_ENTRY_T *ea = a, *eb = b;
+
+   if (ea->mtime != eb->mtime)
+      return (ea->mtime < eb->mtime) ? -1 : 1;
+   return strcmp(ea->name, eb->name);
+}
+
+// Removes the least recently used entries until they fit the size
+static void cache_evict(struct dtoverlay_cache *cache)
+{
+   char path[CACHE_PATH_MAX];
+   CACHE_ENTRY_T *entries;
+   struct dirent *de;
+   struct stat st;
+   long total = 0;
+   int n = 0, i;
+   DIR *dh;
+
+   dh = opendir(cache->dir);
+   if (!dh)
+      return;
+   entries = malloc(CACHE_MAX_ENTRIES * sizeof(CACHE_ENTRY_T));
+   while (entries && (n < CACHE_MAX_ENTRIES) && ((de = readdir(dh)) != NULL))
+   {
+      if (!cache_entry_filter(de))
+         continue;
+      snprintf(path, sizeof(path), "%s/%s", cache->dir, de->d_name);
+      if (stat(path, &st) != 0)
+         continue;
+      strcpy(entries[n].name, de->d_name);
+      entries[n].size = st.st_size;
+      entries[n].mtime = st.st_mtime;
+      total += st.st_size;
+      n++;
+   }
+   closedir(dh);
+
+   if (entries && (total > cache->max_size))
+   {
+      qsort(entries, n, sizeof(CACHE_ENTRY_T), cache_entry_compare);
+      for (i = 0; (i < n) && (total > cache->max_size); i++)
+      {
+         // never the one just stored
+         if (strncmp(entries[i].name, cache->key, CACHE_KEY_LEN) == 0)
+            continue;
+         snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+         if (unlink(path) == 0)
+         {
+            total -= entries[i].size;
+            cache->run.evicted++;
+         }
+      }
+   }
+   free(entries);
+}
+
+// Stores the result merged after a miss. In verify mode a result already
+// there is compared, and replaced if it differs. Returns 1 if it did,
+// 0 on success or -ve on error
+int dtoverlay_cache_store(struct dtoverlay_cache *cache, const char *filename)
+{
+   void *merged, *cached;
+   long merged_len, cached_len;
+   int differs = 0;
+
+   if (!cache->key[0])
+      return -1;
+   merged = cache_read(filename, &merged_len);
+   if (!merged)
+      return -1;
+   if (cache->found)
+   {
+      cached = cache_read(cache->entry, &cached_len);
+      differs = !cached || (cached_len != merged_len) || memcmp(cached, merged, merged_len);
+      free(cached);
+      if (differs)
+      {
+         cache->run.mismatches++;
+         cache->result = "MISMATCH, replaced";
+      }
+      else
+      {
+         cache->run.verified++;
+         cache->result = "verified";
+         free(merged);
+         utime(cache->entry, NULL);
+         return 0;
+      }
+   }
+   if (cache_write(cache->entry, merged, merged_len) != 0)
+   {
+      free(merged);
+      return -1;
+   }
+   free(merged);
+   cache_evict(cache);
+   return differs;
+}
+
+// Adds the counters of this run to the ones in the cache directory and
+// frees the cache, printing both to debug if not NULL
+void dtoverlay_cache_end(struct dtoverlay_cache *cache, FILE *debug)
+{
+   CACHE_STATS_T total;
+   char path[CACHE_PATH_MAX], buf[256];
+   FILE *fp;
+   int len;
+
+   if (!cache)
+      return;
+   memset(&total, 0, sizeof(total));
+   snprintf(path, sizeof(path), "%s/stats", cache->dir);
+   fp = fopen(path, "r+");
+   if (fp && (fscanf(fp, "hits %ld misses %ld verified %ld mismatches %ld evicted %ld",
+                     &total.hits, &total.misses, &total.verified, &total.mismatches,
+                     &total.evicted) != 5))
+      memset(&total, 0, sizeof(total));
+   total.hits += cache->run.hits;
+   total.misses += cache->run.misses;
+   total.verified += cache->run.verified;
+   total.mismatches += cache->run.mismatches;
+   total.evicted += cache->run.evicted;
+   len = snprintf(buf, sizeof(buf), "hits %ld misses %ld verified %ld mismatches %ld evicted %ld\n",
+                  total.hits, total.misses, total.verified, total.mismatches, total.evicted);
+
+   // rewritten in place, the counters only ever grow
+   if (fp)
+      rewind(fp);
+   else
+      fp = fopen(path, "w");
+   if (fp)
+   {
+      fputs(buf, fp);
+      fclose(fp);
+   }
+
+   if (debug)
+      fprintf(debug, "cache %.16s: %s - %.*s\n", cache->key[0] ? cache->key : "-",
+              cache->result ? cache->result : "not used", len - 1, buf);
+   free(cache);
+}
@@ -0,0 +1,249 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * edit transactions on a DTBLOB_T: the changes of a merge are collected
+ * and the tree is written once, at its exact size, when they are committed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "libfdt.h"
+
+#include "dtoverlay.h"
+
+struct fdt_edit *dtoverlay_edit_begin(DTBLOB_T *dtb)
+{
+   return fdt_edit_begin(dtb->fdt);
+}
+
+void dtoverlay_edit_abort(struct fdt_edit *edit)
+{
+   fdt_edit_free(edit);
+}
+
+// Returns 0 on success, otherwise <0 error code. The transaction is freed.
+int dtoverlay_edit_commit(DTBLOB_T *dtb, struct fdt_edit *edit)
+{
+   void *fdt;
+   int size, indexed, err;
+
+   size = fdt_edit_size(edit);
+   if (size < 0)
+   {
+      fdt_edit_free(edit);
+      return size;
+   }
+   fdt = malloc(size);
+   if (!fdt)
+   {
+      fdt_edit_free(edit);
+      return -FDT_ERR_NOSPACE;
+   }
+   err = fdt_edit_finish(edit, fdt, size);
+   fdt_edit_free(edit);
+   if (err)
+   {
+      free(fdt);
+      return err;
+   }
+
+   indexed = fdt_index_disable(dtb->fdt);
+   if (dtb->fdt_is_malloced)
+      free(dtb->fdt);
+   dtb->fdt = fdt;
+   dtb->fdt_is_malloced = 1;
+   if (indexed)
+      fdt_index_enable(fdt);
+   return 0;
+}
+
+// Merges the overlay node into the target node through the transaction,
+// with the rules of dtoverlay_merge_overlay: "name" is never copied, the
+// phandles only below the fragment, and bootargs are appended.
+// Returns 0 on success, otherwise <0 error code.
+int dtoverlay_edit_merge(struct fdt_edit *edit, int target_off,
+                         DTBLOB_T *overlay_dtb, int overlay_off, int depth)
+{
+   const char *prop_name, *subnode_name;
+   const char *prop_val, *target_val;
+   int prop_off, prop_len, target_len;
+   int subnode_off, subnode_len, subtarget_off;
+   char *joined;
+   int err = 0;
+
+   for (prop_off = fdt_first_property_offset(overlay_dtb->fdt, overlay_off);
+        (prop_off >= 0) && !err;
+        prop_off = fdt_next_property_offset(overlay_dtb->fdt, prop_off))
+   {
+      prop_val = fdt_getprop_by_offset(overlay_dtb->fdt, prop_off,
+                                       &prop_name, &prop_len);
+      if (!prop_val)
+         return prop_len;
+
+      if ((strcmp(prop_name, "name") == 0) ||
+          ((depth == 0) && ((strcmp(prop_name, "phandle") == 0) ||
+                            (strcmp(prop_name, "linux,phandle") == 0))))
+         continue;
+
+      target_val = NULL;
+      if (strcmp(prop_name, "bootargs") == 0)
+         target_val = fdt_edit_getprop(edit, target_off, prop_name, &target_len);
+      if (target_val && (target_len > 0) && *target_val)
+      {
+         joined = malloc(target_len + prop_len);
+         if (!joined)
+            return -FDT_ERR_NOSPACE;
+         memcpy(joined, target_val, target_len);
+         joined[target_len - 1] = ' ';
+         memcpy(joined + target_len, prop_val, prop_len);
+         err = fdt_edit_setprop(edit, target_off, prop_name, joined,
+                                target_len + prop_len);
+         free(joined);
+      }
+      else
+         err = fdt_edit_setprop(edit, target_off, prop_name, prop_val, prop_len);
+   }
+
+   for (subnode_off = fdt_first_subnode(overlay_dtb->fdt, overlay_off);
+        (subnode_off >= 0) && !err;
+        subnode_off = fdt_next_subnode(overlay_dtb->fdt, subnode_off))
+   {
+      subnode_name = fdt_get_name(overlay_dtb->fdt, subnode_off, &subnode_len);
+
+      subtarget_off = fdt_edit_subnode_offset_namelen(edit, target_off,
+                                                      subnode_name, subnode_len);
+      if (subtarget_off < 0)
+         subtarget_off = fdt_edit_add_subnode_namelen(edit, target_off,
+                                                      subnode_name, subnode_len);
+      if (subtarget_off < 0)
+         return subtarget_off;
+
+      err = dtoverlay_edit_merge(edit, subtarget_off, overlay_dtb,
+                                 subnode_off, depth + 1);
+   }
+
+   return err;
+}
+
+// The offset of a target-path with the pending changes, so a fragment can
+// target a node an earlier one added. An alias is looked up in the base.
+// Returns the offset, otherwise <0 error code.
+static int dtoverlay_edit_path_offset(struct fdt_edit *edit, const void *fdt,
+                                      const char *path, int len)
+{
+   const char *end = path + len, *p = path, *q, *alias;
+   int node_off = 0;
+
+   if ((len > 0) && (*p != '/'))
+   {
+      q = memchr(p, '/', len);
+      if (!q)
+         q = end;
+      alias = fdt_get_alias_namelen(fdt, p, q - p);
+      if (!alias || (*alias != '/'))
+         return -FDT_ERR_BADPATH;
+      node_off = dtoverlay_edit_path_offset(edit, fdt, alias, strlen(alias));
+      p = q;
+   }
+
+   while ((node_off >= 0) && (p < end))
+   {
+      if (*p == '/')
+      {
+         p++;
+         continue;
+      }
+      q = memchr(p, '/', end - p);
+      if (!q)
+         q = end;
+      node_off = fdt_edit_subnode_offset_namelen(edit, node_off, p, q - p);
+      p = q;
+   }
+   return node_off;
+}
+
+// Merges the fragments of the overlay through the transaction the way
+// dtoverlay_merge_overlay does: fragment@N nodes with an __overlay__ node
+// (__dormant__ ones are left out), targets by target-path or by a phandle
+// of the base. Returns 0 on success, +ve for a fragment without a valid
+// target, otherwise <0 error code.
+int dtoverlay_edit_merge_fragments(struct fdt_edit *edit, DTBLOB_T *base_dtb,
+                                   DTBLOB_T *overlay_dtb)
+{
+   const char *node_name, *target_path;
+   const fdt32_t *target;
+   int frag_off, overlay_off, target_off, len, err;
+
+   for (frag_off = fdt_first_subnode(overlay_dtb->fdt, 0);
+        frag_off >= 0;
+        frag_off = fdt_next_subnode(overlay_dtb->fdt, frag_off))
+   {
+      node_name = fdt_get_name(overlay_dtb->fdt, frag_off, NULL);
+      if (strncmp(node_name, "fragment@", 9) != 0)
+         continue;
+
+      overlay_off = fdt_subnode_offset(overlay_dtb->fdt, frag_off, "__overlay__");
+      if (overlay_off < 0)
+         continue;
+
+      target_path = fdt_getprop(overlay_dtb->fdt, frag_off, "target-path", &len);
+      if (target_path)
+      {
+         if (len && (target_path[len - 1] == '\0'))
+            len--;
+         target_off = dtoverlay_edit_path_offset(edit, base_dtb->fdt,
+                                                 target_path, len);
+      }
+      else
+      {
+         target = fdt_getprop(overlay_dtb->fdt, frag_off, "target", &len);
+         if (!target)
+            return NON_FATAL(len);
+         if (len != 4)
+            return NON_FATAL(FDT_ERR_BADSTRUCTURE);
+         target_off = fdt_node_offset_by_phandle(base_dtb->fdt,
+                                                 fdt32_to_cpu(*target));
+      }
+      if (target_off < 0)
+         return NON_FATAL(target_off);
+
+      err = dtoverlay_edit_merge(edit, target_off, overlay_dtb, overlay_off, 0);
+      if (err)
+         return err;
+   }
+
+   return 0;
+}
+
+// dtoverlay_merge_overlay with one transaction for all the fragments, the
+// base is written once. Returns 0 on success, +ve for a fragment without a
+// valid target, otherwise <0 error code.
+int dtoverlay_edit_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
+{
+   struct fdt_edit *edit;
+   int err;
+
+   edit = dtoverlay_edit_begin(base_dtb);
+   if (!edit)
+      return -FDT_ERR_NOSPACE;
+
+   err = dtoverlay_edit_merge_fragments(edit, base_dtb, overlay_dtb);
+   if (err)
+   {
+      dtoverlay_edit_abort(edit);
+      return err;
+   }
+   err = dtoverlay_edit_commit(base_dtb, edit);
+   if (!err)
+      base_dtb->max_phandle = overlay_dtb->max_phandle;
+   return err;
+}
@@ -0,0 +1,355 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * reads a device tree filesystem like /proc/device-tree into a DTB in
+ * memory: directories become nodes and files properties, written with the
+ * sequential write functions of libfdt. Property names are looked up in a
+ * hash, fdt_property() would search the whole string table for each one
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "libfdt.h"
+
+#include "dtoverlay.h"
+
+#define FS_INITIAL_SIZE		(64 * 1024)
+#define FS_INITIAL_STRINGS	256
+
+typedef struct fs_entry_struct
+{
+   char *name;
+   int is_dir;
+} FS_ENTRY_T;
+
+typedef struct fs_loader_struct
+{
+   void *fdt;
+   int size;
+   int *strings;		/* string handles, 0 = free */
+   unsigned int strings_mask;
+   int strings_used;
+   char *value;
+   int value_max;
+} FS_LOADER_T;
+
+static unsigned int fs_hash(const char *s)
+{
+   unsigned int hash = 2166136261u;
+
+   while (*s)
+      hash = (hash ^ (unsigned char)*s++) * 16777619u;
+   return hash;
+}
+
+static const char *fs_string(FS_LOADER_T *loader, int handle)
+{
+   return (const char *)loader->fdt + fdt_totalsize(loader->fdt) - handle;
+}
+
+// Moves the tree being written to a buffer twice as large. The string
+// handles are counted from the end of the buffer and stay valid.
+static int fs_grow(FS_LOADER_T *loader)
+{
+   void *fdt;
+   int err;
+
+   fdt = malloc(loader->size * 2);
+   if (!fdt)
+      return -FDT_ERR_NOSPACE;
+   err = fdt_resize(loader->fdt, fdt, loader->size * 2);
+   if (err)
+   {
+      free(fdt);
+      return err;
+   }
+   free(loader->fdt);
+   loader->fdt = fdt;
+   loader->size *= 2;
+   return 0;
+}
+
+static int fs_rehash(FS_LOADER_T *loader)
+{
+   unsigned int mask = loader->strings_mask * 2 + 1;
+   unsigned int i, j;
+   int *strings;
+
+   strings = calloc(mask + 1, sizeof(int));
+   if (!strings)
+      return -FDT_ERR_NOSPACE;
+   for (i = 0; i <= loader->strings_mask; i++)
+   {
+      if (!loader->strings[i])
+         continue;
+      j = fs_hash(fs_string(loader, loader->strings[i])) & mask;
+      while (strings[j])
+         j = (j + 1) & mask;
+      strings[j] = loader->strings[i];
+   }
+   free(loader->strings);
+   loader->strings = strings;
+   loader->strings_mask = mask;
+   return 0;
+}
+
+// Returns the handle of the property name, adding it to the string table
+// the first time it is seen, otherwise <0 error code.
+static int fs_find_add_string(FS_LOADER_T *loader, const char *name)
+{
+   unsigned int i;
+   int handle, err;
+
+   if ((loader->strings_used + 1) * 2 > loader->strings_mask)
+   {
+      err = fs_rehash(loader);
+      if (err)
+         return err;
+   }
+
+   i = fs_hash(name) & loader->strings_mask;
+   while (loader->strings[i])
+   {
+      if (strcmp(fs_string(loader, loader->strings[i]), name) == 0)
+         return loader->strings[i];
+      i = (i + 1) & loader->strings_mask;
+   }
+
+   while ((handle = fdt_add_string(loader->fdt, name)) == -FDT_ERR_NOSPACE)
+   {
+      err = fs_grow(loader);
+      if (err)
+         return err;
+   }
+   if (handle > 0)
+   {
+      loader->strings[i] = handle;
+      loader->strings_used++;
+   }
+   return handle;
+}
+
+// Reads the property file into loader->value, returns its length or -1.
+// A read shorter than asked for is the end of the file, which saves a
+// second read for all but the properties larger than the buffer.
+static int fs_read_value(FS_LOADER_T *loader, int dir_fd, const char *name)
+{
+   int fd, len = 0, n;
+   char *value;
+
+   fd = openat(dir_fd, name, O_RDONLY);
+   if (fd < 0)
+      return -1;
+
+   while ((n = read(fd, loader->value + len, loader->value_max - len)) > 0)
+   {
+      len += n;
+      if (len < loader->value_max)
+         break;
+      value = realloc(loader->value, loader->value_max * 2);
+      if (!value)
+      {
+         n = -1;
+         break;
+      }
+      loader->value = value;
+      loader->value_max *= 2;
+   }
+   close(fd);
+   return (n < 0) ? -1 : len;
+}
+
+static int fs_entry_cmp(const void *a, const void *b)
+{
+   return strcmp(((const FS_ENTRY_T *)a)->name, ((const FS_ENTRY_T *)b)->name);
+}
+
+// Returns the entries of the directory sorted by name, so that the tree
+// does not depend on the order the filesystem hands them out.
+static FS_ENTRY_T *fs_read_dir(int dir_fd, int *count)
+{
+   FS_ENTRY_T *entries = NULL, *more;
+   struct dirent *de;
+   struct stat st;
+   int max = 0, n = 0, is_dir;
+   DIR *dir;
+
+   dir = fdopendir(dup(dir_fd));
+   if (!dir)
+      return NULL;
+   while ((de = readdir(dir)) != NULL)
+   {
+      if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+         continue;
+      if ((de->d_type == DT_DIR) || (de->d_type == DT_REG))
+         is_dir = (de->d_type == DT_DIR);
+      else if ((de->d_type == DT_UNKNOWN) &&
+               (fstatat(dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) &&
+               (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode)))
+         is_dir = S_ISDIR(st.st_mode);
+      else
+         continue;
+
+      if (n == max)
+      {
+         max = max ? max * 2 : 32;
+         more = realloc(entries, max * sizeof(FS_ENTRY_T));
+         if (!more)
+            break;
+         entries = more;
+      }
+      entries[n].name = strdup(de->d_name);
+      entries[n].is_dir = is_dir;
+      if (!entries[n].name)
+         break;
+      n++;
+   }
+   closedir(dir);
+
+   if (de)
+   {
+      while (n--)
+         free(entries[n].name);
+      free(entries);
+      return NULL;
+   }
+   if (n)
+      qsort(entries, n, sizeof(FS_ENTRY_T), fs_entry_cmp);
+   *count = n;
+   return entries ? entries : calloc(1, sizeof(FS_ENTRY_T));
+}
+
+static int fs_read_node(FS_LOADER_T *loader, int dir_fd, const char *node_name)
+{
+   FS_ENTRY_T *entries;
+   int count, i, fd, len, handle;
+   int err;
+
+   entries = fs_read_dir(dir_fd, &count);
+   if (!entries)
+      return -FDT_ERR_NOSPACE;
+
+   while ((err = fdt_begin_node(loader->fdt, node_name)) == -FDT_ERR_NOSPACE)
+      if ((err = fs_grow(loader)) != 0)
+         break;
+
+   // The properties have to come before the subnodes
+   for (i = 0; (i < count) && !err; i++)
+   {
+      if (entries[i].is_dir)
+         continue;
+      handle = fs_find_add_string(loader, entries[i].name);
+      if (handle < 0)
+      {
+         err = handle;
+         break;
+      }
+      len = fs_read_value(loader, dir_fd, entries[i].name);
+      if (len < 0)
+      {
+         err = -FDT_ERR_BADVALUE;
+         break;
+      }
+      while ((err = fdt_property_nameoff(loader->fdt, handle, loader->value,
+                                         len)) == -FDT_ERR_NOSPACE)
+         if ((err = fs_grow(loader)) != 0)
+            break;
+   }
+
+   for (i = 0; (i < count) && !err; i++)
+   {
+      if (!entries[i].is_dir)
+         continue;
+      fd = openat(dir_fd, entries[i].name, O_RDONLY | O_DIRECTORY);
+      if (fd < 0)
+      {
+         err = -FDT_ERR_NOTFOUND;
+         break;
+      }
+      err = fs_read_node(loader, fd, entries[i].name);
+      close(fd);
+   }
+
+   for (i = 0; i < count; i++)
+      free(entries[i].name);
+   free(entries);
+
+   while (!err && ((err = fdt_end_node(loader->fdt)) == -FDT_ERR_NOSPACE))
+      err = fs_grow(loader);
+   return err;
+}
+
+// Returns a malloced DTB of the filesystem below dirname, or NULL. A
+// negative max_size (see DTOVERLAY_PADDING) is the space to leave free.
+void *dtoverlay_fs_to_fdt(const char *dirname, int max_size)
+{
+   FS_LOADER_T loader;
+   void *fdt;
+   int dir_fd, size, err;
+
+   memset(&loader, 0, sizeof(loader));
+   loader.size = FS_INITIAL_SIZE;
+   loader.fdt = malloc(loader.size);
+   loader.strings_mask = FS_INITIAL_STRINGS - 1;
+   loader.strings = calloc(FS_INITIAL_STRINGS, sizeof(int));
+   loader.value_max = 4096;
+   loader.value = malloc(loader.value_max);
+   dir_fd = open(dirname, O_RDONLY | O_DIRECTORY);
+
+   err = -FDT_ERR_NOSPACE;
+   if (loader.fdt && loader.strings && loader.value && (dir_fd >= 0))
+   {
+      err = fdt_create(loader.fdt, loader.size);
+      if (!err)
+         err = fdt_finish_reservemap(loader.fdt);
+      if (!err)
+         err = fs_read_node(&loader, dir_fd, "");
+      while (!err && ((err = fdt_finish(loader.fdt)) == -FDT_ERR_NOSPACE))
+         err = fs_grow(&loader);
+   }
+   if (dir_fd >= 0)
+      close(dir_fd);
+   free(loader.strings);
+   free(loader.value);
+   if (err)
+   {
+      free(loader.fdt);
+      return NULL;
+   }
+
+   size = fdt_totalsize(loader.fdt);
+   if (max_size < 0)
+      size -= max_size;
+   else if (max_size > size)
+      size = max_size;
+   if (size > loader.size)
+   {
+      fdt = realloc(loader.fdt, size);
+      if (!fdt)
+      {
+         free(loader.fdt);
+         return NULL;
+      }
+      loader.fdt = fdt;
+   }
+   if (fdt_open_into(loader.fdt, loader.fdt, size))
+   {
+      free(loader.fdt);
+      return NULL;
+   }
+   fdt = realloc(loader.fdt, size);
+   return fdt ? fdt : loader.fdt;
+}
@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
+#include <time.h>
 
 #include <libfdt.h>
 
@@ -49,6 +50,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DT_OVERLAYS_SUBDIR "overlays"
 #define DTOVERLAY_PATH_MAX 128
 #define DIR_MODE 0755
+#define CACHE_SIZE (1024 * 1024)
 
 
 enum {
@@ -57,6 +59,7 @@ enum {
     OPT_REMOVE_FROM,
     OPT_LIST,
     OPT_LIST_ALL,
+    OPT_BATCH,
     OPT_HELP
 };
 
@@ -82,6 +85,7 @@ typedef struct state_struct
 
 static int dtoverlay_add(STATE_T *state, const char *overlay,
                          int argc, const char **argv);
+static int dtoverlay_batch(STATE_T *state, const char *list_file);
 static int dtoverlay_remove(STATE_T *state, const char *overlay, int and_later);
 static int dtoverlay_list(STATE_T *state);
 static int dtoverlay_list_all(STATE_T *state);
@@ -102,6 +106,8 @@ const char *work_dir = WORK_DIR;
 const char *overlay_src_dir;
 const char *dt_overlays_dir;
 const char *error_file = NULL;
+const char *cache_dir = NULL;
+int opt_verify = 0;
 
 int main(int argc, const char **argv)
 {
@@ -110,6 +116,7 @@ int main(int argc, const char **argv)
     int is_dtparam;
     const char *overlay = NULL;
     const char **params = NULL;
+    const char *batch_file = NULL;
     int ret = 0;
     STATE_T *state = NULL;
     const char *cfg_dir;
@@ -149,12 +156,29 @@ int main(int argc, const char **argv)
 		usage();
 	    opt = OPT_LIST_ALL;
 	}
+	else if (strcmp(arg, "-b") == 0)
+	{
+	    if ((opt != OPT_ADD) || is_dtparam || (argn == argc))
+		usage();
+	    opt = OPT_BATCH;
+	    batch_file = argv[argn++];
+	}
 	else if (strcmp(arg, "-d") == 0)
 	{
 	    if (argn == argc)
 		usage();
 	    overlay_src_dir = argv[argn++];
 	}
+	else if (strcmp(arg, "-c") == 0)
+	{
+	    if (argn == argc)
+		usage();
+	    cache_dir = argv[argn++];
+	}
+	else if (strcmp(arg, "-V") == 0)
+	{
+	    opt_verify = 1;
+	}
 	else if (strcmp(arg, "-v") == 0)
 	{
 	    opt_verbose = 1;
@@ -262,6 +286,7 @@ int main(int argc, const char **argv)
     case OPT_ADD:
     case OPT_REMOVE:
     case OPT_REMOVE_FROM:
+    case OPT_BATCH:
 	root_check();
 	run_cmd("which dtoverlay-pre >/dev/null 2>&1 && dtoverlay-pre");
 	break;
@@ -286,6 +311,9 @@ int main(int argc, const char **argv)
     case OPT_LIST_ALL:
 	ret = dtoverlay_list_all(state);
 	break;
+    case OPT_BATCH:
+	ret = dtoverlay_batch(state, batch_file);
+	break;
     default:
 	ret = 1;
 	break;
@@ -296,6 +324,7 @@ int main(int argc, const char **argv)
     case OPT_ADD:
     case OPT_REMOVE:
     case OPT_REMOVE_FROM:
+    case OPT_BATCH:
 	run_cmd("which dtoverlay-post >/dev/null 2>&1 && dtoverlay-post");
 	break;
     default:
@@ -317,8 +346,63 @@ struct dtparam_state
 {
     STRING_VEC_T *used_props;
     const char *override_value;
+    struct fdt_edit *edit;
 };
 
+/* The override is applied to a copy of the property in a blob of its
+   own, and the result goes into the edit transaction, so the live tree
+   is only read until all the parameters are in and then written once.
+   dtparams only change properties of the base, never its nodes. */
+static int dtparam_one_target(int override_type, struct dtparam_state *state,
+			      DTBLOB_T *dtb, int node_off,
+			      const char *prop_name, int target_phandle,
+			      int target_off, int target_size)
+{
+    DTBLOB_T scratch = *dtb;
+    const void *value;
+    int size, len, scratch_node, err;
+
+    value = fdt_edit_getprop(state->edit, node_off, prop_name, &len);
+    if (!value)
+	len = 0;
+    size = 1024 + strlen(prop_name) + 2 * (len + target_off + target_size +
+					   strlen(state->override_value));
+    scratch.fdt = malloc(size);
+    scratch.fdt_is_malloced = 0;
+    scratch.trailer = NULL;
+    scratch.trailer_len = 0;
+    scratch.trailer_is_malloced = 0;
+    if (!scratch.fdt)
+	return NON_FATAL(FDT_ERR_NOSPACE);
+
+    err = fdt_create_empty_tree(scratch.fdt, size);
+    scratch_node = err ? err : fdt_add_subnode(scratch.fdt, 0, "dtparam");
+    if (scratch_node < 0)
+	err = scratch_node;
+    else if (value)
+	err = fdt_setprop(scratch.fdt, scratch_node, prop_name, value, len);
+
+    if (err == 0)
+	err = dtoverlay_override_one_target(override_type,
+					    &scratch, scratch_node,
+					    prop_name, target_phandle,
+					    target_off, target_size,
+					    (void *)state->override_value);
+    if (err == 0)
+    {
+	const void *result = fdt_getprop(scratch.fdt, scratch_node,
+					 prop_name, &len);
+	if (result)
+	    err = fdt_edit_setprop(state->edit, node_off, prop_name,
+				   result, len);
+	else if (value)
+	    err = fdt_edit_delprop(state->edit, node_off, prop_name);
+    }
+
+    free(scratch.fdt);
+    return err;
+}
+
 int dtparam_callback(int override_type,
 		     DTBLOB_T *dtb, int node_off,
 		     const char *prop_name, int target_phandle,
@@ -329,11 +413,10 @@ int dtparam_callback(int override_type,
     char prop_id[80];
     int err;
 
-    err = dtoverlay_override_one_target(override_type,
-					dtb, node_off,
-					prop_name, target_phandle,
-					target_off, target_size,
-					(void *)state->override_value);
+    err = dtparam_one_target(override_type, state,
+			     dtb, node_off,
+			     prop_name, target_phandle,
+			     target_off, target_size);
 
     if ((err == 0) && (target_phandle != 0))
     {
@@ -347,49 +430,172 @@ int dtparam_callback(int override_type,
     return err;
 }
 
+// Records the changes of the override in the edit transaction on dtb.
 // Returns 0 on success, -ve for fatal errors and +ve for non-fatal errors
-int dtparam_apply(DTBLOB_T *dtb, const char *override_name,
+int dtparam_apply(DTBLOB_T *dtb, struct fdt_edit *edit,
+		  const char *override_name,
 		  const char *override_data, int data_len,
 		  const char *override_value, STRING_VEC_T *used_props)
 {
     struct dtparam_state state;
-    void *data;
-    int err;
 
     state.used_props = used_props;
     state.override_value = override_value;
+    state.edit = edit;
+
+    /* The tree isn't written before the commit, the data stays put */
+    return dtoverlay_foreach_override_target(dtb, override_name,
+					     override_data, data_len,
+					     dtparam_callback,
+					     (void *)&state);
+}
+
+// Applies the parameters to an overlay, or to the base DTB for dtparams
+// collecting the properties they change. The dtparams go into one edit
+// transaction, committed when all of them are in. Returns 0 on success.
+static int apply_params(DTBLOB_T *dtb, int is_dtparam,
+			int argc, const char **argv,
+			STRING_VEC_T *used_props, char **param_string)
+{
+    struct fdt_edit *edit = NULL;
+    int err = 0;
+    int i;
 
-    /* Copy the override data in case it moves */
-    data = malloc(data_len);
-    if (data)
+    if (is_dtparam)
     {
-	memcpy(data, override_data, data_len);
-	err = dtoverlay_foreach_override_target(dtb, override_name,
-						data, data_len,
-						dtparam_callback,
-						(void *)&state);
-	free(data);
+	edit = dtoverlay_edit_begin(dtb);
+	if (!edit)
+	    return error("Failed to start editing the base DTB");
     }
-    else
+
+    for (i = 0; (i < argc) && (err == 0); i++)
     {
-	dtoverlay_error("out of memory");
-	err = NON_FATAL(FDT_ERR_NOSPACE);
+	const char *arg = argv[i];
+	const char *param_val = strchr(arg, '=');
+	const char *param, *override;
+	char *p = NULL;
+	int override_len;
+	if (param_val)
+	{
+	    int len = (param_val - arg);
+	    p = sprintf_dup("%.*s", len, arg);
+	    param = p;
+	    param_val++;
+	}
+	else
+	{
+	    /* Use the default parameter value - true */
+	    param = arg;
+	    param_val = "true";
+	}
+
+	override = dtoverlay_find_override(dtb, param, &override_len);
+
+	if (!override)
+	{
+	    err = error("Unknown parameter '%s'", param);
+	    break;
+	}
+
+	if (is_dtparam)
+	    err = dtparam_apply(dtb, edit, param,
+				override, override_len,
+				param_val, used_props);
+	else
+	    err = dtoverlay_apply_override(dtb, param,
+					   override, override_len,
+					   param_val);
+	if (err != 0)
+	{
+	    err = error("Failed to set %s=%s", param, param_val);
+	    break;
+	}
+
+	*param_string = sprintf_dup("%s %s=%s",
+				    *param_string ? *param_string : "",
+				    param, param_val);
+
+	free_string(p);
+    }
+
+    if (edit)
+    {
+	if (err != 0)
+	    dtoverlay_edit_abort(edit);
+	else if (dtoverlay_edit_commit(dtb, edit) != 0)
+	    err = error("Failed to write the dtparams into the base DTB");
     }
 
     return err;
 }
 
+/* Looks the overlay up by its blob (or file) and parameters, writing
+   it to dtbo_file on a hit. Only the used part of the blob counts, the
+   padding behind the strings holds whatever the buffer held before */
+static struct dtoverlay_cache *cache_lookup(DTBLOB_T *dtb, const char *file,
+					    int argc, const char **argv,
+					    const char *dtbo_file, int *hit)
+{
+    struct dtoverlay_cache *cache;
+    int used = dtb ? fdt_off_dt_strings(dtb->fdt) + fdt_size_dt_strings(dtb->fdt) : 0;
+
+    *hit = 0;
+    if (!cache_dir)
+	return NULL;
+    cache = dtoverlay_cache_begin(cache_dir, CACHE_SIZE, opt_verify);
+    if (cache &&
+	((dtoverlay_cache_add(cache, "dtoverlay", 9) != 0) ||
+	 ((dtb ? dtoverlay_cache_add(cache, dtb->fdt, used) :
+	   dtoverlay_cache_add_file(cache, file)) != 0) ||
+	 (dtoverlay_cache_add_params(cache, argc, argv) != 0)))
+    {
+	dtoverlay_cache_end(cache, NULL);
+	return NULL;
+    }
+    if (cache)
+	*hit = (dtoverlay_cache_fetch(cache, dtbo_file) == 1);
+    return cache;
+}
+
+static void cache_done(struct dtoverlay_cache *cache, const char *dtbo_file)
+{
+    if (!cache)
+	return;
+    if (dtbo_file && (dtoverlay_cache_store(cache, dtbo_file) == 1))
+	error("Cached overlay differed from '%s', replaced", dtbo_file);
+    dtoverlay_cache_end(cache, opt_verbose ? stderr : NULL);
+}
+
+static int apply_saved(const char *overlay_file, const char *overlay_name)
+{
+    if (!apply_overlay(overlay_file, overlay_name))
+    {
+	if (error_file)
+	{
+	    rename(overlay_file, error_file);
+	    free_string(error_file);
+	}
+	return 1;
+    }
+
+    return 0;
+}
+
 static int dtoverlay_add(STATE_T *state, const char *overlay,
 			 int argc, const char **argv)
 {
     const char *overlay_name;
-    const char *overlay_file;
+    const char *overlay_file = NULL;
     char *param_string = NULL;
     int is_dtparam;
     DTBLOB_T *base_dtb = NULL;
-    DTBLOB_T *overlay_dtb;
+    DTBLOB_T *overlay_dtb = NULL;
     STRING_VEC_T used_props;
+    struct dtoverlay_cache *cache;
+    const char *dtbo_file;
+    void *fdt;
     int err;
+    int hit;
     int len;
     int i;
 
@@ -397,11 +603,27 @@ static int dtoverlay_add(STATE_T *state, const char *overlay,
     is_dtparam = (strcmp(overlay, "dtparam") == 0);
     if (is_dtparam)
     {
-        /* Convert /proc/device-tree to a .dtb and load it */
-	overlay_file = sprintf_dup("%s/%s", work_dir, "base.dtb");
-	if (run_cmd("dtc -I fs -O dtb -o '%s' /proc/device-tree 1>/dev/null 2>&1",
-		    overlay_file) != 0)
-           return error("Failed to read active DTB");
+        /* Read /proc/device-tree into a .dtb in memory */
+	fdt = dtoverlay_fs_to_fdt("/proc/device-tree", DTOVERLAY_PADDING(4096));
+	if (fdt)
+	{
+	    overlay_dtb = dtoverlay_import_fdt(fdt, fdt_totalsize(fdt));
+	    if (overlay_dtb)
+		overlay_dtb->fdt_is_malloced = 1;
+	    else
+		free(fdt);
+	}
+	if (opt_verbose)
+	    fprintf(stderr, "read /proc/device-tree: %s\n",
+		    overlay_dtb ? "ok" : "failed, trying dtc");
+	if (!overlay_dtb)
+	{
+	    /* Convert /proc/device-tree to a .dtb with dtc and load it */
+	    overlay_file = sprintf_dup("%s/%s", work_dir, "base.dtb");
+	    if (run_cmd("dtc -I fs -O dtb -o '%s' /proc/device-tree 1>/dev/null 2>&1",
+			overlay_file) != 0)
+		return error("Failed to read active DTB");
+	}
     }
     else if ((len > 0) && (strcmp(overlay + len, ".dtbo") == 0))
     {
@@ -422,9 +644,26 @@ static int dtoverlay_add(STATE_T *state, const char *overlay,
     }
 
     overlay_name = sprintf_dup("%d_%s", state->count, overlay);
-    overlay_dtb = dtoverlay_load_dtb(overlay_file, DTOVERLAY_PADDING(4096));
+    /* Create a filename with the sequence number */
+    dtbo_file = sprintf_dup("%s/%s.dtbo", work_dir, overlay_name);
+
+    /* The same blob with the same parameters gives the same overlay */
+    cache = cache_lookup(overlay_dtb, overlay_file, argc, argv, dtbo_file, &hit);
+    if (hit)
+    {
+	if (overlay_dtb)
+	    dtoverlay_free_dtb(overlay_dtb);
+	cache_done(cache, NULL);
+	return apply_saved(dtbo_file, overlay_name);
+    }
+
+    if (!overlay_dtb)
+	overlay_dtb = dtoverlay_load_dtb(overlay_file, DTOVERLAY_PADDING(4096));
     if (!overlay_dtb)
+    {
+	cache_done(cache, NULL);
 	return error("Failed to read '%s'", overlay_file);
+    }
 
     if (is_dtparam)
     {
@@ -433,48 +672,12 @@ static int dtoverlay_add(STATE_T *state, const char *overlay,
     }
 
     /* Apply any parameters next */
-    for (i = 0; i < argc; i++)
+    err = apply_params(overlay_dtb, is_dtparam, argc, argv,
+		       &used_props, &param_string);
+    if (err != 0)
     {
-	const char *arg = argv[i];
-	const char *param_val = strchr(arg, '=');
-	const char *param, *override;
-	char *p = NULL;
-	int override_len;
-	if (param_val)
-	{
-	    int len = (param_val - arg);
-	    p = sprintf_dup("%.*s", len, arg);
-	    param = p;
-	    param_val++;
-	}
-	else
-	{
-	    /* Use the default parameter value - true */
-	    param = arg;
-	    param_val = "true";
-	}
-
-	override = dtoverlay_find_override(overlay_dtb, param, &override_len);
-
-	if (!override)
-	    return error("Unknown parameter '%s'", param);
-
-	if (is_dtparam)
-	    err = dtparam_apply(overlay_dtb, param,
-				override, override_len,
-				param_val, &used_props);
-	else
-	    err = dtoverlay_apply_override(overlay_dtb, param,
-					   override, override_len,
-					   param_val);
-	if (err != 0)
-	    return error("Failed to set %s=%s", param, param_val);
-
-	param_string = sprintf_dup("%s %s=%s",
-				   param_string ? param_string : "",
-				   param, param_val);
-
-	free_string(p);
+	cache_done(cache, NULL);
+	return err;
     }
 
     if (is_dtparam)
@@ -506,27 +709,321 @@ static int dtoverlay_add(STATE_T *state, const char *overlay,
 	dtoverlay_dtb_set_trailer(overlay_dtb, param_string,
 				  strlen(param_string) + 1);
 
-    /* Create a filename with the sequence number */
-    overlay_file = sprintf_dup("%s/%s.dtbo", work_dir, overlay_name);
-
     /* then write the overlay to the file */
     dtoverlay_pack_dtb(overlay_dtb);
-    dtoverlay_save_dtb(overlay_dtb, overlay_file);
+    err = dtoverlay_save_dtb(overlay_dtb, dtbo_file);
     dtoverlay_free_dtb(overlay_dtb);
+    cache_done(cache, (err == 0) ? dtbo_file : NULL);
 
-    if (!apply_overlay(overlay_file, overlay_name))
+    return apply_saved(dtbo_file, overlay_name);
+}
+
+typedef struct batch_entry_struct
+{
+    const char *overlay;
+    STRING_VEC_T params;
+    DTBLOB_T *dtb;
+    char *param_string;
+} BATCH_ENTRY_T;
+
+typedef struct batch_times_struct
+{
+    double read, load, combine, save, apply;
+    int dirs;
+} BATCH_TIMES_T;
+
+static double batch_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Adds the comma separated parameters to the vector */
+static void batch_add_params(STRING_VEC_T *params, const char *list)
+{
+    while (*list)
     {
-	if (error_file)
+	int len = strcspn(list, ",");
+	if (len)
+	    string_vec_add(params, list, len);
+	list += len;
+	if (*list)
+	    list++;
+    }
+}
+
+/* Reads a config.txt style list: "dtoverlay=<overlay>[,<param>=<val>...]"
+   lines, with "dtparam=<param>=<val>[,...]" lines adding to the overlay
+   before them, or to the base DTB before the first overlay. */
+static BATCH_ENTRY_T *batch_read(const char *list_file, int *count,
+				 STRING_VEC_T *base_params)
+{
+    BATCH_ENTRY_T *entries = NULL;
+    char line[1024];
+    int max = 0, n = 0;
+    FILE *fp;
+
+    fp = (strcmp(list_file, "-") == 0) ? stdin : fopen(list_file, "r");
+    if (!fp)
+    {
+	error("Failed to open '%s'", list_file);
+	return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+	char *p = line + strspn(line, " \t");
+	int len = strcspn(p, "#\r\n");
+	while ((len > 0) && ((p[len - 1] == ' ') || (p[len - 1] == '\t')))
+	    len--;
+	p[len] = '\0';
+
+	if (strncmp(p, "dtoverlay=", 10) == 0)
+	{
+	    if (n == max)
+	    {
+		max = max ? max * 2 : 16;
+		entries = realloc(entries, max * sizeof(BATCH_ENTRY_T));
+		if (!entries)
+		    fatal_error("out of memory");
+	    }
+	    p += 10;
+	    len = strcspn(p, ",");
+	    memset(&entries[n], 0, sizeof(BATCH_ENTRY_T));
+	    entries[n].overlay = sprintf_dup("%.*s", len, p);
+	    string_vec_init(&entries[n].params);
+	    batch_add_params(&entries[n].params, p + len);
+	    n++;
+	}
+	else if (strncmp(p, "dtparam=", 8) == 0)
+	{
+	    batch_add_params(n ? &entries[n - 1].params : base_params, p + 8);
+	}
+	else if (*p && opt_verbose)
+	{
+	    fprintf(stderr, "batch: ignoring '%s'\n", p);
+	}
+    }
+    if (fp != stdin)
+	fclose(fp);
+
+    *count = n;
+    return entries ? entries : calloc(1, sizeof(BATCH_ENTRY_T));
+}
+
+/* Saves the overlay with the sequence number and applies it. A failed one
+   goes to the error file if keep_failed is set. Returns 0 on success. */
+static int batch_apply(STATE_T *state, const char *overlay, DTBLOB_T *dtb,
+		       char *param_string, int keep_failed,
+		       BATCH_TIMES_T *times)
+{
+    const char *overlay_name = sprintf_dup("%d_%s", state->count, overlay);
+    const char *overlay_file = sprintf_dup("%s/%s.dtbo", work_dir,
+					   overlay_name);
+    double start = batch_now();
+    int ok;
+
+    if (param_string)
+	dtoverlay_dtb_set_trailer(dtb, param_string, strlen(param_string) + 1);
+    dtoverlay_pack_dtb(dtb);
+    if (dtoverlay_save_dtb(dtb, overlay_file) != 0)
+	return error("Failed to save '%s'", overlay_file);
+    times->save += batch_now() - start;
+
+    start = batch_now();
+    ok = apply_overlay(overlay_file, overlay_name);
+    times->apply += batch_now() - start;
+    times->dirs++;
+
+    if (!ok)
+    {
+	if (keep_failed && error_file)
 	{
 	    rename(overlay_file, error_file);
 	    free_string(error_file);
+	    error_file = NULL;
+	}
+	else
+	{
+	    unlink(overlay_file);
 	}
 	return 1;
     }
 
+    state->count++;
+    return 0;
+}
+
+/* Applies entries [first, first + n) combined, or one by one if the kernel
+   refuses the combination */
+static int batch_apply_group(STATE_T *state, BATCH_ENTRY_T *entries,
+			     int first, int n, DTBLOB_T *combined,
+			     BATCH_TIMES_T *times)
+{
+    char *names = NULL, *params = NULL;
+    int i;
+
+    if (n == 1)
+	return batch_apply(state, entries[first].overlay, entries[first].dtb,
+			   entries[first].param_string, 1, times);
+
+    for (i = first; i < first + n; i++)
+    {
+	names = sprintf_dup("%s%s%s", names ? names : "", names ? "+" : "",
+			    entries[i].overlay);
+	if (entries[i].param_string)
+	    params = sprintf_dup("%s %s:%s", params ? params : "",
+				 entries[i].overlay, entries[i].param_string);
+    }
+    if (batch_apply(state, names, combined, params, 0, times) == 0)
+	return 0;
+
+    if (opt_verbose)
+	fprintf(stderr, "batch: '%s' refused, applying one by one\n", names);
+    for (i = first; i < first + n; i++)
+    {
+	if (batch_apply(state, entries[i].overlay, entries[i].dtb,
+			entries[i].param_string, 1, times) != 0)
+	    return 1;
+    }
     return 0;
 }
 
+/* Adds the overlay to the combined one, created when there is none yet */
+static int batch_combine(DTBLOB_T **combined, DTBLOB_T *dtb,
+			 BATCH_TIMES_T *times)
+{
+    double start = batch_now();
+    int err;
+
+    if (!*combined)
+	*combined = dtoverlay_create_dtb(256);
+    err = *combined ? dtoverlay_combine(*combined, dtb) : -FDT_ERR_NOSPACE;
+    times->combine += batch_now() - start;
+    return err;
+}
+
+/* Applies a list of overlays with as few configfs directories as
+   possible: those that can be are combined into one overlay. */
+static int dtoverlay_batch(STATE_T *state, const char *list_file)
+{
+    BATCH_ENTRY_T *entries;
+    BATCH_TIMES_T times;
+    STRING_VEC_T base_params;
+    DTBLOB_T *combined = NULL;
+    double start;
+    int count = 0, first, ret = 0;
+    int err;
+    int i;
+
+    memset(&times, 0, sizeof(times));
+    string_vec_init(&base_params);
+
+    start = batch_now();
+    entries = batch_read(list_file, &count, &base_params);
+    if (!entries)
+	return 1;
+    times.read = batch_now() - start;
+
+    /* The dtparams of the base DTB come first */
+    if (base_params.num_strings)
+    {
+	start = batch_now();
+	ret = dtoverlay_add(state, "dtparam", base_params.num_strings,
+			    (const char **)base_params.strings);
+	times.apply += batch_now() - start;
+	times.dirs++;
+	if (ret != 0)
+	    goto cleanup;
+	state->count++;
+    }
+
+    start = batch_now();
+    for (i = 0; i < count; i++)
+    {
+	const char *overlay_file = sprintf_dup("%s/%s.dtbo", overlay_src_dir,
+					       entries[i].overlay);
+	entries[i].dtb = dtoverlay_load_dtb(overlay_file,
+					    DTOVERLAY_PADDING(4096));
+	if (!entries[i].dtb)
+	{
+	    ret = error("Failed to read '%s'", overlay_file);
+	    goto cleanup;
+	}
+	ret = apply_params(entries[i].dtb, 0, entries[i].params.num_strings,
+			   (const char **)entries[i].params.strings,
+			   NULL, &entries[i].param_string);
+	if (ret != 0)
+	    goto cleanup;
+    }
+    times.load = batch_now() - start;
+
+    /* Combine while they fit, applying each group as it is closed */
+    for (first = 0, i = 0; i < count; i++)
+    {
+	err = batch_combine(&combined, entries[i].dtb, &times);
+	if ((err > 0) && (i > first))
+	{
+	    ret = batch_apply_group(state, entries, first, i - first,
+				    combined, &times);
+	    dtoverlay_free_dtb(combined);
+	    combined = NULL;
+	    first = i;
+	    if (ret != 0)
+		goto cleanup;
+	    err = batch_combine(&combined, entries[i].dtb, &times);
+	}
+	if (IS_FATAL(err))
+	{
+	    ret = error("Failed to combine '%s' (%d)", entries[i].overlay, err);
+	    goto cleanup;
+	}
+	if (err > 0)
+	{
+	    /* Not even on its own, it goes as it is */
+	    ret = batch_apply_group(state, entries, i, 1, NULL, &times);
+	    dtoverlay_free_dtb(combined);
+	    combined = NULL;
+	    first = i + 1;
+	    if (ret != 0)
+		goto cleanup;
+	}
+    }
+    if (first < count)
+    {
+	ret = batch_apply_group(state, entries, first, count - first,
+				combined, &times);
+	if (ret != 0)
+	    goto cleanup;
+    }
+
+    if (opt_verbose)
+	fprintf(stderr, "batch: %d overlays in %d configfs directories\n"
+		"  read list %8.3f ms\n"
+		"  load+params %6.3f ms\n"
+		"  combine %10.3f ms\n"
+		"  save %13.3f ms\n"
+		"  configfs %9.3f ms\n",
+		count, times.dirs, times.read * 1e3, times.load * 1e3,
+		times.combine * 1e3, times.save * 1e3, times.apply * 1e3);
+
+cleanup:
+    if (combined)
+	dtoverlay_free_dtb(combined);
+    for (i = 0; i < count; i++)
+    {
+	if (entries[i].dtb)
+	    dtoverlay_free_dtb(entries[i].dtb);
+	string_vec_uninit(&entries[i].params);
+    }
+    free(entries);
+    string_vec_uninit(&base_params);
+
+    return ret;
+}
+
 static int dtoverlay_remove(STATE_T *state, const char *overlay, int and_later)
 {
     const char *overlay_dir;
@@ -851,6 +1348,9 @@ static void usage(void)
     printf("  %s -r [<overlay>] Remove an overlay (by name, index or the last)\n", cmd_name);
     printf("  %s -R [<overlay>] Remove from an overlay (by name, index or all)\n",
 	   cmd_name);
+    printf("  %s -b <file>      Add the overlays listed in config.txt style\n", cmd_name);
+    printf("  %*s                (dtoverlay=/dtparam= lines, - for stdin),\n", (int)strlen(cmd_name), "");
+    printf("  %*s                combined into as few overlays as possible\n", (int)strlen(cmd_name), "");
     printf("  %s -l             List active overlays/params\n", cmd_name);
     printf("  %s -a             List all overlays (marking the active)\n", cmd_name);
     printf("  %s -h             Show this usage message\n", cmd_name);
@@ -861,6 +1361,8 @@ static void usage(void)
     printf("Options applicable to most variants:\n");
     printf("    -d <dir>    Specify an alternate location for the overlays\n");
     printf("                (defaults to /boot/overlays or /flash/overlays)\n");
+    printf("    -c <dir>    Cache the overlays with their parameters applied in <dir>\n");
+    printf("    -V          Build them on cache hits as well and check the cached ones\n");
     printf("    -v          Verbose operation\n");
     printf("\n");
     printf("Adding or removing overlays and parameters requires root privileges.\n");
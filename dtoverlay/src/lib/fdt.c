@@ -164,6 +164,7 @@ int fdt_next_node(const void *fdt, int offset, int *depth)
 	int nextoffset = 0;
 	uint32_t tag;
 
+	fdt_index_stats.steps++;
 	if (offset >= 0)
 		if ((nextoffset = _fdt_check_node_offset(fdt, offset)) < 0)
 			return nextoffset;
@@ -0,0 +1,681 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Edit transactions
+ *
+ * libfdt is dual licensed: you can use it either under the terms of
+ * the GPL, or the BSD license, at your option.
+ *
+ *  a) This library is free software; you can redistribute it and/or
+ *     modify it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of the
+ *     License, or (at your option) any later version.
+ *
+ *     This library is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with this library; if not, write to the Free
+ *     Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *     MA 02110-1301 USA
+ *
+ * Alternatively,
+ *
+ *  b) Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "libfdt_env.h"
+
+#include <stdlib.h>
+
+#include <fdt.h>
+#include <libfdt.h>
+
+#include "libfdt_internal.h"
+
+/*
+ * An edit transaction records changes against a blob that is only read
+ * and writes the result in one pass.  Nodes of the blob keep their
+ * offsets, added nodes get handles past the end of the structure block.
+ * The output is laid out the way fdt_rw lays out the same calls: added
+ * properties and subnodes go in front of the existing ones, newest
+ * first, and new names are appended to the string table in call order.
+ */
+
+#define FDT_EDIT_DEPTH		64
+
+enum {
+	FDT_EDIT_NEW,
+	FDT_EDIT_REPLACE,
+	FDT_EDIT_DELETE,
+};
+
+struct fdt_edit_prop {
+	int next;
+	int kind;
+	int nameoff;		/* in the output string table */
+	int len;
+	int data;		/* in the pool */
+};
+
+struct fdt_edit_node {
+	int offset;		/* or handle of an added node */
+	int deleted;
+	int parent;		/* record of the parent, added nodes only */
+	int name;		/* in the pool, added nodes only */
+	int props;
+	int children;		/* added subnodes */
+	int next;		/* next added sibling */
+	int hash_next;
+};
+
+struct fdt_edit {
+	const void *fdt;
+	int handles;		/* the first handle of an added node */
+	struct fdt_edit_node *nodes;
+	int nodes_len;
+	int nodes_max;
+	struct fdt_edit_prop *props;
+	int props_len;
+	int props_max;
+	int *buckets;
+	int buckets_len;
+	char *pool;
+	int pool_len;
+	int pool_max;
+	char *strings;		/* appended to the string table */
+	int strings_len;
+	int strings_max;
+};
+
+struct fdt_edit_writer {
+	char *buf;		/* NULL to count only */
+	int len;
+};
+
+unsigned long fdt_bytes_moved;
+
+static int _fdt_edit_grow(void **p, int *max, int need, int size)
+{
+	void *n;
+	int m = *max ? *max : 64;
+
+	if (need <= *max)
+		return 0;
+	while (m < need)
+		m *= 2;
+	n = realloc(*p, (size_t)m * size);
+	if (!n)
+		return -FDT_ERR_NOSPACE;
+	*p = n;
+	*max = m;
+	return 0;
+}
+
+/* copies len bytes to a growing buffer, returns where they went */
+static int _fdt_edit_store(char **buf, int *len, int *max,
+			   const void *data, int size)
+{
+	int off = *len;
+
+	if (_fdt_edit_grow((void **)buf, max, off + size, 1))
+		return -FDT_ERR_NOSPACE;
+	memcpy(*buf + off, data, size);
+	*len += size;
+	return off;
+}
+
+static const char *_fdt_edit_string(struct fdt_edit *e, int nameoff)
+{
+	int size = fdt_size_dt_strings(e->fdt);
+
+	if (nameoff < size)
+		return fdt_string(e->fdt, nameoff);
+	return e->strings + nameoff - size;
+}
+
+/* like _fdt_find_add_string() on the table fdt_rw would have by now */
+static int _fdt_edit_add_string(struct fdt_edit *e, const char *s)
+{
+	const char *strtab = fdt_string(e->fdt, 0);
+	int size = fdt_size_dt_strings(e->fdt);
+	const char *p;
+	int off;
+
+	p = _fdt_find_string(strtab, size, s);
+	if (p)
+		return p - strtab;
+	if (e->strings_len) {
+		p = _fdt_find_string(e->strings, e->strings_len, s);
+		if (p)
+			return size + (p - e->strings);
+	}
+	off = _fdt_edit_store(&e->strings, &e->strings_len, &e->strings_max,
+			      s, strlen(s) + 1);
+	return off < 0 ? off : size + off;
+}
+
+static int _fdt_edit_find(struct fdt_edit *e, int offset)
+{
+	int i;
+
+	if (!e->buckets_len)
+		return -1;
+	for (i = e->buckets[(offset / FDT_TAGSIZE) & (e->buckets_len - 1)];
+	     i >= 0; i = e->nodes[i].hash_next)
+		if (e->nodes[i].offset == offset)
+			return i;
+	return -1;
+}
+
+static int _fdt_edit_new_node(struct fdt_edit *e, int offset)
+{
+	struct fdt_edit_node *n;
+	int i, b;
+
+	if (_fdt_edit_grow((void **)&e->nodes, &e->nodes_max, e->nodes_len + 1,
+			   sizeof(*e->nodes)))
+		return -FDT_ERR_NOSPACE;
+	if (2 * (e->nodes_len + 1) > e->buckets_len) {
+		b = e->buckets_len ? 2 * e->buckets_len : 256;
+		free(e->buckets);
+		e->buckets = malloc(b * sizeof(int));
+		if (!e->buckets) {
+			e->buckets_len = 0;
+			return -FDT_ERR_NOSPACE;
+		}
+		e->buckets_len = b;
+		memset(e->buckets, 0xff, b * sizeof(int));
+		for (i = 0; i < e->nodes_len; i++) {
+			b = (e->nodes[i].offset / FDT_TAGSIZE) & (e->buckets_len - 1);
+			e->nodes[i].hash_next = e->buckets[b];
+			e->buckets[b] = i;
+		}
+	}
+
+	i = e->nodes_len++;
+	n = &e->nodes[i];
+	memset(n, 0, sizeof(*n));
+	n->offset = offset < 0 ? e->handles + i * FDT_TAGSIZE : offset;
+	n->parent = -1;
+	n->name = -1;
+	n->props = -1;
+	n->children = -1;
+	n->next = -1;
+	b = (n->offset / FDT_TAGSIZE) & (e->buckets_len - 1);
+	n->hash_next = e->buckets[b];
+	e->buckets[b] = i;
+	return i;
+}
+
+/* the record of a node, made for nodes of the blob when create is set */
+static int _fdt_edit_node(struct fdt_edit *e, int offset, int create)
+{
+	int i = _fdt_edit_find(e, offset);
+
+	if (i >= 0)
+		return e->nodes[i].deleted ? -FDT_ERR_BADOFFSET : i;
+	if ((offset >= e->handles) || (_fdt_check_node_offset(e->fdt, offset) < 0))
+		return -FDT_ERR_BADOFFSET;
+	if (!create)
+		return -FDT_ERR_NOTFOUND;
+	return _fdt_edit_new_node(e, offset);
+}
+
+/* the pending change of a property other than a delete, or -1 */
+static int _fdt_edit_prop(struct fdt_edit *e, int node, const char *name,
+			  int *deleted)
+{
+	struct fdt_edit_prop *p;
+	int i;
+
+	if (deleted)
+		*deleted = 0;
+	for (i = e->nodes[node].props; i >= 0; i = p->next) {
+		p = &e->props[i];
+		if (strcmp(_fdt_edit_string(e, p->nameoff), name))
+			continue;
+		if (p->kind != FDT_EDIT_DELETE)
+			return i;
+		if (deleted)
+			*deleted = 1;
+	}
+	return -1;
+}
+
+static int _fdt_edit_add_prop(struct fdt_edit *e, int node, int kind,
+			      int nameoff, int data, int len)
+{
+	struct fdt_edit_prop *p;
+
+	if (_fdt_edit_grow((void **)&e->props, &e->props_max, e->props_len + 1,
+			   sizeof(*e->props)))
+		return -FDT_ERR_NOSPACE;
+	p = &e->props[e->props_len];
+	p->kind = kind;
+	p->nameoff = nameoff;
+	p->data = data;
+	p->len = len;
+	p->next = e->nodes[node].props;
+	e->nodes[node].props = e->props_len++;
+	return 0;
+}
+
+struct fdt_edit *fdt_edit_begin(const void *fdt)
+{
+	struct fdt_edit *e;
+
+	if (fdt_check_header(fdt) || (fdt_version(fdt) < 17))
+		return NULL;
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+	e->fdt = fdt;
+	e->handles = FDT_TAGALIGN(fdt_size_dt_struct(fdt));
+	return e;
+}
+
+void fdt_edit_free(struct fdt_edit *edit)
+{
+	if (!edit)
+		return;
+	free(edit->nodes);
+	free(edit->props);
+	free(edit->buckets);
+	free(edit->pool);
+	free(edit->strings);
+	free(edit);
+}
+
+const void *fdt_edit_getprop(struct fdt_edit *edit, int nodeoffset,
+			     const char *name, int *lenp)
+{
+	int node, prop, deleted;
+
+	node = _fdt_edit_node(edit, nodeoffset, 0);
+	if (node >= 0) {
+		prop = _fdt_edit_prop(edit, node, name, &deleted);
+		if (prop >= 0) {
+			if (lenp)
+				*lenp = edit->props[prop].len;
+			return edit->pool + edit->props[prop].data;
+		}
+		if (deleted || (nodeoffset >= edit->handles)) {
+			if (lenp)
+				*lenp = -FDT_ERR_NOTFOUND;
+			return NULL;
+		}
+	} else if (node != -FDT_ERR_NOTFOUND) {
+		if (lenp)
+			*lenp = node;
+		return NULL;
+	}
+	return fdt_getprop(edit->fdt, nodeoffset, name, lenp);
+}
+
+int fdt_edit_setprop(struct fdt_edit *edit, int nodeoffset, const char *name,
+		     const void *val, int len)
+{
+	const struct fdt_property *old;
+	int node, prop, deleted, data, nameoff;
+
+	node = _fdt_edit_node(edit, nodeoffset, 1);
+	if (node < 0)
+		return node;
+	data = _fdt_edit_store(&edit->pool, &edit->pool_len, &edit->pool_max,
+			       val, len);
+	if (data < 0)
+		return data;
+
+	prop = _fdt_edit_prop(edit, node, name, &deleted);
+	if (prop >= 0) {
+		edit->props[prop].data = data;
+		edit->props[prop].len = len;
+		return 0;
+	}
+	if (!deleted && (nodeoffset < edit->handles)) {
+		old = fdt_get_property(edit->fdt, nodeoffset, name, NULL);
+		if (old)
+			return _fdt_edit_add_prop(edit, node, FDT_EDIT_REPLACE,
+						  fdt32_to_cpu(old->nameoff),
+						  data, len);
+	}
+	nameoff = _fdt_edit_add_string(edit, name);
+	if (nameoff < 0)
+		return nameoff;
+	return _fdt_edit_add_prop(edit, node, FDT_EDIT_NEW, nameoff, data, len);
+}
+
+int fdt_edit_delprop(struct fdt_edit *edit, int nodeoffset, const char *name)
+{
+	const struct fdt_property *old;
+	int node, prop, deleted, *link;
+
+	node = _fdt_edit_node(edit, nodeoffset, 1);
+	if (node < 0)
+		return node;
+
+	prop = _fdt_edit_prop(edit, node, name, &deleted);
+	if (prop >= 0) {
+		if (edit->props[prop].kind == FDT_EDIT_REPLACE) {
+			edit->props[prop].kind = FDT_EDIT_DELETE;
+			return 0;
+		}
+		for (link = &edit->nodes[node].props; *link != prop;
+		     link = &edit->props[*link].next)
+			;
+		*link = edit->props[prop].next;
+		return 0;
+	}
+	if (deleted || (nodeoffset >= edit->handles))
+		return -FDT_ERR_NOTFOUND;
+	old = fdt_get_property(edit->fdt, nodeoffset, name, &deleted);
+	if (!old)
+		return deleted;
+	return _fdt_edit_add_prop(edit, node, FDT_EDIT_DELETE,
+				  fdt32_to_cpu(old->nameoff), -1, 0);
+}
+
+int fdt_edit_subnode_offset_namelen(struct fdt_edit *edit, int parentoffset,
+				    const char *name, int namelen)
+{
+	int node, child, i;
+
+	node = _fdt_edit_node(edit, parentoffset, 0);
+	if ((node < 0) && (node != -FDT_ERR_NOTFOUND))
+		return node;
+
+	/* added subnodes come first */
+	if (node >= 0)
+		for (i = edit->nodes[node].children; i >= 0; i = edit->nodes[i].next)
+			if (_fdt_name_eq(edit->pool + edit->nodes[i].name, name, namelen))
+				return edit->nodes[i].offset;
+	if (parentoffset >= edit->handles)
+		return -FDT_ERR_NOTFOUND;
+
+	child = fdt_subnode_offset_namelen(edit->fdt, parentoffset, name, namelen);
+	if ((child < 0) || (_fdt_edit_node(edit, child, 0) != -FDT_ERR_BADOFFSET))
+		return child;
+
+	/* the first match is deleted, look for another one */
+	for (child = fdt_first_subnode(edit->fdt, parentoffset); child >= 0;
+	     child = fdt_next_subnode(edit->fdt, child)) {
+		if (_fdt_edit_node(edit, child, 0) == -FDT_ERR_BADOFFSET)
+			continue;
+		if (_fdt_name_eq(fdt_get_name(edit->fdt, child, NULL), name, namelen))
+			return child;
+	}
+	return -FDT_ERR_NOTFOUND;
+}
+
+int fdt_edit_subnode_offset(struct fdt_edit *edit, int parentoffset,
+			    const char *name)
+{
+	return fdt_edit_subnode_offset_namelen(edit, parentoffset, name,
+					       strlen(name));
+}
+
+int fdt_edit_add_subnode_namelen(struct fdt_edit *edit, int parentoffset,
+				 const char *name, int namelen)
+{
+	struct fdt_edit_node *n;
+	int parent, node, offset;
+
+	offset = fdt_edit_subnode_offset_namelen(edit, parentoffset, name, namelen);
+	if (offset >= 0)
+		return -FDT_ERR_EXISTS;
+	else if (offset != -FDT_ERR_NOTFOUND)
+		return offset;
+
+	parent = _fdt_edit_node(edit, parentoffset, 1);
+	if (parent < 0)
+		return parent;
+	node = _fdt_edit_new_node(edit, -1);
+	if (node < 0)
+		return node;
+	n = &edit->nodes[node];
+	n->name = _fdt_edit_store(&edit->pool, &edit->pool_len, &edit->pool_max,
+				  name, namelen + 1);
+	if (n->name < 0)
+		return n->name;
+	edit->pool[n->name + namelen] = '\0';
+	n->parent = parent;
+	n->next = edit->nodes[parent].children;
+	edit->nodes[parent].children = node;
+	return n->offset;
+}
+
+int fdt_edit_add_subnode(struct fdt_edit *edit, int parentoffset,
+			 const char *name)
+{
+	return fdt_edit_add_subnode_namelen(edit, parentoffset, name,
+					    strlen(name));
+}
+
+int fdt_edit_del_node(struct fdt_edit *edit, int nodeoffset)
+{
+	int node, *link;
+
+	node = _fdt_edit_node(edit, nodeoffset, 1);
+	if (node < 0)
+		return node;
+	edit->nodes[node].deleted = 1;
+	if (edit->nodes[node].parent < 0)
+		return 0;
+	for (link = &edit->nodes[edit->nodes[node].parent].children;
+	     *link != node; link = &edit->nodes[*link].next)
+		;
+	*link = edit->nodes[node].next;
+	return 0;
+}
+
+static void _fdt_edit_put(struct fdt_edit_writer *w, const void *data, int len)
+{
+	if (w->buf && len)
+		memcpy(w->buf + w->len, data, len);
+	w->len += len;
+}
+
+static void _fdt_edit_put32(struct fdt_edit_writer *w, uint32_t val)
+{
+	fdt32_t v = cpu_to_fdt32(val);
+
+	_fdt_edit_put(w, &v, sizeof(v));
+}
+
+static void _fdt_edit_pad(struct fdt_edit_writer *w)
+{
+	static const char zero[FDT_TAGSIZE];
+
+	_fdt_edit_put(w, zero, FDT_TAGALIGN(w->len) - w->len);
+}
+
+static void _fdt_edit_put_prop(struct fdt_edit *e, struct fdt_edit_writer *w,
+			       struct fdt_edit_prop *p)
+{
+	_fdt_edit_put32(w, FDT_PROP);
+	_fdt_edit_put32(w, p->len);
+	_fdt_edit_put32(w, p->nameoff);
+	_fdt_edit_put(w, e->pool + p->data, p->len);
+	_fdt_edit_pad(w);
+}
+
+static void _fdt_edit_put_new_props(struct fdt_edit *e,
+				    struct fdt_edit_writer *w, int node)
+{
+	int i;
+
+	for (i = e->nodes[node].props; i >= 0; i = e->props[i].next)
+		if (e->props[i].kind == FDT_EDIT_NEW)
+			_fdt_edit_put_prop(e, w, &e->props[i]);
+}
+
+static void _fdt_edit_put_children(struct fdt_edit *e,
+				   struct fdt_edit_writer *w, int node)
+{
+	const char *name;
+	int i;
+
+	for (i = e->nodes[node].children; i >= 0; i = e->nodes[i].next) {
+		name = e->pool + e->nodes[i].name;
+		_fdt_edit_put32(w, FDT_BEGIN_NODE);
+		_fdt_edit_put(w, name, strlen(name) + 1);
+		_fdt_edit_pad(w);
+		_fdt_edit_put_new_props(e, w, i);
+		_fdt_edit_put_children(e, w, i);
+		_fdt_edit_put32(w, FDT_END_NODE);
+	}
+}
+
+/* the structure block with all changes, one pass over the old one */
+static int _fdt_edit_put_struct(struct fdt_edit *e, struct fdt_edit_writer *w)
+{
+	const struct fdt_property *prop;
+	int nodes[FDT_EDIT_DEPTH];
+	int placed[FDT_EDIT_DEPTH];
+	int offset = 0, next, depth = -1;
+	int node, i;
+	uint32_t tag;
+
+	do {
+		tag = fdt_next_tag(e->fdt, offset, &next);
+		if (next < 0)
+			return next;
+
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			if ((depth >= 0) && !placed[depth]) {
+				if (nodes[depth] >= 0)
+					_fdt_edit_put_children(e, w, nodes[depth]);
+				placed[depth] = 1;
+			}
+			node = _fdt_edit_find(e, offset);
+			if ((node >= 0) && e->nodes[node].deleted) {
+				next = _fdt_node_end_offset((void *)(uintptr_t)e->fdt, offset);
+				if (next < 0)
+					return next;
+				break;
+			}
+			if (++depth >= FDT_EDIT_DEPTH)
+				return -FDT_ERR_BADSTRUCTURE;
+			nodes[depth] = node;
+			placed[depth] = 0;
+			_fdt_edit_put(w, _fdt_offset_ptr(e->fdt, offset), next - offset);
+			if (node >= 0)
+				_fdt_edit_put_new_props(e, w, node);
+			break;
+
+		case FDT_PROP:
+			prop = _fdt_offset_ptr(e->fdt, offset);
+			i = -1;
+			if (nodes[depth] >= 0)
+				for (i = e->nodes[nodes[depth]].props; i >= 0; i = e->props[i].next)
+					if ((e->props[i].kind != FDT_EDIT_NEW)
+					    && !strcmp(_fdt_edit_string(e, e->props[i].nameoff),
+						       fdt_string(e->fdt, fdt32_to_cpu(prop->nameoff))))
+						break;
+			if (i < 0)
+				_fdt_edit_put(w, prop, next - offset);
+			else if (e->props[i].kind == FDT_EDIT_REPLACE)
+				_fdt_edit_put_prop(e, w, &e->props[i]);
+			break;
+
+		case FDT_END_NODE:
+			if (depth < 0)
+				return -FDT_ERR_BADSTRUCTURE;
+			if (!placed[depth] && (nodes[depth] >= 0))
+				_fdt_edit_put_children(e, w, nodes[depth]);
+			_fdt_edit_put(w, _fdt_offset_ptr(e->fdt, offset), next - offset);
+			depth--;
+			break;
+
+		default:
+			_fdt_edit_put(w, _fdt_offset_ptr(e->fdt, offset), next - offset);
+			break;
+		}
+		offset = next;
+	} while (tag != FDT_END);
+
+	return 0;
+}
+
+int fdt_edit_size(struct fdt_edit *edit)
+{
+	struct fdt_edit_writer w = { NULL, 0 };
+	int err;
+
+	err = _fdt_edit_put_struct(edit, &w);
+	if (err)
+		return err;
+	return FDT_ALIGN(sizeof(struct fdt_header), 8)
+		+ (fdt_num_mem_rsv(edit->fdt) + 1) * sizeof(struct fdt_reserve_entry)
+		+ w.len + fdt_size_dt_strings(edit->fdt) + edit->strings_len;
+}
+
+int fdt_edit_finish(struct fdt_edit *edit, void *buf, int bufsize)
+{
+	const void *fdt = edit->fdt;
+	struct fdt_edit_writer w;
+	int size, mem_rsv_off, mem_rsv_size, struct_off, strings_off, err;
+
+	size = fdt_edit_size(edit);
+	if (size < 0)
+		return size;
+	if (bufsize < size)
+		return -FDT_ERR_NOSPACE;
+
+	mem_rsv_off = FDT_ALIGN(sizeof(struct fdt_header), 8);
+	mem_rsv_size = (fdt_num_mem_rsv(fdt) + 1) * sizeof(struct fdt_reserve_entry);
+	struct_off = mem_rsv_off + mem_rsv_size;
+
+	w.buf = (char *)buf + struct_off;
+	w.len = 0;
+	err = _fdt_edit_put_struct(edit, &w);
+	if (err)
+		return err;
+	strings_off = struct_off + w.len;
+
+	memset(buf, 0, mem_rsv_off);
+	fdt_set_magic(buf, FDT_MAGIC);
+	fdt_set_totalsize(buf, size);
+	fdt_set_off_dt_struct(buf, struct_off);
+	fdt_set_off_dt_strings(buf, strings_off);
+	fdt_set_off_mem_rsvmap(buf, mem_rsv_off);
+	fdt_set_version(buf, 17);
+	fdt_set_last_comp_version(buf, fdt_last_comp_version(fdt));
+	fdt_set_boot_cpuid_phys(buf, fdt_boot_cpuid_phys(fdt));
+	fdt_set_size_dt_strings(buf, fdt_size_dt_strings(fdt) + edit->strings_len);
+	fdt_set_size_dt_struct(buf, w.len);
+
+	memcpy((char *)buf + mem_rsv_off, _fdt_mem_rsv(fdt, 0), mem_rsv_size);
+	memcpy((char *)buf + strings_off, fdt_string(fdt, 0), fdt_size_dt_strings(fdt));
+	memcpy((char *)buf + strings_off + fdt_size_dt_strings(fdt), edit->strings,
+	       edit->strings_len);
+
+	fdt_bytes_moved += size;
+	return 0;
+}
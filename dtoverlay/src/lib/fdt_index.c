@@ -0,0 +1,515 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Node offset index
+ *
+ * libfdt is dual licensed: you can use it either under the terms of
+ * the GPL, or the BSD license, at your option.
+ *
+ *  a) This library is free software; you can redistribute it and/or
+ *     modify it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of the
+ *     License, or (at your option) any later version.
+ *
+ *     This library is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with this library; if not, write to the Free
+ *     Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *     MA 02110-1301 USA
+ *
+ * Alternatively,
+ *
+ *  b) Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *     1. Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *     2. Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "libfdt_env.h"
+
+#include <stdlib.h>
+
+#include <fdt.h>
+#include <libfdt.h>
+
+#include "libfdt_internal.h"
+
+/*
+ * The index keeps one slot per node.  Slots never move, so the name
+ * and phandle hash chains stay valid while nodes are added; the order
+ * array holds the slots sorted by structure offset, which is what
+ * splices have to shift.
+ */
+
+#define FDT_INDEX_MAX		8
+#define FDT_INDEX_DEPTH		64
+
+struct fdt_index_node {
+	int offset;
+	int parent;		/* slot of the parent, -1 for the root */
+	uint32_t phandle;
+	uint32_t hash;		/* parent slot and name without unit address */
+	int next_name;
+	int next_phandle;
+};
+
+struct fdt_index {
+	const void *fdt;
+	int built;
+	uint32_t size_dt_struct;	/* notices changes made behind our back */
+	struct fdt_index_node *nodes;
+	int nodes_len;
+	int nodes_max;
+	int *order;
+	int order_len;
+	int *name_buckets;
+	int *phandle_buckets;
+	int buckets;		/* power of 2, at least twice the nodes */
+};
+
+struct fdt_index_stats fdt_index_stats;
+
+static struct fdt_index _fdt_indexes[FDT_INDEX_MAX];
+static int _fdt_indexes_used;
+
+static uint32_t _fdt_index_hash(int parent, const char *name, int namelen)
+{
+	uint32_t hash = 2166136261u ^ (uint32_t)parent;
+	int i;
+
+	hash *= 16777619u;
+	for (i = 0; (i < namelen) && name[i] && (name[i] != '@'); i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static const char *_fdt_index_name(const void *fdt, int offset)
+{
+	return ((const struct fdt_node_header *)_fdt_offset_ptr(fdt, offset))->name;
+}
+
+static struct fdt_index *_fdt_index_get(const void *fdt)
+{
+	int i;
+
+	if (!_fdt_indexes_used)
+		return NULL;
+	for (i = 0; i < FDT_INDEX_MAX; i++)
+		if (_fdt_indexes[i].fdt == fdt)
+			return &_fdt_indexes[i];
+	return NULL;
+}
+
+static void _fdt_index_link(struct fdt_index *idx, int slot)
+{
+	struct fdt_index_node *n = &idx->nodes[slot];
+	int b;
+
+	b = n->hash & (idx->buckets - 1);
+	n->next_name = idx->name_buckets[b];
+	idx->name_buckets[b] = slot;
+
+	n->next_phandle = -1;
+	if (n->phandle) {
+		b = n->phandle & (idx->buckets - 1);
+		n->next_phandle = idx->phandle_buckets[b];
+		idx->phandle_buckets[b] = slot;
+	}
+}
+
+static void _fdt_index_unlink(struct fdt_index *idx, int slot)
+{
+	struct fdt_index_node *n = &idx->nodes[slot];
+	int *p;
+
+	for (p = &idx->name_buckets[n->hash & (idx->buckets - 1)];
+	     *p >= 0; p = &idx->nodes[*p].next_name)
+		if (*p == slot) {
+			*p = n->next_name;
+			break;
+		}
+	if (!n->phandle)
+		return;
+	for (p = &idx->phandle_buckets[n->phandle & (idx->buckets - 1)];
+	     *p >= 0; p = &idx->nodes[*p].next_phandle)
+		if (*p == slot) {
+			*p = n->next_phandle;
+			break;
+		}
+}
+
+/* size the hash tables for nodes_max and link all live slots */
+static int _fdt_index_rehash(struct fdt_index *idx)
+{
+	int buckets = 64;
+	int *p;
+	int i;
+
+	while (buckets < 2 * idx->nodes_max)
+		buckets *= 2;
+	if (buckets != idx->buckets) {
+		p = realloc(idx->name_buckets, 2 * buckets * sizeof(int));
+		if (!p)
+			return -FDT_ERR_NOSPACE;
+		idx->name_buckets = p;
+		idx->phandle_buckets = p + buckets;
+		idx->buckets = buckets;
+	}
+	memset(idx->name_buckets, 0xff, 2 * buckets * sizeof(int));
+	for (i = 0; i < idx->order_len; i++)
+		_fdt_index_link(idx, idx->order[i]);
+	return 0;
+}
+
+static int _fdt_index_grow(struct fdt_index *idx, int count)
+{
+	struct fdt_index_node *nodes;
+	int *order;
+	int max = idx->nodes_max ? idx->nodes_max : 256;
+
+	if (count <= idx->nodes_max)
+		return 0;
+	while (max < count)
+		max *= 2;
+	nodes = realloc(idx->nodes, max * sizeof(*nodes));
+	if (!nodes)
+		return -FDT_ERR_NOSPACE;
+	idx->nodes = nodes;
+	order = realloc(idx->order, max * sizeof(*order));
+	if (!order)
+		return -FDT_ERR_NOSPACE;
+	idx->order = order;
+	idx->nodes_max = max;
+	return 1;
+}
+
+static int _fdt_index_build(struct fdt_index *idx, const void *fdt)
+{
+	struct fdt_index_node *n;
+	int stack[FDT_INDEX_DEPTH];
+	int offset, depth, err;
+
+	fdt_index_stats.builds++;
+	fdt_index_stats.walks++;
+	idx->built = 0;
+	idx->nodes_len = 0;
+	idx->order_len = 0;
+
+	for (offset = 0, depth = 0;
+	     (offset >= 0) && (depth >= 0);
+	     offset = fdt_next_node(fdt, offset, &depth)) {
+		if (depth >= FDT_INDEX_DEPTH)
+			return -FDT_ERR_BADSTRUCTURE;
+		err = _fdt_index_grow(idx, idx->nodes_len + 1);
+		if (err < 0)
+			return err;
+		n = &idx->nodes[idx->nodes_len];
+		n->offset = offset;
+		n->parent = depth ? stack[depth - 1] : -1;
+		n->hash = _fdt_index_hash(n->parent, _fdt_index_name(fdt, offset), INT32_MAX);
+		n->phandle = fdt_get_phandle(fdt, offset);
+		stack[depth] = idx->nodes_len;
+		idx->order[idx->order_len++] = idx->nodes_len++;
+	}
+	if ((offset != -FDT_ERR_NOTFOUND) && (offset < 0))
+		return offset;
+
+	err = _fdt_index_rehash(idx);
+	if (err)
+		return err;
+	idx->size_dt_struct = fdt_size_dt_struct(fdt);
+	idx->built = 1;
+	return 0;
+}
+
+/* the index of fdt, built if needed, or NULL to walk the tree */
+static struct fdt_index *_fdt_index_find(const void *fdt)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+
+	if (!idx)
+		return NULL;
+	if (idx->built && (idx->size_dt_struct != fdt_size_dt_struct(fdt)))
+		idx->built = 0;
+	if (!idx->built && _fdt_index_build(idx, fdt)) {
+		/* not worth retrying on every lookup */
+		fdt_index_disable(fdt);
+		return NULL;
+	}
+	fdt_index_stats.lookups++;
+	return idx;
+}
+
+/* position in the order array of the first node at or after offset */
+static int _fdt_index_lower(struct fdt_index *idx, int offset)
+{
+	int lo = 0, hi = idx->order_len, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->nodes[idx->order[mid]].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int _fdt_index_slot(struct fdt_index *idx, int offset)
+{
+	int pos = _fdt_index_lower(idx, offset);
+
+	if ((pos < idx->order_len) && (idx->nodes[idx->order[pos]].offset == offset))
+		return idx->order[pos];
+	return -1;
+}
+
+int fdt_index_enable(const void *fdt)
+{
+	int i;
+
+	FDT_CHECK_HEADER(fdt);
+
+	if (_fdt_index_get(fdt))
+		return 0;
+	for (i = 0; i < FDT_INDEX_MAX; i++)
+		if (!_fdt_indexes[i].fdt) {
+			memset(&_fdt_indexes[i], 0, sizeof(_fdt_indexes[i]));
+			_fdt_indexes[i].fdt = fdt;
+			_fdt_indexes_used++;
+			return 0;
+		}
+	return -FDT_ERR_NOSPACE;
+}
+
+int fdt_index_disable(const void *fdt)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+
+	if (!idx)
+		return 0;
+	free(idx->nodes);
+	free(idx->order);
+	free(idx->name_buckets);
+	memset(idx, 0, sizeof(*idx));
+	_fdt_indexes_used--;
+	return 1;
+}
+
+int _fdt_index_subnode(const void *fdt, int parentoffset,
+		       const char *name, int namelen, int *offset)
+{
+	struct fdt_index *idx = _fdt_index_find(fdt);
+	struct fdt_index_node *n;
+	int parent, slot;
+
+	if (!idx || ((parent = _fdt_index_slot(idx, parentoffset)) < 0))
+		return 0;
+
+	/* the first matching subnode in tree order, like the walk */
+	*offset = -FDT_ERR_NOTFOUND;
+	for (slot = idx->name_buckets[_fdt_index_hash(parent, name, namelen) & (idx->buckets - 1)];
+	     slot >= 0; slot = n->next_name) {
+		n = &idx->nodes[slot];
+		if ((n->parent == parent)
+		    && ((*offset < 0) || (n->offset < *offset))
+		    && _fdt_name_eq(_fdt_index_name(fdt, n->offset), name, namelen))
+			*offset = n->offset;
+	}
+	return 1;
+}
+
+int _fdt_index_phandle(const void *fdt, uint32_t phandle, int *offset)
+{
+	struct fdt_index *idx = _fdt_index_find(fdt);
+	struct fdt_index_node *n;
+	int slot;
+
+	if (!idx)
+		return 0;
+
+	*offset = -FDT_ERR_NOTFOUND;
+	for (slot = idx->phandle_buckets[phandle & (idx->buckets - 1)];
+	     slot >= 0; slot = n->next_phandle) {
+		n = &idx->nodes[slot];
+		if ((n->phandle == phandle) && ((*offset < 0) || (n->offset < *offset)))
+			*offset = n->offset;
+	}
+	return 1;
+}
+
+int _fdt_index_supernode(const void *fdt, int nodeoffset, int supernodedepth,
+			 int *nodedepth, int *offset)
+{
+	struct fdt_index *idx = _fdt_index_find(fdt);
+	int slot, up, depth = 0;
+
+	if (!idx || ((slot = _fdt_index_slot(idx, nodeoffset)) < 0))
+		return 0;
+
+	for (up = idx->nodes[slot].parent; up >= 0; up = idx->nodes[up].parent)
+		depth++;
+	if (nodedepth)
+		*nodedepth = depth;
+	if (supernodedepth > depth) {
+		*offset = -FDT_ERR_NOTFOUND;
+		return 1;
+	}
+	for (; depth > supernodedepth; depth--)
+		slot = idx->nodes[slot].parent;
+	*offset = idx->nodes[slot].offset;
+	return 1;
+}
+
+int _fdt_index_path(const void *fdt, int nodeoffset, char *buf, int buflen,
+		    int *err)
+{
+	struct fdt_index *idx = _fdt_index_find(fdt);
+	const char *name;
+	int chain[FDT_INDEX_DEPTH];
+	int slot, depth = 0, p = 0, len;
+
+	if (!idx || ((slot = _fdt_index_slot(idx, nodeoffset)) < 0))
+		return 0;
+
+	for (; idx->nodes[slot].parent >= 0; slot = idx->nodes[slot].parent)
+		chain[depth++] = slot;
+
+	*err = -FDT_ERR_NOSPACE;
+	if (!depth)
+		buf[p++] = '/';
+	while (depth--) {
+		name = _fdt_index_name(fdt, idx->nodes[chain[depth]].offset);
+		len = strlen(name);
+		if (p + len + 2 > buflen)
+			return 1;
+		buf[p++] = '/';
+		memcpy(buf + p, name, len);
+		p += len;
+	}
+	buf[p] = '\0';
+	*err = 0;
+	return 1;
+}
+
+void _fdt_index_splice(const void *fdt, int offset, int oldlen, int newlen)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+	int first, last, i;
+
+	if (!idx || !idx->built)
+		return;
+
+	/* nodes starting in the replaced range are gone, later ones move */
+	first = _fdt_index_lower(idx, offset);
+	last = oldlen ? _fdt_index_lower(idx, offset + oldlen) : first;
+	for (i = first; i < last; i++)
+		_fdt_index_unlink(idx, idx->order[i]);
+	memmove(idx->order + first, idx->order + last,
+		(idx->order_len - last) * sizeof(int));
+	idx->order_len -= last - first;
+	if (newlen != oldlen)
+		for (i = first; i < idx->order_len; i++)
+			idx->nodes[idx->order[i]].offset += newlen - oldlen;
+	idx->size_dt_struct = fdt_size_dt_struct(fdt);
+	fdt_index_stats.patches++;
+}
+
+void _fdt_index_add_node(const void *fdt, int parentoffset, int nodeoffset)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+	struct fdt_index_node *n;
+	int parent, pos, err, up, depth = 0;
+
+	if (!idx || !idx->built)
+		return;
+	parent = _fdt_index_slot(idx, parentoffset);
+	/* no deeper than a build would accept, _fdt_index_path() relies on it */
+	for (up = parent; up >= 0; up = idx->nodes[up].parent)
+		depth++;
+	if (depth >= FDT_INDEX_DEPTH)
+		err = -FDT_ERR_BADSTRUCTURE;
+	else
+		err = parent < 0 ? -FDT_ERR_BADOFFSET : _fdt_index_grow(idx, idx->nodes_len + 1);
+	if ((err > 0) && _fdt_index_rehash(idx))
+		err = -FDT_ERR_NOSPACE;
+	if (err < 0) {
+		idx->built = 0;
+		return;
+	}
+
+	n = &idx->nodes[idx->nodes_len];
+	n->offset = nodeoffset;
+	n->parent = parent;
+	n->hash = _fdt_index_hash(parent, _fdt_index_name(fdt, nodeoffset), INT32_MAX);
+	n->phandle = 0;
+	pos = _fdt_index_lower(idx, nodeoffset);
+	memmove(idx->order + pos + 1, idx->order + pos,
+		(idx->order_len - pos) * sizeof(int));
+	idx->order[pos] = idx->nodes_len;
+	idx->order_len++;
+	_fdt_index_link(idx, idx->nodes_len++);
+}
+
+void _fdt_index_update_node(const void *fdt, int nodeoffset)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+	struct fdt_index_node *n;
+	int slot;
+
+	if (!idx || !idx->built)
+		return;
+	slot = _fdt_index_slot(idx, nodeoffset);
+	if (slot < 0) {
+		idx->built = 0;
+		return;
+	}
+	n = &idx->nodes[slot];
+	_fdt_index_unlink(idx, slot);
+	n->hash = _fdt_index_hash(n->parent, _fdt_index_name(fdt, nodeoffset), INT32_MAX);
+	n->phandle = fdt_get_phandle(fdt, nodeoffset);
+	_fdt_index_link(idx, slot);
+}
+
+void _fdt_index_prop(const void *fdt, int nodeoffset, const char *name)
+{
+	if (_fdt_indexes_used
+	    && (!strcmp(name, "phandle") || !strcmp(name, "linux,phandle")))
+		_fdt_index_update_node(fdt, nodeoffset);
+}
+
+void _fdt_index_move(const void *fdt, const void *buf)
+{
+	struct fdt_index *idx = _fdt_index_get(fdt);
+
+	if (!idx || (fdt == buf))
+		return;
+	/* structure offsets do not change when the blob moves */
+	fdt_index_disable(buf);
+	idx->fdt = buf;
+}
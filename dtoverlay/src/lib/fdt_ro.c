@@ -55,15 +55,8 @@
 
 #include "libfdt_internal.h"
 
-static int _fdt_nodename_eq(const void *fdt, int offset,
-			    const char *s, int len)
+int _fdt_name_eq(const char *p, const char *s, int len)
 {
-	const char *p = fdt_offset_ptr(fdt, offset + FDT_TAGSIZE, len+1);
-
-	if (! p)
-		/* short match */
-		return 0;
-
 	if (memcmp(p, s, len) != 0)
 		return 0;
 
@@ -75,6 +68,18 @@ static int _fdt_nodename_eq(const void *fdt, int offset,
 		return 0;
 }
 
+static int _fdt_nodename_eq(const void *fdt, int offset,
+			    const char *s, int len)
+{
+	const char *p = fdt_offset_ptr(fdt, offset + FDT_TAGSIZE, len+1);
+
+	if (! p)
+		/* short match */
+		return 0;
+
+	return _fdt_name_eq(p, s, len);
+}
+
 const char *fdt_string(const void *fdt, int stroffset)
 {
 	return (const char *)fdt + fdt_off_dt_strings(fdt) + stroffset;
@@ -136,6 +141,10 @@ int fdt_subnode_offset_namelen(const void *fdt, int offset,
 
 	FDT_CHECK_HEADER(fdt);
 
+	if (_fdt_index_subnode(fdt, offset, name, namelen, &depth))
+		return depth;
+
+	fdt_index_stats.walks++;
 	for (depth = 0;
 	     (offset >= 0) && (depth >= 0);
 	     offset = fdt_next_node(fdt, offset, &depth))
@@ -371,6 +380,10 @@ int fdt_get_path(const void *fdt, int nodeoffset, char *buf, int buflen)
 	if (buflen < 2)
 		return -FDT_ERR_NOSPACE;
 
+	if (_fdt_index_path(fdt, nodeoffset, buf, buflen, &offset))
+		return offset;
+
+	fdt_index_stats.walks++;
 	for (offset = 0, depth = 0;
 	     (offset >= 0) && (offset <= nodeoffset);
 	     offset = fdt_next_node(fdt, offset, &depth)) {
@@ -423,6 +436,11 @@ int fdt_supernode_atdepth_offset(const void *fdt, int nodeoffset,
 	if (supernodedepth < 0)
 		return -FDT_ERR_NOTFOUND;
 
+	if (_fdt_index_supernode(fdt, nodeoffset, supernodedepth, nodedepth,
+				 &offset))
+		return offset;
+
+	fdt_index_stats.walks++;
 	for (offset = 0, depth = 0;
 	     (offset >= 0) && (offset <= nodeoffset);
 	     offset = fdt_next_node(fdt, offset, &depth)) {
@@ -505,12 +523,16 @@ int fdt_node_offset_by_phandle(const void *fdt, uint32_t phandle)
 
 	FDT_CHECK_HEADER(fdt);
 
+	if (_fdt_index_phandle(fdt, phandle, &offset))
+		return offset;
+
 	/* FIXME: The algorithm here is pretty horrible: we
 	 * potentially scan each property of a node in
 	 * fdt_get_phandle(), then if that didn't find what
 	 * we want, we scan over them again making our way to the next
 	 * node.  Still it's the easiest to implement approach;
 	 * performance can come later. */
+	fdt_index_stats.walks++;
 	for (offset = fdt_next_node(fdt, -1, NULL);
 	     offset >= 0;
 	     offset = fdt_next_node(fdt, offset, NULL)) {
@@ -106,6 +106,7 @@ static int _fdt_splice(void *fdt, void *splicepoint, int oldlen, int newlen)
 	if ((end - oldlen + newlen) > ((char *)fdt + fdt_totalsize(fdt)))
 		return -FDT_ERR_NOSPACE;
 	memmove(p + newlen, p + oldlen, end - p - oldlen);
+	fdt_bytes_moved += end - p - oldlen;
 	return 0;
 }
 
@@ -133,6 +134,8 @@ static int _fdt_splice_struct(void *fdt, void *p,
 
 	fdt_set_size_dt_struct(fdt, fdt_size_dt_struct(fdt) + delta);
 	fdt_set_off_dt_strings(fdt, fdt_off_dt_strings(fdt) + delta);
+	_fdt_index_splice(fdt, (char *)p - (char *)_fdt_offset_ptr(fdt, 0),
+			  oldlen, newlen);
 	return 0;
 }
 
@@ -270,6 +273,7 @@ int fdt_set_name(void *fdt, int nodeoffset, const char *name)
 		return err;
 
 	memcpy(namep, name, newlen+1);
+	_fdt_index_update_node(fdt, nodeoffset);
 	return 0;
 }
 
@@ -288,6 +292,7 @@ int fdt_setprop(void *fdt, int nodeoffset, const char *name,
 		return err;
 
 	memcpy(prop->data, val, len);
+	_fdt_index_prop(fdt, nodeoffset, name);
 	return 0;
 }
 
@@ -315,6 +320,7 @@ int fdt_appendprop(void *fdt, int nodeoffset, const char *name,
 			return err;
 		memcpy(prop->data, val, len);
 	}
+	_fdt_index_prop(fdt, nodeoffset, name);
 	return 0;
 }
 
@@ -322,6 +328,7 @@ int fdt_delprop(void *fdt, int nodeoffset, const char *name)
 {
 	struct fdt_property *prop;
 	int len, proplen;
+	int err;
 
 	FDT_RW_CHECK_HEADER(fdt);
 
@@ -330,7 +337,12 @@ int fdt_delprop(void *fdt, int nodeoffset, const char *name)
 		return len;
 
 	proplen = sizeof(*prop) + FDT_TAGALIGN(len);
-	return _fdt_splice_struct(fdt, prop, proplen, 0);
+	err = _fdt_splice_struct(fdt, prop, proplen, 0);
+	if (err)
+		return err;
+
+	_fdt_index_prop(fdt, nodeoffset, name);
+	return 0;
 }
 
 int fdt_add_subnode_namelen(void *fdt, int parentoffset,
@@ -371,6 +383,7 @@ int fdt_add_subnode_namelen(void *fdt, int parentoffset,
 	endtag = (fdt32_t *)((char *)nh + nodelen - FDT_TAGSIZE);
 	*endtag = cpu_to_fdt32(FDT_END_NODE);
 
+	_fdt_index_add_node(fdt, parentoffset, offset);
 	return offset;
 }
 
@@ -447,6 +460,7 @@ int fdt_open_into(const void *fdt, void *buf, int bufsize)
 		fdt_set_version(buf, 17);
 		fdt_set_size_dt_struct(buf, struct_size);
 		fdt_set_totalsize(buf, bufsize);
+		_fdt_index_move(fdt, buf);
 		return 0;
 	}
 
@@ -475,6 +489,7 @@ int fdt_open_into(const void *fdt, void *buf, int bufsize)
 	fdt_set_version(buf, 17);
 	fdt_set_last_comp_version(buf, 16);
 	fdt_set_boot_cpuid_phys(buf, fdt_boot_cpuid_phys(fdt));
+	_fdt_index_move(fdt, buf);
 
 	return 0;
 }
@@ -114,7 +114,7 @@ int fdt_resize(void *fdt, void *buf, int bufsize)
 
 	FDT_SW_CHECK_HEADER(fdt);
 
-	headsize = fdt_off_dt_struct(fdt);
+	headsize = fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt);
 	tailsize = fdt_size_dt_strings(fdt);
 
 	if ((headsize + tailsize) > bufsize)
@@ -197,19 +197,13 @@ int fdt_end_node(void *fdt)
 	return 0;
 }
 
-static int _fdt_find_add_string(void *fdt, const char *s)
+static int _fdt_add_string(void *fdt, const char *s)
 {
 	char *strtab = (char *)fdt + fdt_totalsize(fdt);
-	const char *p;
 	int strtabsize = fdt_size_dt_strings(fdt);
 	int len = strlen(s) + 1;
 	int struct_top, offset;
 
-	p = _fdt_find_string(strtab - strtabsize, strtabsize, s);
-	if (p)
-		return p - strtab;
-
-	/* Add it */
 	offset = -strtabsize - len;
 	struct_top = fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt);
 	if (fdt_totalsize(fdt) + offset < struct_top)
@@ -220,16 +214,34 @@ static int _fdt_find_add_string(void *fdt, const char *s)
 	return offset;
 }
 
-int fdt_property(void *fdt, const char *name, const void *val, int len)
+static int _fdt_find_add_string(void *fdt, const char *s)
 {
-	struct fdt_property *prop;
-	int nameoff;
+	char *strtab = (char *)fdt + fdt_totalsize(fdt);
+	const char *p;
+	int strtabsize = fdt_size_dt_strings(fdt);
+
+	p = _fdt_find_string(strtab - strtabsize, strtabsize, s);
+	if (p)
+		return p - strtab;
+
+	return _fdt_add_string(fdt, s);
+}
+
+int fdt_add_string(void *fdt, const char *s)
+{
+	int offset;
 
 	FDT_SW_CHECK_HEADER(fdt);
 
-	nameoff = _fdt_find_add_string(fdt, name);
-	if (nameoff == 0)
+	offset = _fdt_add_string(fdt, s);
+	if (offset == 0)
 		return -FDT_ERR_NOSPACE;
+	return -offset;
+}
+
+static int _fdt_property(void *fdt, int nameoff, const void *val, int len)
+{
+	struct fdt_property *prop;
 
 	prop = _fdt_grab_space(fdt, sizeof(*prop) + FDT_TAGALIGN(len));
 	if (! prop)
@@ -242,6 +254,29 @@ int fdt_property(void *fdt, const char *name, const void *val, int len)
 	return 0;
 }
 
+int fdt_property(void *fdt, const char *name, const void *val, int len)
+{
+	int nameoff;
+
+	FDT_SW_CHECK_HEADER(fdt);
+
+	nameoff = _fdt_find_add_string(fdt, name);
+	if (nameoff == 0)
+		return -FDT_ERR_NOSPACE;
+
+	return _fdt_property(fdt, nameoff, val, len);
+}
+
+int fdt_property_nameoff(void *fdt, int string, const void *val, int len)
+{
+	FDT_SW_CHECK_HEADER(fdt);
+
+	if ((string <= 0) || (string > fdt_size_dt_strings(fdt)))
+		return -FDT_ERR_BADOFFSET;
+
+	return _fdt_property(fdt, -string, val, len);
+}
+
 int fdt_finish(void *fdt)
 {
 	char *p = (char *)fdt;
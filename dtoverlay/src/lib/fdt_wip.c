@@ -69,6 +69,7 @@ int fdt_setprop_inplace(void *fdt, int nodeoffset, const char *name,
 		return -FDT_ERR_NOSPACE;
 
 	memcpy(propval, val, len);
+	_fdt_index_prop(fdt, nodeoffset, name);
 	return 0;
 }
 
@@ -90,6 +91,7 @@ int fdt_nop_property(void *fdt, int nodeoffset, const char *name)
 		return len;
 
 	_fdt_nop_region(prop, len + sizeof(*prop));
+	_fdt_index_prop(fdt, nodeoffset, name);
 
 	return 0;
 }
@@ -114,5 +116,7 @@ int fdt_nop_node(void *fdt, int nodeoffset)
 
 	_fdt_nop_region(fdt_offset_ptr_w(fdt, nodeoffset, 0),
 			endoffset - nodeoffset);
+	_fdt_index_splice(fdt, nodeoffset, endoffset - nodeoffset,
+			  endoffset - nodeoffset);
 	return 0;
 }
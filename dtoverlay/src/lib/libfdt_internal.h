@@ -66,6 +66,23 @@ int _fdt_check_node_offset(const void *fdt, int offset);
 int _fdt_check_prop_offset(const void *fdt, int offset);
 const char *_fdt_find_string(const char *strtab, int tabsize, const char *s);
 int _fdt_node_end_offset(void *fdt, int nodeoffset);
+/* name p is s, or s plus a unit address when s has none */
+int _fdt_name_eq(const char *p, const char *s, int len);
+
+/* node offset index, see fdt_index_enable(); lookups return 0 when the
+ * blob has no index and the caller has to walk the tree */
+int _fdt_index_subnode(const void *fdt, int parentoffset,
+		       const char *name, int namelen, int *offset);
+int _fdt_index_phandle(const void *fdt, uint32_t phandle, int *offset);
+int _fdt_index_supernode(const void *fdt, int nodeoffset, int supernodedepth,
+			 int *nodedepth, int *offset);
+int _fdt_index_path(const void *fdt, int nodeoffset, char *buf, int buflen,
+		    int *err);
+void _fdt_index_splice(const void *fdt, int offset, int oldlen, int newlen);
+void _fdt_index_add_node(const void *fdt, int parentoffset, int nodeoffset);
+void _fdt_index_update_node(const void *fdt, int nodeoffset);
+void _fdt_index_prop(const void *fdt, int nodeoffset, const char *name);
+void _fdt_index_move(const void *fdt, const void *buf);
 
 static inline const void *_fdt_offset_ptr(const void *fdt, int offset)
 {
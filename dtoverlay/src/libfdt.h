@@ -1272,6 +1272,38 @@ int fdt_add_reservemap_entry(void *fdt, uint64_t addr, uint64_t size);
 int fdt_finish_reservemap(void *fdt);
 int fdt_begin_node(void *fdt, const char *name);
 int fdt_property(void *fdt, const char *name, const void *val, int len);
+
+/**
+ * fdt_add_string - add a string to the string table of a tree being created
+ * @fdt: pointer to the device tree blob, in sequential write state
+ * @s: string to add
+ *
+ * fdt_add_string() appends @s to the string table without looking for an
+ * existing copy, fdt_property() searches the whole table for each name.
+ * Callers creating many properties keep their own lookup of the returned
+ * handles and use fdt_property_nameoff().
+ *
+ * returns:
+ *	handle of the string (>0), on success
+ *	-FDT_ERR_NOSPACE, not enough space left in the buffer
+ *	-FDT_ERR_BADMAGIC, @fdt is not in sequential write state
+ */
+int fdt_add_string(void *fdt, const char *s);
+
+/**
+ * fdt_property_nameoff - create a property with a name from fdt_add_string()
+ * @fdt: pointer to the device tree blob, in sequential write state
+ * @string: handle returned by fdt_add_string()
+ * @val: pointer to data for the property
+ * @len: length of the property value in bytes
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_NOSPACE, not enough space left in the buffer
+ *	-FDT_ERR_BADOFFSET, @string is no string handle
+ *	-FDT_ERR_BADMAGIC, @fdt is not in sequential write state
+ */
+int fdt_property_nameoff(void *fdt, int string, const void *val, int len);
 static inline int fdt_property_u32(void *fdt, const char *name, uint32_t val)
 {
 	fdt32_t tmp = cpu_to_fdt32(val);
@@ -1752,6 +1784,208 @@ int fdt_add_subnode(void *fdt, int parentoffset, const char *name);
  */
 int fdt_del_node(void *fdt, int nodeoffset);
 
+/**********************************************************************/
+/* Node offset index                                                  */
+/**********************************************************************/
+
+struct fdt_index_stats {
+	unsigned long walks;	/* lookups done by walking the tree */
+	unsigned long steps;	/* nodes visited by fdt_next_node() */
+	unsigned long builds;	/* index (re)builds, one walk each */
+	unsigned long lookups;	/* lookups answered by an index */
+	unsigned long patches;	/* splices applied to an index */
+};
+
+extern struct fdt_index_stats fdt_index_stats;
+
+/**
+ * fdt_index_enable - keep an offset index for a blob
+ * @fdt: pointer to the device tree blob
+ *
+ * fdt_index_enable() makes fdt_path_offset(), fdt_subnode_offset(),
+ * fdt_node_offset_by_phandle(), fdt_parent_offset(), fdt_node_depth(),
+ * fdt_supernode_atdepth_offset() and fdt_get_path() use a side index
+ * of the nodes instead of walking the structure block.  The index is
+ * built by the first lookup and follows the changes libfdt makes to
+ * the blob, including fdt_open_into() to another buffer.  A blob
+ * changed by other means (e.g. writing a phandle through
+ * fdt_getprop_w()) needs fdt_index_disable() and fdt_index_enable().
+ *
+ * fdt_index_disable() has to be called before the blob is freed.
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_NOSPACE, too many blobs indexed at the same time
+ *	-FDT_ERR_BADMAGIC,
+ *	-FDT_ERR_BADVERSION,
+ *	-FDT_ERR_BADSTATE, standard meanings
+ */
+int fdt_index_enable(const void *fdt);
+
+/**
+ * fdt_index_disable - drop the offset index of a blob
+ * @fdt: pointer to the device tree blob
+ *
+ * Lookups walk the tree again.  Nothing happens if @fdt has no index.
+ *
+ * returns:
+ *	1, if @fdt had an index
+ *	0, otherwise
+ */
+int fdt_index_disable(const void *fdt);
+
+/**********************************************************************/
+/* Edit transactions                                                  */
+/**********************************************************************/
+
+/* bytes memmove()d by fdt_rw splices and written by fdt_edit_finish() */
+extern unsigned long fdt_bytes_moved;
+
+struct fdt_edit;
+
+/**
+ * fdt_edit_begin - start collecting changes to a blob
+ * @fdt: pointer to the device tree blob
+ *
+ * fdt_edit_begin() returns a transaction that records property and node
+ * changes without touching @fdt.  fdt_edit_finish() then writes the
+ * changed tree in one pass, where fdt_setprop() and friends move the
+ * rest of the blob on every call and need free space in it up front.
+ * @fdt must stay unchanged until fdt_edit_free().
+ *
+ * Nodes of @fdt keep their offsets during the transaction.  Nodes added
+ * by fdt_edit_add_subnode() get handles past the end of the structure
+ * block, which only mean something to the fdt_edit_*() functions.  The
+ * result is the blob the same fdt_rw calls would give, packed.
+ *
+ * returns:
+ *	the transaction, or NULL for a bad blob or no memory
+ */
+struct fdt_edit *fdt_edit_begin(const void *fdt);
+
+/**
+ * fdt_edit_free - drop a transaction
+ * @edit: transaction from fdt_edit_begin()
+ */
+void fdt_edit_free(struct fdt_edit *edit);
+
+/**
+ * fdt_edit_getprop - the value of a property with the pending changes
+ * @edit: transaction from fdt_edit_begin()
+ * @nodeoffset: offset or handle of the node
+ * @name: name of the property
+ * @lenp: pointer to an integer variable (will be overwritten) or NULL
+ *
+ * Like fdt_getprop().  A pending value stays valid until the next
+ * change recorded in @edit.
+ */
+const void *fdt_edit_getprop(struct fdt_edit *edit, int nodeoffset,
+			     const char *name, int *lenp);
+
+/**
+ * fdt_edit_setprop - record a new property value
+ * @edit: transaction from fdt_edit_begin()
+ * @nodeoffset: offset or handle of the node
+ * @name: name of the property
+ * @val: value, copied
+ * @len: length of the value
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_BADOFFSET, no such node or the node was deleted
+ *	-FDT_ERR_NOSPACE, out of memory
+ */
+int fdt_edit_setprop(struct fdt_edit *edit, int nodeoffset, const char *name,
+		     const void *val, int len);
+
+/**
+ * fdt_edit_delprop - record the removal of a property
+ * @edit: transaction from fdt_edit_begin()
+ * @nodeoffset: offset or handle of the node
+ * @name: name of the property
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_NOTFOUND, the node has no such property
+ *	-FDT_ERR_BADOFFSET, no such node or the node was deleted
+ *	-FDT_ERR_NOSPACE, out of memory
+ */
+int fdt_edit_delprop(struct fdt_edit *edit, int nodeoffset, const char *name);
+
+/**
+ * fdt_edit_subnode_offset - find a subnode with the pending changes
+ * @edit: transaction from fdt_edit_begin()
+ * @parentoffset: offset or handle of the parent
+ * @name: name of the subnode, as for fdt_subnode_offset()
+ *
+ * returns:
+ *	offset or handle of the subnode (>=0), on success
+ *	-FDT_ERR_NOTFOUND, no such subnode
+ *	-FDT_ERR_BADOFFSET, no such parent or the parent was deleted
+ */
+int fdt_edit_subnode_offset_namelen(struct fdt_edit *edit, int parentoffset,
+				    const char *name, int namelen);
+int fdt_edit_subnode_offset(struct fdt_edit *edit, int parentoffset,
+			    const char *name);
+
+/**
+ * fdt_edit_add_subnode - record a new node
+ * @edit: transaction from fdt_edit_begin()
+ * @parentoffset: offset or handle of the parent
+ * @name: name of the subnode
+ *
+ * returns:
+ *	handle of the new node (>=0), on success
+ *	-FDT_ERR_EXISTS, the parent already has such a subnode
+ *	-FDT_ERR_BADOFFSET, no such parent or the parent was deleted
+ *	-FDT_ERR_NOSPACE, out of memory
+ */
+int fdt_edit_add_subnode_namelen(struct fdt_edit *edit, int parentoffset,
+				 const char *name, int namelen);
+int fdt_edit_add_subnode(struct fdt_edit *edit, int parentoffset,
+			 const char *name);
+
+/**
+ * fdt_edit_del_node - record the removal of a node and its subnodes
+ * @edit: transaction from fdt_edit_begin()
+ * @nodeoffset: offset or handle of the node
+ *
+ * Nodes below a deleted node must not be changed any more.
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_BADOFFSET, no such node or the node was deleted
+ */
+int fdt_edit_del_node(struct fdt_edit *edit, int nodeoffset);
+
+/**
+ * fdt_edit_size - size of the blob fdt_edit_finish() will write
+ * @edit: transaction from fdt_edit_begin()
+ *
+ * returns:
+ *	the exact size in bytes (>0), on success
+ *	-FDT_ERR_BADSTRUCTURE,
+ *	-FDT_ERR_TRUNCATED, standard meanings
+ */
+int fdt_edit_size(struct fdt_edit *edit);
+
+/**
+ * fdt_edit_finish - write the changed tree
+ * @edit: transaction from fdt_edit_begin()
+ * @buf: buffer for the new blob, must not overlap the old one
+ * @bufsize: size of @buf
+ *
+ * The blob is written packed, its totalsize is fdt_edit_size().  The
+ * transaction is not freed.
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_NOSPACE, @buf is smaller than fdt_edit_size()
+ *	-FDT_ERR_BADSTRUCTURE,
+ *	-FDT_ERR_TRUNCATED, standard meanings
+ */
+int fdt_edit_finish(struct fdt_edit *edit, void *buf, int bufsize);
+
 /**********************************************************************/
 /* Debugging / informational functions                                */
 /**********************************************************************/
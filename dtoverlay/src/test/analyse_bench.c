@@ -0,0 +1,338 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * overlay analysis check and benchmark
+ *
+ * gives the base DTB the symbols and spidev nodes the overlays expect and
+ * runs the analysis "dtmerge -a" does: the two CAN overlays go together,
+ * enabling spidev0 again collides with can0 on the SPI bus, pins and gpios
+ * used twice are found and a symbol the base doesn't have is unresolved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+
+#define BASE_SIZE	(512 * 1024)
+#define OVERLAY_SIZE	(64 * 1024)
+#define MAX_OVERLAYS	16
+
+#define SPI_PATH	"/soc@01c00000/spi@01c05000"
+#define PIO_PATH	"/soc@01c00000/pinctrl@01c20800"
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-b <base dtb>] [overlay dtbo ...]\n", prg);
+   fprintf(stderr, "         -n <loops>          analyses per run - default 1000\n");
+   fprintf(stderr, "         -b <base dtb>       default ../../sunxi-can/lcd/sun7i-a20-bananapi.dtb\n");
+   fprintf(stderr, "         overlays            default ../../mcp25xxfd/overlays/mcp2517fd-can{0,1}.dtbo\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_file(const char *name, int size)
+{
+   void *data;
+   FILE *f;
+   int len;
+
+   f = fopen(name, "rb");
+   if (!f)
+      return NULL;
+   data = malloc(size);
+   len = fread(data, 1, size, f);
+   fclose(f);
+   if ((len <= 0) || fdt_check_header(data) || fdt_open_into(data, data, size))
+   {
+      free(data);
+      return NULL;
+   }
+   return data;
+}
+
+static int add_spidev(void *fdt, int spi, const char *name, unsigned int cs)
+{
+   int node = fdt_add_subnode(fdt, spi, name);
+
+   if (node < 0)
+      return node;
+   fdt_setprop_string(fdt, node, "compatible", "spidev");
+   fdt_setprop_u32(fdt, node, "reg", cs);
+   fdt_setprop_string(fdt, node, "status", "okay");
+   return node;
+}
+
+/* the labels of the RPi overlays on the BananaPi */
+static int make_base(void *fdt)
+{
+   int spi, symbols;
+
+   spi = fdt_path_offset(fdt, SPI_PATH);
+   if ((spi < 0) || (fdt_path_offset(fdt, PIO_PATH) < 0))
+      return -1;
+   if ((add_spidev(fdt, spi, "spidev@0", 0) < 0) ||
+       (add_spidev(fdt, fdt_path_offset(fdt, SPI_PATH), "spidev@1", 1) < 0))
+      return -1;
+   symbols = fdt_add_subnode(fdt, 0, "__symbols__");
+   if (symbols < 0)
+      return symbols;
+   fdt_setprop_string(fdt, symbols, "spi0", SPI_PATH);
+   fdt_setprop_string(fdt, symbols, "gpio", PIO_PATH);
+   fdt_setprop_string(fdt, symbols, "spidev0", SPI_PATH "/spidev@0");
+   return fdt_setprop_string(fdt, symbols, "spidev1", SPI_PATH "/spidev@1");
+}
+
+static void *new_overlay(void)
+{
+   void *fdt = malloc(OVERLAY_SIZE);
+
+   fdt_create_empty_tree(fdt, OVERLAY_SIZE);
+   return fdt;
+}
+
+/* a fragment with the target symbol, "/" for target-path */
+static int add_fragment(void *fdt, int index, const char *target)
+{
+   char name[32], fixup[64];
+   int frag, fixups;
+
+   snprintf(name, sizeof(name), "fragment@%d", index);
+   frag = fdt_add_subnode(fdt, 0, name);
+   if (target[0] == '/')
+   {
+      fdt_setprop_string(fdt, frag, "target-path", target);
+   }
+   else
+   {
+      fdt_setprop_u32(fdt, frag, "target", 0xffffffff);
+      fixups = fdt_path_offset(fdt, "/__fixups__");
+      if (fixups < 0)
+         fixups = fdt_add_subnode(fdt, 0, "__fixups__");
+      snprintf(fixup, sizeof(fixup), "/%s:target:0", name);
+      fdt_appendprop_string(fdt, fixups, target, fixup);
+   }
+   /* adding __fixups__ may have moved it */
+   frag = fdt_subnode_offset(fdt, 0, name);
+   return fdt_add_subnode(fdt, frag, "__overlay__");
+}
+
+/* spidev0 enabled again */
+static void *spidev_overlay(void)
+{
+   void *fdt = new_overlay();
+
+   fdt_setprop_string(fdt, add_fragment(fdt, 0, "spidev0"), "status", "okay");
+   return fdt;
+}
+
+/* a pin group with the pin of can0 and a device using it, which has a
+   gpio of the serial console as well */
+static void *pins_overlay(void)
+{
+   void *fdt = new_overlay();
+   uint32_t gpios[4] = { cpu_to_fdt32(0xffffffff), cpu_to_fdt32(1),
+                         cpu_to_fdt32(22), cpu_to_fdt32(0) };
+   int node, fixups;
+
+   node = fdt_add_subnode(fdt, add_fragment(fdt, 0, "gpio"), "test_pins");
+   fdt_setprop_u32(fdt, node, "brcm,pins", 25);
+   fdt_setprop_u32(fdt, node, "phandle", 1);
+   node = fdt_add_subnode(fdt, add_fragment(fdt, 1, "/"), "test");
+   fdt_setprop_u32(fdt, node, "pinctrl-0", 1);
+   fdt_setprop(fdt, node, "reset-gpios", gpios, sizeof(gpios));
+   fixups = fdt_path_offset(fdt, "/__fixups__");
+   fdt_appendprop_string(fdt, fixups, "gpio", "/fragment@1/__overlay__/test:reset-gpios:0");
+   node = fdt_add_subnode(fdt, 0, "__local_fixups__");
+   node = fdt_add_subnode(fdt, node, "fragment@1");
+   node = fdt_add_subnode(fdt, node, "__overlay__");
+   node = fdt_add_subnode(fdt, node, "test");
+   fdt_setprop_u32(fdt, node, "pinctrl-0", 0);
+   return fdt;
+}
+
+/* a target the base doesn't have */
+static void *unresolved_overlay(void)
+{
+   void *fdt = new_overlay();
+
+   fdt_setprop_string(fdt, add_fragment(fdt, 0, "i2c7"), "status", "okay");
+   return fdt;
+}
+
+/* the result of analysing the overlays, the report in *report */
+static int analyse(void *base, void **overlays, int n, char **report)
+{
+   struct dtoverlay_analysis *an;
+   size_t size;
+   FILE *out;
+   char name[32];
+   int i, err = 0;
+
+   out = report ? open_memstream(report, &size) : NULL;
+   an = dtoverlay_analyse_begin(base, out);
+   if (!an)
+      return -1;
+   for (i = 0; (i < n) && !err; i++)
+   {
+      snprintf(name, sizeof(name), "overlay%d", i);
+      err = dtoverlay_analyse_add(an, overlays[i], name);
+   }
+   if (err)
+      dtoverlay_analyse_end(an);
+   else
+      err = dtoverlay_analyse_end(an);
+   if (out)
+      fclose(out);
+   return err;
+}
+
+static int count(const char *report, const char *what)
+{
+   int n = 0;
+
+   while ((report = strstr(report, what)) != NULL)
+   {
+      report++;
+      n++;
+   }
+   return n;
+}
+
+static int check(const char *what, void *base, void **overlays, int n,
+                 int problems, const char **expected)
+{
+   char *report = NULL;
+   int err, errors = 0;
+
+   err = analyse(base, overlays, n, &report);
+   if (err != problems)
+   {
+      printf("* %s: %d problems instead of %d\n", what, err, problems);
+      errors++;
+   }
+   for (; *expected; expected++)
+   {
+      if (count(report, *expected) != 1)
+      {
+         printf("* %s: '%s' reported %d times\n", what, *expected, count(report, *expected));
+         errors++;
+      }
+   }
+   if (errors)
+      printf("%s", report);
+   free(report);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   const char *base_file = "../../sunxi-can/lcd/sun7i-a20-bananapi.dtb";
+   const char *defaults[] = { "../../mcp25xxfd/overlays/mcp2517fd-can0.dtbo",
+                              "../../mcp25xxfd/overlays/mcp2517fd-can1.dtbo" };
+   const char *clean[] = { "2 overlays: 0 conflicts or unresolved, 0 overridden", NULL };
+   const char *spidev[] = { "conflict: reg 0x0 of " SPI_PATH,
+                            SPI_PATH "/spidev@0:status already set by overlay0", NULL };
+   const char *pins[] = { "conflict: pin 25 of " PIO_PATH, "conflict: pin PB22 of " PIO_PATH,
+                          NULL };
+   const char *unresolved[] = { "overlay1: unresolved symbol 'i2c7'", NULL };
+   const char **files = defaults;
+   void *base, *overlays[MAX_OVERLAYS], *crafted[2];
+   int opt, i, n = 2, loops = 1000, errors = 0;
+   double start, t_base, t_all;
+
+   while ((opt = getopt(argc, argv, "n:b:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         base_file = optarg;
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if (optind < argc)
+   {
+      files = (const char **)argv + optind;
+      n = argc - optind;
+   }
+   if ((loops < 1) || (n < 1) || (n > MAX_OVERLAYS))
+      usage(argv[0]);
+
+   base = read_file(base_file, BASE_SIZE);
+   if (!base)
+   {
+      printf("* can't read '%s'\n", base_file);
+      return 1;
+   }
+   for (i = 0; i < n; i++)
+   {
+      overlays[i] = read_file(files[i], OVERLAY_SIZE);
+      if (!overlays[i])
+      {
+         printf("* can't read '%s'\n", files[i]);
+         return 1;
+      }
+   }
+   if (make_base(base) < 0)
+   {
+      printf("* can't add the symbols to the base\n");
+      return 1;
+   }
+
+   if (files == defaults)
+   {
+      errors += check("can0 and can1", base, overlays, 2, 0, clean);
+      crafted[0] = overlays[0];
+      crafted[1] = spidev_overlay();
+      errors += check("spidev0 again", base, crafted, 2, 1, spidev);
+      free(crafted[1]);
+      crafted[1] = pins_overlay();
+      errors += check("pins and gpios", base, crafted, 2, 2, pins);
+      free(crafted[1]);
+      crafted[1] = unresolved_overlay();
+      errors += check("unresolved", base, crafted, 2, 1, unresolved);
+      free(crafted[1]);
+   }
+
+   start = now();
+   for (i = 0; i < loops; i++)
+      analyse(base, overlays, 0, NULL);
+   t_base = (now() - start) / loops;
+   start = now();
+   for (i = 0; i < loops; i++)
+      analyse(base, overlays, n, NULL);
+   t_all = (now() - start) / loops;
+
+   printf("%s: %d overlays\n", base_file, n);
+   printf("  base tables        %8.3f ms\n", t_base * 1e3);
+   printf("  with the overlays  %8.3f ms\n", t_all * 1e3);
+
+   for (i = 0; i < n; i++)
+      free(overlays[i]);
+   free(base);
+   printf("%s\n", errors ? "FAILED" : "analyse checks passed");
+   return errors ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * merged DTB cache check and benchmark
+ *
+ * keys the merge of the base with the overlays the way dtmerge does: the
+ * same blobs and parameters hit, a changed byte, another parameter order
+ * or the pieces cut differently miss, while "x" and "x=true" are the
+ * same. Checks eviction of the least recently used entries and that
+ * verification finds and replaces a damaged entry, then compares a hit
+ * with merging
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+#include "overlay_apply.h"
+
+#define BASE_SIZE	(512 * 1024)
+#define OVERLAY_SIZE	(64 * 1024)
+#define MAX_OVERLAYS	16
+
+static char dir[64];
+static char out_file[128];
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-b <base dtb>] [overlay dtbo ...]\n", prg);
+   fprintf(stderr, "         -n <loops>          merges and hits per run - default 1000\n");
+   fprintf(stderr, "         -b <base dtb>       default ../../sunxi-can/lcd/sun7i-a20-bananapi.dtb\n");
+   fprintf(stderr, "         overlays            default ../../mcp25xxfd/overlays/mcp2517fd-can{0,1}.dtbo\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_file(const char *name, int size)
+{
+   void *data;
+   FILE *f;
+   int len;
+
+   f = fopen(name, "rb");
+   if (!f)
+      return NULL;
+   data = malloc(size);
+   len = fread(data, 1, size, f);
+   fclose(f);
+   if ((len <= 0) || fdt_check_header(data) || fdt_open_into(data, data, size))
+   {
+      free(data);
+      return NULL;
+   }
+   return data;
+}
+
+static int write_file(const char *name, const void *data, int len)
+{
+   FILE *f = fopen(name, "wb");
+   int ok;
+
+   if (!f)
+      return -1;
+   ok = (fwrite(data, 1, len, f) == (size_t)len);
+   return ((fclose(f) == 0) && ok) ? 0 : -1;
+}
+
+/* the entries in the cache */
+static int entries(char names[][160], int max)
+{
+   struct dirent *de;
+   DIR *dh = opendir(dir);
+   int n = 0;
+
+   while (dh && ((de = readdir(dh)) != NULL))
+   {
+      if (strstr(de->d_name, ".dtb") && (strlen(de->d_name) == 68))
+      {
+         if (n < max)
+            snprintf(names[n], 160, "%s/%.68s", dir, de->d_name);
+         n++;
+      }
+   }
+   if (dh)
+      closedir(dh);
+   return n;
+}
+
+static struct dtoverlay_cache *lookup(void *base, void **overlays, int n,
+                                      int argc, const char **argv, int verify, int *hit)
+{
+   struct dtoverlay_cache *cache = dtoverlay_cache_begin(dir, 1024 * 1024, verify);
+   int i;
+
+   dtoverlay_cache_add(cache, "dtmerge", 7);
+   dtoverlay_cache_add(cache, base, fdt_totalsize(base));
+   for (i = 0; i < n; i++)
+      dtoverlay_cache_add(cache, overlays[i], fdt_totalsize(overlays[i]));
+   dtoverlay_cache_add_params(cache, argc, argv);
+   *hit = dtoverlay_cache_fetch(cache, out_file);
+   return cache;
+}
+
+/* merges the overlays onto the base, into out_file */
+static int merge(void *base, void **overlays, int n)
+{
+   DTBLOB_T base_dtb, overlay_dtb;
+   int i, err = 0;
+
+   memset(&base_dtb, 0, sizeof(base_dtb));
+   memset(&overlay_dtb, 0, sizeof(overlay_dtb));
+   base_dtb.fdt = malloc(BASE_SIZE);
+   fdt_open_into(base, base_dtb.fdt, BASE_SIZE);
+   for (i = 0; (i < n) && !err; i++)
+   {
+      overlay_dtb.fdt = malloc(OVERLAY_SIZE);
+      fdt_open_into(overlays[i], overlay_dtb.fdt, OVERLAY_SIZE);
+      err = apply(&base_dtb, &overlay_dtb, 0);
+      free(overlay_dtb.fdt);
+   }
+   fdt_pack(base_dtb.fdt);
+   if (!err)
+      err = write_file(out_file, base_dtb.fdt, fdt_totalsize(base_dtb.fdt));
+   free(base_dtb.fdt);
+   return err;
+}
+
+/* a lookup with the inputs, merged and stored on a miss. Returns the hit */
+static int run(void *base, void **overlays, int n, int argc, const char **argv)
+{
+   struct dtoverlay_cache *cache;
+   int hit;
+
+   cache = lookup(base, overlays, n, argc, argv, 0, &hit);
+   if (hit != 1)
+   {
+      merge(base, overlays, n);
+      dtoverlay_cache_store(cache, out_file);
+   }
+   dtoverlay_cache_end(cache, NULL);
+   return hit;
+}
+
+static int expect(const char *what, int got, int want)
+{
+   if (got == want)
+      return 0;
+   printf("* %s: %d instead of %d\n", what, got, want);
+   return 1;
+}
+
+/* pieces cut differently have to give other keys */
+static int boundaries(void)
+{
+   struct dtoverlay_cache *a, *b;
+   char names[4][160];
+   int errors;
+
+   a = dtoverlay_cache_begin(dir, 1024 * 1024, 0);
+   dtoverlay_cache_add(a, "ab", 2);
+   dtoverlay_cache_add(a, "c", 1);
+   dtoverlay_cache_fetch(a, out_file);
+   dtoverlay_cache_store(a, out_file);
+   dtoverlay_cache_end(a, NULL);
+   b = dtoverlay_cache_begin(dir, 1024 * 1024, 0);
+   dtoverlay_cache_add(b, "a", 1);
+   dtoverlay_cache_add(b, "bc", 2);
+   errors = expect("pieces cut differently", dtoverlay_cache_fetch(b, out_file), 0);
+   dtoverlay_cache_store(b, out_file);
+   dtoverlay_cache_end(b, NULL);
+   errors += expect("entries", entries(names, 4), 2);
+   return errors;
+}
+
+static void clear(void)
+{
+   char path[320];
+   struct dirent *de;
+   DIR *dh = opendir(dir);
+
+   while (dh && ((de = readdir(dh)) != NULL))
+   {
+      if (de->d_name[0] == '.')
+         continue;
+      snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+      unlink(path);
+   }
+   if (dh)
+      closedir(dh);
+}
+
+int main(int argc, char **argv)
+{
+   const char *base_file = "../../sunxi-can/lcd/sun7i-a20-bananapi.dtb";
+   const char *defaults[] = { "../../mcp25xxfd/overlays/mcp2517fd-can0.dtbo",
+                              "../../mcp25xxfd/overlays/mcp2517fd-can1.dtbo" };
+   const char *params[] = { "oscillator=40000000", "interrupt=25" };
+   const char *params_swapped[] = { "interrupt=25", "oscillator=40000000" };
+   const char *bare[] = { "opendrain" }, *bare_true[] = { "opendrain=true" };
+   const char **files = defaults;
+   struct dtoverlay_cache *cache;
+   void *base, *overlays[MAX_OVERLAYS], *changed[MAX_OVERLAYS];
+   char names[8][160], stats[256];
+   struct utimbuf times;
+   struct stat st;
+   FILE *f;
+   int opt, i, n = 2, loops = 1000, hit, errors = 0;
+   double start, t_merge, t_hit;
+
+   while ((opt = getopt(argc, argv, "n:b:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         base_file = optarg;
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if (optind < argc)
+   {
+      files = (const char **)argv + optind;
+      n = argc - optind;
+   }
+   if ((loops < 1) || (n < 1) || (n > MAX_OVERLAYS))
+      usage(argv[0]);
+
+   base = read_file(base_file, BASE_SIZE);
+   if (!base)
+   {
+      printf("* can't read '%s'\n", base_file);
+      return 1;
+   }
+   for (i = 0; i < n; i++)
+   {
+      overlays[i] = read_file(files[i], OVERLAY_SIZE);
+      if (!overlays[i])
+      {
+         printf("* can't read '%s'\n", files[i]);
+         return 1;
+      }
+      changed[i] = overlays[i];
+   }
+   if (make_base(base, overlays, n, 0) < 0)
+   {
+      printf("* can't add the symbols to the base\n");
+      return 1;
+   }
+   /* hashed as they are in their files */
+   fdt_pack(base);
+   for (i = 0; i < n; i++)
+      fdt_pack(overlays[i]);
+   strcpy(dir, "/tmp/cache_benchXXXXXX");
+   if (!mkdtemp(dir))
+      return 1;
+   snprintf(out_file, sizeof(out_file), "%s/.merged", dir);
+
+   /* what goes into the key */
+   errors += expect("first run", run(base, overlays, n, 2, params), 0);
+   errors += expect("same inputs", run(base, overlays, n, 2, params), 1);
+   errors += expect("parameters swapped", run(base, overlays, n, 2, params_swapped), 0);
+   errors += expect("bare parameter", run(base, overlays, n, 1, bare), 0);
+   errors += expect("bare parameter as =true", run(base, overlays, n, 1, bare_true), 1);
+   changed[n - 1] = malloc(OVERLAY_SIZE);
+   memcpy(changed[n - 1], overlays[n - 1], fdt_totalsize(overlays[n - 1]));
+   fdt_set_boot_cpuid_phys(changed[n - 1], fdt_boot_cpuid_phys(changed[n - 1]) ^ 1);
+   errors += expect("a byte changed", run(base, changed, n, 2, params), 0);
+   free(changed[n - 1]);
+   errors += expect("entries", entries(names, 8), 4);
+   clear();
+   errors += boundaries();
+   clear();
+
+   /* verification of a damaged entry */
+   run(base, overlays, n, 0, NULL);
+   entries(names, 8);
+   f = fopen(names[0], "r+b");
+   fseek(f, 100, SEEK_SET);
+   fputc(0x55, f);
+   fclose(f);
+   cache = lookup(base, overlays, n, 0, NULL, 1, &hit);
+   errors += expect("verify fetch", hit, 0);
+   merge(base, overlays, n);
+   errors += expect("verify damaged", dtoverlay_cache_store(cache, out_file), 1);
+   dtoverlay_cache_end(cache, NULL);
+   cache = lookup(base, overlays, n, 0, NULL, 1, &hit);
+   merge(base, overlays, n);
+   errors += expect("verify replaced", dtoverlay_cache_store(cache, out_file), 0);
+   dtoverlay_cache_end(cache, NULL);
+   errors += expect("hit after verification", run(base, overlays, n, 0, NULL), 1);
+   stats[0] = '\0';
+   snprintf(names[1], 160, "%s/stats", dir);
+   f = fopen(names[1], "r");
+   if (f)
+   {
+      if (!fgets(stats, sizeof(stats), f))
+         stats[0] = '\0';
+      fclose(f);
+   }
+   errors += expect("stats", strcmp(stats, "hits 1 misses 1 verified 1 mismatches 1 evicted 0\n"), 0);
+   clear();
+
+   /* eviction by size: three entries fit, the oldest go */
+   for (i = 0; i < 4; i++)
+   {
+      char param[32];
+      const char *p = param;
+      snprintf(param, sizeof(param), "index=%d", i);
+      run(base, overlays, n, 1, &p);
+      if (i == 2)
+      {
+         /* make them the older ones, the second used last */
+         entries(names, 8);
+         for (opt = 0; opt < 3; opt++)
+         {
+            times.actime = times.modtime = time(NULL) - 100 + opt;
+            utime(names[opt], &times);
+         }
+      }
+   }
+   stat(out_file, &st);
+   cache = dtoverlay_cache_begin(dir, 3 * st.st_size + st.st_size / 2, 0);
+   dtoverlay_cache_add(cache, "evict", 5);
+   dtoverlay_cache_fetch(cache, out_file);
+   dtoverlay_cache_store(cache, out_file);
+   dtoverlay_cache_end(cache, NULL);
+   errors += expect("entries after eviction", entries(names, 8), 3);
+   clear();
+
+   /* merge against hit */
+   start = now();
+   for (i = 0; i < loops; i++)
+      merge(base, overlays, n);
+   t_merge = (now() - start) / loops;
+   run(base, overlays, n, 2, params);
+   start = now();
+   for (i = 0, hit = 0; i < loops; i++)
+      hit += run(base, overlays, n, 2, params);
+   errors += expect("hits", hit, loops);
+   t_hit = (now() - start) / loops;
+   if (stat(out_file, &st) != 0)
+      st.st_size = 0;
+
+   printf("%s: %d overlays, merged %ld bytes\n", base_file, n, (long)st.st_size);
+   printf("  merge and write   %8.3f ms\n", t_merge * 1e3);
+   printf("  cache hit         %8.3f ms  %.1fx\n", t_hit * 1e3, t_merge / t_hit);
+
+   clear();
+   unlink(out_file);
+   rmdir(dir);
+   for (i = 0; i < n; i++)
+      free(overlays[i]);
+   free(base);
+   printf("%s\n", errors ? "FAILED" : "cache checks passed");
+   return errors ? 1 : 0;
+}
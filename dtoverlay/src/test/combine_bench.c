@@ -0,0 +1,360 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * overlay combining check and benchmark
+ *
+ * combines the overlays with dtoverlay_combine() the way "dtoverlay -b"
+ * does and applies the result to the base DTB. The merged tree has to be
+ * the one applying the overlays one after the other gives. Adding an
+ * overlay again, or one using a symbol of the combined overlay, has to be
+ * refused without touching it
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+#include "overlay_apply.h"
+
+#define BASE_SIZE	(512 * 1024)
+#define OVERLAY_SIZE	(64 * 1024)
+#define MAX_OVERLAYS	16
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-b <base dtb>] [overlay dtbo ...]\n", prg);
+   fprintf(stderr, "         -n <loops>          combines per run - default 1000\n");
+   fprintf(stderr, "         -b <base dtb>       default ../../sunxi-can/lcd/sun7i-a20-bananapi.dtb\n");
+   fprintf(stderr, "         overlays            default ../../mcp25xxfd/overlays/mcp2517fd-can{0,1}.dtbo\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_file(const char *name, int size)
+{
+   void *data;
+   FILE *f;
+   int len;
+
+   f = fopen(name, "rb");
+   if (!f)
+      return NULL;
+   data = malloc(size);
+   len = fread(data, 1, size, f);
+   fclose(f);
+   if ((len <= 0) || fdt_check_header(data) || fdt_open_into(data, data, size))
+   {
+      free(data);
+      return NULL;
+   }
+   return data;
+}
+
+static void *copy(const void *fdt, int size)
+{
+   void *buf = malloc(size);
+
+   if (fdt_open_into(fdt, buf, size))
+   {
+      free(buf);
+      return NULL;
+   }
+   return buf;
+}
+
+static int count_nodes(const void *fdt)
+{
+   int node, count = 0;
+
+   for (node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL))
+      count++;
+   return count;
+}
+
+/* the same nodes with the same properties, in any order */
+static int same_tree(const void *a, const void *b)
+{
+   const char *name;
+   const void *value, *found;
+   char path[MAX_PATH];
+   int node, other, prop, len, found_len, props, errors = 0;
+
+   if (count_nodes(a) != count_nodes(b))
+   {
+      printf("%d nodes combined, %d one by one\n", count_nodes(b), count_nodes(a));
+      errors++;
+   }
+   for (node = 0; node >= 0; node = fdt_next_node(a, node, NULL))
+   {
+      fdt_get_path(a, node, path, sizeof(path));
+      other = fdt_path_offset(b, path);
+      if (other < 0)
+      {
+         printf("%s missing\n", path);
+         errors++;
+         continue;
+      }
+      props = 0;
+      for (prop = fdt_first_property_offset(b, other); prop >= 0;
+           prop = fdt_next_property_offset(b, prop))
+         props--;
+      for (prop = fdt_first_property_offset(a, node); prop >= 0;
+           prop = fdt_next_property_offset(a, prop), props++)
+      {
+         value = fdt_getprop_by_offset(a, prop, &name, &len);
+         found = fdt_getprop(b, other, name, &found_len);
+         if (!found || (found_len != len) || memcmp(found, value, len))
+         {
+            printf("%s:%s differs\n", path, name);
+            errors++;
+         }
+      }
+      if (props)
+      {
+         printf("%s: %d properties more\n", path, -props);
+         errors++;
+      }
+   }
+   return errors;
+}
+
+static int fragments(const void *fdt)
+{
+   int node, count = 0;
+
+   fdt_for_each_subnode(node, fdt, 0)
+      if (fdt_subnode_offset(fdt, node, "__overlay__") >= 0)
+         count++;
+   return count;
+}
+
+static DTBLOB_T *empty_overlay(void)
+{
+   DTBLOB_T *dtb = calloc(1, sizeof(DTBLOB_T));
+
+   dtb->fdt = malloc(256);
+   dtb->fdt_is_malloced = 1;
+   fdt_create_empty_tree(dtb->fdt, 256);
+   return dtb;
+}
+
+static void free_overlay(DTBLOB_T *dtb)
+{
+   if (dtb->fdt_is_malloced)
+      free(dtb->fdt);
+   free(dtb);
+}
+
+/* combines all, returns NULL if one is refused */
+static DTBLOB_T *combine(void **overlays, int n)
+{
+   DTBLOB_T *combined = empty_overlay(), overlay;
+   int i, err;
+
+   memset(&overlay, 0, sizeof(overlay));
+   for (i = 0; i < n; i++)
+   {
+      overlay.fdt = overlays[i];
+      err = dtoverlay_combine(combined, &overlay);
+      if (err)
+      {
+         printf("* overlay %d not combined: %d\n", i, err);
+         free_overlay(combined);
+         return NULL;
+      }
+   }
+   return combined;
+}
+
+/* a fragment targeting a symbol of the overlay */
+static void *user_of(const void *overlay)
+{
+   void *fdt = malloc(OVERLAY_SIZE);
+   const char *sym;
+   int prop, frag, node;
+
+   prop = fdt_first_property_offset(overlay, fdt_path_offset(overlay, "/__symbols__"));
+   if (prop < 0)
+   {
+      free(fdt);
+      return NULL;
+   }
+   fdt_getprop_by_offset(overlay, prop, &sym, NULL);
+   fdt_create_empty_tree(fdt, OVERLAY_SIZE);
+   frag = fdt_add_subnode(fdt, 0, "fragment@0");
+   fdt_setprop_u32(fdt, frag, "target", 0xffffffff);
+   node = fdt_add_subnode(fdt, frag, "__overlay__");
+   fdt_setprop_string(fdt, node, "status", "okay");
+   node = fdt_add_subnode(fdt, 0, "__fixups__");
+   fdt_setprop_string(fdt, node, sym, "/fragment@0:target:0");
+   return fdt;
+}
+
+/* refused, and the combined overlay as it was */
+static int refused(DTBLOB_T *combined, void *overlay, const char *what)
+{
+   DTBLOB_T dtb;
+   void *before;
+   int err, errors = 0;
+
+   memset(&dtb, 0, sizeof(dtb));
+   dtb.fdt = overlay;
+   before = copy(combined->fdt, fdt_totalsize(combined->fdt));
+   err = dtoverlay_combine(combined, &dtb);
+   if (err != 1)
+   {
+      printf("* %s: combined (%d)\n", what, err);
+      errors++;
+   }
+   else if ((fdt_totalsize(before) != fdt_totalsize(combined->fdt)) ||
+            memcmp(before, combined->fdt, fdt_totalsize(before)))
+   {
+      printf("* %s: refused, but the combined overlay changed\n", what);
+      errors++;
+   }
+   free(before);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   const char *base_file = "../../sunxi-can/lcd/sun7i-a20-bananapi.dtb";
+   const char *defaults[] = { "../../mcp25xxfd/overlays/mcp2517fd-can0.dtbo",
+                              "../../mcp25xxfd/overlays/mcp2517fd-can1.dtbo" };
+   const char **files = defaults;
+   void *base, *overlays[MAX_OVERLAYS], *one, *all, *user;
+   DTBLOB_T base_dtb, overlay_dtb, *combined;
+   int opt, i, n = 2, loops = 1000, frags = 0, errors = 0;
+   double start, t;
+
+   while ((opt = getopt(argc, argv, "n:b:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         base_file = optarg;
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if (optind < argc)
+   {
+      files = (const char **)argv + optind;
+      n = argc - optind;
+   }
+   if ((loops < 1) || (n < 2) || (n > MAX_OVERLAYS))
+      usage(argv[0]);
+
+   base = read_file(base_file, BASE_SIZE);
+   if (!base)
+   {
+      printf("* can't read '%s'\n", base_file);
+      return 1;
+   }
+   for (i = 0; i < n; i++)
+   {
+      overlays[i] = read_file(files[i], OVERLAY_SIZE);
+      if (!overlays[i])
+      {
+         printf("* can't read '%s'\n", files[i]);
+         return 1;
+      }
+      frags += fragments(overlays[i]);
+   }
+   if (make_base(base, overlays, n, 0) < 0)
+   {
+      printf("* can't add the symbols to the base\n");
+      return 1;
+   }
+
+   /* one after the other */
+   memset(&base_dtb, 0, sizeof(base_dtb));
+   memset(&overlay_dtb, 0, sizeof(overlay_dtb));
+   one = copy(base, BASE_SIZE);
+   base_dtb.fdt = one;
+   for (i = 0; (i < n) && !errors; i++)
+   {
+      overlay_dtb.fdt = copy(overlays[i], OVERLAY_SIZE);
+      if (apply(&base_dtb, &overlay_dtb, 0))
+      {
+         printf("* can't apply '%s'\n", files[i]);
+         errors++;
+      }
+      free(overlay_dtb.fdt);
+   }
+
+   /* combined, then applied */
+   combined = combine(overlays, n);
+   if (!combined)
+      return 1;
+   if (fdt_path_offset(combined->fdt, "/__overrides__") >= 0)
+   {
+      printf("* __overrides__ left in the combined overlay\n");
+      errors++;
+   }
+   all = copy(base, BASE_SIZE);
+   base_dtb.fdt = all;
+   overlay_dtb.fdt = copy(combined->fdt, OVERLAY_SIZE);
+   if (apply(&base_dtb, &overlay_dtb, 0))
+   {
+      printf("* can't apply the combined overlay\n");
+      errors++;
+   }
+   free(overlay_dtb.fdt);
+   if (!errors)
+      errors += same_tree(one, all);
+
+   errors += refused(combined, overlays[0], "the first overlay again");
+   user = user_of(overlays[0]);
+   if (user)
+   {
+      errors += refused(combined, user, "a user of its symbols");
+      free(user);
+   }
+
+   start = now();
+   for (i = 0; i < loops; i++)
+   {
+      DTBLOB_T *c = combine(overlays, n);
+      if (!c)
+         break;
+      free_overlay(c);
+   }
+   t = (now() - start) / loops;
+
+   printf("%s: %d nodes, %d overlays\n", base_file, count_nodes(base), n);
+   printf("  %d fragments in %d configfs directories, combined %d fragments in one\n",
+          frags, n, fragments(combined->fdt));
+   printf("  dtoverlay_combine   %8.3f ms  %d bytes\n", t * 1e3, fdt_totalsize(combined->fdt));
+
+   free_overlay(combined);
+   for (i = 0; i < n; i++)
+      free(overlays[i]);
+   free(one);
+   free(all);
+   free(base);
+   printf("%s\n", errors ? "FAILED" : "combine checks passed");
+   return errors ? 1 : 0;
+}
@@ -0,0 +1,332 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * device tree filesystem loader benchmark
+ *
+ * writes a DTB out as a device tree filesystem the way /proc/device-tree
+ * shows it, reads it back with dtoverlay_fs_to_fdt() and checks that every
+ * node and property came back. The time taken is compared with what
+ * dtoverlay did before: a shell running dtc into a temporary file which is
+ * then read again. Without dtc only the shell start is measured. A copy
+ * grown past the loader's first 64 kB buffer is read back as well
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+
+#define MAX_SIZE	(1024 * 1024)
+/* nodes added for a tree larger than the loader's first buffer of 64 kB */
+#define LARGE_NODES	300
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-b <base dtb>]\n", prg);
+   fprintf(stderr, "         -n <loops>          loads per method - default 100\n");
+   fprintf(stderr, "         -b <base dtb>       default ../../sunxi-can/lcd/sun7i-a20-bananapi.dtb\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_file(const char *name)
+{
+   void *data;
+   FILE *f;
+   int len;
+
+   f = fopen(name, "rb");
+   if (!f)
+      return NULL;
+   data = malloc(MAX_SIZE);
+   len = fread(data, 1, MAX_SIZE, f);
+   fclose(f);
+   if ((len <= 0) || fdt_check_header(data))
+   {
+      free(data);
+      return NULL;
+   }
+   return data;
+}
+
+/* a directory per node, a file per property */
+static int write_node(const void *fdt, int node, int dir_fd)
+{
+   const char *name;
+   const void *value;
+   int prop, sub, fd, len;
+
+   for (prop = fdt_first_property_offset(fdt, node); prop >= 0;
+        prop = fdt_next_property_offset(fdt, prop))
+   {
+      value = fdt_getprop_by_offset(fdt, prop, &name, &len);
+      fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if ((fd < 0) || (write(fd, value, len) != len))
+         return -1;
+      close(fd);
+   }
+   fdt_for_each_subnode(sub, fdt, node)
+   {
+      name = fdt_get_name(fdt, sub, NULL);
+      if (mkdirat(dir_fd, name, 0755))
+         return -1;
+      fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
+      if ((fd < 0) || write_node(fdt, sub, fd))
+         return -1;
+      close(fd);
+   }
+   return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+   return remove(path);
+}
+
+static int count_nodes(const void *fdt)
+{
+   int node, count = 0;
+
+   for (node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL))
+      count++;
+   return count;
+}
+
+/* every node and property of the original, and nothing else */
+static int check(const void *orig, const void *loaded)
+{
+   const char *name;
+   const void *value, *found;
+   char path[256];
+   int node, other, prop, len, found_len, props, errors = 0;
+
+   if (count_nodes(orig) != count_nodes(loaded))
+   {
+      printf("%d nodes read back, %d written\n", count_nodes(loaded), count_nodes(orig));
+      errors++;
+   }
+   for (node = 0; node >= 0; node = fdt_next_node(orig, node, NULL))
+   {
+      fdt_get_path(orig, node, path, sizeof(path));
+      other = fdt_path_offset(loaded, path);
+      if (other < 0)
+      {
+         printf("%s missing\n", path);
+         errors++;
+         continue;
+      }
+      props = 0;
+      for (prop = fdt_first_property_offset(loaded, other); prop >= 0;
+           prop = fdt_next_property_offset(loaded, prop))
+         props--;
+      for (prop = fdt_first_property_offset(orig, node); prop >= 0;
+           prop = fdt_next_property_offset(orig, prop), props++)
+      {
+         value = fdt_getprop_by_offset(orig, prop, &name, &len);
+         found = fdt_getprop(loaded, other, name, &found_len);
+         if (!found || (found_len != len) || memcmp(found, value, len))
+         {
+            printf("%s:%s differs\n", path, name);
+            errors++;
+         }
+      }
+      if (props)
+      {
+         printf("%s: %d properties too many\n", path, -props);
+         errors++;
+      }
+   }
+   return errors;
+}
+
+/* writes fdt out below a new temporary directory, loads it back and checks it */
+static int round_trip(const void *orig)
+{
+   char dir[] = "/tmp/dtfs_bench.XXXXXX";
+   void *fdt;
+   int fd, errors = 0;
+
+   if (!mkdtemp(dir))
+   {
+      perror(dir);
+      return 1;
+   }
+   fd = open(dir, O_RDONLY | O_DIRECTORY);
+   if ((fd < 0) || write_node(orig, 0, fd))
+   {
+      printf("* can't write the tree to %s\n", dir);
+      nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+      return 1;
+   }
+   close(fd);
+
+   fdt = dtoverlay_fs_to_fdt(dir, DTOVERLAY_PADDING(4096));
+   if (!fdt)
+   {
+      printf("* dtoverlay_fs_to_fdt failed on %d bytes\n", fdt_totalsize(orig));
+      errors++;
+   }
+   else
+   {
+      errors += check(orig, fdt);
+      if (fdt_totalsize(fdt) != fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt) + 4096)
+      {
+         printf("padding of %d bytes, 4096 asked for\n",
+                fdt_totalsize(fdt) - fdt_off_dt_strings(fdt) - fdt_size_dt_strings(fdt));
+         errors++;
+      }
+      free(fdt);
+   }
+   nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+   return errors;
+}
+
+/* the base with LARGE_NODES more nodes, so the loader has to grow its buffer */
+static int check_large(const void *base)
+{
+   unsigned char data[256];
+   char name[32];
+   void *large;
+   int parent, node, i, errors;
+
+   large = malloc(MAX_SIZE);
+   fdt_open_into(base, large, MAX_SIZE);
+   memset(data, 0x5a, sizeof(data));
+   parent = fdt_add_subnode(large, 0, "dtfs-bench");
+   for (i = 0; (i < LARGE_NODES) && (parent >= 0); i++)
+   {
+      snprintf(name, sizeof(name), "node@%x", i);
+      node = fdt_add_subnode(large, parent, name);
+      if ((node < 0) || fdt_setprop_u32(large, node, "reg", i) ||
+          fdt_setprop_string(large, node, "compatible", "dtfs-bench") ||
+          fdt_setprop(large, node, "data", data, sizeof(data)))
+         parent = -1;
+   }
+   if (parent < 0)
+   {
+      printf("* growing the base failed\n");
+      free(large);
+      return 1;
+   }
+   fdt_pack(large);
+   errors = round_trip(large);
+   printf("%d nodes, %d bytes read back %s\n", count_nodes(large), fdt_totalsize(large),
+          errors ? "with errors" : "complete");
+   free(large);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   const char *base_file = "../../sunxi-can/lcd/sun7i-a20-bananapi.dtb";
+   char dir[] = "/tmp/dtfs_bench.XXXXXX", cmd[256], out[64];
+   double start, native, shell, dtc = 0;
+   int opt, i, fd, loops = 100, have_dtc, errors = 0;
+   void *base;
+
+   while ((opt = getopt(argc, argv, "n:b:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         base_file = optarg;
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if (loops < 1)
+      usage(argv[0]);
+
+   base = read_file(base_file);
+   if (!base)
+   {
+      printf("* can't read '%s'\n", base_file);
+      return 1;
+   }
+   if (!mkdtemp(dir))
+   {
+      perror(dir);
+      return 1;
+   }
+   fd = open(dir, O_RDONLY | O_DIRECTORY);
+   if ((fd < 0) || write_node(base, 0, fd))
+   {
+      printf("* can't write the tree to %s\n", dir);
+      nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+      return 1;
+   }
+   close(fd);
+   errors += round_trip(base);
+
+   start = now();
+   for (i = 0; i < loops; i++)
+      free(dtoverlay_fs_to_fdt(dir, DTOVERLAY_PADDING(4096)));
+   native = (now() - start) / loops;
+
+   start = now();
+   for (i = 0; i < loops; i++)
+      if (system("true"))
+         break;
+   shell = (now() - start) / loops;
+
+   have_dtc = (system("dtc -v >/dev/null 2>&1") == 0);
+   if (have_dtc)
+   {
+      snprintf(out, sizeof(out), "%s.dtb", dir);
+      snprintf(cmd, sizeof(cmd), "dtc -I fs -O dtb -o '%s' '%s' 1>/dev/null 2>&1", out, dir);
+      start = now();
+      for (i = 0; i < loops; i++)
+      {
+         if (system(cmd))
+         {
+            printf("* dtc failed\n");
+            errors++;
+            break;
+         }
+         free(read_file(out));
+      }
+      dtc = (now() - start) / loops;
+      remove(out);
+   }
+   nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+   printf("%s: %d nodes, %d bytes\n", base_file, count_nodes(base), fdt_totalsize(base));
+   printf("  dtoverlay_fs_to_fdt   %8.3f ms\n", native * 1e3);
+   if (have_dtc)
+      printf("  dtc -I fs and reload  %8.3f ms  %.1fx\n", dtc * 1e3, dtc / native);
+   else
+      printf("  dtc -I fs and reload        -     (no dtc)\n");
+   printf("  sh -c true alone      %8.3f ms  %.1fx\n", shell * 1e3, shell / native);
+   errors += check_large(base);
+   free(base);
+   printf("%s\n", errors ? "FAILED" : "device tree filesystem checks passed");
+   return errors ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * libfdt node index benchmark
+ *
+ * grows a base DTB to about 100 kB and applies the bundled overlays and a
+ * generated overlay with many fragments the way dtmerge does: phandles are
+ * renumbered, __local_fixups__ and __fixups__ resolved, the fragments merged
+ * into their targets and the overlay symbols added to the base. Every overlay
+ * is applied with tree walks, with the node index and with an edit
+ * transaction that writes the merged tree once; the merged trees have to be
+ * the same. Time, lookups done by walking, nodes visited and the bytes
+ * memmove()d by fdt_rw are shown
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <stdarg.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+#include "overlay_apply.h"
+
+#define BASE_SIZE	(512 * 1024)
+#define OVERLAY_SIZE	(256 * 1024)
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-b <base dtb>] [-s <kB>] [-f <fragments>] [overlay dtbo ...]\n", prg);
+   fprintf(stderr, "         -n <loops>          applications per overlay - default 50\n");
+   fprintf(stderr, "         -b <base dtb>       default ../../sunxi-can/lcd/sun7i-a20-bananapi.dtb\n");
+   fprintf(stderr, "         -s <kB>             grow the base to this size - default 100\n");
+   fprintf(stderr, "         -f <fragments>      fragments of the generated overlay - default 200\n");
+   fprintf(stderr, "         overlay dtbo        default ../../mcp25xxfd/overlays/mcp2517fd-can[01].dtbo\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_file(const char *name, int size)
+{
+   void *data;
+   FILE *f;
+   int len;
+
+   f = fopen(name, "rb");
+   if (!f)
+   {
+      perror(name);
+      return NULL;
+   }
+   data = malloc(size);
+   len = fread(data, 1, size, f);
+   fclose(f);
+   if ((len <= 0) || fdt_open_into(data, data, size))
+   {
+      printf("* '%s' is no DTB\n", name);
+      free(data);
+      return NULL;
+   }
+   return data;
+}
+
+/* fragments targeting the filler nodes, each adding a node that refers to itself */
+static void *make_overlay(int fragments, int fillers)
+{
+   void *fdt = malloc(OVERLAY_SIZE);
+   char name[32], path[MAX_PATH];
+   int i, frag, ovl, node, fixups;
+
+   fdt_create_empty_tree(fdt, OVERLAY_SIZE);
+   fdt_setprop_string(fdt, 0, "compatible", "bench,overlay");
+   for (i = 0; i < fragments; i++)
+   {
+      snprintf(name, sizeof(name), "fragment@%d", i);
+      frag = fdt_add_subnode(fdt, 0, name);
+      fdt_setprop_u32(fdt, frag, "target", 0xffffffff);
+      ovl = fdt_add_subnode(fdt, frag, "__overlay__");
+      fdt_setprop_string(fdt, ovl, "status", "okay");
+      snprintf(name, sizeof(name), "child@%d", i);
+      node = add_node(fdt, ovl, name, i + 1);
+      fdt_setprop_string(fdt, node, "compatible", "bench,child");
+      fdt_setprop_u32(fdt, node, "self", i + 1);
+   }
+
+   fixups = fdt_add_subnode(fdt, 0, "__fixups__");
+   for (i = 0; i < fragments; i++)
+   {
+      snprintf(name, sizeof(name), "node%d", (i * 7) % fillers);
+      snprintf(path, sizeof(path), "/fragment@%d:target:0", i);
+      fdt_appendprop(fdt, fixups, name, path, strlen(path) + 1);
+   }
+
+   fdt_add_subnode(fdt, 0, "__local_fixups__");
+   fdt_add_subnode(fdt, 0, "__symbols__");
+   for (i = 0; i < fragments; i++)
+   {
+      snprintf(name, sizeof(name), "fragment@%d", i);
+      node = fdt_add_subnode(fdt, fdt_path_offset(fdt, "/__local_fixups__"), name);
+      node = fdt_add_subnode(fdt, node, "__overlay__");
+      snprintf(name, sizeof(name), "child@%d", i);
+      node = fdt_add_subnode(fdt, node, name);
+      fdt_setprop_u32(fdt, node, "self", 0);
+
+      snprintf(path, sizeof(path), "/fragment@%d/__overlay__/child@%d", i, i);
+      snprintf(name, sizeof(name), "bench_child%d", i);
+      fdt_setprop_string(fdt, fdt_path_offset(fdt, "/__symbols__"), name, path);
+   }
+   return fdt;
+}
+
+/* a chain of added nodes deeper than the index takes, paths fall back to walks */
+static int check_deep(const void *base)
+{
+   void *fdt = malloc(BASE_SIZE);
+   char path[MAX_PATH], expected[MAX_PATH] = "";
+   int node = 0, i, errors = 0;
+
+   fdt_open_into(base, fdt, BASE_SIZE);
+   fdt_index_enable(fdt);
+   fdt_path_offset(fdt, "/");
+   for (i = 0; (i < 100) && (node >= 0); i++)
+   {
+      node = fdt_add_subnode(fdt, node, "d");
+      strcat(expected, "/d");
+   }
+   if ((node < 0) || fdt_get_path(fdt, node, path, sizeof(path)) || strcmp(path, expected) ||
+       (fdt_path_offset(fdt, expected) != node))
+   {
+      printf("path of a node %d deep wrong\n", i);
+      errors++;
+   }
+   fdt_index_disable(fdt);
+   free(fdt);
+   return errors;
+}
+
+/* deletes, renames and nops a few nodes, then compares every lookup with a walk */
+static int check_index(const void *merged)
+{
+   void *fdt = malloc(BASE_SIZE);
+   char path[MAX_PATH];
+   int *found, count = 0, node, i, errors = 0;
+
+   fdt_open_into(merged, fdt, BASE_SIZE);
+   fdt_index_enable(fdt);
+   fdt_del_node(fdt, fdt_path_offset(fdt, "/bench/node@2000"));
+   fdt_set_name(fdt, fdt_path_offset(fdt, "/bench/node@3000"), "renamed@3000");
+   fdt_nop_node(fdt, fdt_path_offset(fdt, "/bench/node@4000"));
+   fdt_delprop(fdt, fdt_path_offset(fdt, "/bench/node@5000"), "phandle");
+   fdt_setprop_u32(fdt, fdt_path_offset(fdt, "/bench/node@6000"), "phandle", 0x7fff0000);
+
+   for (node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL))
+      count++;
+   found = malloc(4 * count * sizeof(int));
+   for (i = 0, node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL), i++)
+   {
+      found[4 * i] = fdt_get_path(fdt, node, path, sizeof(path));
+      found[4 * i + 1] = found[4 * i] ? found[4 * i] : fdt_path_offset(fdt, path);
+      found[4 * i + 2] = fdt_parent_offset(fdt, node);
+      found[4 * i + 3] = fdt_node_offset_by_phandle(fdt, fdt_get_phandle(fdt, node));
+   }
+   fdt_index_disable(fdt);
+   for (i = 0, node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL), i++)
+   {
+      if ((found[4 * i] != fdt_get_path(fdt, node, path, sizeof(path))) ||
+          (found[4 * i + 1] != (found[4 * i] ? found[4 * i] : fdt_path_offset(fdt, path))) ||
+          (found[4 * i + 2] != fdt_parent_offset(fdt, node)) ||
+          (found[4 * i + 3] != fdt_node_offset_by_phandle(fdt, fdt_get_phandle(fdt, node))))
+      {
+         printf("index and walk differ at %s\n", path);
+         errors++;
+      }
+   }
+   if ((fdt_path_offset(fdt, "/bench/renamed") < 0) || (fdt_node_offset_by_phandle(fdt, 0x7fff0000) < 0))
+      errors++;
+   free(found);
+   free(fdt);
+   return errors;
+}
+
+enum mode { WALK, INDEX, EDIT };
+
+struct result {
+   double time;
+   struct fdt_index_stats stats;
+   unsigned long moved;
+   void *merged;
+};
+
+static int run(const void *base, const void *overlay, int loops, enum mode mode, struct result *r)
+{
+   void *b = malloc(BASE_SIZE), *o = malloc(OVERLAY_SIZE);
+   DTBLOB_T base_dtb, overlay_dtb;
+   double start, t = 0;
+   int i, err = 0;
+
+   memset(&fdt_index_stats, 0, sizeof(fdt_index_stats));
+   fdt_bytes_moved = 0;
+   memset(&base_dtb, 0, sizeof(base_dtb));
+   memset(&overlay_dtb, 0, sizeof(overlay_dtb));
+   overlay_dtb.fdt = o;
+   for (i = 0; (i < loops) && !err; i++)
+   {
+      if (base_dtb.fdt_is_malloced)
+         free(base_dtb.fdt);
+      base_dtb.fdt = b;
+      base_dtb.fdt_is_malloced = 0;
+      fdt_open_into(base, b, BASE_SIZE);
+      fdt_open_into(overlay, o, OVERLAY_SIZE);
+      start = now();
+      if (mode != WALK)
+      {
+         fdt_index_enable(base_dtb.fdt);
+         fdt_index_enable(o);
+      }
+      err = apply(&base_dtb, &overlay_dtb, mode == EDIT);
+      fdt_index_disable(base_dtb.fdt);
+      fdt_index_disable(o);
+      t += now() - start;
+   }
+   /* the committed tree is already packed */
+   fdt_pack(base_dtb.fdt);
+   if (base_dtb.fdt_is_malloced)
+   {
+      memcpy(b, base_dtb.fdt, fdt_totalsize(base_dtb.fdt));
+      free(base_dtb.fdt);
+   }
+   r->time = t / loops;
+   r->stats = fdt_index_stats;
+   r->moved = fdt_bytes_moved;
+   r->merged = b;
+   free(o);
+   return err;
+}
+
+static int same(const char *name, const char *what, const void *a, const void *b)
+{
+   if ((fdt_totalsize(a) == fdt_totalsize(b)) && !memcmp(a, b, fdt_totalsize(a)))
+      return 0;
+   printf("%s: merged trees of %s differ\n", name, what);
+   return 1;
+}
+
+/* fdt_rw leaves the padding behind property values as it finds it, the
+   edit writes zeros: tags, names and values have to be the same */
+static int same_tags(const char *name, const char *what, const void *a, const void *b)
+{
+   const char *name_a, *name_b;
+   const void *val_a, *val_b;
+   int off_a = 0, off_b = 0, next_a, next_b, len_a, len_b;
+   uint32_t tag;
+
+   if (fdt_totalsize(a) != fdt_totalsize(b))
+      return same(name, what, a, b);
+   do
+   {
+      tag = fdt_next_tag(a, off_a, &next_a);
+      if (tag != fdt_next_tag(b, off_b, &next_b))
+         return same(name, what, a, b);
+      if (tag == FDT_BEGIN_NODE)
+      {
+         name_a = fdt_get_name(a, off_a, &len_a);
+         name_b = fdt_get_name(b, off_b, &len_b);
+         if ((len_a != len_b) || memcmp(name_a, name_b, len_a))
+            return same(name, what, a, b);
+      }
+      else if (tag == FDT_PROP)
+      {
+         val_a = fdt_getprop_by_offset(a, off_a, &name_a, &len_a);
+         val_b = fdt_getprop_by_offset(b, off_b, &name_b, &len_b);
+         if (strcmp(name_a, name_b) || (len_a != len_b) || memcmp(val_a, val_b, len_a))
+            return same(name, what, a, b);
+      }
+      off_a = next_a;
+      off_b = next_b;
+   } while (tag != FDT_END);
+   return 0;
+}
+
+/* the same deletes, replacements and additions done by fdt_rw and by an edit */
+static int check_edit(const void *merged)
+{
+   void *fdt = malloc(BASE_SIZE), *out = malloc(BASE_SIZE);
+   struct fdt_edit *e = fdt_edit_begin(merged);
+   const char *compatible = "bench,filler-with-a-longer-name";
+   int node, errors = 0;
+
+   fdt_open_into(merged, fdt, BASE_SIZE);
+   fdt_delprop(fdt, fdt_path_offset(fdt, "/bench/node@5000"), "status");
+   fdt_del_node(fdt, fdt_path_offset(fdt, "/bench/node@2000"));
+   fdt_setprop_string(fdt, fdt_path_offset(fdt, "/bench/node@3000"), "compatible", compatible);
+   node = fdt_add_subnode(fdt, fdt_path_offset(fdt, "/bench/node@3000"), "edit@1");
+   fdt_setprop_u32(fdt, node, "bench-edit", 1);
+   fdt_pack(fdt);
+
+   fdt_edit_delprop(e, fdt_path_offset(merged, "/bench/node@5000"), "status");
+   fdt_edit_del_node(e, fdt_path_offset(merged, "/bench/node@2000"));
+   fdt_edit_setprop(e, fdt_path_offset(merged, "/bench/node@3000"), "compatible",
+                    compatible, strlen(compatible) + 1);
+   node = fdt_edit_add_subnode(e, fdt_path_offset(merged, "/bench/node@3000"), "edit@1");
+   fdt_edit_setprop(e, node, "bench-edit", "\0\0\0\1", 4);
+   if (fdt_edit_finish(e, out, BASE_SIZE))
+      errors++;
+   else
+      errors += same_tags("edit", "fdt_rw and edit", fdt, out);
+   fdt_edit_free(e);
+   free(out);
+   free(fdt);
+   return errors;
+}
+
+static int bench(const char *name, const void *base, const void *overlay, int loops)
+{
+   struct result walk, index, edit;
+   int errors = 0;
+
+   if (run(base, overlay, loops, WALK, &walk) || run(base, overlay, loops, INDEX, &index) ||
+       run(base, overlay, loops, EDIT, &edit))
+   {
+      printf("%s: applying the overlay failed\n", name);
+      errors++;
+   }
+   else
+   {
+      errors += same(name, "walk and index", walk.merged, index.merged);
+      errors += same_tags(name, "fdt_rw and edit", walk.merged, edit.merged);
+      if (!errors)
+         errors += check_index(index.merged) + check_edit(edit.merged);
+   }
+
+   printf("%-20s %6d bytes  walk  %8.3f ms  %7lu walks  %9lu nodes visited  %9lu bytes moved\n", name,
+          fdt_off_dt_strings(overlay) + fdt_size_dt_strings(overlay), walk.time * 1e3,
+          walk.stats.walks / loops, walk.stats.steps / loops, walk.moved / loops);
+   printf("%-20s %12s  index %8.3f ms  %7lu walks  %9lu nodes visited  %9lu bytes moved  %5lu lookups  %5lu patches  %.1fx\n",
+          "", "", index.time * 1e3, index.stats.walks / loops, index.stats.steps / loops,
+          index.moved / loops, index.stats.lookups / loops, index.stats.patches / loops, walk.time / index.time);
+   printf("%-20s %12s  edit  %8.3f ms  %7lu walks  %9lu nodes visited  %9lu bytes moved  %5lu lookups  %5lu patches  %.1fx\n",
+          "", "", edit.time * 1e3, edit.stats.walks / loops, edit.stats.steps / loops,
+          edit.moved / loops, edit.stats.lookups / loops, edit.stats.patches / loops, walk.time / edit.time);
+   free(walk.merged);
+   free(index.merged);
+   free(edit.merged);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   const char *base_file = "../../sunxi-can/lcd/sun7i-a20-bananapi.dtb";
+   const char *default_overlays[] = { "../../mcp25xxfd/overlays/mcp2517fd-can0.dtbo",
+                                      "../../mcp25xxfd/overlays/mcp2517fd-can1.dtbo" };
+   const char **overlay_files = default_overlays;
+   void *base, *overlays[16];
+   int opt, i, n = 2, loops = 50, kbytes = 100, fragments = 200, fillers, errors = 0;
+
+   while ((opt = getopt(argc, argv, "n:b:s:f:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'b':
+         base_file = optarg;
+         break;
+      case 's':
+         kbytes = strtoul(optarg, NULL, 10);
+         break;
+      case 'f':
+         fragments = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if (optind < argc)
+   {
+      overlay_files = (const char **)argv + optind;
+      n = argc - optind;
+   }
+   if ((n > 15) || (loops < 1))
+      usage(argv[0]);
+
+   base = read_file(base_file, BASE_SIZE);
+   if (!base)
+      exit(1);
+   for (i = 0; i < n; i++)
+   {
+      overlays[i] = read_file(overlay_files[i], OVERLAY_SIZE);
+      if (!overlays[i])
+         exit(1);
+   }
+   fillers = make_base(base, overlays, n, kbytes);
+   if (fillers <= 0)
+   {
+      printf("* growing the base failed\n");
+      exit(1);
+   }
+   overlays[n] = make_overlay(fragments, fillers);
+   printf("base %s: %d bytes, %d nodes added, %d loops\n", base_file,
+          fdt_off_dt_strings(base) + fdt_size_dt_strings(base), fillers, loops);
+
+   for (i = 0; i < n; i++)
+   {
+      const char *name = strrchr(overlay_files[i], '/');
+      errors += bench(name ? name + 1 : overlay_files[i], base, overlays[i], loops);
+   }
+   errors += bench("generated", base, overlays[n], loops);
+   errors += check_deep(base);
+
+   for (i = 0; i <= n; i++)
+      free(overlays[i]);
+   free(base);
+   printf("%s\n", errors ? "FAILED" : "checks passed");
+   return errors ? 1 : 0;
+}
@@ -0,0 +1,447 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * overlay help index benchmark
+ *
+ * writes a README in the format of /boot/overlays/README and asks for the
+ * help of every overlay, and for some of its parameters, the way
+ * "dtoverlay -h" does: once with the former fgets() scan, kept here as
+ * the reference, and once with the help index. The text has to be the
+ * same; the time per call is shown for the first call, which builds the
+ * index, and for the following ones, which map it
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../utils.h"
+
+#define OVERLAY_HELP_INDENT 8
+#define TEXT_MAX (64 * 1024)
+
+static void usage(char *prg)
+{
+   fprintf(stderr, "\nUsage: %s [-n <loops>] [-o <overlays>]\n", prg);
+   fprintf(stderr, "         -n <loops>          help calls per overlay - default 5\n");
+   fprintf(stderr, "         -o <overlays>       overlays in the README - default 250\n\n");
+   exit(1);
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the former implementation, reading the README with fgets() */
+
+typedef struct ref_state_struct
+{
+   FILE *fp;
+   long rec_pos;
+   int line_len;
+   int line_pos;
+   int blank_count;
+   int end_of_field;
+   char line_buf[82];
+} REF_STATE_T;
+
+static int ref_get_line(REF_STATE_T *state)
+{
+   int line_len;
+
+   if (state->line_pos >= 0)
+      return state->line_len;
+
+get_next_line:
+   state->line_buf[sizeof(state->line_buf) - 1] = ' ';
+   line_len = -1;
+   if (fgets(state->line_buf, sizeof(state->line_buf), state->fp))
+   {
+      line_len = strlen(state->line_buf);
+      if (line_len && (state->line_buf[line_len - 1] == '\n'))
+      {
+         line_len--;
+         state->line_buf[line_len] = '\0';
+      }
+   }
+
+   if (state->rec_pos >= 0)
+   {
+      if (line_len == 0)
+      {
+         state->blank_count++;
+         if (state->blank_count >= 2)
+            return -1;
+         state->line_pos = 0;
+         goto get_next_line;
+      }
+      else if (state->blank_count)
+      {
+         state->blank_count = 0;
+         return 0;
+      }
+   }
+
+   state->line_len = line_len;
+   state->line_pos = (line_len >= 0) ? 0 : -1;
+   return line_len;
+}
+
+static void *ref_open(const char *helpfile)
+{
+   REF_STATE_T *state = NULL;
+   FILE *fp = fopen(helpfile, "r");
+
+   if (fp)
+   {
+      state = calloc(1, sizeof(REF_STATE_T));
+      state->fp = fp;
+      state->line_pos = -1;
+      state->rec_pos = -1;
+   }
+   return state;
+}
+
+static void ref_close(void *s)
+{
+   REF_STATE_T *state = s;
+
+   fclose(state->fp);
+   free(state);
+}
+
+static int ref_find_field(void *s, const char *field)
+{
+   REF_STATE_T *state = s;
+   int field_len = strlen(field);
+   int found = 0;
+
+   if (state->rec_pos >= 0)
+      fseek(state->fp, state->rec_pos, SEEK_SET);
+
+   while (!found)
+   {
+      int line_len = ref_get_line(state);
+      if (line_len < 0)
+         break;
+      if ((line_len >= (field_len + 1)) &&
+          (state->line_buf[field_len] == ':') &&
+          (memcmp(state->line_buf, field, field_len) == 0))
+      {
+         if (line_len > OVERLAY_HELP_INDENT)
+            state->line_pos = OVERLAY_HELP_INDENT;
+         else
+            state->line_pos = -1;
+         state->end_of_field = 0;
+         found = 1;
+      }
+      else
+      {
+         state->line_pos = -1;
+      }
+   }
+   return found;
+}
+
+static const char *ref_field_data(void *s)
+{
+   REF_STATE_T *state = s;
+   int line_len, pos;
+
+   if (state->end_of_field)
+      return NULL;
+
+   line_len = state->line_len;
+   if ((state->line_pos < 0) || (state->line_pos >= line_len))
+   {
+      line_len = ref_get_line(state);
+      if ((line_len < 0) || (state->line_buf[0] != ' '))
+      {
+         state->end_of_field = 1;
+         return NULL;
+      }
+      if (line_len == 0)
+         return "";
+   }
+
+   pos = line_len;
+   if (pos > OVERLAY_HELP_INDENT)
+      pos = OVERLAY_HELP_INDENT;
+   state->line_pos = -1;
+   return &state->line_buf[pos];
+}
+
+static int ref_find(void *s, const char *name)
+{
+   REF_STATE_T *state = s;
+
+   state->line_pos = -1;
+   state->rec_pos = -1;
+   state->blank_count = 0;
+   fseek(state->fp, 0, SEEK_SET);
+
+   while (ref_find_field(state, "Name"))
+   {
+      const char *overlay = ref_field_data(state);
+      if (overlay && (strcmp(overlay, name) == 0))
+      {
+         state->rec_pos = (long)ftell(state->fp);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/* both implementations behind the same calls */
+
+typedef struct help_ops_struct
+{
+   void *(*open)(const char *helpfile);
+   void (*close)(void *state);
+   int (*find)(void *state, const char *name);
+   int (*find_field)(void *state, const char *field);
+   const char *(*field_data)(void *state);
+} HELP_OPS_T;
+
+static const HELP_OPS_T ref_ops = {
+   ref_open, ref_close, ref_find, ref_find_field, ref_field_data
+};
+
+static const HELP_OPS_T index_ops = {
+   (void *(*)(const char *))overlay_help_open,
+   (void (*)(void *))overlay_help_close,
+   (int (*)(void *, const char *))overlay_help_find,
+   (int (*)(void *, const char *))overlay_help_find_field,
+   (const char *(*)(void *))overlay_help_field_data
+};
+
+static void append(char *text, const char *fmt, ...)
+{
+   size_t len = strlen(text);
+   va_list ap;
+
+   va_start(ap, fmt);
+   vsnprintf(text + len, TEXT_MAX - len, fmt, ap);
+   va_end(ap);
+}
+
+static void field(const HELP_OPS_T *ops, void *state, const char *name, char *text)
+{
+   const char *line;
+
+   if (!ops->find_field(state, name))
+      return;
+   append(text, "%s:\n", name);
+   while ((line = ops->field_data(state)) != NULL)
+      append(text, "%s\n", line);
+}
+
+/* what overlay_help() in dtoverlay_main.c shows */
+static int help(const HELP_OPS_T *ops, const char *readme, const char *overlay,
+                const char *param, char *text)
+{
+   const char *line;
+   void *state;
+   int in_param = 0;
+
+   text[0] = '\0';
+   state = ops->open(readme);
+   if (!state)
+      return -1;
+   if (!ops->find(state, overlay))
+   {
+      ops->close(state);
+      return 0;
+   }
+   if (param)
+   {
+      if (ops->find_field(state, "Params"))
+      {
+         while ((line = ops->field_data(state)) != NULL)
+         {
+            if (line[0] == '\0')
+               continue;
+            if (line[0] != ' ')
+               in_param = (strcspn(line, " ") == strlen(param)) &&
+                          !memcmp(line, param, strlen(param));
+            if (in_param)
+               append(text, "%s\n", line);
+         }
+      }
+   }
+   else
+   {
+      append(text, "Name:   %s\n", overlay);
+      field(ops, state, "Info", text);
+      field(ops, state, "Load", text);
+      field(ops, state, "Params", text);
+   }
+   ops->close(state);
+   return 1;
+}
+
+static void write_record(FILE *f, int i)
+{
+   int p;
+
+   fprintf(f, "Name:   overlay%03d\n", i);
+   fprintf(f, "Info:   Overlay number %d for a device on the I2C or SPI bus, with\n", i);
+   fprintf(f, "        a second line of information\n\n");
+   fprintf(f, "Load:   dtoverlay=overlay%03d,<param>=<val>\n", i);
+   fprintf(f, "Params: ");
+   for (p = 0; p < 8; p++)
+   {
+      fprintf(f, "%s%-24s Parameter %d of overlay %d, which sets something\n",
+              p ? "        " : "", p ? "param" : "addr", p, i);
+      fprintf(f, "                                (default %d)\n", p);
+      if (p == 3)
+         fprintf(f, "\n");
+   }
+   fprintf(f, "\n\n");
+}
+
+static int write_readme(const char *name, int overlays)
+{
+   FILE *f = fopen(name, "w");
+   int i;
+
+   if (!f)
+      return -1;
+   fprintf(f, "Introduction\n============\n\nThis directory contains the overlays.\n\n\n");
+   fprintf(f, "Name:   <The base DTB>\n");
+   fprintf(f, "Info:   Configures the base hardware\n");
+   fprintf(f, "Load:   <loaded automatically>\n");
+   fprintf(f, "Params: audio                   Set to \"on\" to enable the audio\n\n\n");
+   for (i = overlays - 1; i >= 0; i--)
+      write_record(f, i);
+   fclose(f);
+   return 0;
+}
+
+static int compare(const char *readme, int overlays, int loops, double *ref_time, double *index_time)
+{
+   char name[32], *ref_text = malloc(TEXT_MAX), *index_text = malloc(TEXT_MAX);
+   const char *param;
+   double start;
+   int i, l, errors = 0;
+
+   *ref_time = *index_time = 0;
+   for (i = -1; i <= overlays; i++)
+   {
+      if (i < 0)
+         strcpy(name, "<The base DTB>");
+      else
+         snprintf(name, sizeof(name), "overlay%03d", i);
+      for (l = 0; l < loops; l++)
+      {
+         param = (l & 1) ? "param" : NULL;
+         start = now();
+         help(&ref_ops, readme, name, param, ref_text);
+         *ref_time += now() - start;
+         start = now();
+         help(&index_ops, readme, name, param, index_text);
+         *index_time += now() - start;
+         /* overlay<overlays> is one too many, it has no help */
+         if ((!ref_text[0] && (i < overlays) && (!param || (i >= 0))) ||
+             strcmp(ref_text, index_text))
+         {
+            if (errors++ < 3)
+               printf("help for %s%s%s differs:\n%s---\n%s", name, param ? " " : "",
+                      param ? param : "", ref_text, index_text);
+         }
+      }
+   }
+   *ref_time /= (overlays + 2) * loops;
+   *index_time /= (overlays + 2) * loops;
+   free(ref_text);
+   free(index_text);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   char readme[] = "/tmp/help_index_bench.XXXXXX", index[64], text[256];
+   double start, build, ref_time, index_time;
+   struct stat st, index_st;
+   int opt, fd, loops = 5, overlays = 250, errors = 0;
+   FILE *f;
+
+   while ((opt = getopt(argc, argv, "n:o:h?")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         loops = strtoul(optarg, NULL, 10);
+         break;
+      case 'o':
+         overlays = strtoul(optarg, NULL, 10);
+         break;
+      default:
+         usage(argv[0]);
+      }
+   }
+   if ((loops < 1) || (overlays < 1) || (overlays > 999))
+      usage(argv[0]);
+
+   fd = mkstemp(readme);
+   if (fd < 0)
+   {
+      perror(readme);
+      return 1;
+   }
+   close(fd);
+   snprintf(index, sizeof(index), "%s.idx", readme);
+   write_readme(readme, overlays);
+   stat(readme, &st);
+
+   start = now();
+   overlay_help_close(overlay_help_open(readme));
+   build = now() - start;
+   if (stat(index, &index_st) != 0)
+   {
+      printf("no index written\n");
+      errors++;
+   }
+
+   errors += compare(readme, overlays, loops, &ref_time, &index_time);
+   printf("README of %d overlays, %ld bytes, index %ld bytes\n", overlays,
+          (long)st.st_size, (long)index_st.st_size);
+   printf("  fgets scan       %8.3f ms per help call\n", ref_time * 1e3);
+   printf("  index, building  %8.3f ms\n", build * 1e3);
+   printf("  index, mapped    %8.3f ms per help call  %.1fx\n", index_time * 1e3, ref_time / index_time);
+
+   /* a changed README is noticed by its size and mtime */
+   f = fopen(readme, "a");
+   fprintf(f, "Name:   added\nInfo:   Appended later\n\n\n");
+   fclose(f);
+   if ((help(&index_ops, readme, "added", NULL, text) != 1) || !strstr(text, "Appended later"))
+   {
+      printf("changed README not noticed\n");
+      errors++;
+   }
+   if (help(&index_ops, readme, "missing", NULL, text) != 0)
+   {
+      printf("missing overlay found\n");
+      errors++;
+   }
+
+   unlink(index);
+   unlink(readme);
+   printf("%s\n", errors ? "FAILED" : "help index checks passed");
+   return errors ? 1 : 0;
+}
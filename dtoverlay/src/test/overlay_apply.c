@@ -0,0 +1,356 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * applies an overlay to a base DTB for the benchmarks the way dtmerge does:
+ * phandles are renumbered, __local_fixups__ and __fixups__ resolved, the
+ * fragments merged into their targets and the overlay symbols added to the
+ * base, with fdt_rw or with an edit transaction
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "../libfdt.h"
+#include "../dtoverlay.h"
+#include "overlay_apply.h"
+
+int add_node(void *fdt, int parent, const char *name, uint32_t phandle)
+{
+   int node = fdt_add_subnode(fdt, parent, name);
+
+   if ((node >= 0) && phandle)
+      fdt_setprop_u32(fdt, node, "phandle", phandle);
+   return node;
+}
+
+uint32_t max_phandle(const void *fdt)
+{
+   uint32_t phandle, max = 0;
+   int node;
+
+   for (node = fdt_next_node(fdt, -1, NULL); node >= 0; node = fdt_next_node(fdt, node, NULL))
+   {
+      phandle = fdt_get_phandle(fdt, node);
+      if (phandle > max)
+         max = phandle;
+   }
+   return max;
+}
+
+/* the symbols the overlays ask for and filler nodes up to kbytes */
+int make_base(void *fdt, void **overlays, int n, int kbytes)
+{
+   uint32_t phandle = max_phandle(fdt);
+   char name[32], path[MAX_PATH];
+   const char *sym;
+   int i, bench, node, symbols, prop, reg[2];
+
+   bench = fdt_add_subnode(fdt, 0, "bench");
+   symbols = fdt_path_offset(fdt, "/__symbols__");
+   if (symbols < 0)
+      symbols = fdt_add_subnode(fdt, 0, "__symbols__");
+   if ((bench < 0) || (symbols < 0))
+      return -1;
+
+   for (i = 0; i < n; i++)
+   {
+      node = fdt_path_offset(overlays[i], "/__fixups__");
+      for (prop = fdt_first_property_offset(overlays[i], node); prop >= 0;
+           prop = fdt_next_property_offset(overlays[i], prop))
+      {
+         fdt_getprop_by_offset(overlays[i], prop, &sym, NULL);
+         if (fdt_getprop(fdt, fdt_path_offset(fdt, "/__symbols__"), sym, NULL))
+            continue;
+         if (add_node(fdt, fdt_path_offset(fdt, "/bench"), sym, ++phandle) < 0)
+            return -1;
+         snprintf(path, sizeof(path), "/bench/%s", sym);
+         fdt_setprop_string(fdt, fdt_path_offset(fdt, "/__symbols__"), sym, path);
+      }
+   }
+
+   for (i = 0; fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt) < kbytes * 1024; i++)
+   {
+      snprintf(name, sizeof(name), "node@%x", 0x1000 * i);
+      node = add_node(fdt, fdt_path_offset(fdt, "/bench"), name, ++phandle);
+      if (node < 0)
+         return -1;
+      reg[0] = cpu_to_fdt32(0x1000 * i);
+      reg[1] = cpu_to_fdt32(0x400);
+      fdt_setprop_string(fdt, node, "compatible", "bench,filler");
+      fdt_setprop(fdt, node, "reg", reg, sizeof(reg));
+      fdt_setprop_string(fdt, node, "status", "disabled");
+      fdt_setprop_u32(fdt, node, "interrupts", i);
+      snprintf(path, sizeof(path), "/bench/%s", name);
+      snprintf(name, sizeof(name), "node%d", i);
+      fdt_setprop_string(fdt, fdt_path_offset(fdt, "/__symbols__"), name, path);
+   }
+   return i;
+}
+
+static int renumber(void *overlay, uint32_t offset)
+{
+   uint32_t phandle;
+   int node;
+
+   for (node = fdt_next_node(overlay, -1, NULL); node >= 0; node = fdt_next_node(overlay, node, NULL))
+   {
+      phandle = fdt_get_phandle(overlay, node);
+      if (!phandle)
+         continue;
+      if (fdt_getprop(overlay, node, "phandle", NULL))
+         fdt_setprop_inplace_u32(overlay, node, "phandle", phandle + offset);
+      if (fdt_getprop(overlay, node, "linux,phandle", NULL))
+         fdt_setprop_inplace_u32(overlay, node, "linux,phandle", phandle + offset);
+   }
+   return 0;
+}
+
+/* path is the overlay path of the __local_fixups__ node at fixup */
+static int local_fixups(void *overlay, int fixup, char *path, int len, uint32_t offset)
+{
+   const fdt32_t *cells;
+   const char *name;
+   fdt32_t *value;
+   int prop, node, sub, count, i, namelen, err;
+
+   node = fdt_path_offset(overlay, len ? path : "/");
+   if (node < 0)
+      return node;
+   for (prop = fdt_first_property_offset(overlay, fixup); prop >= 0;
+        prop = fdt_next_property_offset(overlay, prop))
+   {
+      cells = fdt_getprop_by_offset(overlay, prop, &name, &count);
+      value = fdt_getprop_w(overlay, node, name, NULL);
+      if (!value)
+         return -FDT_ERR_NOTFOUND;
+      for (i = 0; i < count / 4; i++)
+      {
+         fdt32_t *cell = (fdt32_t *)((char *)value + fdt32_to_cpu(cells[i]));
+         *cell = cpu_to_fdt32(fdt32_to_cpu(*cell) + offset);
+      }
+   }
+   fdt_for_each_subnode(sub, overlay, fixup)
+   {
+      name = fdt_get_name(overlay, sub, &namelen);
+      if (len + namelen + 2 > MAX_PATH)
+         return -FDT_ERR_NOSPACE;
+      path[len] = '/';
+      memcpy(path + len + 1, name, namelen + 1);
+      err = local_fixups(overlay, sub, path, len + 1 + namelen, offset);
+      path[len] = '\0';
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+static int fixups(void *base, void *overlay, uint32_t *max)
+{
+   const char *sym, *list, *end, *target, *colon;
+   char path[MAX_PATH];
+   uint32_t phandle;
+   fdt32_t *value;
+   int prop, node, len, off;
+
+   for (prop = fdt_first_property_offset(overlay, fdt_path_offset(overlay, "/__fixups__")); prop >= 0;
+        prop = fdt_next_property_offset(overlay, prop))
+   {
+      list = fdt_getprop_by_offset(overlay, prop, &sym, &len);
+      target = fdt_getprop(base, fdt_path_offset(base, "/__symbols__"), sym, NULL);
+      if (!target)
+      {
+         printf("* no symbol '%s' in the base\n", sym);
+         return -FDT_ERR_NOTFOUND;
+      }
+      node = fdt_path_offset(base, target);
+      if (node < 0)
+         return node;
+      phandle = fdt_get_phandle(base, node);
+      if (!phandle)
+      {
+         phandle = ++(*max);
+         fdt_setprop_u32(base, node, "phandle", phandle);
+      }
+
+      for (end = list + len; list < end; list += strlen(list) + 1)
+      {
+         colon = strchr(list, ':');
+         if (!colon || (colon - list >= MAX_PATH))
+            return -FDT_ERR_BADVALUE;
+         memcpy(path, list, colon - list);
+         path[colon - list] = '\0';
+         node = fdt_path_offset(overlay, path);
+         target = colon + 1;
+         colon = strchr(target, ':');
+         if ((node < 0) || !colon)
+            return -FDT_ERR_BADVALUE;
+         off = atoi(colon + 1);
+         value = fdt_getprop_namelen_w(overlay, node, target, colon - target, &len);
+         if (!value || (off + 4 > len))
+            return -FDT_ERR_BADVALUE;
+         *(fdt32_t *)((char *)value + off) = cpu_to_fdt32(phandle);
+      }
+   }
+   return 0;
+}
+
+static int fragment_target(const void *base, const void *overlay, int frag)
+{
+   const fdt32_t *phandle;
+   const char *path;
+
+   phandle = fdt_getprop(overlay, frag, "target", NULL);
+   if (phandle)
+      return fdt_node_offset_by_phandle(base, fdt32_to_cpu(*phandle));
+   path = fdt_getprop(overlay, frag, "target-path", NULL);
+   if (path)
+      return fdt_path_offset(base, path);
+   return -FDT_ERR_NOTFOUND;
+}
+
+/* the rules of dtoverlay_merge_overlay, done with fdt_rw */
+static int merge_node(void *base, int target, const void *overlay, int node, int depth)
+{
+   const char *name;
+   const void *data;
+   char *old;
+   int prop, sub, child, len, oldlen, err;
+
+   for (prop = fdt_first_property_offset(overlay, node); prop >= 0;
+        prop = fdt_next_property_offset(overlay, prop))
+   {
+      data = fdt_getprop_by_offset(overlay, prop, &name, &len);
+      if (!strcmp(name, "name") ||
+          (!depth && (!strcmp(name, "phandle") || !strcmp(name, "linux,phandle"))))
+         continue;
+      old = strcmp(name, "bootargs") ? NULL : fdt_getprop_w(base, target, name, &oldlen);
+      if (old && (oldlen > 0) && *old)
+      {
+         old[oldlen - 1] = ' ';
+         err = fdt_appendprop(base, target, name, data, len);
+      }
+      else
+         err = fdt_setprop(base, target, name, data, len);
+      if (err)
+         return err;
+   }
+   fdt_for_each_subnode(sub, overlay, node)
+   {
+      name = fdt_get_name(overlay, sub, NULL);
+      child = fdt_subnode_offset(base, target, name);
+      if (child == -FDT_ERR_NOTFOUND)
+         child = fdt_add_subnode(base, target, name);
+      if (child < 0)
+         return child;
+      err = merge_node(base, child, overlay, sub, depth + 1);
+      if (err)
+         return err;
+   }
+   return 0;
+}
+
+/* with an edit transaction the tree is written once, when it is committed */
+static int merge(DTBLOB_T *base, DTBLOB_T *overlay, int edit)
+{
+   struct fdt_edit *e = NULL;
+   const char *name, *path, *rest;
+   char merged[MAX_PATH];
+   int frag, target, prop, symbols, len, err = 0;
+
+   if (edit)
+   {
+      e = dtoverlay_edit_begin(base);
+      if (!e)
+         return -FDT_ERR_NOSPACE;
+   }
+
+   if (e)
+      err = dtoverlay_edit_merge_fragments(e, base, overlay);
+   else
+   {
+      fdt_for_each_subnode(frag, overlay->fdt, 0)
+      {
+         target = fragment_target(base->fdt, overlay->fdt, frag);
+         if (target == -FDT_ERR_NOTFOUND)
+            continue;
+         if (target < 0)
+         {
+            err = target;
+            break;
+         }
+         prop = fdt_subnode_offset(overlay->fdt, frag, "__overlay__");
+         err = merge_node(base->fdt, target, overlay->fdt, prop, 0);
+         if (err)
+            break;
+      }
+   }
+
+   /* "/fragment@N/__overlay__/..." becomes the path below the target */
+   symbols = fdt_path_offset(overlay->fdt, "/__symbols__");
+   for (prop = fdt_first_property_offset(overlay->fdt, symbols); (prop >= 0) && !err;
+        prop = fdt_next_property_offset(overlay->fdt, prop))
+   {
+      path = fdt_getprop_by_offset(overlay->fdt, prop, &name, NULL);
+      rest = strstr(path, "/__overlay__");
+      if (!rest)
+         continue;
+      frag = fdt_path_offset_namelen(overlay->fdt, path, rest - path);
+      target = fragment_target(base->fdt, overlay->fdt, frag);
+      if (target < 0)
+         continue;
+      err = fdt_get_path(base->fdt, target, merged, sizeof(merged));
+      if (err)
+         break;
+      rest += strlen("/__overlay__");
+      len = strlen(merged);
+      if (len + strlen(rest) >= sizeof(merged))
+      {
+         err = -FDT_ERR_NOSPACE;
+         break;
+      }
+      strcpy(merged + (len > 1 ? len : 0), rest);
+      symbols = fdt_path_offset(base->fdt, "/__symbols__");
+      if (e)
+         err = fdt_edit_setprop(e, symbols, name, merged, strlen(merged) + 1);
+      else
+         err = fdt_setprop_string(base->fdt, symbols, name, merged);
+   }
+
+   if (!e)
+      return err;
+   if (err)
+   {
+      dtoverlay_edit_abort(e);
+      return err;
+   }
+   return dtoverlay_edit_commit(base, e);
+}
+
+int apply(DTBLOB_T *base, DTBLOB_T *overlay, int edit)
+{
+   char path[MAX_PATH] = "";
+   uint32_t max = max_phandle(base->fdt), last;
+   int fixup, err;
+
+   err = renumber(overlay->fdt, max);
+   fixup = fdt_path_offset(overlay->fdt, "/__local_fixups__");
+   if (!err && (fixup >= 0))
+      err = local_fixups(overlay->fdt, fixup, path, 0, max);
+   last = max_phandle(overlay->fdt);
+   if (last > max)
+      max = last;
+   if (!err)
+      err = fixups(base->fdt, overlay->fdt, &max);
+   if (!err)
+      err = merge(base, overlay, edit);
+   return err;
+}
@@ -0,0 +1,23 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef OVERLAY_APPLY_H
+#define OVERLAY_APPLY_H
+
+#define MAX_PATH	256
+
+int add_node(void *fdt, int parent, const char *name, uint32_t phandle);
+uint32_t max_phandle(const void *fdt);
+
+/* the symbols the overlays ask for and filler nodes up to kbytes */
+int make_base(void *fdt, void **overlays, int n, int kbytes);
+
+int apply(DTBLOB_T *base, DTBLOB_T *overlay, int edit);
+
+#endif
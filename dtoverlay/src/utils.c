@@ -30,7 +30,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 
 #include "utils.h"
@@ -41,58 +44,431 @@ int opt_verbose;
 int opt_dry_run;
 static STRING_T *allocated_strings;
 
+#define OVERLAY_HELP_INDEX_MAGIC "DTOHIDX1"
+#define OVERLAY_HELP_INDEX_SUFFIX ".idx"
+
+/* The index is a cache of the README on the same machine, so it is kept
+   in host byte order. Names live in a blob after the fields. */
+typedef struct overlay_help_index_struct
+{
+    char magic[8];
+    uint32_t num_records;
+    uint32_t num_fields;
+    uint32_t names_size;
+    uint32_t pad;
+    int64_t readme_size;
+    int64_t readme_mtime_sec;
+    int64_t readme_mtime_nsec;
+} OVERLAY_HELP_INDEX_T;
+
+typedef struct overlay_help_record_struct
+{
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t rec_pos;		/* the line after "Name:" */
+    uint32_t first_field;
+    uint32_t num_fields;
+} OVERLAY_HELP_RECORD_T;
+
+typedef struct overlay_help_field_struct
+{
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t line_pos;		/* the "<field>:" line */
+} OVERLAY_HELP_FIELD_T;
+
 struct overlay_help_state_struct
 {
-    FILE *fp;
+    const char *data;
+    size_t size;
+    size_t pos;
+    size_t line_start;
     long rec_pos;
     int line_len;
     int line_pos;
     int blank_count;
     int end_of_field;
     char line_buf[82];
+    OVERLAY_HELP_INDEX_T *index;
+    size_t index_size;
+    int index_mapped;
+    const OVERLAY_HELP_RECORD_T *record;
 };
 
 static int overlay_help_get_line(OVERLAY_HELP_STATE_T *state);
 
+static const OVERLAY_HELP_RECORD_T *overlay_help_records(OVERLAY_HELP_INDEX_T *index)
+{
+    return (const OVERLAY_HELP_RECORD_T *)(index + 1);
+}
+
+static const OVERLAY_HELP_FIELD_T *overlay_help_fields(OVERLAY_HELP_INDEX_T *index)
+{
+    return (const OVERLAY_HELP_FIELD_T *)(overlay_help_records(index) +
+					  index->num_records);
+}
+
+static const char *overlay_help_names(OVERLAY_HELP_INDEX_T *index)
+{
+    return (const char *)(overlay_help_fields(index) + index->num_fields);
+}
+
+static size_t overlay_help_index_size(uint32_t records, uint32_t fields,
+				      uint32_t names_size)
+{
+    return sizeof(OVERLAY_HELP_INDEX_T) +
+	(size_t)records * sizeof(OVERLAY_HELP_RECORD_T) +
+	(size_t)fields * sizeof(OVERLAY_HELP_FIELD_T) + names_size;
+}
+
+/* Checks an index read from disk against the README it was built from */
+static int overlay_help_index_valid(OVERLAY_HELP_INDEX_T *index, size_t size,
+				    const struct stat *st)
+{
+    const OVERLAY_HELP_RECORD_T *rec;
+    const OVERLAY_HELP_FIELD_T *field;
+    uint32_t i;
+
+    if ((size < sizeof(*index)) ||
+	(memcmp(index->magic, OVERLAY_HELP_INDEX_MAGIC, 8) != 0) ||
+	(index->readme_size != (int64_t)st->st_size) ||
+	(index->readme_mtime_sec != (int64_t)st->st_mtim.tv_sec) ||
+	(index->readme_mtime_nsec != (int64_t)st->st_mtim.tv_nsec) ||
+	(index->num_records > size) || (index->num_fields > size) ||
+	(index->names_size > size) ||
+	(overlay_help_index_size(index->num_records, index->num_fields,
+				 index->names_size) != size))
+	return 0;
+
+    rec = overlay_help_records(index);
+    for (i = 0; i < index->num_records; i++, rec++)
+    {
+	if ((rec->name_off + (uint64_t)rec->name_len > index->names_size) ||
+	    (rec->rec_pos > st->st_size) ||
+	    (rec->first_field + (uint64_t)rec->num_fields > index->num_fields))
+	    return 0;
+    }
+    field = overlay_help_fields(index);
+    for (i = 0; i < index->num_fields; i++, field++)
+    {
+	if ((field->name_off + (uint64_t)field->name_len > index->names_size) ||
+	    (field->line_pos > st->st_size))
+	    return 0;
+    }
+    return 1;
+}
+
+typedef struct overlay_help_builder_struct
+{
+    OVERLAY_HELP_RECORD_T *records;
+    OVERLAY_HELP_FIELD_T *fields;
+    char *names;
+    uint32_t num_records, max_records;
+    uint32_t num_fields, max_fields;
+    uint32_t names_size, max_names;
+} OVERLAY_HELP_BUILDER_T;
+
+static void *overlay_help_grow(void *array, uint32_t *max, size_t size)
+{
+    *max = *max ? *max * 2 : 64;
+    array = realloc(array, *max * size);
+    if (!array)
+	fatal_error("Out of memory");
+    return array;
+}
+
+static uint32_t overlay_help_add_name(OVERLAY_HELP_BUILDER_T *b,
+				      const char *name, int len)
+{
+    uint32_t off = b->names_size;
+
+    while (b->names_size + len > b->max_names)
+	b->names = overlay_help_grow(b->names, &b->max_names, 1);
+    memcpy(b->names + off, name, len);
+    b->names_size += len;
+    return off;
+}
+
+static const char *overlay_help_builder_names;
+
+static int overlay_help_record_cmp(const void *a, const void *b)
+{
+    const OVERLAY_HELP_RECORD_T *ra = a, *rb = b;
+    uint32_t len = (ra->name_len < rb->name_len) ? ra->name_len : rb->name_len;
+    int cmp;
+
+    cmp = memcmp(overlay_help_builder_names + ra->name_off,
+		 overlay_help_builder_names + rb->name_off, len);
+    if (cmp == 0)
+	cmp = (int)ra->name_len - (int)rb->name_len;
+    /* The first record of a name wins, as with a scan of the file */
+    if (cmp == 0)
+	cmp = (ra->rec_pos < rb->rec_pos) ? -1 : (ra->rec_pos > rb->rec_pos);
+    return cmp;
+}
+
+/* Scans the README once, as overlay_help_find() used to for every lookup,
+   and notes where each record and each field of a record starts */
+static OVERLAY_HELP_INDEX_T *overlay_help_build_index(OVERLAY_HELP_STATE_T *state,
+						      const struct stat *st,
+						      size_t *size)
+{
+    OVERLAY_HELP_BUILDER_T b;
+    OVERLAY_HELP_INDEX_T *index;
+    OVERLAY_HELP_RECORD_T *rec;
+    uint32_t i, n;
+    char *p;
+
+    memset(&b, 0, sizeof(b));
+    state->pos = 0;
+    state->rec_pos = -1;
+    state->line_pos = -1;
+    state->blank_count = 0;
+
+    while (overlay_help_find_field(state, "Name"))
+    {
+	const char *overlay = overlay_help_field_data(state);
+	if (!overlay)
+	    continue;
+	if (b.num_records == b.max_records)
+	    b.records = overlay_help_grow(b.records, &b.max_records,
+					  sizeof(*b.records));
+	rec = &b.records[b.num_records++];
+	rec->name_len = strlen(overlay);
+	rec->name_off = overlay_help_add_name(&b, overlay, rec->name_len);
+	rec->rec_pos = state->pos;
+    }
+
+    for (i = 0; i < b.num_records; i++)
+    {
+	rec = &b.records[i];
+	rec->first_field = b.num_fields;
+	state->pos = rec->rec_pos;
+	state->rec_pos = rec->rec_pos;
+	state->line_pos = -1;
+	state->blank_count = 0;
+	while (1)
+	{
+	    int line_len = overlay_help_get_line(state);
+	    const char *colon;
+	    uint32_t j;
+
+	    if (line_len < 0)
+		break;
+	    /* A blank line leaves the next one pending */
+	    if (line_len == 0)
+		continue;
+	    state->line_pos = -1;
+	    if (state->line_buf[0] == ' ')
+		continue;
+	    colon = strchr(state->line_buf, ':');
+	    if (!colon)
+		continue;
+	    n = colon - state->line_buf;
+	    /* The first one of a name is the one a scan would find */
+	    for (j = rec->first_field; j < b.num_fields; j++)
+		if ((b.fields[j].name_len == n) &&
+		    (memcmp(b.names + b.fields[j].name_off,
+			    state->line_buf, n) == 0))
+		    break;
+	    if (j < b.num_fields)
+		continue;
+	    if (b.num_fields == b.max_fields)
+		b.fields = overlay_help_grow(b.fields, &b.max_fields,
+					     sizeof(*b.fields));
+	    b.fields[b.num_fields].name_len = n;
+	    b.fields[b.num_fields].name_off =
+		overlay_help_add_name(&b, state->line_buf, n);
+	    b.fields[b.num_fields].line_pos = state->line_start;
+	    b.num_fields++;
+	}
+	rec->num_fields = b.num_fields - rec->first_field;
+    }
+
+    /* Sorted by name for a binary search, duplicates dropped */
+    overlay_help_builder_names = b.names;
+    if (b.num_records)
+	qsort(b.records, b.num_records, sizeof(*b.records),
+	      overlay_help_record_cmp);
+    for (i = 0, n = 0; i < b.num_records; i++)
+    {
+	if (n && (b.records[n - 1].name_len == b.records[i].name_len) &&
+	    (memcmp(b.names + b.records[n - 1].name_off,
+		    b.names + b.records[i].name_off,
+		    b.records[i].name_len) == 0))
+	    continue;
+	b.records[n++] = b.records[i];
+    }
+    b.num_records = n;
+
+    *size = overlay_help_index_size(b.num_records, b.num_fields,
+				    b.names_size);
+    index = calloc(1, *size);
+    if (!index)
+	fatal_error("Out of memory");
+    memcpy(index->magic, OVERLAY_HELP_INDEX_MAGIC, 8);
+    index->num_records = b.num_records;
+    index->num_fields = b.num_fields;
+    index->names_size = b.names_size;
+    index->readme_size = st->st_size;
+    index->readme_mtime_sec = st->st_mtim.tv_sec;
+    index->readme_mtime_nsec = st->st_mtim.tv_nsec;
+    p = (char *)(index + 1);
+    memcpy(p, b.records, b.num_records * sizeof(*b.records));
+    p += b.num_records * sizeof(*b.records);
+    memcpy(p, b.fields, b.num_fields * sizeof(*b.fields));
+    p += b.num_fields * sizeof(*b.fields);
+    memcpy(p, b.names, b.names_size);
+
+    free(b.records);
+    free(b.fields);
+    free(b.names);
+    return index;
+}
+
+/* Writes the index next to the README, quietly giving up if that is not
+   possible - it is only a cache */
+static void overlay_help_save_index(const char *index_path,
+				    const OVERLAY_HELP_INDEX_T *index,
+				    size_t size)
+{
+    char *tmp_path = sprintf_dup("%s.%d", index_path, (int)getpid());
+    int fd;
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+	int ok = (write(fd, index, size) == (ssize_t)size);
+	close(fd);
+	if (!ok || (rename(tmp_path, index_path) != 0))
+	    unlink(tmp_path);
+    }
+    free_string(tmp_path);
+}
+
+static void overlay_help_load_index(OVERLAY_HELP_STATE_T *state,
+				    const char *helpfile,
+				    const struct stat *st)
+{
+    char *index_path = sprintf_dup("%s" OVERLAY_HELP_INDEX_SUFFIX, helpfile);
+    struct stat index_st;
+    void *map;
+    int fd;
+
+    fd = open(index_path, O_RDONLY);
+    if ((fd >= 0) && (fstat(fd, &index_st) == 0) &&
+	(index_st.st_size >= (off_t)sizeof(OVERLAY_HELP_INDEX_T)))
+    {
+	map = mmap(NULL, index_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED)
+	{
+	    if (overlay_help_index_valid(map, index_st.st_size, st))
+	    {
+		state->index = map;
+		state->index_size = index_st.st_size;
+		state->index_mapped = 1;
+	    }
+	    else
+	    {
+		munmap(map, index_st.st_size);
+	    }
+	}
+    }
+    if (fd >= 0)
+	close(fd);
+
+    if (!state->index)
+    {
+	if (opt_verbose)
+	    fprintf(stderr, "building help index '%s'\n", index_path);
+	state->index = overlay_help_build_index(state, st, &state->index_size);
+	overlay_help_save_index(index_path, state->index, state->index_size);
+    }
+    free_string(index_path);
+}
+
 OVERLAY_HELP_STATE_T *overlay_help_open(const char *helpfile)
 {
     OVERLAY_HELP_STATE_T *state = NULL;
-    FILE *fp = fopen(helpfile, "r");
-    if (fp)
+    struct stat st;
+    void *map = NULL;
+    int fd;
+
+    fd = open(helpfile, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &st) != 0)
     {
-        state = calloc(1, sizeof(OVERLAY_HELP_STATE_T));
-        if (!state)
-                fatal_error("Out of memory");
-        state->fp = fp;
-        state->line_pos = -1;
-        state->rec_pos = -1;
+	close(fd);
+	return NULL;
     }
+    if (st.st_size > 0)
+    {
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+	{
+	    close(fd);
+	    return NULL;
+	}
+    }
+    close(fd);
+
+    state = calloc(1, sizeof(OVERLAY_HELP_STATE_T));
+    if (!state)
+	fatal_error("Out of memory");
+    state->data = map;
+    state->size = st.st_size;
+    overlay_help_load_index(state, helpfile, &st);
+    state->pos = 0;
+    state->line_pos = -1;
+    state->rec_pos = -1;
 
     return state;
 }
 
 void overlay_help_close(OVERLAY_HELP_STATE_T *state)
 {
-    fclose(state->fp);
+    if (state->index_mapped)
+	munmap(state->index, state->index_size);
+    else
+	free(state->index);
+    if (state->data)
+	munmap((void *)state->data, state->size);
     free(state);
 }
 
 int overlay_help_find(OVERLAY_HELP_STATE_T *state, const char *name)
 {
+    const OVERLAY_HELP_RECORD_T *records = overlay_help_records(state->index);
+    const char *names = overlay_help_names(state->index);
+    uint32_t name_len = strlen(name);
+    int lo = 0, hi = (int)state->index->num_records - 1;
+
     state->line_pos = -1;
     state->rec_pos = -1;
     state->blank_count = 0;
+    state->record = NULL;
 
-    fseek(state->fp, 0, SEEK_SET);
-
-    while (overlay_help_find_field(state, "Name"))
+    while (lo <= hi)
     {
-        const char *overlay = overlay_help_field_data(state);
-        if (overlay && (strcmp(overlay, name) == 0))
-        {
-            state->rec_pos = (long)ftell(state->fp);
-            return 1;
-        }
+	int mid = (lo + hi) / 2;
+	const OVERLAY_HELP_RECORD_T *rec = &records[mid];
+	uint32_t len = (rec->name_len < name_len) ? rec->name_len : name_len;
+	int cmp = memcmp(names + rec->name_off, name, len);
+
+	if (cmp == 0)
+	    cmp = (int)rec->name_len - (int)name_len;
+	if (cmp == 0)
+	{
+	    state->record = rec;
+	    state->rec_pos = rec->rec_pos;
+	    state->pos = rec->rec_pos;
+	    return 1;
+	}
+	if (cmp < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
     }
 
     return 0;
@@ -103,8 +479,28 @@ int overlay_help_find_field(OVERLAY_HELP_STATE_T *state, const char *field)
     int field_len = strlen(field);
     int found = 0;
 
-    if (state->rec_pos >= 0)
-        fseek(state->fp, state->rec_pos, SEEK_SET);
+    if (state->record)
+    {
+	/* Start at the line of the field, if the record has it */
+	const OVERLAY_HELP_FIELD_T *f = overlay_help_fields(state->index) +
+	    state->record->first_field;
+	const char *names = overlay_help_names(state->index);
+	uint32_t i;
+
+	for (i = 0; i < state->record->num_fields; i++, f++)
+	    if ((f->name_len == (uint32_t)field_len) &&
+		(memcmp(names + f->name_off, field, field_len) == 0))
+		break;
+	if (i == state->record->num_fields)
+	    return 0;
+	state->pos = f->line_pos;
+	state->line_pos = -1;
+	state->blank_count = 0;
+    }
+    else if (state->rec_pos >= 0)
+    {
+	state->pos = state->rec_pos;
+    }
 
     while (!found)
     {
@@ -216,8 +612,22 @@ static int overlay_help_get_line(OVERLAY_HELP_STATE_T *state)
 get_next_line:
     state->line_buf[sizeof(state->line_buf) - 1] = ' ';
     line_len = -1;
-    if (fgets(state->line_buf, sizeof(state->line_buf), state->fp))
+    if (state->pos < state->size)
     {
+	/* As fgets() would, up to and including a newline */
+	size_t len = state->size - state->pos;
+	const char *nl;
+
+	if (len > sizeof(state->line_buf) - 1)
+	    len = sizeof(state->line_buf) - 1;
+	nl = memchr(state->data + state->pos, '\n', len);
+	if (nl)
+	    len = nl - (state->data + state->pos) + 1;
+	memcpy(state->line_buf, state->data + state->pos, len);
+	state->line_buf[len] = '\0';
+	state->line_start = state->pos;
+	state->pos += len;
+
 	// Check for overflow
 
 	// Strip the newline
@@ -244,6 +654,7 @@ get_next_line:
 	    /* Return a single blank line now - the non-empty line will be
 	       returned next time */
 	    state->blank_count = 0;
+	    state->line_len = line_len;
 	    return 0;
 	}
     }
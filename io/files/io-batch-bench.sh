@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# compare commands/s of 'io -B' against calling io once per access
+#
+# usage: io-batch-bench.sh <addr> [<count>]
+#
+
+IO=${IO:-io}
+ADDR=${1:?usage: $0 <addr> [<count>]}
+COUNT=${2:-500}
+SCRIPT=/tmp/io-batch-bench.$$
+
+uptime_cs() {
+	read up rest < /proc/uptime
+	echo ${up%.*}${up#*.}
+}
+
+i=0
+: > $SCRIPT
+while [ $i -lt $COUNT ]; do
+	echo "r4 $ADDR" >> $SCRIPT
+	i=$((i + 1))
+done
+
+start=$(uptime_cs)
+i=0
+while [ $i -lt $COUNT ]; do
+	$IO -4 $ADDR > /dev/null || exit 1
+	i=$((i + 1))
+done
+loop_cs=$(($(uptime_cs) - start))
+
+start=$(uptime_cs)
+$IO -B $SCRIPT > /dev/null || exit 1
+batch_cs=$(($(uptime_cs) - start))
+
+rm -f $SCRIPT
+[ $loop_cs -gt 0 ] || loop_cs=1
+[ $batch_cs -gt 0 ] || batch_cs=1
+echo "$COUNT reads"
+echo "io loop : $((loop_cs * 10)) ms, $((COUNT * 100 / loop_cs)) commands/s"
+echo "io -B   : $((batch_cs * 10)) ms, $((COUNT * 100 / batch_cs)) commands/s"
@@ -16,26 +16,89 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <ctype.h>
 
 #define MEM_READ  0
 #define MEM_WRITE 1
 #define MEM_AND   2
 #define MEM_OR    3
+#define MEM_CMP   4
+#define MEM_WATCH 5
+
+/* file based accesses are staged through a buffer of this size */
+#define CHUNK_SIZE	65536
+
+/*
+ * watch ring file layout: one header followed by 'slots' records of
+ * struct watch_record plus 'len' bytes of register data each, all in
+ * host byte order
+ */
+#define WATCH_MAGIC	0x494f5752	/* "IOWR" */
+#define WATCH_SLOTS	1024
+
+struct watch_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t addr;		/* physical address sampled */
+	uint32_t len;		/* bytes per sample */
+	uint32_t iosize;	/* access size used */
+	uint32_t slots;		/* records in the ring */
+	uint32_t interval_us;
+	uint64_t count;		/* samples taken, next slot is count % slots */
+};
+
+struct watch_record {
+	uint64_t timestamp_ns;	/* CLOCK_REALTIME */
+	uint64_t seq;
+};
+
+/* batch mode keeps every page it touched mapped until the script ends */
+#define BATCH_PAGES	256
+#define PAGE_MASK	(~4095UL)
+
+struct batch_page {
+	unsigned long phys;
+	void *virt;
+};
+
+/* delays shorter than this are busy waited to get microsecond accuracy */
+#define SPIN_US		100
 
 static void
 usage (char *argv0)
 {
 	fprintf(stderr,
 "Raw memory i/o utility - $Revision: 2.0 $\n\n"
-"%s -v -1|2|4 -r|w|a|o [-l <len>] [-f <file>] <addr> [<value>]\n\n"
+"%s -v -1|2|4 -r|w|a|o|c [-l <len>] [-f <file>] <addr> [<value>]\n"
+"%s -W <usecs> [-n <count>] [-s <slots>] -1|2|4 [-l <len>] -f <file> <addr>\n"
+"%s -B <script>|-\n\n"
 "    -v         Verbose, asks for confirmation\n"
 "    -1|2|4     Sets memory access size in bytes (default byte)\n"
 "    -l <len>   Length in bytes of area to access (defaults to\n"
 "               one access, or whole file length)\n"
 "    -r|w|a|o   Read from or Write to memory (default read)\n"
 "               optional write with modify (and/or)\n"
+"    -c         Compare memory with file, report differing ranges\n"
+"               (exit status 2 if any)\n"
 "    -f <file>  File to write on memory read, or\n"
-"               to read on memory write\n"
+"               to read on memory write/compare\n"
+"    -W <usecs> Watch: sample the area every <usecs> into a\n"
+"               binary ring file with timestamps\n"
+"    -n <count> Number of watch samples (default endless)\n"
+"    -s <slots> Records in the watch ring file (default %d)\n"
+"    -B <file>  Run a batch script ('-' for stdin), one command per line:\n"
+"                 r[1|2|4] <addr> [<count>]      read\n"
+"                 w[1|2|4] <addr> <value>        write\n"
+"                 a[1|2|4] <addr> <value>        and\n"
+"                 o[1|2|4] <addr> <value>        or\n"
+"                 p[1|2|4] <addr> <mask> <value> [<timeout us>]\n"
+"                                                poll until (*addr & mask) == value\n"
+"                 d <usecs>                      delay\n"
+"               Results go to stdout as '<cmd> <addr> <value> <usecs>'\n"
+"               lines, with -v a summary goes to stderr\n"
 "    <addr>     The memory address to access\n"
 "    <val>      The value to write (implies -w)\n\n"
 "Examples:\n"
@@ -44,9 +107,13 @@ usage (char *argv0)
 "    %s -2 -l 8 0x1000          Reads 8 words from 0x1000\n"
 "    %s -r -f dmp -l 100 200    Reads 100 bytes from addr 200 to file\n"
 "    %s -w -f img 0x10000       Writes the whole of file to memory\n"
+"    %s -c -f img 0x10000       Compares the whole of file with memory\n"
+"    %s -W 1000 -4 -l 64 -f ring 0x18040000\n"
+"                               Samples 16 registers every ms\n"
 "\n"
-"Note access size (-1|2|4) does not apply to file based accesses.\n\n",
-		argv0, argv0, argv0, argv0, argv0, argv0);
+"File based accesses use the widest aligned access (up to 4 bytes)\n"
+"unless -1|2|4 is given.\n\n",
+		argv0, argv0, argv0, WATCH_SLOTS, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
 	exit(1);
 }
 
@@ -168,23 +235,486 @@ or_write_memory(unsigned long phys_addr, void *addr, int len, int iosize, unsign
 }
 
 
+/*
+ * Copy between device memory and a normal buffer using only naturally
+ * aligned accesses of 'iosize' bytes, so registers never see the byte
+ * or burst accesses memcpy()/read()/write() may use
+ */
+static void
+copy_from_io(void *dst, volatile void *src, int len, int iosize)
+{
+	int i;
+
+	switch(iosize) {
+	case 1:
+		for (i = 0; i < len; i++)
+			((uint8_t *)dst)[i] = ((volatile uint8_t *)src)[i];
+		break;
+	case 2:
+		for (i = 0; i < len / 2; i++)
+			((uint16_t *)dst)[i] = ((volatile uint16_t *)src)[i];
+		break;
+	case 4:
+		for (i = 0; i < len / 4; i++)
+			((uint32_t *)dst)[i] = ((volatile uint32_t *)src)[i];
+		break;
+	}
+}
+
+
+static void
+copy_to_io(volatile void *dst, void *src, int len, int iosize)
+{
+	int i;
+
+	switch(iosize) {
+	case 1:
+		for (i = 0; i < len; i++)
+			((volatile uint8_t *)dst)[i] = ((uint8_t *)src)[i];
+		break;
+	case 2:
+		for (i = 0; i < len / 2; i++)
+			((volatile uint16_t *)dst)[i] = ((uint16_t *)src)[i];
+		break;
+	case 4:
+		for (i = 0; i < len / 4; i++)
+			((volatile uint32_t *)dst)[i] = ((uint32_t *)src)[i];
+		break;
+	}
+}
+
+
+static int
+read_full(int fd, void *buf, int len)
+{
+	int n, done = 0;
+
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n < 0 ? n : done;
+		done += n;
+	}
+	return done;
+}
+
+
+static int
+write_full(int fd, void *buf, int len)
+{
+	int n, done = 0;
+
+	while (done < len) {
+		n = write(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return n;
+		done += n;
+	}
+	return done;
+}
+
+
+static void
+dump_to_file(int ffd, void *addr, int len, int iosize, void *buf)
+{
+	int n;
+
+	while (len) {
+		n = len > CHUNK_SIZE ? CHUNK_SIZE : len;
+		copy_from_io(buf, addr, n, iosize);
+		if (write_full(ffd, buf, n) != n) {
+			fprintf(stderr, "File write failed: %s\n", strerror(errno));
+			exit(1);
+		}
+		addr += n;
+		len -= n;
+	}
+}
+
+
+static void
+load_from_file(int ffd, void *addr, int len, int iosize, void *buf)
+{
+	int n, total = len;
+
+	while (len) {
+		n = len > CHUNK_SIZE ? CHUNK_SIZE : len;
+		if (read_full(ffd, buf, n) != n) {
+			fprintf(stderr, "Only read %d of %d bytes from file\n",
+					total - len, total);
+			exit(1);
+		}
+		copy_to_io(addr, buf, n, iosize);
+		addr += n;
+		len -= n;
+	}
+}
+
+
+/* returns the number of differing bytes, ranges are printed as found */
+static unsigned long
+compare_with_file(int ffd, unsigned long phys_addr, void *addr, int len, int iosize, void *buf)
+{
+	unsigned char *mem = buf, *file = buf + CHUNK_SIZE;
+	unsigned long diff_start = 0, diffs = 0, pos = 0;
+	int in_diff = 0, n, i;
+
+	while (len) {
+		n = len > CHUNK_SIZE ? CHUNK_SIZE : len;
+		if (read_full(ffd, file, n) != n) {
+			fprintf(stderr, "File read failed\n");
+			exit(1);
+		}
+		copy_from_io(mem, addr, n, iosize);
+		if (!in_diff && !memcmp(mem, file, n)) {
+			pos += n;
+		} else {
+			for (i = 0; i < n; i++, pos++) {
+				if (mem[i] != file[i]) {
+					diffs++;
+					if (!in_diff) {
+						diff_start = pos;
+						in_diff = 1;
+					}
+				} else if (in_diff) {
+					printf("%08lx-%08lx: %lu bytes differ\n", phys_addr + diff_start,
+						phys_addr + pos - 1, pos - diff_start);
+					in_diff = 0;
+				}
+			}
+		}
+		addr += n;
+		len -= n;
+	}
+	if (in_diff)
+		printf("%08lx-%08lx: %lu bytes differ\n", phys_addr + diff_start,
+			phys_addr + pos - 1, pos - diff_start);
+	return diffs;
+}
+
+
+static void
+watch_memory(int ffd, unsigned long phys_addr, void *addr, int len, int iosize,
+		unsigned long interval_us, unsigned long count, unsigned long slots)
+{
+	struct watch_header hdr;
+	struct watch_record *rec;
+	struct timespec next, now;
+	size_t rec_len = sizeof(*rec) + len;
+	uint64_t seq;
+
+	rec = malloc(rec_len);
+	if (!rec) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = WATCH_MAGIC;
+	hdr.version = 1;
+	hdr.addr = phys_addr;
+	hdr.len = len;
+	hdr.iosize = iosize;
+	hdr.slots = slots;
+	hdr.interval_us = interval_us;
+	if (ftruncate(ffd, sizeof(hdr) + slots * rec_len) < 0 ||
+			pwrite(ffd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		fprintf(stderr, "Failed to set up ring file: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (seq = 0; !count || seq < count; seq++) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		copy_from_io(rec + 1, addr, len, iosize);
+		rec->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+		rec->seq = seq;
+		hdr.count = seq + 1;
+		if (pwrite(ffd, rec, rec_len, sizeof(hdr) + (seq % slots) * rec_len) != (ssize_t)rec_len ||
+				pwrite(ffd, &hdr.count, sizeof(hdr.count),
+					offsetof(struct watch_header, count)) != (ssize_t)sizeof(hdr.count)) {
+			fprintf(stderr, "File write failed: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		/* absolute deadlines, so the rate doesn't drift with the work done */
+		next.tv_nsec += (interval_us % 1000000) * 1000;
+		next.tv_sec += interval_us / 1000000 + next.tv_nsec / 1000000000;
+		next.tv_nsec %= 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+	}
+	free(rec);
+}
+
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void
+delay_us(unsigned long usecs)
+{
+	uint64_t end = now_us() + usecs;
+	struct timespec ts;
+
+	if (usecs > SPIN_US) {
+		usecs -= SPIN_US;
+		ts.tv_sec = usecs / 1000000;
+		ts.tv_nsec = (usecs % 1000000) * 1000;
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+			;
+	}
+	while (now_us() < end)
+		;
+}
+
+
+static struct batch_page batch_pages[BATCH_PAGES];
+static int batch_npages;
+static int batch_mfd = -1;
+static int batch_prot;
+
+
+/* map the page holding phys_addr once and hand out the virtual address */
+static volatile void *
+batch_map(unsigned long phys_addr)
+{
+	static struct batch_page *last;
+	unsigned long phys = phys_addr & PAGE_MASK;
+	struct batch_page *p;
+	int i;
+
+	if (last && last->phys == phys)
+		return last->virt + (phys_addr - phys);
+	for (i = 0; i < batch_npages; i++) {
+		if (batch_pages[i].phys == phys) {
+			last = &batch_pages[i];
+			return last->virt + (phys_addr - phys);
+		}
+	}
+	if (batch_npages == BATCH_PAGES) {
+		fprintf(stderr, "Too many pages mapped\n");
+		return NULL;
+	}
+	p = &batch_pages[batch_npages];
+	p->virt = mmap(NULL, 4096, batch_prot, MAP_SHARED, batch_mfd, phys);
+	if (p->virt == (void *)(-1)) {
+		fprintf(stderr, "mmap() failed at 0x%08lx: %s\n", phys, strerror(errno));
+		return NULL;
+	}
+	p->phys = phys;
+	batch_npages++;
+	last = p;
+	return p->virt + (phys_addr - phys);
+}
+
+
+static unsigned long
+io_read(volatile void *addr, int iosize)
+{
+	switch(iosize) {
+	case 1:
+		return *(volatile uint8_t *)addr;
+	case 2:
+		return *(volatile uint16_t *)addr;
+	default:
+		return *(volatile uint32_t *)addr;
+	}
+}
+
+
+static void
+io_write(volatile void *addr, int iosize, unsigned long value)
+{
+	switch(iosize) {
+	case 1:
+		*(volatile uint8_t *)addr = value;
+		break;
+	case 2:
+		*(volatile uint16_t *)addr = value;
+		break;
+	default:
+		*(volatile uint32_t *)addr = value;
+		break;
+	}
+}
+
+
+/* values wider than the access would be silently truncated by io_write */
+static int
+value_fits(unsigned long value, int iosize)
+{
+	return iosize >= (int)sizeof(value) || !(value >> (iosize * 8));
+}
+
+
+/* returns 0 on success, -1 on a script error */
+static int
+batch_command(char *line, uint64_t start, unsigned long *accesses)
+{
+	unsigned long arg[4];
+	char *p = line, *endptr;
+	volatile void *io;
+	unsigned long value, i, count;
+	uint64_t t, timeout;
+	int cmd, iosize = 4, nargs = 0;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	if (!*p || *p == '#')
+		return 0;
+	cmd = *p++;
+	if (*p == '1' || *p == '2' || *p == '4')
+		iosize = *p++ - '0';
+	if (*p && !isspace((unsigned char)*p))
+		return -1;
+	while (nargs < 4) {
+		while (isspace((unsigned char)*p))
+			p++;
+		if (!*p || *p == '#')
+			break;
+		arg[nargs++] = strtoul(p, &endptr, 0);
+		if (endptr == p || (*endptr && !isspace((unsigned char)*endptr)))
+			return -1;
+		p = endptr;
+	}
+
+	if (cmd == 'd') {
+		if (nargs != 1)
+			return -1;
+		delay_us(arg[0]);
+		return 0;
+	}
+	if (nargs < 1 || (arg[0] & (iosize - 1)))
+		return -1;
+
+	switch (cmd) {
+	case 'r':
+		count = nargs > 1 ? arg[1] : 1;
+		for (i = 0; i < count; i++) {
+			io = batch_map(arg[0] + i * iosize);
+			if (!io)
+				return -1;
+			value = io_read(io, iosize);
+			printf("r 0x%08lx 0x%0*lx %llu\n", arg[0] + i * iosize, iosize * 2, value,
+				(unsigned long long)(now_us() - start));
+		}
+		*accesses += count;
+		return 0;
+	case 'w':
+	case 'a':
+	case 'o':
+		if (nargs != 2 || !value_fits(arg[1], iosize) || !(io = batch_map(arg[0])))
+			return -1;
+		value = arg[1];
+		if (cmd == 'a')
+			value &= io_read(io, iosize);
+		else if (cmd == 'o')
+			value |= io_read(io, iosize);
+		io_write(io, iosize, value);
+		printf("%c 0x%08lx 0x%0*lx %llu\n", cmd, arg[0], iosize * 2, value,
+			(unsigned long long)(now_us() - start));
+		*accesses += 1;
+		return 0;
+	case 'p':
+		if (nargs < 3 || !value_fits(arg[1], iosize) || !value_fits(arg[2], iosize) ||
+				!(io = batch_map(arg[0])))
+			return -1;
+		t = now_us();
+		timeout = nargs > 3 ? arg[3] : 1000000;
+		do {
+			value = io_read(io, iosize);
+			*accesses += 1;
+		} while ((value & arg[1]) != arg[2] && now_us() - t < timeout);
+		printf("p 0x%08lx 0x%0*lx %llu %s\n", arg[0], iosize * 2, value,
+			(unsigned long long)(now_us() - start),
+			(value & arg[1]) == arg[2] ? "ok" : "timeout");
+		return 0;
+	}
+	return -1;
+}
+
+
+static int
+run_batch(char *script, int verbose)
+{
+	char line[256];
+	FILE *f;
+	uint64_t start, elapsed;
+	unsigned long lineno = 0, commands = 0, accesses = 0;
+	int ret = 0;
+
+	f = strcmp(script, "-") ? fopen(script, "r") : stdin;
+	if (!f) {
+		fprintf(stderr, "Failed to open script '%s': %s\n", script, strerror(errno));
+		return 1;
+	}
+	batch_prot = PROT_READ|PROT_WRITE;
+	batch_mfd = open("/dev/mem", O_RDWR);
+	if (batch_mfd == -1) {
+		perror("open /dev/mem");
+		return 1;
+	}
+
+	start = now_us();
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (batch_command(line, start, &accesses) < 0) {
+			line[strcspn(line, "\n")] = 0;
+			printf("e %lu \"%s\"\n", lineno, line);
+			ret = 1;
+			break;
+		}
+		commands++;
+	}
+	elapsed = now_us() - start;
+	fflush(stdout);
+
+	if (verbose)
+		fprintf(stderr, "%lu lines, %lu accesses, %d pages mapped in %llu us, %llu lines/s\n",
+			commands, accesses, batch_npages, (unsigned long long)elapsed,
+			(unsigned long long)(elapsed ? commands * 1000000ULL / elapsed : 0));
+
+	while (batch_npages--)
+		munmap(batch_pages[batch_npages].virt, 4096);
+	close(batch_mfd);
+	if (f != stdin)
+		fclose(f);
+	return ret;
+}
+
+
 int
 main (int argc, char **argv)
 {
-	int mfd, ffd = 0, req_len = 0, opt;
+	int mfd, ffd = 0, req_len = 0, opt, ret = 0;
 	void *real_io;
 	unsigned long real_len, real_addr, req_addr, req_value = 0, offset;
 	char *endptr;
 	int memfunc = MEM_READ;
-	int iosize = 1;
+	int iosize = 1, iosize_set = 0;
 	char *filename = NULL;
 	int verbose = 0;
+	int mem_ro;
+	unsigned long watch_us = 0, watch_count = 0, watch_slots = WATCH_SLOTS;
+	void *buf = NULL;
+	char *script = NULL;
 
 	opterr = 0;
 	if (argc == 1)
 		usage(argv[0]);
 
-	while ((opt = getopt(argc, argv, "hv124rwaol:f:")) > 0) {
+	while ((opt = getopt(argc, argv, "hv124rwaocl:f:W:n:s:B:")) > 0) {
 		switch (opt) {
 		case 'h':
 			usage(argv[0]);
@@ -195,6 +725,7 @@ main (int argc, char **argv)
 		case '2':
 		case '4':
 			iosize = opt - '0';
+			iosize_set = 1;
 			break;
 		case 'r':
 			memfunc = MEM_READ;
@@ -208,6 +739,31 @@ main (int argc, char **argv)
 		case 'w':
 			memfunc = MEM_WRITE;
 			break;
+		case 'c':
+			memfunc = MEM_CMP;
+			break;
+		case 'W':
+			memfunc = MEM_WATCH;
+			watch_us = strtoul(optarg, &endptr, 0);
+			if (*endptr || !watch_us) {
+				fprintf(stderr, "Bad <usecs> value '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'n':
+			watch_count = strtoul(optarg, &endptr, 0);
+			if (*endptr) {
+				fprintf(stderr, "Bad <count> value '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 's':
+			watch_slots = strtoul(optarg, &endptr, 0);
+			if (*endptr || !watch_slots) {
+				fprintf(stderr, "Bad <slots> value '%s'\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'l':
 			req_len = strtoul(optarg, &endptr, 0);
 			if (*endptr) {
@@ -218,12 +774,18 @@ main (int argc, char **argv)
 		case 'f':
 			filename = strdup(optarg);
 			break;
+		case 'B':
+			script = optarg;
+			break;
 		default:
 			fprintf(stderr, "Unknown option: %c\n", opt);
 			usage(argv[0]);
 		}
 	}
 
+	if (script)
+		return run_batch(script, verbose);
+
 	if (optind == argc) {
 		fprintf(stderr, "No address given\n");
 		exit(1);
@@ -262,6 +824,12 @@ main (int argc, char **argv)
 		fprintf(stderr, "No size given for file memread\n");
 		exit(1);
 	}
+	if (!filename && (memfunc == MEM_CMP || memfunc == MEM_WATCH)) {
+		fprintf(stderr, "No file given for %s\n",
+				memfunc == MEM_CMP ? "compare" : "watch");
+		exit(1);
+	}
+	mem_ro = (memfunc == MEM_READ || memfunc == MEM_CMP || memfunc == MEM_WATCH);
 	if (optind < argc) {
 		fprintf(stderr, "Too many arguments '%s'...\n", argv[optind]);
 		exit(1);
@@ -273,7 +841,14 @@ main (int argc, char **argv)
 			exit(1);
 		}
 	}
-	if (filename && (memfunc != MEM_READ)) {
+	if (filename && (memfunc == MEM_WATCH)) {
+		ffd = open(filename, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+		if (ffd < 0) {
+			fprintf(stderr, "Failed to open ring file '%s': %s\n", filename, strerror(errno));
+			exit(1);
+		}
+	}
+	else if (filename && (memfunc != MEM_READ)) {
 		ffd = open(filename, O_RDONLY);
 		if (ffd < 0) {
 			fprintf(stderr, "Failed to open source file '%s': %s\n", filename, strerror(errno));
@@ -281,7 +856,7 @@ main (int argc, char **argv)
 		}
 	}
 
-	if (filename && !req_len) {
+	if (filename && !req_len && memfunc != MEM_WATCH) {
 		req_len = lseek(ffd, 0, SEEK_END);
 		if (req_len < 0) {
 			fprintf(stderr, "Failed to seek on '%s': %s\n",
@@ -297,6 +872,14 @@ main (int argc, char **argv)
 	if (!req_len)
 		req_len = iosize;
 
+	/* bulk file transfers default to the widest access the alignment allows */
+	if (filename && memfunc != MEM_WATCH && !iosize_set) {
+		if (!((req_addr | req_len) & 3))
+			iosize = 4;
+		else if (!((req_addr | req_len) & 1))
+			iosize = 2;
+	}
+
 	if ((iosize == 2 && (req_addr & 1)) ||
 			(iosize == 4 && (req_addr & 3))) {
 		fprintf(stderr, "Badly aligned <addr> for access size\n");
@@ -314,6 +897,14 @@ main (int argc, char **argv)
 		printf("Request to read 0x%x bytes from address 0x%08lx\n"
 			"\tto file %s, using %d byte accesses\n",
 			req_len, req_addr, filename, iosize);
+	else if (filename && (memfunc == MEM_CMP))
+		printf("Request to compare 0x%x bytes at address 0x%08lx\n"
+			"\twith file %s, using %d byte accesses\n",
+			req_len, req_addr, filename, iosize);
+	else if (filename && (memfunc == MEM_WATCH))
+		printf("Request to sample 0x%x bytes at address 0x%08lx every %lu us\n"
+			"\tinto ring file %s, using %d byte accesses\n",
+			req_len, req_addr, watch_us, filename, iosize);
 	else if (filename)
 		printf("Request to write 0x%x bytes to address 0x%08lx\n"
 			"\tfrom file %s, using %d byte accesses\n",
@@ -343,7 +934,7 @@ main (int argc, char **argv)
 		printf("Attempting to map 0x%lx bytes at address 0x%08lx\n",
 			real_len, real_addr);
 
-	mfd = open("/dev/mem", (memfunc == MEM_READ) ? O_RDONLY : O_RDWR);
+	mfd = open("/dev/mem", mem_ro ? O_RDONLY : O_RDWR);
 	if (mfd == -1) {
 		perror("open /dev/mem");
 		exit(1);
@@ -351,7 +942,7 @@ main (int argc, char **argv)
 	if (verbose)
 		printf("open(/dev/mem) ok\n");
 	real_io = mmap(NULL, real_len,
-			(memfunc == MEM_READ) ? PROT_READ:PROT_READ|PROT_WRITE,
+			mem_ro ? PROT_READ:PROT_READ|PROT_WRITE,
 			MAP_SHARED, mfd, real_addr);
 	if (real_io == (void *)(-1)) {
 		fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
@@ -372,31 +963,27 @@ main (int argc, char **argv)
 		}
 	}
 
-	if (filename && (memfunc == MEM_READ)) {
-		int n = write(ffd, real_io + offset, req_len);
-
-		if (n < 0) {
-			fprintf(stderr, "File write failed: %s\n", strerror(errno));
-			exit(1);
-		}
-		else if (n != req_len) {
-			fprintf(stderr, "Only wrote %d of %d bytes to file\n",
-					n, req_len);
+	if (filename && memfunc != MEM_WATCH) {
+		buf = malloc(2 * CHUNK_SIZE);
+		if (!buf) {
+			fprintf(stderr, "Out of memory\n");
 			exit(1);
 		}
 	}
-	else if (filename) {
-		int n = read(ffd, real_io + offset, req_len);
 
-		if (n < 0) {
-			fprintf(stderr, "File read failed: %s\n", strerror(errno));
-			exit(1);
-		}
-		else if (n != req_len) {
-			fprintf(stderr, "Only read %d of %d bytes from file\n",
-					n, req_len);
-			exit(1);
-		}
+	if (filename && (memfunc == MEM_READ)) {
+		dump_to_file(ffd, real_io + offset, req_len, iosize, buf);
+	}
+	else if (filename && (memfunc == MEM_CMP)) {
+		if (compare_with_file(ffd, req_addr, real_io + offset, req_len, iosize, buf))
+			ret = 2;
+	}
+	else if (filename && (memfunc == MEM_WATCH)) {
+		watch_memory(ffd, req_addr, real_io + offset, req_len, iosize,
+				watch_us, watch_count, watch_slots);
+	}
+	else if (filename) {
+		load_from_file(ffd, real_io + offset, req_len, iosize, buf);
 	}
 	else {
 		switch (memfunc)
@@ -419,7 +1006,8 @@ main (int argc, char **argv)
 	if (filename)
 		close(ffd);
 	close (mfd);
+	free(buf);
 
-	return 0;
+	return ret;
 }
 
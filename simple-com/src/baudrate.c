@@ -0,0 +1,37 @@
+/*
+ * arbitrary bit rates via termios2/BOTHER
+ *
+ * <asm/termbits.h> clashes with the libc <termios.h>, so this lives in
+ * its own compilation unit
+ */
+
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "baudrate.h"
+
+int set_custom_baudrate(int fd, unsigned int rate) {
+	struct termios2 tio;
+
+	if(ioctl(fd, TCGETS2, &tio) < 0)
+		return -1;
+	tio.c_cflag &= ~CBAUD;
+	tio.c_cflag |= BOTHER;
+	tio.c_ospeed = rate;
+#ifdef IBSHIFT
+	tio.c_cflag &= ~(CBAUD << IBSHIFT);
+	tio.c_cflag |= BOTHER << IBSHIFT;
+#endif
+	tio.c_ispeed = rate;
+	return ioctl(fd, TCSETS2, &tio);
+}
+
+/* the driver may round the rate, read back what it really uses */
+int get_custom_baudrate(int fd, unsigned int *rate) {
+	struct termios2 tio;
+
+	if(ioctl(fd, TCGETS2, &tio) < 0)
+		return -1;
+	*rate = tio.c_ospeed;
+	return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef _BAUDRATE_H_
+#define _BAUDRATE_H_
+
+int set_custom_baudrate(int fd, unsigned int rate);
+int get_custom_baudrate(int fd, unsigned int *rate);
+
+#endif
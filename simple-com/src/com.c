@@ -1,8 +1,23 @@
 /*
- * Building: cc -o com com.c
- * Usage   : ./com /dev/device [speed]
+ * Building: make, or cc -o com com.c baudrate.c
+ * Usage   : ./com [-b chunk] [-c capturefile] [-t] [-l] [-r count[:size]] /dev/device [speed]
  * Example : ./com /dev/ttyS0 [115200]
  * Keys    : Ctrl-A - exit, Ctrl-X - display control lines status
+ * Options : -b chunk   move up to 'chunk' bytes per read()/write() (default 4096)
+ *           -c file    capture received data to file, each line timestamped
+ *           -t         loopback throughput test (TX wired to RX); tests the
+ *                      given speed or every speed of the table
+ *           -d msecs   duration of each loopback test step (default 1000)
+ *           -l         low latency mode (ASYNC_LOW_LATENCY)
+ *           -m vmin    VMIN for the port (default 1)
+ *           -v vtime   VTIME for the port in 1/10 s (default 0)
+ *           -r count[:size]
+ *                      request/response latency benchmark, the far end
+ *                      must echo (loopback cable or 'com -e' on the peer)
+ *           -e         echo everything received back to the sender
+ *
+ * speed is either one of the table entries or any other bit rate, the
+ * latter is set through termios2/BOTHER
  * Darcs   : darcs get http://tinyserial.sf.net/
  * Homepage: http://tinyserial.sourceforge.net
  * Version : 2009-03-05
@@ -43,13 +58,54 @@
 #include <sys/signal.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <linux/serial.h>
+
+#include "baudrate.h"
 
-int transfer_byte(int from, int to, int is_control);
+#define DEFAULT_CHUNK	4096
+#define MAX_CHUNK	65536
+/* keep the loopback test from stuffing the driver's TX queue */
+#define LOOP_WINDOW	4096
+#define MAX_REQUEST	4096
+#define DEFAULT_SPEED	"500000"
+
+int transfer_block(int from, int to, int is_control);
 
 typedef struct {char *name; int flag; } speed_spec;
 
+static speed_spec speeds[] =
+{
+	{"1200", B1200},
+	{"2400", B2400},
+	{"4800", B4800},
+	{"9600", B9600},
+	{"19200", B19200},
+	{"38400", B38400},
+	{"57600", B57600},
+	{"115200", B115200},
+	{"460800", B460800},
+	{"500000", B500000},
+	{"576000", B576000},
+	{"921600", B921600},
+	{"1000000", B1000000},
+	{"2000000", B2000000},
+	{NULL, 0}
+};
+
+static int chunk_size = DEFAULT_CHUNK;
+static char *xfer_buf;
+static FILE *capture;
+static int capture_bol = 1;
+static int low_latency;
+static int vmin = 1;
+static int vtime;
+/* port flags before -l, put back on exit */
+static struct serial_struct saved_serial;
+static int serial_saved;
+
 
 void print_status(int fd) {
 	int status;
@@ -70,35 +126,395 @@ void print_status(int fd) {
 	fprintf(stderr, "\r\n");
 }
 
+void usage(char *prg) {
+	fprintf(stderr, "usage: %s [-b chunk] [-c capturefile] [-t [-d msecs]] [-l] [-m vmin] [-v vtime]\n", prg);
+	fprintf(stderr, "       [-r count[:size] | -e] /dev/device [speed]\n");
+	fprintf(stderr, "example: %s /dev/ttyS0 [500000]\n", prg);
+}
+
+void set_low_latency(int fd) {
+	struct serial_struct ss;
+
+	if(ioctl(fd, TIOCGSERIAL, &ss) < 0) {
+		perror("TIOCGSERIAL");
+		return;
+	}
+	if(!serial_saved) {
+		saved_serial = ss;
+		serial_saved = 1;
+	}
+	ss.flags |= ASYNC_LOW_LATENCY;
+	if(ioctl(fd, TIOCSSERIAL, &ss) < 0)
+		perror("TIOCSSERIAL");
+}
+
+void restore_low_latency(int fd) {
+	struct serial_struct ss;
+
+	if(!serial_saved || ioctl(fd, TIOCGSERIAL, &ss) < 0)
+		return;
+	ss.flags = saved_serial.flags;
+	if(ioctl(fd, TIOCSSERIAL, &ss) < 0)
+		perror("TIOCSSERIAL");
+}
+
+speed_spec *find_speed(const char *name) {
+	speed_spec *s;
+
+	for(s = speeds; s->name; s++) {
+		if(strcmp(s->name, name) == 0)
+			return s;
+	}
+	return NULL;
+}
+
+/* VMIN and VTIME are single cc bytes */
+int cc_value(const char *arg, const char *name) {
+	char *end;
+	long value = strtol(arg, &end, 0);
+
+	if(*end || value < 0 || value > 255) {
+		fprintf(stderr, "%s must be 0..255\n", name);
+		exit(1);
+	}
+	return value;
+}
+
+/* speeds with flag 0 are not in the table and go through termios2 */
+void setup_port(int fd, speed_spec *s) {
+	struct termios tio;
+	unsigned int rate;
+
+	memset(&tio, 0, sizeof(tio));
+	tio.c_cflag = (s->flag ? s->flag : B38400) | CS8 | CLOCAL | CREAD;
+	tio.c_iflag = IGNPAR;
+	tio.c_oflag = 0;
+	tio.c_lflag = 0;
+	tio.c_cc[VMIN]=vmin;
+	tio.c_cc[VTIME]=vtime;
+	tcflush(fd, TCIOFLUSH);
+	tcsetattr(fd,TCSANOW,&tio);
+
+	if(!s->flag) {
+		rate = strtoul(s->name, NULL, 10);
+		if(set_custom_baudrate(fd, rate) < 0)
+			perror("setting custom baudrate");
+		else if(get_custom_baudrate(fd, &rate) == 0 && rate != strtoul(s->name, NULL, 10))
+			fprintf(stderr, "driver uses %u baud instead of %s\n", rate, s->name);
+	}
+	if(low_latency)
+		set_low_latency(fd);
+}
+
+long elapsed_us(struct timeval *start) {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_usec - start->tv_usec);
+}
+
+/* write the whole buffer to a (possibly non-blocking) descriptor */
+int write_all(int fd, const char *buf, int len) {
+	int ret;
+	fd_set wfds;
+
+	while(len > 0) {
+		ret = write(fd, buf, len);
+		if(ret > 0) {
+			buf += ret;
+			len -= ret;
+			continue;
+		}
+		if(ret == -1 && errno == EINTR)
+			continue;
+		if(ret == -1 && errno == EAGAIN) {
+			FD_ZERO(&wfds);
+			FD_SET(fd, &wfds);
+			select(fd+1, NULL, &wfds, NULL, NULL);
+			continue;
+		}
+		perror("write failed");
+		return -1;
+	}
+	return 0;
+}
+
+/* append received data to the capture file, each line prefixed by a timestamp */
+void capture_data(const char *buf, int len) {
+	struct timeval tv;
+	const char *nl;
+	int n;
+
+	gettimeofday(&tv, NULL);
+	while(len > 0) {
+		if(capture_bol)
+			fprintf(capture, "[%ld.%06ld] ", (long)tv.tv_sec, (long)tv.tv_usec);
+		nl = memchr(buf, '\n', len);
+		n = nl ? nl - buf + 1 : len;
+		fwrite(buf, 1, n, capture);
+		capture_bol = (nl != NULL);
+		buf += n;
+		len -= n;
+	}
+}
+
+int get_icount(int fd, struct serial_icounter_struct *ic) {
+	memset(ic, 0, sizeof(*ic));
+	return ioctl(fd, TIOCGICOUNT, ic);
+}
+
+/*
+ * send a counting byte pattern and verify what comes back;
+ * TX and RX of the port must be connected
+ */
+void loopback_test(int fd, speed_spec *s, int msecs) {
+	struct serial_icounter_struct ic_start, ic_end;
+	struct timeval start, tv;
+	unsigned long tx = 0, rx = 0, errors = 0;
+	unsigned char tx_seq = 0, rx_seq = 0;
+	unsigned char *buf = (unsigned char *) xfer_buf;
+	int have_icount, sending = 1, ret, i, n;
+	long duration = 0, us;
+	fd_set rfds, wfds;
+
+	setup_port(fd, s);
+	have_icount = (get_icount(fd, &ic_start) == 0);
+	gettimeofday(&start, NULL);
+
+	for(;;) {
+		us = elapsed_us(&start);
+		if(sending && us >= msecs * 1000L) {
+			sending = 0;
+			duration = us;
+		}
+		/* give the bytes in flight some time to drain */
+		if(!sending && (rx >= tx || us >= msecs * 1000L + 500000L))
+			break;
+
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(fd, &rfds);
+		if(sending && tx - rx < LOOP_WINDOW)
+			FD_SET(fd, &wfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		ret = select(fd+1, &rfds, &wfds, NULL, &tv);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			perror("select");
+			break;
+		}
+		if(FD_ISSET(fd, &wfds)) {
+			n = LOOP_WINDOW - (tx - rx);
+			if(n > chunk_size)
+				n = chunk_size;
+			for(i = 0; i < n; i++)
+				buf[i] = tx_seq + i;
+			ret = write(fd, buf, n);
+			if(ret > 0) {
+				tx += ret;
+				tx_seq += ret;
+			}
+		}
+		if(FD_ISSET(fd, &rfds)) {
+			ret = read(fd, buf, chunk_size);
+			for(i = 0; i < ret; i++) {
+				if(buf[i] != rx_seq)
+					errors++;
+				rx_seq = buf[i] + 1;
+			}
+			if(ret > 0)
+				rx += ret;
+		}
+	}
+
+	if(!duration)
+		duration = 1;
+	fprintf(stderr, "%8s baud: %8lu bytes/s (%3lu%% of line rate), tx %lu rx %lu, %lu errors",
+		s->name, rx * 1000000UL / duration, rx * 1000000UL / duration * 1000 / strtoul(s->name, NULL, 10),
+		tx, rx, errors);
+	if(have_icount && get_icount(fd, &ic_end) == 0)
+		fprintf(stderr, ", %d overruns, %d buffer overruns\n",
+			ic_end.overrun - ic_start.overrun, ic_end.buf_overrun - ic_start.buf_overrun);
+	else
+		fprintf(stderr, ", overruns n/a\n");
+}
+
+int wait_readable(int fd, int msecs) {
+	struct timeval tv;
+	fd_set fds;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	tv.tv_sec = msecs / 1000;
+	tv.tv_usec = (msecs % 1000) * 1000;
+	return select(fd+1, &fds, NULL, NULL, &tv);
+}
+
+int compare_long(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * request/response round trip benchmark: send 'size' bytes, block until
+ * the same amount came back and take the time; VMIN decides how many
+ * bytes a single read() waits for
+ */
+void latency_test(int fd, speed_spec *s, int count, int size) {
+	unsigned char req[MAX_REQUEST], rsp[MAX_REQUEST];
+	struct timeval start;
+	long *rtt, sum = 0;
+	int i, n, ret, got, errors = 0, timeouts = 0;
+
+	rtt = malloc(count * sizeof(long));
+	if(!rtt) {
+		perror("malloc");
+		return;
+	}
+	setup_port(fd, s);
+	/* blocking reads, so VMIN/VTIME are in charge of the wakeups */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+	for(i = 0, n = 0; i < count; i++) {
+		memset(req, i, size);
+		gettimeofday(&start, NULL);
+		if(write_all(fd, (char *)req, size) < 0)
+			break;
+		for(got = 0; got < size; got += ret) {
+			/* VTIME is an inter-byte timer only, don't hang on a lost request */
+			if(got == 0 && wait_readable(fd, 1000) <= 0)
+				break;
+			ret = read(fd, rsp + got, size - got);
+			if(ret < 0 && errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			if(ret <= 0)
+				break;
+		}
+		if(got < size) {
+			timeouts++;
+			tcflush(fd, TCIFLUSH);
+			continue;
+		}
+		rtt[n] = elapsed_us(&start);
+		sum += rtt[n++];
+		if(memcmp(req, rsp, size))
+			errors++;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if(n) {
+		qsort(rtt, n, sizeof(long), compare_long);
+		fprintf(stderr, "%s baud, %d byte requests: %d round trips, min %ld avg %ld median %ld p99 %ld max %ld us\n",
+			s->name, size, n, rtt[0], sum / n, rtt[n / 2], rtt[(n * 99) / 100], rtt[n - 1]);
+	}
+	fprintf(stderr, "%d mismatches, %d timeouts\n", errors, timeouts);
+	free(rtt);
+}
+
+/* responder side of the latency benchmark */
+void echo_loop(int fd) {
+	fd_set fds;
+	int ret;
+
+	for(;;) {
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		ret = select(fd+1, &fds, NULL, NULL, NULL);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret < 0) {
+			perror("select");
+			return;
+		}
+		ret = read(fd, xfer_buf, chunk_size);
+		if(ret < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if(ret <= 0) {
+			fprintf(stderr, "\nnothing to read. probably port disconnected.\n");
+			return;
+		}
+		if(write_all(fd, xfer_buf, ret) < 0)
+			return;
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	int comfd;
-	struct termios oldtio, newtio;       //place for old and new port settings for serial port
+	struct termios oldtio;               //place for old port settings for serial port
 	struct termios oldkey, newkey;       //place tor old and new port settings for keyboard teletype
-	char *devicename = argv[1];
+	char *devicename;
+	char *capturename = NULL;
 	int need_exit = 0;
-	speed_spec speeds[] =
-	{
-		{"1200", B1200},
-		{"2400", B2400},
-		{"4800", B4800},
-		{"9600", B9600},
-		{"19200", B19200},
-		{"38400", B38400},
-		{"57600", B57600},
-		{"115200", B115200},
-		{"460800", B460800},
-		{"500000", B500000},
-		{"576000", B576000},
-		{"921600", B921600},
-		{"1000000", B1000000},
-		{"2000000", B2000000},
-		{NULL, 0}
-	};
-	int speed = B500000;
-
-	if(argc < 2) {
-		fprintf(stderr, "example: %s /dev/ttyS0 [500000]\n", argv[0]);
+	int looptest = 0;
+	int echo = 0;
+	int requests = 0, request_size = 1;
+	int msecs = 1000;
+	int opt;
+	char *p;
+	speed_spec *s, *selected = NULL;
+	speed_spec custom = {NULL, 0};
+	speed_spec *speed = find_speed(DEFAULT_SPEED);
+
+	while((opt = getopt(argc, argv, "b:c:d:elm:r:tv:h?")) != -1) {
+		switch(opt) {
+		case 'b':
+			chunk_size = strtoul(optarg, NULL, 0);
+			if(chunk_size < 1 || chunk_size > MAX_CHUNK) {
+				fprintf(stderr, "chunk size must be 1..%d\n", MAX_CHUNK);
+				exit(1);
+			}
+			break;
+		case 'c':
+			capturename = optarg;
+			break;
+		case 'd':
+			msecs = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			echo = 1;
+			break;
+		case 'l':
+			low_latency = 1;
+			break;
+		case 'm':
+			vmin = cc_value(optarg, "vmin");
+			break;
+		case 'r':
+			requests = strtoul(optarg, &p, 0);
+			if(*p == ':')
+				request_size = strtoul(p + 1, NULL, 0);
+			if(requests < 1 || request_size < 1 || request_size > MAX_REQUEST) {
+				fprintf(stderr, "request size must be 1..%d\n", MAX_REQUEST);
+				exit(1);
+			}
+			break;
+		case 't':
+			looptest = 1;
+			break;
+		case 'v':
+			vtime = cc_value(optarg, "vtime");
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if(optind >= argc) {
+		usage(argv[0]);
+		exit(1);
+	}
+	devicename = argv[optind];
+
+	xfer_buf = malloc(chunk_size);
+	if(!xfer_buf) {
+		perror("malloc");
 		exit(1);
 	}
 
@@ -109,14 +525,59 @@ int main(int argc, char *argv[])
 		exit(-1);
 	}
 
-	if(argc > 2) {	
-		speed_spec *s;
-		for(s = speeds; s->name; s++) {
-			if(strcmp(s->name, argv[2]) == 0) {
-				speed = s->flag;
-				fprintf(stderr, "setting speed %s\n", s->name);
-				break;
+	if(argc > optind + 1) {
+		selected = find_speed(argv[optind + 1]);
+		if(selected) {
+			speed = selected;
+		} else {
+			if(strtoul(argv[optind + 1], NULL, 10) == 0) {
+				fprintf(stderr, "invalid speed %s\n", argv[optind + 1]);
+				exit(1);
 			}
+			custom.name = argv[optind + 1];
+			speed = selected = &custom;
+		}
+		fprintf(stderr, "setting speed %s\n", selected->name);
+	}
+
+	tcgetattr(comfd,&oldtio); // save current port settings 
+
+	if(looptest) {
+		if(selected) {
+			loopback_test(comfd, selected, msecs);
+		} else {
+			for(s = speeds; s->name; s++)
+				loopback_test(comfd, s, msecs);
+		}
+		restore_low_latency(comfd);
+		tcsetattr(comfd,TCSANOW,&oldtio);
+		close(comfd);
+		return 0;
+	}
+
+	if(requests || echo) {
+		/* one shot request/response settings unless told otherwise */
+		if(requests && vmin == 1 && vtime == 0) {
+			vmin = request_size > 255 ? 255 : request_size;
+			vtime = 10;
+		}
+		if(requests)
+			latency_test(comfd, speed, requests, request_size);
+		else {
+			setup_port(comfd, speed);
+			echo_loop(comfd);
+		}
+		restore_low_latency(comfd);
+		tcsetattr(comfd,TCSANOW,&oldtio);
+		close(comfd);
+		return 0;
+	}
+
+	if(capturename) {
+		capture = fopen(capturename, "a");
+		if(!capture) {
+			perror(capturename);
+			exit(1);
 		}
 	}
 
@@ -132,16 +593,7 @@ int main(int argc, char *argv[])
 	tcflush(STDIN_FILENO, TCIFLUSH);
 	tcsetattr(STDIN_FILENO,TCSANOW,&newkey);
 
-
-	tcgetattr(comfd,&oldtio); // save current port settings 
-	newtio.c_cflag = speed | CS8 | CLOCAL | CREAD;
-	newtio.c_iflag = IGNPAR;
-	newtio.c_oflag = 0;
-	newtio.c_lflag = 0;
-	newtio.c_cc[VMIN]=1;
-	newtio.c_cc[VTIME]=0;
-	tcflush(comfd, TCIFLUSH);
-	tcsetattr(comfd,TCSANOW,&newtio);
+	setup_port(comfd, speed);
 
 	print_status(comfd);
 
@@ -159,45 +611,54 @@ int main(int argc, char *argv[])
 			perror("select");
 		} else if (ret > 0) {
 			if(FD_ISSET(STDIN_FILENO, &fds)) {
-				need_exit = transfer_byte(STDIN_FILENO, comfd, 1);
+				need_exit = transfer_block(STDIN_FILENO, comfd, 1);
 			}
-			if(FD_ISSET(comfd, &fds)) {
-				need_exit = transfer_byte(comfd, STDIN_FILENO, 0);
+			if(!need_exit && FD_ISSET(comfd, &fds)) {
+				need_exit = transfer_block(comfd, STDIN_FILENO, 0);
 			}
 		}
 	}
 
+	restore_low_latency(comfd);
 	tcsetattr(comfd,TCSANOW,&oldtio);
 	tcsetattr(STDIN_FILENO,TCSANOW,&oldkey);
 	close(comfd);
+	if(capture)
+		fclose(capture);
 
 	return 0;
 }
 
 
-int transfer_byte(int from, int to, int is_control) {
-	char c;
-	int ret;
+/* move up to chunk_size bytes in one go, control keys are only honoured on the keyboard side */
+int transfer_block(int from, int to, int is_control) {
+	char *c = xfer_buf;
+	int ret, i, start;
 	do {
-		ret = read(from, &c, 1);
+		ret = read(from, c, chunk_size);
 	} while (ret < 0 && errno == EINTR);
-	if(ret == 1) {
-		if(is_control) {
-			if(c == '\x01') { // C-a
-				return -1;
-			} else if(c == '\x18') { // C-x
-				print_status(to);
-				return 0;
-			}
-		}
-		while(write(to, &c, 1) == -1) {
-			if(errno!=EAGAIN && errno!=EINTR) { perror("write failed"); break; }
-		}
-	} else {
+	if(ret < 0 && errno == EAGAIN)
+		return 0;
+	if(ret <= 0) {
 		fprintf(stderr, "\nnothing to read. probably port disconnected.\n");
 		return -2;
 	}
+	if(!is_control) {
+		if(capture)
+			capture_data(c, ret);
+		write_all(to, c, ret);
+		return 0;
+	}
+	for(i = 0, start = 0; i < ret; i++) {
+		if(c[i] == '\x01') { // C-a
+			write_all(to, c + start, i - start);
+			return -1;
+		} else if(c[i] == '\x18') { // C-x
+			write_all(to, c + start, i - start);
+			print_status(to);
+			start = i + 1;
+		}
+	}
+	write_all(to, c + start, ret - start);
 	return 0;
 }
-
-
@@ -0,0 +1,400 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sml/sml_file.h>
+#include <sml/sml_message.h>
+#include <sml/sml_transport.h>
+
+#include "history.h"
+#include "obis.h"
+
+#define HISTORY_DUMP_HEADER	16
+#define HISTORY_BLOCK_HEADER	16
+/* GetProfileList.Res messages per SML file and the buffer they are written to */
+#define HISTORY_SML_BATCH	32
+#define HISTORY_SML_BUFFER	8192
+
+static int put_varint(unsigned char *p, unsigned long long v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+	p[n++] = v | 0x80;
+	v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+/* bytes taken, 0 if the varint runs past end */
+static int get_varint(const unsigned char *p, const unsigned char *end, unsigned long long *v)
+{
+    int n = 0, shift = 0;
+
+    *v = 0;
+    while (p + n < end && shift < 64) {
+	*v |= (unsigned long long)(p[n] & 0x7f) << shift;
+	if (!(p[n++] & 0x80))
+	    return n;
+	shift += 7;
+    }
+    return 0;
+}
+
+static inline unsigned long long zigzag(long long v)
+{
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static inline long long unzigzag(unsigned long long v)
+{
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+int history_init(struct history *history, size_t bytes)
+{
+    memset(history, 0, sizeof(struct history));
+    history->blocks_len = bytes / HISTORY_BLOCK;
+    if (history->blocks_len < 2)
+	history->blocks_len = 2;
+    history->blocks = calloc(history->blocks_len, sizeof(struct history_block));
+    return history->blocks ? 0 : -1;
+}
+
+void history_free(struct history *history)
+{
+    free(history->blocks);
+    history->blocks = NULL;
+    history->used = 0;
+}
+
+void history_clear(struct history *history)
+{
+    seqlock_write_begin(&history->seqlock);
+    history->used = 0;
+    seqlock_write_end(&history->seqlock);
+}
+
+void history_add(struct history *history, unsigned int time, long long value, unsigned char time_tag)
+{
+    struct history_block *block;
+    unsigned char delta[20];
+    int n;
+
+    if (!history->blocks || (history->used && time == history->last_time && time_tag == history->time_tag))
+	return;
+
+    seqlock_write_begin(&history->seqlock);
+    /* the meter restarted its second index or changed the kind of time */
+    if (history->used && (time < history->last_time || time_tag != history->time_tag))
+	history->used = 0;
+    history->time_tag = time_tag;
+
+    if (history->used) {
+	block = &history->blocks[(history->first + history->used - 1) % history->blocks_len];
+	n = put_varint(delta, time - history->last_time);
+	n += put_varint(delta + n, zigzag(value - history->last_value));
+	if (block->len + n <= HISTORY_DATA && block->samples < 0xffff) {
+	    memcpy(block->data + block->len, delta, n);
+	    block->len += n;
+	    block->samples++;
+	    goto done;
+	}
+    }
+
+    if (history->used == history->blocks_len) {
+	history->first = (history->first + 1) % history->blocks_len;
+	history->used--;
+    }
+    block = &history->blocks[(history->first + history->used) % history->blocks_len];
+    history->used++;
+    block->time = time;
+    block->value = value;
+    block->samples = 1;
+    block->len = 0;
+
+done:
+    history->last_time = time;
+    history->last_value = value;
+    seqlock_write_end(&history->seqlock);
+}
+
+int history_snapshot(struct history *history, struct history *copy)
+{
+    unsigned int sequence, head;
+
+    memset(copy, 0, sizeof(struct history));
+    copy->blocks = malloc(history->blocks_len * sizeof(struct history_block));
+    if (!copy->blocks)
+	return -1;
+
+    /* the copy is linear, oldest block first */
+    do {
+	sequence = seqlock_read_begin(&history->seqlock);
+	copy->time_tag = history->time_tag;
+	copy->blocks_len = history->blocks_len;
+	copy->used = history->used;
+	copy->last_time = history->last_time;
+	copy->last_value = history->last_value;
+	head = history->blocks_len - history->first;
+	if (head > copy->used)
+	    head = copy->used;
+	memcpy(copy->blocks, history->blocks + history->first, head * sizeof(struct history_block));
+	memcpy(copy->blocks + head, history->blocks, (copy->used - head) * sizeof(struct history_block));
+    } while (seqlock_read_retry(&history->seqlock, sequence));
+    return 0;
+}
+
+/* 1 if cb stopped the walk, -1 if the block is malformed */
+static int block_walk(unsigned int time, long long value, unsigned int samples, const unsigned char *data,
+		      unsigned int len, unsigned int from, unsigned int to, history_cb cb, void *arg)
+{
+    const unsigned char *p = data, *end = data + len;
+    unsigned long long dt, dv;
+    int n;
+
+    while (1) {
+	if (time > to)
+	    return 1;
+	if (time >= from && cb(arg, time, value))
+	    return 1;
+	if (!--samples)
+	    break;
+	if (!(n = get_varint(p, end, &dt)))
+	    return -1;
+	p += n;
+	if (!(n = get_varint(p, end, &dv)))
+	    return -1;
+	p += n;
+	time += dt;
+	value += unzigzag(dv);
+    }
+    return p == end ? 0 : -1;
+}
+
+int history_walk(const struct history *history, unsigned int from, unsigned int to, history_cb cb, void *arg)
+{
+    const struct history_block *block;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < history->used; i++) {
+	block = &history->blocks[(history->first + i) % history->blocks_len];
+	/* all samples of this block are older than the next block */
+	if (i + 1 < history->used && history->blocks[(history->first + i + 1) % history->blocks_len].time <= from)
+	    continue;
+	ret = block_walk(block->time, block->value, block->samples, block->data, block->len, from, to, cb, arg);
+	if (ret)
+	    return ret < 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+unsigned int history_samples(const struct history *history)
+{
+    unsigned int i, samples = 0;
+
+    for (i = 0; i < history->used; i++)
+	samples += history->blocks[(history->first + i) % history->blocks_len].samples;
+    return samples;
+}
+
+size_t history_bytes(const struct history *history)
+{
+    unsigned int i;
+    size_t bytes = 0;
+
+    for (i = 0; i < history->used; i++)
+	bytes += HISTORY_BLOCK_HEADER + history->blocks[(history->first + i) % history->blocks_len].len;
+    return bytes;
+}
+
+static unsigned char *put_le(unsigned char *p, unsigned long long v, int bytes)
+{
+    while (bytes--) {
+	*p++ = v;
+	v >>= 8;
+    }
+    return p;
+}
+
+static unsigned long long get_le(const unsigned char *p, int bytes)
+{
+    unsigned long long v = 0;
+
+    while (bytes--)
+	v = v << 8 | p[bytes];
+    return v;
+}
+
+unsigned char *history_dump(const struct history *history, const unsigned char *obis, signed char scaler,
+			    unsigned char unit, size_t *len)
+{
+    const struct history_block *block;
+    unsigned char *dump, *p;
+    unsigned int i;
+
+    dump = malloc(HISTORY_DUMP_HEADER + history_bytes(history));
+    if (!dump)
+	return NULL;
+    p = dump;
+    memcpy(p, "SMLH", 4);
+    p += 4;
+    *p++ = HISTORY_DUMP_VERSION;
+    *p++ = history->time_tag;
+    *p++ = scaler;
+    *p++ = unit;
+    memcpy(p, obis, OBIS_LEN);
+    p += OBIS_LEN;
+    p = put_le(p, history->used, 2);
+    for (i = 0; i < history->used; i++) {
+	block = &history->blocks[(history->first + i) % history->blocks_len];
+	p = put_le(p, block->time, 4);
+	p = put_le(p, block->value, 8);
+	p = put_le(p, block->samples, 2);
+	p = put_le(p, block->len, 2);
+	memcpy(p, block->data, block->len);
+	p += block->len;
+    }
+    *len = p - dump;
+    return dump;
+}
+
+int history_dump_walk(const unsigned char *dump, size_t len, history_cb cb, void *arg)
+{
+    const unsigned char *p = dump + HISTORY_DUMP_HEADER, *end = dump + len;
+    unsigned int blocks, samples, data_len;
+    int ret;
+
+    if (len < HISTORY_DUMP_HEADER || memcmp(dump, "SMLH", 4) || dump[4] != HISTORY_DUMP_VERSION)
+	return -1;
+    blocks = get_le(dump + 14, 2);
+    while (blocks--) {
+	if (end - p < HISTORY_BLOCK_HEADER)
+	    return -1;
+	samples = get_le(p + 12, 2);
+	data_len = get_le(p + 14, 2);
+	if (!samples || end - p - HISTORY_BLOCK_HEADER < data_len)
+	    return -1;
+	ret = block_walk(get_le(p, 4), get_le(p + 4, 8), samples, p + HISTORY_BLOCK_HEADER, data_len,
+			 0, ~0U, cb, arg);
+	if (ret)
+	    return ret < 0 ? -1 : 0;
+	p += HISTORY_BLOCK_HEADER + data_len;
+    }
+    return p == end ? 0 : -1;
+}
+
+struct sml_writer {
+    int fd;
+    int error;
+    sml_file *file;
+    const char *server_id;
+    const unsigned char *obis;
+    signed char scaler;
+    unsigned char unit;
+    unsigned char time_tag;
+    unsigned int act_time;
+    unsigned int transaction;
+};
+
+static sml_time *sml_time_of(unsigned char tag, unsigned int time)
+{
+    sml_time *t = sml_time_init();
+
+    t->tag = sml_u8_init(tag);
+    t->data.timestamp = sml_u32_init(time);
+    return t;
+}
+
+static sml_message *profile_message(struct sml_writer *w, unsigned int time, long long value)
+{
+    sml_get_profile_list_response *res;
+    sml_period_entry *entry;
+    sml_message *msg;
+    unsigned char id[4];
+
+    entry = sml_period_entry_init();
+    entry->obj_name = sml_octet_string_init((unsigned char *)w->obis, OBIS_LEN);
+    entry->unit = sml_unit_init(w->unit);
+    entry->scaler = sml_i8_init(w->scaler);
+    entry->value = sml_value_init();
+    entry->value->type = SML_TYPE_INTEGER | SML_TYPE_NUMBER_64;
+    entry->value->data.int64 = sml_i64_init(value);
+
+    res = sml_get_profile_list_response_init();
+    res->server_id = sml_octet_string_init_from_hex((char *)w->server_id);
+    res->act_time = sml_time_of(w->time_tag, w->act_time);
+    res->parameter_tree_path = sml_tree_path_init();
+    sml_tree_path_add_path_entry(res->parameter_tree_path, sml_octet_string_init((unsigned char *)w->obis, OBIS_LEN));
+    res->val_time = sml_time_of(w->time_tag, time);
+    res->period_list = sml_sequence_init((void (*)(void *))&sml_period_entry_free);
+    sml_sequence_add(res->period_list, entry);
+
+    /* a counter does for the transaction id, no random numbers needed */
+    msg = sml_malloc(sizeof(sml_message));
+    memset(msg, 0, sizeof(sml_message));
+    put_le(id, ++w->transaction, sizeof(id));
+    msg->transaction_id = sml_octet_string_init(id, sizeof(id));
+    msg->group_id = sml_u8_init(0);
+    msg->abort_on_error = sml_u8_init(0);
+    msg->message_body = sml_message_body_init(SML_MESSAGE_GET_PROFILE_LIST_RESPONSE, res);
+    return msg;
+}
+
+static int sml_flush(struct sml_writer *w)
+{
+    if (w->file && w->file->messages_len) {
+	if (!sml_transport_write(w->fd, w->file))
+	    w->error = 1;
+	sml_file_free(w->file);
+    } else if (w->file) {
+	sml_file_free(w->file);
+    }
+    w->file = NULL;
+    return w->error;
+}
+
+static int sml_sample(void *arg, unsigned int time, long long value)
+{
+    struct sml_writer *w = (struct sml_writer *)arg;
+
+    if (!w->file) {
+	w->file = sml_file_init();
+	sml_buffer_free(w->file->buf);
+	w->file->buf = sml_buffer_init(HISTORY_SML_BUFFER);
+    }
+    sml_file_add_message(w->file, profile_message(w, time, value));
+    if (w->file->messages_len == HISTORY_SML_BATCH)
+	return sml_flush(w);
+    return 0;
+}
+
+int history_write_sml(int fd, const struct history *history, const char *server_id, const unsigned char *obis,
+		      signed char scaler, unsigned char unit, unsigned int from, unsigned int to)
+{
+    struct sml_writer w;
+
+    memset(&w, 0, sizeof(w));
+    w.fd = fd;
+    w.server_id = server_id;
+    w.obis = obis;
+    w.scaler = scaler;
+    w.unit = unit;
+    w.time_tag = history->time_tag;
+    w.act_time = history->last_time;
+    if (history_walk(history, from, to, sml_sample, &w) < 0)
+	w.error = 1;
+    sml_flush(&w);
+    return w.error ? -1 : 0;
+}
@@ -0,0 +1,96 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef HISTORY_H_INCLUDED
+#define HISTORY_H_INCLUDED
+
+#include <stddef.h>
+#include "mib.h"
+
+/*
+ * value history
+ *
+ * a fixed amount of memory per meter value, split into blocks used as a
+ * ring: when the newest block is full the oldest one is dropped. A block
+ * starts with the time and raw value of its first sample, the following
+ * samples are stored as varint coded time and value differences; rising
+ * energy counters read every second take two bytes per sample.
+ *
+ * Times are the meter's own (sensor time, mostly a second index), the
+ * receive time only if the meter sends none. Samples that don't advance
+ * the time are dropped.
+ *
+ * The reader thread is the only writer; readers copy the ring under the
+ * sequence lock and decode the copy.
+ *
+ * binary dump, all numbers little endian:
+ *   "SMLH" version(1) time_tag(1) scaler(1) unit(1) obis(6) blocks(2)
+ *   per block, oldest first:
+ *     time(4) value(8) samples(2) length(2) data(length)
+ */
+
+#define HISTORY_BLOCK		256
+#define HISTORY_DATA		(HISTORY_BLOCK - 16)
+#define HISTORY_DUMP_VERSION	1
+
+struct history_block {
+    unsigned int time;
+    unsigned short samples;
+    unsigned short len;
+    long long value;
+    unsigned char data[HISTORY_DATA];
+};
+
+struct history {
+    struct seqlock seqlock;
+    unsigned char time_tag;	/* SML_TIME_SEC_INDEX or SML_TIME_TIMESTAMP */
+    unsigned int blocks_len;	/* capacity */
+    unsigned int first;		/* oldest block */
+    unsigned int used;
+    unsigned int last_time;
+    long long last_value;
+    struct history_block *blocks;
+};
+
+/* return non zero to stop */
+typedef int (*history_cb) (void *arg, unsigned int time, long long value);
+
+/* bytes are rounded down to whole blocks, at least two */
+int history_init(struct history *history, size_t bytes);
+
+void history_free(struct history *history);
+
+/* drops all samples, for a new meter on the port */
+void history_clear(struct history *history);
+
+void history_add(struct history *history, unsigned int time, long long value, unsigned char time_tag);
+
+/* consistent copy of history to decode at leisure, free with history_free() */
+int history_snapshot(struct history *history, struct history *copy);
+
+/* samples with from <= time <= to, oldest first */
+int history_walk(const struct history *history, unsigned int from, unsigned int to, history_cb cb, void *arg);
+
+unsigned int history_samples(const struct history *history);
+
+/* bytes taken by the samples, block headers included */
+size_t history_bytes(const struct history *history);
+
+/* binary dump into a malloc()ed buffer */
+unsigned char *history_dump(const struct history *history, const unsigned char *obis, signed char scaler,
+			    unsigned char unit, size_t *len);
+
+/* samples of a binary dump, -1 if it is malformed */
+int history_dump_walk(const unsigned char *dump, size_t len, history_cb cb, void *arg);
+
+/* SML files of GetProfileList.Res messages, one per sample, written to fd */
+int history_write_sml(int fd, const struct history *history, const char *server_id, const unsigned char *obis,
+		      signed char scaler, unsigned char unit, unsigned int from, unsigned int to);
+
+#endif
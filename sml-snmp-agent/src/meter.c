@@ -0,0 +1,368 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include "snmp.h"
+#include "meter.h"
+
+#define ENTERPRISE	"1.3.6.1.4.1.39241"
+
+struct meter meters[METER_MAX];
+int meters_len;
+struct seqlock value_seqlock;
+
+static const unsigned long long decimal[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL
+};
+
+#define DECIMAL_MAX	(sizeof(decimal) / sizeof(decimal[0]) - 1)
+
+struct meter *meter_add(const char *device)
+{
+    struct meter *meter;
+
+    if (meters_len == METER_MAX || strlen(device) >= METER_DEVICE_LEN)
+	return NULL;
+    meter = &meters[meters_len];
+    memset(meter, 0, sizeof(struct meter));
+    meter->index = ++meters_len;
+    meter->fd = -1;
+    strcpy(meter->device, device);
+    return meter;
+}
+
+int meter_init(size_t history)
+{
+    int i, j;
+
+    if (!obis_len)
+	obis_defaults();
+    for (i = 0; i < meters_len; i++) {
+	meters[i].values = calloc(obis_len, sizeof(struct meter_value));
+	if (!meters[i].values)
+	    return -1;
+	if (!history)
+	    continue;
+	meters[i].history = calloc(obis_len, sizeof(struct history));
+	if (!meters[i].history)
+	    return -1;
+	for (j = 0; j < obis_len; j++) {
+	    if (history_init(&meters[i].history[j], history))
+		return -1;
+	}
+    }
+    return 0;
+}
+
+static void meter_value_set(struct meter_value *slot, long long raw, unsigned char type, signed char scaler,
+			    unsigned char unit, time_t time)
+{
+    seqlock_write_begin(&slot->seqlock);
+    slot->raw = raw;
+    slot->type = type;
+    slot->scaler = scaler;
+    slot->unit = unit;
+    slot->time = time;
+    seqlock_write_end(&slot->seqlock);
+}
+
+void meter_update(struct meter *meter, sml_file *file, time_t now)
+{
+    sml_get_list_response *body;
+    sml_list *entry;
+    time_t time;
+    long long raw;
+    int i, index, time_tag;
+
+    meter->telegrams++;
+    for (i = 0; i < file->messages_len; i++) {
+	sml_message *message = file->messages[i];
+
+	if (*message->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+	    continue;
+	body = (sml_get_list_response *) message->message_body->data;
+	if (body->server_id)
+	    meter_set_server_id(meter, body->server_id->str, body->server_id->len);
+
+	time = now;
+	time_tag = SML_TIME_TIMESTAMP;
+	if (body->act_sensor_time) {
+	    time = *body->act_sensor_time->data.timestamp;
+	    time_tag = *body->act_sensor_time->tag;
+	} else if (body->act_gateway_time) {
+	    time = *body->act_gateway_time->data.timestamp;
+	    time_tag = *body->act_gateway_time->tag;
+	}
+
+	for (entry = body->val_list; entry != NULL; entry = entry->next) {	/* linked list */
+	    if (!entry->obj_name || entry->obj_name->len != OBIS_LEN || !entry->value)
+		continue;
+	    /* codes nobody asked for are dropped before the value is looked at */
+	    index = obis_lookup(entry->obj_name->str);
+	    if (index < 0)
+		continue;
+
+	    switch (entry->value->type) {
+	    case 0x51:
+		raw = *entry->value->data.int8;
+		break;
+	    case 0x52:
+		raw = *entry->value->data.int16;
+		break;
+	    case 0x54:
+		raw = *entry->value->data.int32;
+		break;
+	    case 0x58:
+		raw = *entry->value->data.int64;
+		break;
+	    case 0x61:
+		raw = *entry->value->data.uint8;
+		break;
+	    case 0x62:
+		raw = *entry->value->data.uint16;
+		break;
+	    case 0x64:
+		raw = *entry->value->data.uint32;
+		break;
+	    case 0x68:
+		raw = (long long)*entry->value->data.uint64;
+		break;
+	    default:
+		continue;
+	    }
+	    meter_value_set(&meter->values[index], raw, entry->value->type,
+			    entry->scaler ? *entry->scaler : 0, entry->unit ? *entry->unit : 0, time);
+	    if (meter->history)
+		history_add(&meter->history[index], time, raw, time_tag);
+	}
+    }
+    meter->crc_errors = meter->decoder ? meter->decoder->crc_errors : 0;
+}
+
+void meter_set_server_id(struct meter *meter, const unsigned char *id, int len)
+{
+    char hex[sizeof(meter->server_id)];
+    int i;
+
+    if (len > SERVER_ID_MAX)
+	len = SERVER_ID_MAX;
+    for (i = 0; i < len; i++)
+	sprintf(hex + 2 * i, "%02x", id[i]);
+    hex[2 * len] = '\0';
+    if (!strcmp(hex, meter->server_id))
+	return;
+
+    /* another meter on this port, forget the values of the old one */
+    seqlock_write_begin(&value_seqlock);
+    strcpy(meter->server_id, hex);
+    seqlock_write_end(&value_seqlock);
+    for (i = 0; i < obis_len; i++) {
+	meter_value_set(&meter->values[i], 0, 0, 0, 0, 0);
+	if (meter->history)
+	    history_clear(&meter->history[i]);
+    }
+}
+
+long long meter_value_get(struct meter_value *value, time_t *time)
+{
+    unsigned long long raw, div;
+    unsigned int sequence;
+    unsigned char type;
+    int scaler, negative;
+
+    do {
+	sequence = seqlock_read_begin(&value->seqlock);
+	raw = value->raw;
+	type = value->type;
+	scaler = value->scaler;
+	if (time)
+	    *time = value->time;
+    } while (seqlock_read_retry(&value->seqlock, sequence));
+
+    /* unsigned types stay unsigned, signed ones are scaled by magnitude */
+    negative = (type & 0xf0) == 0x50 && (long long)raw < 0;
+    if (negative)
+	raw = -raw;
+    if (scaler > (int)DECIMAL_MAX)
+	scaler = DECIMAL_MAX;
+    if (scaler < -(int)DECIMAL_MAX)
+	scaler = -(int)DECIMAL_MAX;
+    if (scaler >= 0) {
+	raw *= decimal[scaler];
+    } else {
+	div = decimal[-scaler];
+	raw = (raw + div / 2) / div;
+    }
+    return negative ? -(long long)raw : (long long)raw;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+	n = write(fd, data, len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return -1;
+	data += n;
+	len -= n;
+    }
+    return 0;
+}
+
+int meter_history_request(int fd, const char *request)
+{
+    char command[16], obis_text[32], server_id[sizeof(meters[0].server_id)];
+    unsigned char obis[OBIS_LEN], *dump;
+    unsigned int from = 0, to = ~0U, sequence;
+    struct meter_value *value;
+    struct history copy;
+    struct meter *meter;
+    signed char scaler;
+    unsigned char unit;
+    int m, index, ret;
+    size_t len;
+
+    if (sscanf(request, "%15s %d %31s %u %u", command, &m, obis_text, &from, &to) < 3)
+	return -1;
+    if (m < 1 || m > meters_len || obis_parse(obis_text, obis) || (index = obis_lookup(obis)) < 0)
+	return -1;
+    meter = &meters[m - 1];
+    if (!meter->history)
+	return -1;
+
+    value = &meter->values[index];
+    do {
+	sequence = seqlock_read_begin(&value->seqlock);
+	scaler = value->scaler;
+	unit = value->unit;
+    } while (seqlock_read_retry(&value->seqlock, sequence));
+    do {
+	sequence = seqlock_read_begin(&value_seqlock);
+	strcpy(server_id, meter->server_id);
+    } while (seqlock_read_retry(&value_seqlock, sequence));
+
+    if (history_snapshot(&meter->history[index], &copy))
+	return -1;
+    if (!strcmp(command, "dump")) {
+	dump = history_dump(&copy, obis, scaler, unit, &len);
+	ret = dump ? write_all(fd, dump, len) : -1;
+	free(dump);
+    } else if (!strcmp(command, "profile")) {
+	ret = history_write_sml(fd, &copy, server_id, obis, scaler, unit, from, to);
+    } else {
+	ret = -1;
+    }
+    history_free(&copy);
+    return ret;
+}
+
+/* INTEGER is an Integer32, readings beyond it saturate instead of wrapping */
+static void get_value(void *arg, struct mib_value *value)
+{
+    long long reading = meter_value_get((struct meter_value *)arg, NULL);
+
+    value->type = PRIMV_INT;
+    if (reading > INT_MAX)
+	value->integer = INT_MAX;
+    else if (reading < INT_MIN)
+	value->integer = INT_MIN;
+    else
+	value->integer = reading;
+}
+
+static void get_device(void *arg, struct mib_value *value)
+{
+    value->type = PRIMV_OCTSTR;
+    value->string = ((struct meter *)arg)->device;
+}
+
+#if 2 * SERVER_ID_MAX + 1 > MIB_BUFFER_MAX
+#error "server ids don't fit into a mib_value buffer"
+#endif
+
+/* the id changes when the meter on the port is replaced, so it is copied under value_seqlock */
+static void get_server_id(void *arg, struct mib_value *value)
+{
+    struct meter *meter = arg;
+
+    value->type = PRIMV_OCTSTR;
+    memcpy(value->buffer, meter->server_id, sizeof(meter->server_id));
+    value->buffer[sizeof(meter->server_id) - 1] = '\0';
+    value->string = value->buffer;
+}
+
+static void get_telegrams(void *arg, struct mib_value *value)
+{
+    value->type = PRIMV_COUNTR;
+    value->integer = ((struct meter *)arg)->telegrams;
+}
+
+static void get_crc_errors(void *arg, struct mib_value *value)
+{
+    value->type = PRIMV_COUNTR;
+    value->integer = ((struct meter *)arg)->crc_errors;
+}
+
+static void register_oid(const char *oid, mib_getter get, void *arg)
+{
+    mib_register(strdup(oid), get, arg);
+}
+
+void meter_register_mib(void)
+{
+    static const char *legacy[] = {
+	ENTERPRISE ".1.8.0", ENTERPRISE ".1.8.1", ENTERPRISE ".1.8.2", ENTERPRISE ".16.7.0"
+    };
+    static const unsigned char legacy_obis[][OBIS_LEN] = {
+	{ 0x01, 0x00, 0x01, 0x08, 0x00, 0xff },
+	{ 0x01, 0x00, 0x01, 0x08, 0x01, 0xff },
+	{ 0x01, 0x00, 0x01, 0x08, 0x02, 0xff },
+	{ 0x01, 0x00, 0x10, 0x07, 0x00, 0xff },
+    };
+    struct meter *meter;
+    const unsigned char *o;
+    char oid[80];
+    int i, j;
+
+    for (i = 0; i < meters_len; i++) {
+	meter = &meters[i];
+	snprintf(oid, sizeof(oid), ENTERPRISE ".2.1.%d", meter->index);
+	register_oid(oid, get_device, meter);
+	snprintf(oid, sizeof(oid), ENTERPRISE ".2.2.%d", meter->index);
+	register_oid(oid, get_server_id, meter);
+	snprintf(oid, sizeof(oid), ENTERPRISE ".2.3.%d", meter->index);
+	register_oid(oid, get_telegrams, meter);
+	snprintf(oid, sizeof(oid), ENTERPRISE ".2.4.%d", meter->index);
+	register_oid(oid, get_crc_errors, meter);
+	for (j = 0; j < obis_len; j++) {
+	    o = obis_codes[j];
+	    snprintf(oid, sizeof(oid), ENTERPRISE ".3.%d.%d.%d.%d.%d.%d.%d", meter->index,
+		     o[0], o[1], o[2], o[3], o[4], o[5]);
+	    register_oid(oid, get_value, &meter->values[j]);
+	}
+    }
+    if (!meters_len)
+	return;
+    for (i = 0; i < sizeof(legacy) / sizeof(legacy[0]); i++) {
+	j = obis_lookup(legacy_obis[i]);
+	if (j >= 0)
+	    mib_register(legacy[i], get_value, &meters[0].values[j]);
+    }
+}
@@ -0,0 +1,101 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef METER_H_INCLUDED
+#define METER_H_INCLUDED
+
+#include <time.h>
+#include <sml/sml_transport.h>
+#include <sml/sml_file.h>
+#include "mib.h"
+#include "obis.h"
+#include "history.h"
+
+/*
+ * meter table
+ *
+ * one meter per serial port, numbered from 1 in the order of the ports; every
+ * meter has a value for each code of the OBIS registry, in registry order,
+ * together with the server id they came from. A new server id on a port
+ * starts over with empty values.
+ *
+ * The reader thread is the only writer. Each value has its own sequence
+ * lock, the raw reading is 64 bit and not atomic on the 32 bit targets;
+ * SNMP readers retry and never hold up the parser.
+ *
+ * SNMP (enterprise 1.3.6.1.4.1.39241):
+ *   .2.1.<m>                   device
+ *   .2.2.<m>                   server id, hex
+ *   .2.3.<m>                   telegrams
+ *   .2.4.<m>                   transport CRC errors
+ *   .3.<m>.<A>.<B>.<C>.<D>.<E>.<F>  value of OBIS code A-B:C.D.E*F, scaled
+ *                              and rounded to an Integer32, saturating
+ * the old .1.8.0-2 and .16.7.0 objects show the values of meter 1
+ *
+ * with a history size every value also keeps its recent readings, see
+ * history.h; meter_history_request() serves them:
+ *   dump <m> <obis>                  binary dump
+ *   profile <m> <obis> [from [to]]   SML GetProfileList.Res messages
+ */
+
+#define METER_MAX		64
+#define METER_DEVICE_LEN	32
+#define SERVER_ID_MAX		16
+
+struct meter_value {
+    struct seqlock seqlock;
+    long long raw;
+    unsigned char type;		/* SML type of raw, 0 until the first reading */
+    signed char scaler;
+    unsigned char unit;
+    time_t time;
+};
+
+struct meter {
+    int index;
+    char device[METER_DEVICE_LEN];
+    int fd;
+    time_t retry;
+    sml_transport_decoder *decoder;
+    char server_id[2 * SERVER_ID_MAX + 1];
+    volatile unsigned int telegrams;
+    volatile unsigned int crc_errors;
+    struct meter_value *values;	/* obis_len values */
+    struct history *history;	/* obis_len histories or NULL */
+};
+
+extern struct meter meters[METER_MAX];
+extern int meters_len;
+
+/* guards the server id, the values have their own locks */
+extern struct seqlock value_seqlock;
+
+struct meter *meter_add(const char *device);
+
+/*
+ * value tables for the OBIS registry, the defaults if nothing is configured,
+ * with history bytes of history per value
+ */
+int meter_init(size_t history);
+
+/* takes the readings of a parsed telegram, received at time now */
+void meter_update(struct meter *meter, sml_file *file, time_t now);
+
+/* new server id on the port */
+void meter_set_server_id(struct meter *meter, const unsigned char *id, int len);
+
+/* reading scaled to an integer, consistent with the time it was taken */
+long long meter_value_get(struct meter_value *value, time_t *time);
+
+/* answers one request line on fd, -1 if it can't be served */
+int meter_history_request(int fd, const char *request);
+
+void meter_register_mib(void);
+
+#endif
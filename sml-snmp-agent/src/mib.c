@@ -0,0 +1,146 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snmp.h"
+#include "mib.h"
+
+static struct mib_entry *mib;
+static int mib_len;
+static int mib_alloc;
+
+/* octets of the sub-identifier starting at oid[i] */
+static int subid_len(const unsigned char *oid, int len, int i)
+{
+    int n = i;
+
+    while (n < len && (oid[n] & 0x80))
+	n++;
+    if (n < len)
+	n++;
+    return n - i;
+}
+
+/*
+ * compares two BER encoded OIDs in OID order; plain memcmp() isn't enough
+ * as 0xff 0x7f (16383) would sort after 0x81 0x80 0x00 (16384)
+ */
+int mib_oid_cmp(const unsigned char *a, int alen, const unsigned char *b, int blen)
+{
+    int i = 0, j = 0, na, nb, r;
+
+    while (i < alen && j < blen) {
+	na = subid_len(a, alen, i);
+	nb = subid_len(b, blen, j);
+	/* without leading 0x80 padding the longer encoding is the larger value */
+	if (na != nb)
+	    return na - nb;
+	r = memcmp(a + i, b + j, na);
+	if (r)
+	    return r;
+	i += na;
+	j += nb;
+    }
+    return (i < alen) - (j < blen);
+}
+
+int mib_register(const char *oid, mib_getter get, void *arg)
+{
+    unsigned char *encoded;
+    int lo, hi, mid, r;
+    struct mib_entry entry;
+
+    encoded = encode_oid((unsigned char *)oid);
+    if (encoded[1] > MIB_OID_MAX) {
+	fprintf(stderr, "%s: OID %s too long\n", __func__, oid);
+	free(encoded);
+	return -1;
+    }
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.oid, encoded + 2, encoded[1]);
+    entry.oid_len = encoded[1];
+    entry.name = oid;
+    entry.get = get;
+    entry.arg = arg;
+    free(encoded);
+
+    lo = 0;
+    hi = mib_len;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	r = mib_oid_cmp(mib[mid].oid, mib[mid].oid_len, entry.oid, entry.oid_len);
+	if (!r) {
+	    mib[mid] = entry;
+	    return 0;
+	}
+	if (r < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    if (mib_len == mib_alloc) {
+	struct mib_entry *n;
+
+	n = realloc(mib, (mib_alloc ? mib_alloc * 2 : 16) * sizeof(struct mib_entry));
+	if (!n)
+	    return -1;
+	mib = n;
+	mib_alloc = mib_alloc ? mib_alloc * 2 : 16;
+    }
+    memmove(&mib[lo + 1], &mib[lo], (mib_len - lo) * sizeof(struct mib_entry));
+    mib[lo] = entry;
+    mib_len++;
+    return 0;
+}
+
+/* index of the first entry not less than oid, or greater than oid with after set */
+static int mib_search(const unsigned char *oid, int len, int after)
+{
+    int lo = 0, hi = mib_len, mid, r;
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	r = mib_oid_cmp(mib[mid].oid, mib[mid].oid_len, oid, len);
+	if (r < 0 || (after && !r))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+const struct mib_entry *mib_find(const unsigned char *oid, int len)
+{
+    int i = mib_search(oid, len, 0);
+
+    if (i < mib_len && !mib_oid_cmp(mib[i].oid, mib[i].oid_len, oid, len))
+	return &mib[i];
+    return NULL;
+}
+
+/* lexicographic successor, as needed for GETNEXT */
+const struct mib_entry *mib_next(const unsigned char *oid, int len)
+{
+    int i = mib_search(oid, len, 1);
+
+    return i < mib_len ? &mib[i] : NULL;
+}
+
+int mib_size(void)
+{
+    return mib_len;
+}
+
+const struct mib_entry *mib_entry_at(int index)
+{
+    return (index >= 0 && index < mib_len) ? &mib[index] : NULL;
+}
@@ -0,0 +1,90 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef MIB_H_INCLUDED
+#define MIB_H_INCLUDED
+
+/*
+ * MIB registry
+ *
+ * OIDs are registered once and kept BER encoded (the content octets of the
+ * OBJECT IDENTIFIER, without tag and length) in a table sorted in OID order,
+ * so a request OID is looked up by binary search directly on the bytes it
+ * arrived in. Every entry has a getter filling in the current value.
+ */
+
+#define MIB_OID_MAX	32
+#define MIB_BUFFER_MAX	48
+
+struct mib_value {
+    unsigned char type;
+    long long integer;		/* signed INTEGER or an unsigned 32 bit type */
+    const char *string;
+    char buffer[MIB_BUFFER_MAX];	/* copy of a string that may change under the reader */
+};
+
+typedef void (*mib_getter) (void *arg, struct mib_value *value);
+
+struct mib_entry {
+    unsigned char oid[MIB_OID_MAX];
+    unsigned char oid_len;
+    const char *name;
+    mib_getter get;
+    void *arg;
+};
+
+int mib_register(const char *oid, mib_getter get, void *arg);
+
+int mib_oid_cmp(const unsigned char *a, int alen, const unsigned char *b, int blen);
+
+const struct mib_entry *mib_find(const unsigned char *oid, int len);
+
+const struct mib_entry *mib_next(const unsigned char *oid, int len);
+
+int mib_size(void);
+
+const struct mib_entry *mib_entry_at(int index);
+
+/*
+ * sequence lock for the values behind the getters: the single writer makes
+ * the sequence odd while updating, readers never block and retry if the
+ * sequence was odd or changed while they read
+ */
+struct seqlock {
+    volatile unsigned int sequence;
+};
+
+static inline void seqlock_write_begin(struct seqlock *s)
+{
+    s->sequence++;
+    __sync_synchronize();
+}
+
+static inline void seqlock_write_end(struct seqlock *s)
+{
+    __sync_synchronize();
+    s->sequence++;
+}
+
+static inline unsigned int seqlock_read_begin(struct seqlock *s)
+{
+    unsigned int sequence;
+
+    while ((sequence = s->sequence) & 1) ;
+    __sync_synchronize();
+    return sequence;
+}
+
+static inline int seqlock_read_retry(struct seqlock *s, unsigned int sequence)
+{
+    __sync_synchronize();
+    return s->sequence != sequence;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "obis.h"
+
+/* at most half full, so a miss ends after a probe or two */
+#define OBIS_HASH_BITS	9
+#define OBIS_HASH_SIZE	(1 << OBIS_HASH_BITS)
+
+unsigned char obis_codes[OBIS_MAX][OBIS_LEN];
+int obis_len;
+
+struct obis_slot {
+    unsigned long long key;
+    int index;			/* index + 1, 0 is a free slot */
+};
+
+static struct obis_slot obis_hash[OBIS_HASH_SIZE];
+
+static inline unsigned long long obis_key(const unsigned char *code)
+{
+    return (unsigned long long)code[0] << 40 | (unsigned long long)code[1] << 32 |
+	(unsigned long)code[2] << 24 | code[3] << 16 | code[4] << 8 | code[5];
+}
+
+/* Fibonacci hashing, the top bits of the product mix all six bytes */
+static inline unsigned int obis_hash_of(unsigned long long key)
+{
+    return (key * 0x9e3779b97f4a7c15ULL) >> (64 - OBIS_HASH_BITS);
+}
+
+int obis_lookup(const unsigned char *code)
+{
+    unsigned long long key = obis_key(code);
+    unsigned int h = obis_hash_of(key);
+
+    while (obis_hash[h].index) {
+	if (obis_hash[h].key == key)
+	    return obis_hash[h].index - 1;
+	h = (h + 1) & (OBIS_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+int obis_add(const unsigned char *code)
+{
+    unsigned long long key = obis_key(code);
+    unsigned int h = obis_hash_of(key);
+
+    while (obis_hash[h].index) {
+	if (obis_hash[h].key == key)
+	    return obis_hash[h].index - 1;
+	h = (h + 1) & (OBIS_HASH_SIZE - 1);
+    }
+    if (obis_len == OBIS_MAX)
+	return -1;
+    memcpy(obis_codes[obis_len], code, OBIS_LEN);
+    obis_hash[h].key = key;
+    obis_hash[h].index = ++obis_len;
+    return obis_len - 1;
+}
+
+int obis_parse(const char *text, unsigned char *code)
+{
+    /* separators after A to E in the two notations */
+    static const char named[] = "-:..*";
+    unsigned long group;
+    char *end;
+    int i;
+
+    for (i = 0; i < OBIS_LEN; i++) {
+	if (!isdigit((unsigned char)*text))
+	    return -1;
+	group = strtoul(text, &end, 10);
+	if (group > 255)
+	    return -1;
+	code[i] = group;
+	text = end;
+	if (i == OBIS_LEN - 1)
+	    break;
+	if (*text == named[i] || *text == '.') {
+	    text++;
+	} else if (i == 4 && (!*text || isspace((unsigned char)*text))) {
+	    code[5] = 0xff;
+	    break;
+	} else {
+	    return -1;
+	}
+    }
+    while (isspace((unsigned char)*text))
+	text++;
+    return *text ? -1 : 0;
+}
+
+int obis_load(const char *file)
+{
+    char line[128], *p, *end;
+    unsigned char code[OBIS_LEN];
+    int n = 0;
+    FILE *f;
+
+    f = fopen(file, "r");
+    if (!f) {
+	fprintf(stderr, "can't open %s\n", file);
+	return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+	n++;
+	if ((p = strchr(line, '#')))
+	    *p = '\0';
+	for (p = line; isspace((unsigned char)*p); p++) ;
+	if (!*p)
+	    continue;
+	for (end = p + strlen(p); end > p && isspace((unsigned char)end[-1]); end--) ;
+	*end = '\0';
+	if (obis_parse(p, code)) {
+	    fprintf(stderr, "%s:%d: invalid OBIS code %s\n", file, n, p);
+	    fclose(f);
+	    return -1;
+	}
+	if (obis_add(code) < 0) {
+	    fprintf(stderr, "%s:%d: more than %d OBIS codes\n", file, n, OBIS_MAX);
+	    fclose(f);
+	    return -1;
+	}
+    }
+    fclose(f);
+    return 0;
+}
+
+void obis_clear(void)
+{
+    memset(obis_hash, 0, sizeof(obis_hash));
+    obis_len = 0;
+}
+
+void obis_defaults(void)
+{
+    static const unsigned char defaults[][OBIS_LEN] = {
+	{ 0x01, 0x00, 0x01, 0x08, 0x00, 0xff },	/* energy tarif 0 */
+	{ 0x01, 0x00, 0x01, 0x08, 0x01, 0xff },	/* energy tarif 1 */
+	{ 0x01, 0x00, 0x01, 0x08, 0x02, 0xff },	/* energy tarif 2 */
+	{ 0x01, 0x00, 0x10, 0x07, 0x00, 0xff },	/* power */
+    };
+    int i;
+
+    for (i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++)
+	obis_add(defaults[i]);
+}
@@ -0,0 +1,49 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef OBIS_H_INCLUDED
+#define OBIS_H_INCLUDED
+
+/*
+ * OBIS registry
+ *
+ * the OBIS codes the agent keeps, read from a config file at startup and
+ * fixed afterwards; every code gets an index into the value table of each
+ * meter. Codes are looked up by an open addressing hash over the six bytes,
+ * so the cost per list entry doesn't depend on the number of codes.
+ *
+ * config file, one code per line, '#' starts a comment:
+ *   1-0:1.8.0*255
+ *   1.0.16.7.0.255
+ * a missing group F means 255
+ */
+
+#define OBIS_LEN	6
+#define OBIS_MAX	256
+
+extern unsigned char obis_codes[OBIS_MAX][OBIS_LEN];
+extern int obis_len;
+
+/* index of code, added if not known yet; -1 if the registry is full */
+int obis_add(const unsigned char *code);
+
+/* index of code, -1 if it isn't configured */
+int obis_lookup(const unsigned char *code);
+
+/* "A-B:C.D.E*F" or "A.B.C.D.E.F" to six bytes, -1 on a syntax error */
+int obis_parse(const char *text, unsigned char *code);
+
+int obis_load(const char *file);
+
+void obis_clear(void);
+
+/* energy tarif 0-2 and power, used without a config file */
+void obis_defaults(void);
+
+#endif
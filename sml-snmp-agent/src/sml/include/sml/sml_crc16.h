@@ -26,8 +26,14 @@ extern "C" {
 #endif
 
 // CRC16 FSC implementation based on DIN 62056-46
+// CRC16 as used by SML (CCITT, reflected, like PPP/X.25), returned with
+// the bytes swapped, ready to compare with the big endian value on the wire
 u16 sml_crc16_calculate(unsigned char *cp, int len) ;
 
+// raw state update for incremental use, start with 0xffff; the final value
+// still needs the inversion and byte swap done by sml_crc16_calculate()
+u16 sml_crc16_update(u16 fcs, unsigned char *cp, int len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,7 @@
 
 #include "sml_message.h"
 #include "sml_shared.h"
+#include "sml_arena.h"
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -32,11 +33,18 @@ typedef struct {
     sml_message **messages;
     short messages_len;
     sml_buffer *buf;
+    sml_arena *arena;
 } sml_file;
 
 sml_file *sml_file_init();
 // parses a SML file.
 sml_file *sml_file_parse(unsigned char *buffer, size_t buffer_len);
+
+// Parses like sml_file_parse(), but all nodes come from the arena and octet
+// strings point into buffer, which has to stay valid until the file is
+// freed. Freeing the file just resets the arena; single nodes of such a
+// file must not be freed. Without an arena it is sml_file_parse().
+sml_file *sml_file_parse_arena(sml_arena *arena, unsigned char *buffer, size_t buffer_len);
 void sml_file_add_message(sml_file *file, sml_message *message);
 void sml_file_write(sml_file *file);
 void sml_file_free(sml_file *file);
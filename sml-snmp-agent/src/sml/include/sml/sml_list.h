@@ -60,6 +60,7 @@ sml_list *sml_list_parse(sml_buffer *buf);
 void sml_list_write(sml_list *list, sml_buffer *buf);
 void sml_list_add(sml_list *list, sml_list *new_entry);
 void sml_list_free(sml_list *list);
+void sml_list_entry_free(sml_list *list);
 
 #ifdef __cplusplus
 }
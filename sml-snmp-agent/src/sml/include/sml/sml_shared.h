@@ -109,6 +109,12 @@ int sml_buf_optional_is_skipped(sml_buffer *buf);
 // Prints arbitrarily byte string to stdout with printf
 void hexdump(unsigned char *buffer, size_t buffer_len);
 
+// Allocators used for all libSML structures. They fall back to the heap
+// unless an arena is set for the calling thread (see sml_arena.h).
+void *sml_malloc(size_t size);
+void *sml_realloc(void *p, size_t size);
+void sml_free(void *p);
+
 #ifdef __cplusplus
 }
 #endif
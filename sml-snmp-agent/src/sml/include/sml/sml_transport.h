@@ -26,14 +26,53 @@
 extern "C" {
 #endif
 
+// Incremental decoder for the SML transport protocol (version 1).
+// Data of any chunk size goes in, complete frames come out once each,
+// with their start and end sequences, doubled escape sequences in the
+// payload collapsed and the trailing CRC16 verified.
+typedef struct {
+	unsigned char *buf;
+	size_t size;
+	size_t len;			// bytes in buf
+	size_t pos;			// scan position
+	size_t start;		// start of the current frame
+	size_t consumed;	// end of the frame handed out last
+	size_t candidate;	// unaligned start seen inside the current frame
+	size_t candidate_pos;	// scan position in the candidate's alignment
+	int escapes;		// escaped sequences in the current frame
+	int check_crc;		// drop frames with a bad CRC, default on
+	unsigned long frames;
+	unsigned long crc_errors;
+	unsigned long resyncs;
+	unsigned long overflows;
+} sml_transport_decoder;
+
+// max_frame is the size of the biggest frame accepted
+sml_transport_decoder *sml_transport_decoder_init(size_t max_frame);
+void sml_transport_decoder_reset(sml_transport_decoder *dec);
+void sml_transport_decoder_free(sml_transport_decoder *dec);
+
+// Free space to read() into directly, followed by a commit of the bytes read.
+unsigned char *sml_transport_decoder_space(sml_transport_decoder *dec, size_t *avail);
+void sml_transport_decoder_commit(sml_transport_decoder *dec, size_t n);
+
+// Copies data into the decoder, returns the number of bytes taken. If that
+// is less than len, fetch the pending frames before feeding the rest.
+size_t sml_transport_decoder_feed(sml_transport_decoder *dec, const unsigned char *data, size_t len);
+
+// Returns 1 and the next complete frame, 0 if more data is needed. The
+// frame stays valid until the decoder gets new data.
+int sml_transport_decoder_next(sml_transport_decoder *dec, unsigned char **frame, size_t *frame_len);
+
 // sml_transport_read reads continously bytes from fd and scans
 // for the SML transport protocol escape sequences. If a SML file
 // is detected it will be copied into the buffer. The total amount of bytes read
-// will be returned. If the SML file exceeds the len of the buffer, -1 will be returned
+// will be returned. Files exceeding the len of the buffer are skipped,
+// 0 is returned on EOF or a read error.
 size_t sml_transport_read(int fd, unsigned char *buffer, size_t max_len);
 
-// sml_transport_listen is an endless loop which reads continously
-// via sml_transport_read and calls the sml_transporter_receiver
+// sml_transport_listen reads continously from fd in chunks and calls
+// the sml_transporter_receiver for every file, until EOF or a read error
 void sml_transport_listen(int fd, void (*sml_transport_receiver)(unsigned char *buffer, size_t buffer_len));
 
 // sml_transport_writes adds the SML transport protocol escape
@@ -0,0 +1,64 @@
+// This file is part of libSML.
+//
+// libSML is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// libSML is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with libSML.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _SML_ARENA_H_
+#define _SML_ARENA_H_
+
+#include "sml_shared.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A sml_arena hands out the memory for all nodes of one parsed file.
+// Nothing is freed individually, sml_arena_reset() releases everything
+// at once and keeps the memory for the next telegram.
+typedef struct sml_arena_chunk {
+	struct sml_arena_chunk *next;
+	size_t size;
+	size_t used;
+	unsigned char data[];
+} sml_arena_chunk;
+
+typedef struct {
+	sml_arena_chunk *chunks;	// current chunk first
+	size_t chunk_size;
+	size_t peak;				// bytes used by the largest telegram so far
+	void *last;					// last allocation, may grow in place
+} sml_arena;
+
+// 0 if the first chunk can't be allocated
+sml_arena *sml_arena_init(size_t chunk_size);
+void *sml_arena_alloc(sml_arena *arena, size_t size);
+void *sml_arena_realloc(sml_arena *arena, void *p, size_t size);
+int sml_arena_owns(sml_arena *arena, void *p);
+size_t sml_arena_used(sml_arena *arena);
+
+// Drops all allocations. If the last telegram needed more than one chunk,
+// the chunks are merged so the next one fits without another malloc.
+void sml_arena_reset(sml_arena *arena);
+void sml_arena_free(sml_arena *arena);
+
+// The arena all sml_malloc()/sml_realloc() calls of this thread are served
+// from, 0 for the normal heap.
+sml_arena *sml_arena_get_current();
+void sml_arena_set_current(sml_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _SML_ARENA_H_ */
@@ -75,6 +75,10 @@ typedef struct {
 	/* end of message */
 } sml_message;
 
+// messages with a CRC not matching their content are rejected as parse
+// errors, set to 0 for meters known to send broken CRCs
+extern int sml_message_check_crc;
+
 // SML MESSAGE
 sml_message *sml_message_parse(sml_buffer *buf);
 sml_message *sml_message_init(); // Sets a transaction id.
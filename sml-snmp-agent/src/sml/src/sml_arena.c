@@ -0,0 +1,194 @@
+// This file is part of libSML.
+//
+// libSML is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// libSML is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with libSML.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <sml/sml_arena.h>
+#include <string.h>
+
+// every block is preceded by its size, so realloc knows how much to copy
+#define SML_ARENA_ALIGN		sizeof(u64)
+#define SML_ARENA_HDR		SML_ARENA_ALIGN
+#define SML_ARENA_ROUND(n)	(((n) + SML_ARENA_ALIGN - 1) & ~(SML_ARENA_ALIGN - 1))
+
+static __thread sml_arena *current_arena;
+
+static sml_arena_chunk *sml_arena_chunk_init(size_t size) {
+	sml_arena_chunk *chunk = (sml_arena_chunk *) malloc(sizeof(sml_arena_chunk) + size);
+	if (!chunk) {
+		return 0;
+	}
+	chunk->next = 0;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+sml_arena *sml_arena_init(size_t chunk_size) {
+	sml_arena *arena = (sml_arena *) malloc(sizeof(sml_arena));
+	if (!arena) {
+		return 0;
+	}
+	memset(arena, 0, sizeof(sml_arena));
+	arena->chunk_size = SML_ARENA_ROUND(chunk_size);
+	arena->chunks = sml_arena_chunk_init(arena->chunk_size);
+	if (!arena->chunks) {
+		free(arena);
+		return 0;
+	}
+
+	return arena;
+}
+
+void *sml_arena_alloc(sml_arena *arena, size_t size) {
+	sml_arena_chunk *chunk = arena->chunks;
+	size_t need = SML_ARENA_HDR + SML_ARENA_ROUND(size);
+	unsigned char *p;
+
+	if (!chunk || chunk->size - chunk->used < need) {
+		chunk = sml_arena_chunk_init(need > arena->chunk_size ? need : arena->chunk_size);
+		if (!chunk) {
+			return 0;
+		}
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	p = chunk->data + chunk->used;
+	*(size_t *) p = size;
+	chunk->used += need;
+	arena->last = p + SML_ARENA_HDR;
+
+	return arena->last;
+}
+
+void *sml_arena_realloc(sml_arena *arena, void *p, size_t size) {
+	sml_arena_chunk *chunk = arena->chunks;
+	size_t *old_size;
+	void *np;
+
+	if (!p) {
+		return sml_arena_alloc(arena, size);
+	}
+	old_size = (size_t *) ((unsigned char *) p - SML_ARENA_HDR);
+
+	if (size <= *old_size) {
+		return p;
+	}
+
+	// growing the newest block only moves the fill mark
+	if (p == arena->last && SML_ARENA_ROUND(size) - SML_ARENA_ROUND(*old_size) <= chunk->size - chunk->used) {
+		chunk->used += SML_ARENA_ROUND(size) - SML_ARENA_ROUND(*old_size);
+		*old_size = size;
+		return p;
+	}
+
+	np = sml_arena_alloc(arena, size);
+	if (np) {
+		memcpy(np, p, *old_size);
+	}
+	return np;
+}
+
+int sml_arena_owns(sml_arena *arena, void *p) {
+	sml_arena_chunk *chunk;
+
+	for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+		if ((unsigned char *) p >= chunk->data && (unsigned char *) p < chunk->data + chunk->size) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+size_t sml_arena_used(sml_arena *arena) {
+	sml_arena_chunk *chunk;
+	size_t used = 0;
+
+	for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+		used += chunk->used;
+	}
+	return used;
+}
+
+void sml_arena_reset(sml_arena *arena) {
+	sml_arena_chunk *chunk, *next;
+	size_t used = sml_arena_used(arena);
+
+	if (used > arena->peak) {
+		arena->peak = used;
+	}
+	if (arena->chunks && arena->chunks->next) {
+		for (chunk = arena->chunks; chunk; chunk = next) {
+			next = chunk->next;
+			free(chunk);
+		}
+		if (arena->chunk_size < arena->peak) {
+			arena->chunk_size = SML_ARENA_ROUND(arena->peak);
+		}
+		arena->chunks = sml_arena_chunk_init(arena->chunk_size);
+	}
+	else if (arena->chunks) {
+		arena->chunks->used = 0;
+	}
+	arena->last = 0;
+}
+
+void sml_arena_free(sml_arena *arena) {
+	sml_arena_chunk *chunk, *next;
+
+	if (arena) {
+		if (current_arena == arena) {
+			current_arena = 0;
+		}
+		for (chunk = arena->chunks; chunk; chunk = next) {
+			next = chunk->next;
+			free(chunk);
+		}
+		free(arena);
+	}
+}
+
+sml_arena *sml_arena_get_current() {
+	return current_arena;
+}
+
+void sml_arena_set_current(sml_arena *arena) {
+	current_arena = arena;
+}
+
+void *sml_malloc(size_t size) {
+	if (current_arena) {
+		return sml_arena_alloc(current_arena, size);
+	}
+	return malloc(size);
+}
+
+void *sml_realloc(void *p, size_t size) {
+	if (current_arena) {
+		if (p && !sml_arena_owns(current_arena, p)) {
+			return realloc(p, size);
+		}
+		return sml_arena_realloc(current_arena, p, size);
+	}
+	return realloc(p, size);
+}
+
+void sml_free(void *p) {
+	// octet strings parsed in an arena point into the receive buffer,
+	// the error paths must not hand them to free()
+	if (current_arena) {
+		return;
+	}
+	free(p);
+}
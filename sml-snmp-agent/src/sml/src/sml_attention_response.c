@@ -21,7 +21,7 @@
 #include <sml/sml_tree.h>
 
 sml_attention_response *sml_attention_response_init() {
-	sml_attention_response *msg = (sml_attention_response *) malloc(sizeof(sml_attention_response));
+	sml_attention_response *msg = (sml_attention_response *) sml_malloc(sizeof(sml_attention_response));
 	memset(msg, 0, sizeof(sml_attention_response));
 
 	return msg;
@@ -75,7 +75,7 @@ void sml_attention_response_free(sml_attention_response *msg){
 		sml_octet_string_free(msg->attention_message);
 		sml_tree_free(msg->attention_details);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
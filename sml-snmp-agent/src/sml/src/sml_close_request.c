@@ -21,7 +21,7 @@
 #include <stdio.h>
 
 sml_close_request *sml_close_request_init() {
-	sml_close_request *close_request = (sml_close_request *) malloc(sizeof(sml_close_request));
+	sml_close_request *close_request = (sml_close_request *) sml_malloc(sizeof(sml_close_request));
 	memset(close_request, 0, sizeof(sml_close_request));
 
 	return close_request;
@@ -58,7 +58,7 @@ void sml_close_request_write(sml_close_request *msg, sml_buffer *buf) {
 void sml_close_request_free(sml_close_request *msg) {
 	if (msg) {
 		sml_octet_string_free(msg->global_signature);
-		free(msg);
+		sml_free(msg);
 	}
 }
 
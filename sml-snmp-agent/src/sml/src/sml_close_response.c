@@ -21,7 +21,7 @@
 #include <stdio.h>
 
 sml_close_response *sml_close_response_init() {
-	sml_close_response *msg = (sml_close_response *) malloc(sizeof(sml_close_response));
+	sml_close_response *msg = (sml_close_response *) sml_malloc(sizeof(sml_close_response));
 	memset(msg, 0, sizeof(sml_close_response));
 
 	return msg;
@@ -59,7 +59,7 @@ void sml_close_response_free(sml_close_response *msg) {
 	if (msg) {
 		sml_octet_string_free(msg->global_signature);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
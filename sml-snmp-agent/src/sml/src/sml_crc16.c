@@ -44,16 +44,52 @@ static u16 fcstab [256] = { 0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x65
 		0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330, 0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
 
-u16 sml_crc16_calculate(unsigned char *cp, int len) {
-	u16 fcs = PPPINITFCS16;
-	
+// fcstab extended for slicing-by-8: crctab[k][b] is the CRC of byte b
+// followed by k zero bytes, so 8 input bytes need 8 independent lookups
+static u16 crctab[8][256];
+
+static void __attribute__((constructor)) sml_crc16_init_tables(void) {
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crctab[0][i] = fcstab[i];
+	}
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			crctab[k][i] = (crctab[k - 1][i] >> 8) ^ fcstab[crctab[k - 1][i] & 0xff];
+		}
+	}
+}
+
+u16 sml_crc16_update(u16 fcs, unsigned char *cp, int len) {
+	// bytes are picked one by one, this works on either endianness and
+	// doesn't care about the alignment of cp
+	while (len >= 8) {
+		fcs = crctab[7][(cp[0] ^ fcs) & 0xff] ^ crctab[6][(cp[1] ^ (fcs >> 8)) & 0xff] ^
+			crctab[5][cp[2]] ^ crctab[4][cp[3]] ^
+			crctab[3][cp[4]] ^ crctab[2][cp[5]] ^
+			crctab[1][cp[6]] ^ crctab[0][cp[7]];
+		cp += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		fcs = crctab[3][(cp[0] ^ fcs) & 0xff] ^ crctab[2][(cp[1] ^ (fcs >> 8)) & 0xff] ^
+			crctab[1][cp[2]] ^ crctab[0][cp[3]];
+		cp += 4;
+		len -= 4;
+	}
 	while (len--) {
 		fcs = (fcs >> 8) ^ fcstab[(fcs ^ *cp++) & 0xff];
 	}
-	
+
+	return fcs;
+}
+
+u16 sml_crc16_calculate(unsigned char *cp, int len) {
+	u16 fcs = sml_crc16_update(PPPINITFCS16, cp, len);
+
 	fcs ^= 0xffff;
 	fcs = ((fcs & 0xff) << 8) | ((fcs & 0xff00) >> 8);
 
 	return fcs;
 }
-
@@ -22,20 +22,15 @@
 #include <sml/sml_message.h>
 #include <sml/sml_number.h>
 #include <sml/sml_time.h>
+#include <sml/sml_arena.h>
 #include <stdio.h>
 #include <string.h>
 
 // EDL meter must provide at least 250 bytes as a receive buffer
 #define SML_FILE_BUFFER_LENGTH 512
 
-sml_file *sml_file_parse(unsigned char *buffer, size_t buffer_len) {
-	sml_file *file = (sml_file*) malloc(sizeof(sml_file));
-	memset(file, 0, sizeof(sml_file));
-
-	sml_buffer *buf = sml_buffer_init(buffer_len);
-	memcpy(buf->buffer, buffer, buffer_len);
-	file->buf = buf;
-
+static void sml_file_parse_messages(sml_file *file) {
+	sml_buffer *buf = file->buf;
 	sml_message *msg;
 
 	// parsing all messages
@@ -57,12 +52,49 @@ sml_file *sml_file_parse(unsigned char *buffer, size_t buffer_len) {
 		sml_file_add_message(file, msg);
 
 	}
+}
+
+sml_file *sml_file_parse(unsigned char *buffer, size_t buffer_len) {
+	sml_file *file = (sml_file*) sml_malloc(sizeof(sml_file));
+	memset(file, 0, sizeof(sml_file));
+
+	sml_buffer *buf = sml_buffer_init(buffer_len);
+	memcpy(buf->buffer, buffer, buffer_len);
+	file->buf = buf;
+
+	sml_file_parse_messages(file);
+
+	return file;
+}
+
+sml_file *sml_file_parse_arena(sml_arena *arena, unsigned char *buffer, size_t buffer_len) {
+	sml_arena *previous = sml_arena_get_current();
+
+	if (!arena) {
+		return sml_file_parse(buffer, buffer_len);
+	}
+	sml_arena_reset(arena);
+	sml_arena_set_current(arena);
+
+	sml_file *file = (sml_file*) sml_malloc(sizeof(sml_file));
+	memset(file, 0, sizeof(sml_file));
+	file->arena = arena;
 
+	// no copy, the parsed nodes point right into the caller's buffer
+	sml_buffer *buf = (sml_buffer *) sml_malloc(sizeof(sml_buffer));
+	memset(buf, 0, sizeof(sml_buffer));
+	buf->buffer = buffer;
+	buf->buffer_len = buffer_len;
+	file->buf = buf;
+
+	sml_file_parse_messages(file);
+
+	sml_arena_set_current(previous);
 	return file;
 }
 
 sml_file *sml_file_init() {
-	sml_file *file = (sml_file*) malloc(sizeof(sml_file));
+	sml_file *file = (sml_file*) sml_malloc(sizeof(sml_file));
 	memset(file, 0, sizeof(sml_file));
 
 	sml_buffer *buf = sml_buffer_init(SML_FILE_BUFFER_LENGTH);
@@ -73,7 +105,7 @@ sml_file *sml_file_init() {
 
 void sml_file_add_message(sml_file *file, sml_message *message) {
 	file->messages_len++;
-	file->messages = (sml_message **) realloc(file->messages, sizeof(sml_message *) * file->messages_len);
+	file->messages = (sml_message **) sml_realloc(file->messages, sizeof(sml_message *) * file->messages_len);
 	file->messages[file->messages_len - 1] = message;
 }
 
@@ -88,20 +120,24 @@ void sml_file_write(sml_file *file) {
 }
 
 void sml_file_free(sml_file *file) {
+	if (file && file->arena) {
+		sml_arena_reset(file->arena);
+		return;
+	}
 	if (file) {
 		if (file->messages) {
 			int i;
 			for (i = 0; i < file->messages_len; i++) {
 				sml_message_free(file->messages[i]);
 			}
-			free(file->messages);
+			sml_free(file->messages);
 		}
 
 		if (file->buf) {
 			sml_buffer_free(file->buf);
 		}
 
-		free(file);
+		sml_free(file);
 	}
 }
 
@@ -21,7 +21,7 @@
 #include <stdio.h>
 
 sml_get_list_request* sml_get_list_request_init() {
-	  sml_get_list_request *msg = (sml_get_list_request *) malloc(sizeof(sml_get_list_request));
+	  sml_get_list_request *msg = (sml_get_list_request *) sml_malloc(sizeof(sml_get_list_request));
 	  memset(msg, 0, sizeof(sml_get_list_request));
 
 	  return msg;
@@ -39,7 +39,7 @@ void sml_get_list_request_write(sml_get_list_request *msg, sml_buffer *buf) {
 
 
 sml_get_list_request *sml_get_list_request_parse(sml_buffer *buf) {
-	sml_get_list_request *msg = (sml_get_list_request *) malloc(sizeof(sml_get_list_request));
+	sml_get_list_request *msg = (sml_get_list_request *) sml_malloc(sizeof(sml_get_list_request));
 	memset(msg, 0, sizeof(sml_get_list_request));
 
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
@@ -82,7 +82,7 @@ void sml_get_list_request_free(sml_get_list_request *msg) {
 		sml_octet_string_free(msg->list_name);
 		sml_octet_string_free(msg->username);
 		sml_octet_string_free(msg->password);
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -20,7 +20,7 @@
 #include <sml/sml_get_list_response.h>
 
 sml_get_list_response *sml_get_list_response_init() {
-	sml_get_list_response *msg = (sml_get_list_response *) malloc(sizeof(sml_get_list_response));
+	sml_get_list_response *msg = (sml_get_list_response *) sml_malloc(sizeof(sml_get_list_response));
 	memset(msg, 0, sizeof(sml_get_list_response));
 	
 	return msg;
@@ -89,7 +89,7 @@ void sml_get_list_response_free(sml_get_list_response *msg) {
 		sml_octet_string_free(msg->list_signature);
 		sml_time_free(msg->act_gateway_time);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
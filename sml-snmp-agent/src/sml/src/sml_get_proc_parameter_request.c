@@ -22,7 +22,7 @@
 #include <stdio.h>
 
 sml_get_proc_parameter_request *sml_get_proc_parameter_request_init() {
-	sml_get_proc_parameter_request *msg = (sml_get_proc_parameter_request *) malloc(sizeof (sml_get_proc_parameter_request));
+	sml_get_proc_parameter_request *msg = (sml_get_proc_parameter_request *) sml_malloc(sizeof (sml_get_proc_parameter_request));
 	memset(msg, 0, sizeof(sml_get_proc_parameter_request));
 
 	return msg;
@@ -81,7 +81,7 @@ void sml_get_proc_parameter_request_free(sml_get_proc_parameter_request *msg) {
 		sml_tree_path_free(msg->parameter_tree_path);
 		sml_octet_string_free(msg->attribute);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
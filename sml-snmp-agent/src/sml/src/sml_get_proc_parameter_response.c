@@ -20,7 +20,7 @@
 #include <stdio.h>
 
 sml_get_proc_parameter_response *sml_get_proc_parameter_response_init() {
-	sml_get_proc_parameter_response *msg = (sml_get_proc_parameter_response *)malloc(sizeof(sml_get_proc_parameter_response));
+	sml_get_proc_parameter_response *msg = (sml_get_proc_parameter_response *)sml_malloc(sizeof(sml_get_proc_parameter_response));
 	memset(msg, 0, sizeof(sml_get_proc_parameter_response));
 
 	return msg;
@@ -68,7 +68,7 @@ void sml_get_proc_parameter_response_free(sml_get_proc_parameter_response *msg)
 		sml_tree_path_free(msg->parameter_tree_path);
 		sml_tree_free(msg->parameter_tree);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -22,7 +22,7 @@
 // sml_get_profile_list_response;
 
 sml_get_profile_list_response *sml_get_profile_list_response_init() {
-	sml_get_profile_list_response *msg = (sml_get_profile_list_response *) malloc(sizeof(sml_get_profile_list_response));
+	sml_get_profile_list_response *msg = (sml_get_profile_list_response *) sml_malloc(sizeof(sml_get_profile_list_response));
 	memset(msg, 0, sizeof(sml_get_profile_list_response));
 	return msg;
 }
@@ -101,7 +101,7 @@ void sml_get_profile_list_response_free(sml_get_profile_list_response *msg) {
 		sml_octet_string_free(msg->rawdata);
 		sml_signature_free(msg->period_signature);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
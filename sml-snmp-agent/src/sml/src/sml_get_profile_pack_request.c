@@ -24,7 +24,7 @@
 #include <stdio.h>
 
 sml_get_profile_pack_request *sml_get_profile_pack_request_init(){
-	sml_get_profile_pack_request *msg = (sml_get_profile_pack_request *) malloc(sizeof(sml_get_profile_pack_request));
+	sml_get_profile_pack_request *msg = (sml_get_profile_pack_request *) sml_malloc(sizeof(sml_get_profile_pack_request));
 	memset(msg, 0, sizeof(sml_get_profile_pack_request));
 
 	return msg;
@@ -42,13 +42,13 @@ void sml_get_profile_pack_request_write(sml_get_profile_pack_request *msg, sml_b
 	sml_tree_path_write(msg->parameter_tree_path, buf);
 
 	if (msg->object_list) {
-		int len = 1;
-		sml_obj_req_entry_list *l = msg->object_list;
-		for (l = msg->object_list; l->next; l = l->next) {
+		int len = 0;
+		sml_obj_req_entry_list *l;
+		for (l = msg->object_list; l; l = l->next) {
 			len++;
 		}
 		sml_buf_set_type_and_length(buf, SML_TYPE_LIST, len);
-		for (l = msg->object_list; l->next; l = l->next) {
+		for (l = msg->object_list; l; l = l->next) {
 			sml_obj_req_entry_write(l->object_list_entry, buf);
 		}
 	}
@@ -101,11 +101,10 @@ sml_get_profile_pack_request *sml_get_profile_pack_request_parse(sml_buffer *buf
 		int i, len = sml_buf_get_next_length(buf);
 		sml_obj_req_entry_list *last = 0, *n = 0;
 		for (i = len; i > 0; i--) {
-			n = (sml_obj_req_entry_list *) malloc(sizeof(sml_obj_req_entry_list));
+			n = (sml_obj_req_entry_list *) sml_malloc(sizeof(sml_obj_req_entry_list));
 			memset(n, 0, sizeof(sml_obj_req_entry_list));
-			n->object_list_entry = sml_obj_req_entry_parse(buf);
-			if (sml_buf_has_errors(buf)) goto error;
 
+			// linked first, so the error path frees it
 			if (msg->object_list == 0) {
 				msg->object_list = n;
 				last = msg->object_list;
@@ -114,6 +113,9 @@ sml_get_profile_pack_request *sml_get_profile_pack_request_parse(sml_buffer *buf
 				last->next = n;
 				last = n;
 			}
+
+			n->object_list_entry = sml_obj_req_entry_parse(buf);
+			if (sml_buf_has_errors(buf)) goto error;
 		}
 	}
 
@@ -142,13 +144,13 @@ void sml_get_profile_pack_request_free(sml_get_profile_pack_request *msg){
 			do {
 				n = d->next;
 				sml_obj_req_entry_free(d->object_list_entry);
-				free(d);
+				sml_free(d);
 				d = n;
 			} while (d);
 		}
 		
 		sml_tree_free(msg->das_details);
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -23,7 +23,7 @@
 // sml_get_profile_pack_response;
 
 sml_get_profile_pack_response *sml_get_profile_pack_response_init() {
-	sml_get_profile_pack_response *msg = (sml_get_profile_pack_response *) malloc(sizeof(sml_get_profile_pack_response));
+	sml_get_profile_pack_response *msg = (sml_get_profile_pack_response *) sml_malloc(sizeof(sml_get_profile_pack_response));
 	memset(msg, 0, sizeof(sml_get_profile_pack_response));
 	
 	return msg;
@@ -98,7 +98,7 @@ void sml_get_profile_pack_response_free(sml_get_profile_pack_response *msg){
 		sml_octet_string_free(msg->rawdata);
 		sml_signature_free(msg->profile_signature);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -106,7 +106,7 @@ void sml_get_profile_pack_response_free(sml_get_profile_pack_response *msg){
 // sml_prof_obj_header_entry;
 
 sml_prof_obj_header_entry *sml_prof_obj_header_entry_init() {
-	sml_prof_obj_header_entry *entry = (sml_prof_obj_header_entry *) malloc(sizeof(sml_prof_obj_header_entry));
+	sml_prof_obj_header_entry *entry = (sml_prof_obj_header_entry *) sml_malloc(sizeof(sml_prof_obj_header_entry));
 	memset(entry, 0, sizeof(sml_prof_obj_header_entry));
 	return entry;
 }
@@ -152,7 +152,7 @@ void sml_prof_obj_header_entry_free(sml_prof_obj_header_entry *entry) {
 		sml_unit_free(entry->unit);
 		sml_number_free(entry->scaler);
 
-		free(entry);
+		sml_free(entry);
 	}
 }
 
@@ -160,7 +160,7 @@ void sml_prof_obj_header_entry_free(sml_prof_obj_header_entry *entry) {
 // sml_prof_obj_period_entry;
 
 sml_prof_obj_period_entry *sml_prof_obj_period_entry_init() {
-	sml_prof_obj_period_entry *entry = (sml_prof_obj_period_entry *) malloc(sizeof(sml_prof_obj_period_entry));
+	sml_prof_obj_period_entry *entry = (sml_prof_obj_period_entry *) sml_malloc(sizeof(sml_prof_obj_period_entry));
 	memset(entry, 0, sizeof(sml_prof_obj_period_entry));
 	return entry;
 }
@@ -211,7 +211,7 @@ void sml_prof_obj_period_entry_free(sml_prof_obj_period_entry *entry) {
 		sml_sequence_free(entry->value_list);
 		sml_signature_free(entry->period_signature);
 
-		free(entry);
+		sml_free(entry);
 	}
 }
 
@@ -219,7 +219,7 @@ void sml_prof_obj_period_entry_free(sml_prof_obj_period_entry *entry) {
 // sml_value_entry;
 
 sml_value_entry *sml_value_entry_init() {
-	sml_value_entry *entry = (sml_value_entry *) malloc(sizeof(sml_value_entry));
+	sml_value_entry *entry = (sml_value_entry *) sml_malloc(sizeof(sml_value_entry));
 	memset(entry, 0, sizeof(sml_value_entry));
 
 	return entry;
@@ -262,7 +262,7 @@ void sml_value_entry_free(sml_value_entry *entry) {
 		sml_value_free(entry->value);
 		sml_signature_free(entry->value_signature);
 
-		free(entry);
+		sml_free(entry);
 	}
 }
 
@@ -28,7 +28,7 @@
 // sml_sequence;
 
 sml_sequence *sml_sequence_init(void (*elem_free) (void *elem)) {
-	sml_sequence *seq = (sml_sequence *) malloc(sizeof(sml_sequence));
+	sml_sequence *seq = (sml_sequence *) sml_malloc(sizeof(sml_sequence));
 	memset(seq, 0, sizeof(sml_sequence));
 	seq->elem_free = elem_free;
 
@@ -36,14 +36,19 @@ sml_sequence *sml_sequence_init(void (*elem_free) (void *elem)) {
 }
 
 sml_sequence *sml_sequence_parse(sml_buffer *buf, void *(*elem_parse) (sml_buffer *buf), void (*elem_free) (void *elem)) {
+	sml_sequence *seq = 0;
+	int i, len;
+	void *p;
+
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
 		buf->error = 1;
 		goto error;
 	}
 
-	sml_sequence *seq = sml_sequence_init(elem_free);
-	int i, len = sml_buf_get_next_length(buf);
-	void *p;
+	len = sml_buf_get_next_length(buf);
+	if (len < 0) goto error;
+
+	seq = sml_sequence_init(elem_free);
 	for (i = 0; i < len; i++) {
 		p = elem_parse(buf);
 		if (sml_buf_has_errors(buf)) goto error;
@@ -80,16 +85,16 @@ void sml_sequence_free(sml_sequence *seq) {
 		}
 		
 		if (seq->elems != 0) {
-			free(seq->elems);
+			sml_free(seq->elems);
 		}
 		
-		free(seq);
+		sml_free(seq);
 	}
 }
 
 void sml_sequence_add(sml_sequence *seq, void *new_entry) {
 	seq->elems_len++;
-	seq->elems = (void **) realloc(seq->elems, sizeof(void *) * seq->elems_len);
+	seq->elems = (void **) sml_realloc(seq->elems, sizeof(void *) * seq->elems_len);
 	seq->elems[seq->elems_len - 1] = new_entry;
 }
 
@@ -97,7 +102,7 @@ void sml_sequence_add(sml_sequence *seq, void *new_entry) {
 // sml_list;
 
 sml_list *sml_list_init(){
-	 sml_list *s = (sml_list *)malloc(sizeof(sml_list));
+	 sml_list *s = (sml_list *)sml_malloc(sizeof(sml_list));
 	 memset(s, 0, sizeof(sml_list));
 	return s;
 }
@@ -107,6 +112,8 @@ void sml_list_add(sml_list *list, sml_list *new_entry) {
 }
 
 sml_list *sml_list_entry_parse(sml_buffer *buf) {
+	sml_list *l = 0;
+
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
 		buf->error = 1;
 		goto error;
@@ -116,7 +123,7 @@ sml_list *sml_list_entry_parse(sml_buffer *buf) {
 		buf->error = 1;
 		goto error;
 	}
-	sml_list *l = sml_list_init();
+	l = sml_list_init();
 
 	l->obj_name = sml_octet_string_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
@@ -141,10 +148,10 @@ sml_list *sml_list_entry_parse(sml_buffer *buf) {
 
 	return l;
 
-// This function doesn't free the allocated memory in error cases,
-// this is done in sml_list_parse.
+// the entry isn't linked into the list yet, sml_list_parse can't free it
 error:
 	buf->error = 1;
+	sml_list_entry_free(l);
 	return 0;
 }
 
@@ -230,7 +237,7 @@ void sml_list_entry_free(sml_list *list) {
 		sml_value_free(list->value);
 		sml_octet_string_free(list->value_signature);
 		
-		free(list);
+		sml_free(list);
 	}
 }
 
@@ -30,9 +30,13 @@
 
 // sml_message;
 
+int sml_message_check_crc = 1;
+
 sml_message *sml_message_parse(sml_buffer *buf) {
-	sml_message *msg = (sml_message *) malloc(sizeof(sml_message));
+	sml_message *msg = (sml_message *) sml_malloc(sizeof(sml_message));
 	memset(msg, 0, sizeof(sml_message));
+	int msg_start = buf->cursor;
+	int crc_start;
 
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
 		buf->error = 1;
@@ -56,10 +60,18 @@ sml_message *sml_message_parse(sml_buffer *buf) {
 	msg->message_body = sml_message_body_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
 
+	crc_start = buf->cursor;
 	msg->crc = sml_u16_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
 
-	if (sml_buf_get_current_byte(buf) == SML_MESSAGE_END) {
+	// the CRC covers the message up to the CRC field
+	if (sml_message_check_crc && msg->crc &&
+		*msg->crc != sml_crc16_calculate(&(buf->buffer[msg_start]), crc_start - msg_start)) {
+		buf->error = 1;
+		goto error;
+	}
+
+	if (buf->cursor < buf->buffer_len && sml_buf_get_current_byte(buf) == SML_MESSAGE_END) {
 		sml_buf_update_bytes_read(buf, 1);
 	}
 	
@@ -71,7 +83,7 @@ error:
 }
 
 sml_message *sml_message_init() {
-	sml_message *msg = (sml_message *) malloc(sizeof(sml_message));
+	sml_message *msg = (sml_message *) sml_malloc(sizeof(sml_message));
 	memset(msg, 0, sizeof(sml_message));
 	msg->transaction_id = sml_octet_string_generate_uuid();
 	return msg;
@@ -84,7 +96,7 @@ void sml_message_free(sml_message *msg) {
 		sml_number_free(msg->abort_on_error);
 		sml_message_body_free(msg->message_body);
 		sml_number_free(msg->crc);
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -108,7 +120,7 @@ void sml_message_write(sml_message *msg, sml_buffer *buf) {
 // sml_message_body;
 
 sml_message_body *sml_message_body_parse(sml_buffer *buf) {
-	sml_message_body *msg_body = (sml_message_body *) malloc(sizeof(sml_message_body));
+	sml_message_body *msg_body = (sml_message_body *) sml_malloc(sizeof(sml_message_body));
 	memset(msg_body, 0, sizeof(sml_message_body));
 
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
@@ -123,6 +135,10 @@ sml_message_body *sml_message_body_parse(sml_buffer *buf) {
 
 	msg_body->tag = sml_u32_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
+	if (!msg_body->tag) {
+		buf->error = 1;
+		goto error;
+	}
 
 	switch (*(msg_body->tag)) {
 		case SML_MESSAGE_OPEN_REQUEST:
@@ -169,18 +185,21 @@ sml_message_body *sml_message_body_parse(sml_buffer *buf) {
 			break;
 		default:
 			printf("error: message type %04X not yet implemented\n", *(msg_body->tag));
-			break;
+			// the body can't be skipped, nothing after it makes sense
+			buf->error = 1;
+			goto error;
 	}
 
 	return msg_body;
 
 error:
-	free(msg_body);
+	sml_number_free(msg_body->tag);
+	sml_free(msg_body);
 	return 0;
 }
 
 sml_message_body *sml_message_body_init(u32 tag, void *data) {
-	sml_message_body *message_body = (sml_message_body *) malloc(sizeof(sml_message_body));
+	sml_message_body *message_body = (sml_message_body *) sml_malloc(sizeof(sml_message_body));
 	memset(message_body, 0, sizeof(sml_message_body));
 	message_body->tag = sml_u32_init(tag);
 	message_body->data = data;
@@ -290,7 +309,7 @@ void sml_message_body_free(sml_message_body *message_body) {
 				break;
 		}
 		sml_number_free(message_body->tag);
-		free(message_body);
+		sml_free(message_body);
 	}
 }
 
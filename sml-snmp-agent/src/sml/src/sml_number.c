@@ -37,7 +37,7 @@ void *sml_number_init(u64 number, unsigned char type, int size) {
 		  bytes += sizeof(u64) - size;
 	}
 
-	unsigned char *np = malloc(size);
+	unsigned char *np = sml_malloc(size);
 	memset(np, 0, size);
 	memcpy(np, bytes, size);
 	return np;
@@ -63,10 +63,10 @@ void *sml_number_parse(sml_buffer *buf, unsigned char type, int max_size) {
 		return 0;
 	}
 
-	unsigned char *np = malloc(max_size);
+	unsigned char *np = sml_malloc(max_size);
 	memset(np, 0, max_size);
 
-	b = sml_buf_get_current_byte(buf);
+	b = l > 0 ? sml_buf_get_current_byte(buf) : 0;
 	if (type == SML_TYPE_INTEGER && (b & 128)) {
 		negative_int = 1;
 	}
@@ -126,7 +126,7 @@ int sml_number_endian() {
 
 void sml_number_free(void *np) {
 	if (np) {
-		free(np);
+		sml_free(np);
 	}
 }
 
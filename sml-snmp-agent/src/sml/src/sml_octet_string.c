@@ -18,6 +18,7 @@
 
 
 #include <sml/sml_octet_string.h>
+#include <sml/sml_arena.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -34,10 +35,10 @@ uint8_t c2toi(uint8_t c1, uint8_t c2);
 uint8_t c2ptoi(char* c);
 
 octet_string *sml_octet_string_init(unsigned char *str, int length) {
-	octet_string *s = (octet_string *)malloc(sizeof(octet_string));
+	octet_string *s = (octet_string *)sml_malloc(sizeof(octet_string));
 	memset(s, 0, sizeof(octet_string));
 	if (length > 0) {
-		s->str = (unsigned char *)malloc(length);
+		s->str = (unsigned char *)sml_malloc(length);
 		memcpy(s->str, str, length);
 		s->len = length;
 	}
@@ -60,9 +61,9 @@ octet_string *sml_octet_string_init_from_hex(char *str) {
 void sml_octet_string_free(octet_string *str) {
 	if (str) {
 		if (str->str) {
-			free(str->str);
+			sml_free(str->str);
 		}
-		free(str);
+		sml_free(str);
 	}
 }
 
@@ -83,7 +84,16 @@ octet_string *sml_octet_string_parse(sml_buffer *buf) {
 		return 0;
 	}
 
-	octet_string *str = sml_octet_string_init(sml_buf_get_current_buf(buf), l);
+	octet_string *str;
+	if (sml_arena_get_current()) {
+		// arena parsing keeps the receive buffer, reference it
+		str = (octet_string *) sml_malloc(sizeof(octet_string));
+		str->str = l > 0 ? sml_buf_get_current_buf(buf) : 0;
+		str->len = l > 0 ? l : 0;
+	}
+	else {
+		str = sml_octet_string_init(sml_buf_get_current_buf(buf), l);
+	}
 	sml_buf_update_bytes_read(buf, l);
 	return str;
 }
@@ -22,7 +22,7 @@
 #include <stdio.h>
 
 sml_open_request *sml_open_request_init(){
-	sml_open_request *open_request = (sml_open_request *) malloc(sizeof(sml_open_request));
+	sml_open_request *open_request = (sml_open_request *) sml_malloc(sizeof(sml_open_request));
 	memset(open_request, 0, sizeof(sml_open_request));
 	return open_request;
 }
@@ -90,7 +90,7 @@ void sml_open_request_free(sml_open_request *msg) {
 		sml_octet_string_free(msg->password);
 		sml_number_free(msg->sml_version);
 		
-		free(msg);
+		sml_free(msg);
 	}
 }
 
@@ -21,7 +21,7 @@
 #include <sml/sml_number.h>
 
 sml_open_response *sml_open_response_init() {
-	sml_open_response *msg = (sml_open_response *) malloc(sizeof(sml_open_response));
+	sml_open_response *msg = (sml_open_response *) sml_malloc(sizeof(sml_open_response));
 	memset(msg, 0, sizeof(sml_open_response));
 
 	return msg;
@@ -84,7 +84,7 @@ void sml_open_response_free(sml_open_response *msg) {
 		sml_time_free(msg->ref_time);
 		sml_number_free(msg->sml_version);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
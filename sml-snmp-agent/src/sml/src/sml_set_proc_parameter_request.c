@@ -20,7 +20,7 @@
 #include <sml/sml_set_proc_parameter_request.h>
 
 sml_set_proc_parameter_request *sml_set_proc_parameter_request_init() {
-	sml_set_proc_parameter_request *msg = (sml_set_proc_parameter_request *) malloc(sizeof (sml_set_proc_parameter_request));
+	sml_set_proc_parameter_request *msg = (sml_set_proc_parameter_request *) sml_malloc(sizeof (sml_set_proc_parameter_request));
 	memset(msg, 0, sizeof(sml_set_proc_parameter_request));
 
 	return msg;
@@ -78,7 +78,7 @@ void sml_set_proc_parameter_request_free(sml_set_proc_parameter_request *msg) {
 		sml_tree_path_free(msg->parameter_tree_path);
 		sml_tree_free(msg->parameter_tree);
 
-		free(msg);
+		sml_free(msg);
 	}
 }
 
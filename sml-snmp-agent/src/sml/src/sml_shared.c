@@ -38,9 +38,21 @@ int sml_buf_get_next_length(sml_buffer *buf) {
 		if(list) {
 			list += -1;
 		}
+		// more TL-fields than an int holds, or than the buffer has
+		if (length > 0xffffff || buf->cursor == buf->buffer_len) {
+			buf->error = 1;
+			return -1;
+		}
 	}
 	sml_buf_update_bytes_read(buf, 1);
 
+	// every list element takes at least a byte, so neither may go past
+	// the end of the buffer
+	if (length + list > (int) (buf->buffer_len - buf->cursor)) {
+		buf->error = 1;
+		return -1;
+	}
+
 	return length + list;
 }
 
@@ -58,7 +70,7 @@ void sml_buf_set_type_and_length(sml_buffer *buf, unsigned int type, unsigned in
 		int mask_pos = (sizeof(unsigned int) * 2) - 1;
 
 		// the 4 most significant bits of l (1111 0000 0000 ...)
-		unsigned int mask = 0xF0 << (8 * (sizeof(unsigned int) - 1));
+		unsigned int mask = 0xF0u << (8 * (sizeof(unsigned int) - 1));
 
 		// select the next 4 most significant bits with a bit set until there 
 		// is something
@@ -67,13 +79,18 @@ void sml_buf_set_type_and_length(sml_buffer *buf, unsigned int type, unsigned in
 			mask_pos--;
 		}
 
-		l += mask_pos; // for every TL-field
-
-		if ((0x0F << (4 * (mask_pos + 1))) & l) {
-			// for the rare case that the addition of the number of TL-fields
-			// result in another TL-field.
-			mask_pos++;
-			l++;
+		// the length of a list counts its elements, all others count
+		// their TL-fields too
+		if (type != SML_TYPE_LIST) {
+			l += mask_pos; // for every TL-field
+
+			if ((0x0F << (4 * (mask_pos + 1))) & l) {
+				// for the rare case that the addition of the number of TL-fields
+				// result in another TL-field.
+				mask <<= 4;
+				mask_pos++;
+				l++;
+			}
 		}
 
 		// copy 4 bits of the number to the buffer
@@ -83,6 +100,7 @@ void sml_buf_set_type_and_length(sml_buffer *buf, unsigned int type, unsigned in
 			mask >>= 4;
 			mask_pos--;
 			buf->cursor++;
+			buf->buffer[buf->cursor] = 0;
 		}
 	}
 
@@ -95,10 +113,18 @@ int sml_buf_has_errors(sml_buffer *buf) {
 }
 
 int sml_buf_get_next_type(sml_buffer *buf) {
+	// a value is expected, but the buffer ends
+	if (buf->cursor >= buf->buffer_len) {
+		buf->error = 1;
+		return 0;
+	}
 	return (buf->buffer[buf->cursor] & SML_TYPE_FIELD);
 }
 
 unsigned char sml_buf_get_current_byte(sml_buffer *buf) {
+	if (buf->cursor >= buf->buffer_len) {
+		return 0;
+	}
 	return buf->buffer[buf->cursor];
 }
 
@@ -111,9 +137,9 @@ void sml_buf_update_bytes_read(sml_buffer *buf, int bytes) {
 }
 
 sml_buffer *sml_buffer_init(size_t length) {
-	sml_buffer *buf = (sml_buffer *) malloc(sizeof(sml_buffer));
+	sml_buffer *buf = (sml_buffer *) sml_malloc(sizeof(sml_buffer));
 	memset(buf, 0, sizeof(sml_buffer));
-	buf->buffer = (unsigned char *) malloc(length);
+	buf->buffer = (unsigned char *) sml_malloc(length);
 	buf->buffer_len = length;
 	memset(buf->buffer, 0, buf->buffer_len);
 
@@ -128,10 +154,10 @@ void sml_buf_optional_write(sml_buffer *buf) {
 void sml_buffer_free(sml_buffer *buf) {
 	if (buf) {
 		if (buf->buffer)
-			free(buf->buffer);
+			sml_free(buf->buffer);
 		if (buf->error_msg)
-			free(buf->error_msg);
-		free(buf);
+			sml_free(buf->error_msg);
+		sml_free(buf);
 	}
 }
 
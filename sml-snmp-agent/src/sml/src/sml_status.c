@@ -20,7 +20,7 @@
 #include <sml/sml_status.h>
 
 sml_status *sml_status_init() {
-	sml_status *status = (sml_status *) malloc(sizeof(sml_status));
+	sml_status *status = (sml_status *) sml_malloc(sizeof(sml_status));
 	memset(status, 0, sizeof(sml_status));
 
 	return status;
@@ -43,6 +43,11 @@ sml_status *sml_status_parse(sml_buffer *buf) {
 			while (max < ((byte & SML_LENGTH_FIELD) - 1)) {
 				max <<= 1;
 			}
+			// 64 bit at most, a wider one would clobber the type
+			if (max > SML_TYPE_NUMBER_64) {
+				buf->error = 1;
+				break;
+			}
 
 			status->data.status8 = sml_number_parse(buf, type, max);
 			status->type |= max;
@@ -71,7 +76,7 @@ void sml_status_write(sml_status *status, sml_buffer *buf) {
 void sml_status_free(sml_status *status) {
 	if (status) {
 		sml_number_free(status->data.status8);
-		free(status);
+		sml_free(status);
 	}
 }
 
@@ -23,7 +23,7 @@
 #include <stdio.h>
 
 sml_time *sml_time_init() {
-	sml_time *t = (sml_time *) malloc(sizeof(sml_time));
+	sml_time *t = (sml_time *) sml_malloc(sizeof(sml_time));
 	memset(t, 0, sizeof(sml_time));
 	return t;
 }
@@ -51,6 +51,12 @@ sml_time *sml_time_parse(sml_buffer *buf) {
 	tme->data.timestamp = sml_u32_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
 
+	// neither may be left out
+	if (!tme->tag || !tme->data.timestamp) {
+		buf->error = 1;
+		goto error;
+	}
+
 	return tme;
 
 error:
@@ -73,7 +79,7 @@ void sml_time_free(sml_time *tme) {
     if (tme) {
 		sml_number_free(tme->tag);
 		sml_number_free(tme->data.timestamp);
-        free(tme);
+        sml_free(tme);
     }
 }
 
@@ -25,95 +25,349 @@
 #include <sys/types.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 
 #define MC_SML_BUFFER_LEN 8096
 
+// escape sequences inside a frame are aligned to 4 bytes relative to its start
+#define SML_ESC_LEN 4
+#define SML_HUNTING ((size_t) -1)
+
 unsigned char esc_seq[] = {0x1b, 0x1b, 0x1b, 0x1b};
 unsigned char start_seq[] = {0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01};
 unsigned char end_seq[] = {0x1b, 0x1b, 0x1b, 0x1b, 0x1a};
 
+sml_transport_decoder *sml_transport_decoder_init(size_t max_frame) {
+	sml_transport_decoder *dec = (sml_transport_decoder *) malloc(sizeof(sml_transport_decoder));
+	memset(dec, 0, sizeof(sml_transport_decoder));
+	dec->buf = (unsigned char *) malloc(max_frame);
+	dec->size = max_frame;
+	dec->start = SML_HUNTING;
+	dec->candidate = SML_HUNTING;
+	dec->check_crc = 1;
+
+	return dec;
+}
+
+void sml_transport_decoder_reset(sml_transport_decoder *dec) {
+	dec->len = 0;
+	dec->pos = 0;
+	dec->consumed = 0;
+	dec->escapes = 0;
+	dec->start = SML_HUNTING;
+	dec->candidate = SML_HUNTING;
+}
+
+void sml_transport_decoder_free(sml_transport_decoder *dec) {
+	if (dec) {
+		free(dec->buf);
+		free(dec);
+	}
+}
+
+// drops everything that is neither part of the current frame nor unscanned
+static void sml_transport_decoder_compact(sml_transport_decoder *dec) {
+	size_t keep = (dec->start != SML_HUNTING) ? dec->start : dec->pos;
+
+	if (keep < dec->consumed) {
+		keep = dec->consumed;
+	}
+	if (keep == 0) {
+		return;
+	}
+	memmove(dec->buf, dec->buf + keep, dec->len - keep);
+	dec->len -= keep;
+	dec->pos -= keep;
+	dec->consumed = 0;
+	if (dec->start != SML_HUNTING) {
+		dec->start -= keep;
+	}
+	if (dec->candidate != SML_HUNTING) {
+		dec->candidate -= keep;
+		dec->candidate_pos -= keep;
+	}
+}
 
-size_t sml_read(int fd, fd_set *set, unsigned char *buffer, size_t len) {
-	
-	size_t r, tr = 0;
+// the current frame turned out to be broken, hunt again from the first
+// unaligned start inside it, or from the given position
+static void sml_transport_decoder_drop(sml_transport_decoder *dec, size_t pos) {
+	if (dec->candidate != SML_HUNTING) {
+		pos = dec->candidate;
+	}
+	dec->pos = pos;
+	dec->start = SML_HUNTING;
+	dec->candidate = SML_HUNTING;
+	dec->escapes = 0;
+}
 
-	while (tr < len) {
-		select(fd + 1, set, 0, 0, 0);
-		if (FD_ISSET(fd, set)) {
-			
-			r = read(fd, &(buffer[tr]), len - tr);
-			if (r < 0) continue;
+// Follows the candidate in its own alignment. Returns 1 once it is a
+// complete frame with a good CRC: the bytes lost were in the current frame,
+// which can't end where the sender meant it to.
+static int sml_transport_candidate_done(sml_transport_decoder *dec) {
+	unsigned char *b = dec->buf;
+	size_t p, end;
+	u16 crc;
 
-			tr += r;
+	if (dec->candidate == SML_HUNTING || !dec->check_crc) {
+		return 0;
+	}
+	for (p = dec->candidate_pos; p + 2 * SML_ESC_LEN <= dec->len; p += SML_ESC_LEN) {
+		if (memcmp(b + p, esc_seq, SML_ESC_LEN)) {
+			continue;
+		}
+		if (!memcmp(b + p + SML_ESC_LEN, esc_seq, SML_ESC_LEN)) {
+			p += SML_ESC_LEN;
+			continue;
+		}
+		if (b[p + SML_ESC_LEN] != 0x1a) {
+			// not a frame after all
+			dec->candidate = SML_HUNTING;
+			return 0;
 		}
+		end = p + 2 * SML_ESC_LEN;
+		crc = sml_crc16_calculate(b + dec->candidate, end - dec->candidate - 2);
+		if (b[end - 2] != (crc >> 8) || b[end - 1] != (crc & 0xff)) {
+			dec->candidate = SML_HUNTING;
+			return 0;
+		}
+		return 1;
 	}
-	return tr;
+	dec->candidate_pos = p;
+	return 0;
 }
 
-size_t sml_transport_read(int fd, unsigned char *buffer, size_t max_len) {
+// more data is needed for the current frame, unless the candidate is done
+static int sml_transport_decoder_stalled(sml_transport_decoder *dec) {
+	if (!sml_transport_candidate_done(dec)) {
+		return 0;
+	}
+	dec->resyncs++;
+	sml_transport_decoder_drop(dec, dec->candidate);
+	return 1;
+}
 
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(fd, &readfds);
-
-	unsigned char buf[max_len];
-	memset(buf, 0, max_len);
-	unsigned int len = 0;
-	
-	while (len < 8) {
-		sml_read(fd, &readfds, &(buf[len]), 1);
-
-		if ((buf[len] == 0x1b && len < 4) || (buf[len] == 0x01 && len >= 4)) {
-			len++;
-		}
-		else {
-			len = 0;
-		}
-	}
-
-	// found start sequence
-
-	while (len < max_len) {
-		
-		sml_read(fd, &readfds, &(buf[len]), 4);
-			
-		if (memcmp(&buf[len], esc_seq, 4) == 0) {
-			
-			// found esc sequence
-			len += 4;
-			sml_read(fd, &readfds, &(buf[len]), 4);
-			
-			if (buf[len] == 0x1a) {
-				
-				// found end sequence
-				len += 4;
-				memcpy(buffer, &(buf[0]), len);
-				return len;
+unsigned char *sml_transport_decoder_space(sml_transport_decoder *dec, size_t *avail) {
+	sml_transport_decoder_compact(dec);
+
+	if (dec->len == dec->size) {
+		// a frame filled the whole buffer, it can't be valid
+		dec->overflows++;
+		sml_transport_decoder_drop(dec, dec->start + 1);
+		sml_transport_decoder_compact(dec);
+	}
+	*avail = dec->size - dec->len;
+	return dec->buf + dec->len;
+}
+
+void sml_transport_decoder_commit(sml_transport_decoder *dec, size_t n) {
+	dec->len += n;
+}
+
+size_t sml_transport_decoder_feed(sml_transport_decoder *dec, const unsigned char *data, size_t len) {
+	size_t avail;
+	unsigned char *space = sml_transport_decoder_space(dec, &avail);
+
+	if (len > avail) {
+		len = avail;
+	}
+	memcpy(space, data, len);
+	sml_transport_decoder_commit(dec, len);
+	return len;
+}
+
+// removes the doubled escape sequences, returns the new frame length
+static size_t sml_transport_unescape(unsigned char *frame, size_t len) {
+	size_t p;
+
+	for (p = 8; p + 2 * SML_ESC_LEN <= len - 8; p += SML_ESC_LEN) {
+		if (!memcmp(frame + p, esc_seq, SML_ESC_LEN) && !memcmp(frame + p + SML_ESC_LEN, esc_seq, SML_ESC_LEN)) {
+			memmove(frame + p + SML_ESC_LEN, frame + p + 2 * SML_ESC_LEN, len - p - 2 * SML_ESC_LEN);
+			len -= SML_ESC_LEN;
+		}
+	}
+	return len;
+}
+
+int sml_transport_decoder_next(sml_transport_decoder *dec, unsigned char **frame, size_t *frame_len) {
+	unsigned char *b = dec->buf, *q;
+	size_t p, end;
+	u16 crc;
+
+	for (;;) {
+		if (dec->start == SML_HUNTING) {
+			q = memchr(b + dec->pos, 0x1b, dec->len - dec->pos);
+			if (!q) {
+				dec->pos = dec->len;
+				return 0;
 			}
-			else {
-				// dont read other escaped sequences yet
-				printf("error: unrecognized sequence\n");
+			p = q - b;
+			dec->pos = p;
+			if (dec->len - p < sizeof(start_seq)) {
 				return 0;
 			}
+			if (memcmp(b + p, start_seq, sizeof(start_seq))) {
+				dec->pos = p + 1;
+				continue;
+			}
+			dec->start = p;
+			dec->pos = p + sizeof(start_seq);
+			dec->escapes = 0;
+		}
+
+		// find the next aligned escape sequence, memchr skips the payload
+		q = memchr(b + dec->pos, 0x1b, dec->len - dec->pos);
+		if (!q) {
+			dec->pos = dec->len - ((dec->len - dec->start) % SML_ESC_LEN);
+			if (sml_transport_decoder_stalled(dec)) {
+				continue;
+			}
+			return 0;
+		}
+		p = q - b;
+		if ((p - dec->start) % SML_ESC_LEN) {
+			// bytes got lost, a new frame may start off the alignment
+			if (dec->len - p < sizeof(start_seq)) {
+				dec->pos = p;
+				if (sml_transport_decoder_stalled(dec)) {
+					continue;
+				}
+				return 0;
+			}
+			// unaligned sequences in the payload aren't escaped, so this
+			// only becomes the next frame if the current one fails
+			if (!memcmp(b + p, start_seq, sizeof(start_seq)) && dec->candidate == SML_HUNTING) {
+				dec->candidate = p;
+				dec->candidate_pos = p + sizeof(start_seq);
+			}
+			dec->pos = p + SML_ESC_LEN - ((p - dec->start) % SML_ESC_LEN);
+			if (dec->pos > dec->len) {
+				dec->pos = dec->len - ((dec->len - dec->start) % SML_ESC_LEN);
+			}
+			continue;
+		}
+		dec->pos = p;
+		if (dec->len - p < 2 * SML_ESC_LEN) {
+			if (sml_transport_decoder_stalled(dec)) {
+				continue;
+			}
+			return 0;
+		}
+		if (memcmp(b + p, esc_seq, SML_ESC_LEN)) {
+			dec->pos = p + SML_ESC_LEN;
+			continue;
+		}
+
+		if (!memcmp(b + p + SML_ESC_LEN, esc_seq, SML_ESC_LEN)) {
+			// escaped 1b1b1b1b in the payload
+			dec->escapes++;
+			dec->pos = p + 2 * SML_ESC_LEN;
+			continue;
+		}
+		if (!memcmp(b + p, start_seq, sizeof(start_seq))) {
+			// start of a new frame, the current one was truncated
+			dec->resyncs++;
+			sml_transport_decoder_drop(dec, p);
+			continue;
+		}
+		if (b[p + SML_ESC_LEN] != 0x1a) {
+			// unknown escape sequence, hunt for the next start
+			dec->resyncs++;
+			sml_transport_decoder_drop(dec, dec->start + 1);
+			continue;
 		}
-		len += 4;
 
+		// end sequence: 1b1b1b1b 1a <padding> <crc16>
+		end = p + 2 * SML_ESC_LEN;
+		if (dec->check_crc) {
+			crc = sml_crc16_calculate(b + dec->start, end - dec->start - 2);
+			if (b[end - 2] != (crc >> 8) || b[end - 1] != (crc & 0xff)) {
+				dec->crc_errors++;
+				sml_transport_decoder_drop(dec, end);
+				continue;
+			}
+		}
+
+		*frame = b + dec->start;
+		*frame_len = end - dec->start;
+		if (dec->escapes) {
+			*frame_len = sml_transport_unescape(*frame, *frame_len);
+		}
+		dec->frames++;
+		dec->consumed = end;
+		dec->pos = end;
+		dec->start = SML_HUNTING;
+		dec->candidate = SML_HUNTING;
+		return 1;
 	}
+}
 
-	return 0;
+// fills the decoder with whatever fd has, returns 0 on EOF or error
+static int sml_transport_fill(int fd, sml_transport_decoder *dec) {
+	unsigned char *space;
+	size_t avail;
+	ssize_t r;
+	fd_set readfds;
+
+	for (;;) {
+		space = sml_transport_decoder_space(dec, &avail);
+		FD_ZERO(&readfds);
+		FD_SET(fd, &readfds);
+		if (select(fd + 1, &readfds, 0, 0, 0) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 0;
+		}
+		r = read(fd, space, avail);
+		if (r > 0) {
+			sml_transport_decoder_commit(dec, r);
+			return 1;
+		}
+		if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+			return 0;
+		}
+	}
 }
 
-void sml_transport_listen(int fd, void (*sml_transport_receiver)(unsigned char *buffer, size_t buffer_len)) {
-	unsigned char buffer[MC_SML_BUFFER_LEN];
-	size_t bytes;
+size_t sml_transport_read(int fd, unsigned char *buffer, size_t max_len) {
+	static __thread sml_transport_decoder *dec;
+	static __thread int dec_fd = -1;
+	unsigned char *frame;
+	size_t len;
 
-	while (1) {
-		bytes = sml_transport_read(fd, buffer, MC_SML_BUFFER_LEN);
+	if (!dec) {
+		dec = sml_transport_decoder_init(MC_SML_BUFFER_LEN);
+	}
+	if (fd != dec_fd) {
+		sml_transport_decoder_reset(dec);
+		dec_fd = fd;
+	}
+
+	for (;;) {
+		while (sml_transport_decoder_next(dec, &frame, &len)) {
+			if (len <= max_len) {
+				memcpy(buffer, frame, len);
+				return len;
+			}
+		}
+		if (!sml_transport_fill(fd, dec)) {
+			dec_fd = -1;
+			return 0;
+		}
+	}
+}
+
+void sml_transport_listen(int fd, void (*sml_transport_receiver)(unsigned char *buffer, size_t buffer_len)) {
+	sml_transport_decoder *dec = sml_transport_decoder_init(MC_SML_BUFFER_LEN);
+	unsigned char *frame;
+	size_t len;
 
-		if (bytes > 0) {
-			sml_transport_receiver(buffer, bytes);
+	while (sml_transport_fill(fd, dec)) {
+		while (sml_transport_decoder_next(dec, &frame, &len)) {
+			sml_transport_receiver(frame, len);
 		}
 	}
+	sml_transport_decoder_free(dec);
 }
 
 int sml_transport_write(int fd, sml_file *file) {
@@ -24,7 +24,7 @@
 // sml_tree_path;
 
 sml_tree_path *sml_tree_path_init() {
-	sml_tree_path *tree_path = (sml_tree_path *) malloc(sizeof(sml_tree_path));
+	sml_tree_path *tree_path = (sml_tree_path *) sml_malloc(sizeof(sml_tree_path));
 	memset(tree_path, 0, sizeof(sml_tree_path));
 
 	return tree_path;
@@ -39,7 +39,7 @@ sml_tree_path *sml_tree_path_parse(sml_buffer *buf) {
 
 	if (sml_buf_get_next_type(buf) != SML_TYPE_LIST) {
 		buf->error = 1;
-		return 0;
+		goto error;
 	}
 
 	octet_string *s;
@@ -62,7 +62,7 @@ error:
 
 void sml_tree_path_add_path_entry(sml_tree_path *tree_path, octet_string *entry) {
 	tree_path->path_entries_len++;
-	tree_path->path_entries = (octet_string **) realloc(tree_path->path_entries,
+	tree_path->path_entries = (octet_string **) sml_realloc(tree_path->path_entries,
 		sizeof(octet_string *) * tree_path->path_entries_len);
 
 	tree_path->path_entries[tree_path->path_entries_len - 1] = entry;
@@ -82,6 +82,9 @@ void sml_tree_path_write(sml_tree_path *tree_path, sml_buffer *buf) {
 			sml_octet_string_write(tree_path->path_entries[i], buf);
 		}
 	}
+	else {
+		sml_buf_set_type_and_length(buf, SML_TYPE_LIST, 0);
+	}
 }
 
 void sml_tree_path_free(sml_tree_path *tree_path) {
@@ -92,10 +95,10 @@ void sml_tree_path_free(sml_tree_path *tree_path) {
 				sml_octet_string_free(tree_path->path_entries[i]);
 			}
 
-			free(tree_path->path_entries);
+			sml_free(tree_path->path_entries);
 		}
 
-		free(tree_path);
+		sml_free(tree_path);
 	}
 }
 
@@ -103,7 +106,7 @@ void sml_tree_path_free(sml_tree_path *tree_path) {
 // sml_tree;
 
 sml_tree *sml_tree_init() {
-	sml_tree *tree = (sml_tree *) malloc(sizeof(sml_tree));
+	sml_tree *tree = (sml_tree *) sml_malloc(sizeof(sml_tree));
 	memset(tree, 0, sizeof(sml_tree));
 
 	return tree;
@@ -147,6 +150,8 @@ sml_tree *sml_tree_parse(sml_buffer *buf) {
 				sml_tree_add_tree(tree, c);
 			}
 		}
+		// a bad length leaves the loop right away
+		if (sml_buf_has_errors(buf)) goto error;
 	}
 
 	return tree;
@@ -158,7 +163,7 @@ error:
 
 void sml_tree_add_tree(sml_tree *base_tree, sml_tree *tree) {
 	base_tree->child_list_len++;
-	base_tree->child_list = (sml_tree **) realloc(base_tree->child_list,
+	base_tree->child_list = (sml_tree **) sml_realloc(base_tree->child_list,
 		sizeof(sml_tree *) * base_tree->child_list_len);
 	base_tree->child_list[base_tree->child_list_len - 1] = tree;
 }
@@ -172,8 +177,8 @@ void sml_tree_free(sml_tree *tree) {
 			sml_tree_free(tree->child_list[i]);
 		}
 
-		free(tree->child_list);
-		free(tree);
+		sml_free(tree->child_list);
+		sml_free(tree);
 	}
 }
 
@@ -205,7 +210,7 @@ void sml_tree_write(sml_tree *tree, sml_buffer *buf) {
 // sml_proc_par_value;
 
 sml_proc_par_value *sml_proc_par_value_init() {
-	sml_proc_par_value *value = (sml_proc_par_value *) malloc(sizeof(sml_proc_par_value));
+	sml_proc_par_value *value = (sml_proc_par_value *) sml_malloc(sizeof(sml_proc_par_value));
 	memset(value, 0, sizeof(sml_proc_par_value));
 	return value;
 }
@@ -229,6 +234,10 @@ sml_proc_par_value *sml_proc_par_value_parse(sml_buffer *buf) {
 
 	ppv->tag = sml_u8_parse(buf);
 	if (sml_buf_has_errors(buf)) goto error;
+	if (!ppv->tag) {
+		buf->error = 1;
+		goto error;
+	}
 
 	switch (*(ppv->tag)) {
 		case SML_PROC_PAR_VALUE_TAG_VALUE:
@@ -300,7 +309,7 @@ void sml_proc_par_value_free(sml_proc_par_value *ppv) {
 					break;
 				default:
 					if (ppv->data.value) {
-						free(ppv->data.value);
+						sml_free(ppv->data.value);
 					}
 			}
 			sml_number_free(ppv->tag);
@@ -308,11 +317,11 @@ void sml_proc_par_value_free(sml_proc_par_value *ppv) {
 		else {
 			// Without the tag, there might be a memory leak.
 			if (ppv->data.value) {
-				free(ppv->data.value);
+				sml_free(ppv->data.value);
 			}
 		}
 
-		free(ppv);
+		sml_free(ppv);
 	}
 }
 
@@ -320,7 +329,7 @@ void sml_proc_par_value_free(sml_proc_par_value *ppv) {
 // sml_tuple_entry;
 
 sml_tupel_entry *sml_tupel_entry_init() {
-	sml_tupel_entry *tupel = (sml_tupel_entry *) malloc(sizeof(sml_tupel_entry));
+	sml_tupel_entry *tupel = (sml_tupel_entry *) sml_malloc(sizeof(sml_tupel_entry));
 	memset(tupel, 0, sizeof(sml_tupel_entry));
 
 	return tupel;
@@ -480,7 +489,7 @@ void sml_tupel_entry_free(sml_tupel_entry *tupel) {
 
 		sml_octet_string_free(tupel->signature_mA_R2_R3);
 
-		free(tupel);
+		sml_free(tupel);
 	}
 }
 
@@ -489,7 +498,7 @@ void sml_tupel_entry_free(sml_tupel_entry *tupel) {
 // sml_period_entry;
 
 sml_period_entry *sml_period_entry_init() {
-	sml_period_entry *period = (sml_period_entry *) malloc(sizeof(sml_period_entry));
+	sml_period_entry *period = (sml_period_entry *) sml_malloc(sizeof(sml_period_entry));
 	memset(period, 0, sizeof(sml_period_entry));
 
 	return period;
@@ -557,7 +566,7 @@ void sml_period_entry_free(sml_period_entry *period) {
 		sml_value_free(period->value);
 		sml_octet_string_free(period->value_signature);
 
-		free(period);
+		sml_free(period);
 	}
 }
 
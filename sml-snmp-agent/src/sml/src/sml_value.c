@@ -45,6 +45,11 @@ sml_value *sml_value_parse(sml_buffer *buf) {
 			while (max < ((byte & SML_LENGTH_FIELD) - 1)) {
 				max <<= 1;
 			}
+			// 64 bit at most, a wider one would clobber the type
+			if (max > SML_TYPE_NUMBER_64) {
+				buf->error = 1;
+				break;
+			}
 
 			value->data.uint8 = sml_number_parse(buf, type, max);
 			value->type |= max;
@@ -83,8 +88,8 @@ void sml_value_write(sml_value *value, sml_buffer *buf) {
 }
 
 sml_value *sml_value_init() {
-	sml_value *value = (sml_value *) malloc(sizeof(sml_value));
-	memset(value, 0, sizeof(value));
+	sml_value *value = (sml_value *) sml_malloc(sizeof(sml_value));
+	memset(value, 0, sizeof(sml_value));
 
 	return value;
 }
@@ -102,7 +107,7 @@ void sml_value_free(sml_value *value) {
 				sml_number_free(value->data.int8);
 				break;
 		}
-		free(value);
+		sml_free(value);
 	}
 }
 
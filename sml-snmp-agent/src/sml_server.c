@@ -19,41 +19,47 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
-#include <math.h>
 #include <pthread.h>
 #include <libgen.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
 #include "snmp.h"
 #include "sml_server.h"
+#include "mib.h"
+#include "meter.h"
 
 #include <sml/sml_file.h>
 #include <sml/sml_transport.h>
 
 #define SML_BUFFER_LEN	8096
+#define SML_ARENA_SIZE	4096
 #define SNMP_PORT	161
+#define SNMP_WORKERS	4
 #define MAX_STRING_LEN	32
 #define MAXLINE		128
-
-pthread_mutex_t value_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define METER_RETRY	5
+#define EPOLL_EVENTS	16
+#define HISTORY_KB	16
 
 extern void *snmp_agent(void *);
-const char obis_tarif0[] = { 0x01, 0x00, 0x01, 0x08, 0x00 };
-const char obis_tarif1[] = { 0x01, 0x00, 0x01, 0x08, 0x01 };
-const char obis_tarif2[] = { 0x01, 0x00, 0x01, 0x08, 0x02 };
-const char power_meter[] = { 0x01, 0x00, 0x10, 0x07, 0x00 };
-
-unsigned int counter_tarif0;
-unsigned int counter_tarif1;
-unsigned int counter_tarif2;
-unsigned int pmeter;
 
 int verbose = 0;
 
+/* all nodes of a telegram come from here, reset once per telegram */
+sml_arena *telegram_arena;
+
 void print_usage(char *prg) {
-    fprintf(stderr, "\nUsage: %s -p <snmp_port> -i <interface> [f]\n", prg);
+    fprintf(stderr, "\nUsage: %s -p <snmp_port> -i <interface> [-i <interface> ...] [-c <obis_config>] [-H <kbytes>] [-s <socket>] [-w <workers>] [-f [-q]]\n", prg);
     fprintf(stderr, "   Version 1.1\n\n");
     fprintf(stderr, "         -p <port>           SNMP port - default 161\n");
     fprintf(stderr, "         -i <interface>      serial interface - default /dev/ttyUSB0\n");
-    fprintf(stderr, "         -f                  running in foreground\n\n");
+    fprintf(stderr, "                             repeated for more meters, numbered from 1 in this order\n");
+    fprintf(stderr, "         -c <obis_config>    OBIS codes to keep, one per line - default 1.8.0-2 and 16.7.0\n");
+    fprintf(stderr, "         -H <kbytes>         history per value - default %d, 0 is off\n", HISTORY_KB);
+    fprintf(stderr, "         -s <socket>         serve the history on this unix socket\n");
+    fprintf(stderr, "         -w <workers>        SNMP worker threads - default one per CPU, up to %d\n", SNMP_WORKERS);
+    fprintf(stderr, "         -f                  running in foreground\n");
+    fprintf(stderr, "         -q                  no meter output in foreground\n\n");
 }
 
 void print_hex(unsigned char c) {
@@ -121,176 +127,231 @@ int serial_port_open(const char *device) {
     return fd;
 }
 
-void transport_receiver(unsigned char *buffer, size_t buffer_len) {
+void transport_receiver(struct meter *meter, unsigned char *buffer, size_t buffer_len) {
     short i;
-    //unsigned char message_buffer[SML_BUFFER_LEN];
     sml_get_list_response *body;
     sml_list *entry = NULL;
-    int m = 0, n = 10;
-    struct timeval time;
+    time_t stamp;
+    int index;
 
     // the buffer contains the whole message, with transport escape sequences.
     // these escape sequences are stripped here.
-    sml_file *file = sml_file_parse(buffer + 8, buffer_len - 16);
+    sml_file *file = sml_file_parse_arena(telegram_arena, buffer + 8, buffer_len - 16);
     // the sml file is parsed now
 
-    // read here some values ..
-    for (i = 0; i < file->messages_len; i++) {
-	sml_message *message = file->messages[i];
-
-	if (*message->message_body->tag == SML_MESSAGE_GET_LIST_RESPONSE) {
-	    body = (sml_get_list_response *) message->message_body->data;
-	    // printf("new message from: %*s\n", body->server_id->len, body->server_id->str);
-	    entry = body->val_list;
-
-	    int time_mode = 1;
-	    if (body->act_sensor_time) {
-		time.tv_sec = *body->act_sensor_time->data.timestamp;
-		time.tv_usec = 0;
-		time_mode = 1;
-		if (verbose)
-		    printf("sensor time: %lu.%lu, %i\n", time.tv_sec, time.tv_usec, *body->act_sensor_time->tag);
-	    }
-	    if (body->act_gateway_time) {
-		time.tv_sec = *body->act_sensor_time->data.timestamp;
-		time.tv_usec = 0;
-		time_mode = -1;
-		if (verbose)
-		    printf("sensor time: %lu.%lu, %i\n", time.tv_sec, time.tv_usec, *body->act_sensor_time->tag);
-	    }
-	    for (entry = body->val_list; entry != NULL; entry = entry->next) {	/* linked list */
-		//int unit = (entry->unit) ? *entry->unit : 0;
-		int scaler = (entry->scaler) ? *entry->scaler : 1;
-		// printf("  scale: %d  unit: %d\n",unit,scaler);
-		double value;
-
-		switch (entry->value->type) {
-		case 0x51:
-		    value = *entry->value->data.int8;
-		    break;
-		case 0x52:
-		    value = *entry->value->data.int16;
-		    break;
-		case 0x54:
-		    value = *entry->value->data.int32;
-		    break;
-		case 0x58:
-		    value = *entry->value->data.int64;
-		    break;
-		case 0x61:
-		    value = *entry->value->data.uint8;
-		    break;
-		case 0x62:
-		    value = *entry->value->data.uint16;
-		    break;
-		case 0x64:
-		    value = *entry->value->data.uint32;
-		    break;
-		case 0x68:
-		    value = *entry->value->data.uint64;
-		    break;
-		default:
-		    //      fprintf(stderr, "Unknown value type: %x\n", entry->value->type);
-		    value = 0;
-		    break;
-		}
-
-		/* apply scaler */
-		value *= pow(10, scaler);
-		/* printf("Value: %f\n",value); */
-
-		/* get time
-		 if (entry->val_time) { // TODO handle SML_TIME_SEC_INDEX
-		      time.tv_sec = *entry->val_time->data.timestamp;
-		        time.tv_usec = 0;
-		        time_mode = 2;
-		 } else if (time_mode == 0) {
-		        gettimeofday(&time, NULL);
-		        time_mode = 3;
-		} */
-		gettimeofday(&time, NULL);
-
-		pthread_mutex_lock(&value_mutex);
-		if (!memcmp(entry->obj_name->str, obis_tarif0, sizeof(obis_tarif0))) {
-		    counter_tarif0 = (int)(value + 0.5);
-		    if (verbose)
-			printf("CT0:%d\n", counter_tarif0);
-		}
-		if (!memcmp(entry->obj_name->str, obis_tarif1, sizeof(obis_tarif1))) {
-		    counter_tarif1 = (int)(value + 0.5);
-		    if (verbose)
-			printf("CT1:%d\n", counter_tarif1);
-		}
-		if (!memcmp(entry->obj_name->str, obis_tarif2, sizeof(obis_tarif2))) {
-		    counter_tarif2 = (int)(value + 0.5);
-		    if (verbose)
-			printf("CT2:%d\n", counter_tarif2);
-		}
-		if (!memcmp(entry->obj_name->str, power_meter, sizeof(power_meter))) {
-		    pmeter = (int)(value + 0.5);
-		    if (verbose)
-			printf("Power:%d\n", pmeter);
-		}
-		pthread_mutex_unlock(&value_mutex);
-
-		/* printf("%lu.%lu (%i)\t%.2f %s\n", time.tv_sec, time.tv_usec, time_mode, value, dlms_get_unit(unit)); */
-		if (verbose) {
-		    print_octet_str(entry->obj_name);
-		    printf("%lu.%lu (%i)\t%.2f\n", time.tv_sec, time.tv_usec, time_mode, value);
+    meter_update(meter, file, time(NULL));
+
+    if (verbose) {
+	for (i = 0; i < file->messages_len; i++) {
+	    if (*file->messages[i]->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+		continue;
+	    body = (sml_get_list_response *) file->messages[i]->message_body->data;
+	    for (entry = body->val_list; entry != NULL; entry = entry->next) {
+		if (!entry->obj_name)
+		    continue;
+		printf("meter %d: ", meter->index);
+		print_octet_str(entry->obj_name);
+		index = entry->obj_name->len == OBIS_LEN ? obis_lookup(entry->obj_name->str) : -1;
+		if (index >= 0) {
+		    long long value = meter_value_get(&meter->values[index], &stamp);
+		    printf("%lu\t%lld\n", (unsigned long)stamp, value);
+		} else {
+		    printf("\n");
 		}
 	    }
 	}
-	/* iterating through linked list */
-	for (m = 0; m < n && entry != NULL; m++) {
-	    /*  meter_sml_parse(entry, &rds[m]); */
-	    printf(" -> entry %d\n", m);
-	    entry = entry->next;
-	}
-    }
-
-    if (verbose)
 	sml_file_print(file);
+    }
 
     sml_file_free(file);
 }
 
+int meter_open(struct meter *meter, int epfd) {
+    struct epoll_event ev;
+
+    meter->fd = serial_port_open(meter->device);
+    if (meter->fd < 0) {
+	meter->retry = time(NULL) + METER_RETRY;
+	return -1;
+    }
+    if (!meter->decoder)
+	meter->decoder = sml_transport_decoder_init(SML_BUFFER_LEN);
+    else
+	sml_transport_decoder_reset(meter->decoder);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = meter;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, meter->fd, &ev) < 0) {
+	fprintf(stderr, "epoll_ctl(%s): %s\n", meter->device, strerror(errno));
+	close(meter->fd);
+	meter->fd = -1;
+	meter->retry = time(NULL) + METER_RETRY;
+	return -1;
+    }
+    return 0;
+}
+
+/* unplugged USB heads come back under the same name, try again later */
+void meter_close(struct meter *meter, int epfd) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, meter->fd, NULL);
+    close(meter->fd);
+    meter->fd = -1;
+    meter->retry = time(NULL) + METER_RETRY;
+}
+
+void meter_read(struct meter *meter, int epfd) {
+    unsigned char *space, *frame;
+    size_t avail, len;
+    ssize_t r;
+
+    while (1) {
+	space = sml_transport_decoder_space(meter->decoder, &avail);
+	r = read(meter->fd, space, avail);
+	if (r > 0) {
+	    sml_transport_decoder_commit(meter->decoder, r);
+	    while (sml_transport_decoder_next(meter->decoder, &frame, &len))
+		transport_receiver(meter, frame, len);
+	    continue;
+	}
+	if (r < 0 && (errno == EAGAIN || errno == EINTR))
+	    return;
+	fprintf(stderr, "meter %d: %s %s\n", meter->index, meter->device, r ? strerror(errno) : "closed");
+	meter_close(meter, epfd);
+	return;
+    }
+}
+
+/* all serial ports in one thread, the parser and the arena are not shared */
 void *reader_thread(void *threadarg) {
     struct edl21_data *data;
+    struct epoll_event events[EPOLL_EVENTS];
+    time_t now;
+    int i, n;
 
     data = (struct edl21_data *) threadarg;
-    sml_transport_listen(data->fd, &transport_receiver);
+    while (1) {
+	n = epoll_wait(data->epfd, events, EPOLL_EVENTS, 1000);
+	if (n < 0 && errno != EINTR) {
+	    fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+	    break;
+	}
+	for (i = 0; i < n; i++)
+	    meter_read((struct meter *)events[i].data.ptr, data->epfd);
+
+	now = time(NULL);
+	for (i = 0; i < meters_len; i++) {
+	    if (meters[i].fd < 0 && meters[i].retry <= now)
+		meter_open(&meters[i], data->epfd);
+	}
+    }
+    return 0;
+}
+
+int history_socket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "socket path to long\n");
+	return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+	fprintf(stderr, "history socket %s: %s\n", path, strerror(errno));
+	if (fd >= 0)
+	    close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+/* one request line per connection, answered and closed */
+void *history_thread(void *threadarg) {
+    struct history_data *data;
+    struct timeval timeout = { 2, 0 };
+    char request[MAXLINE];
+    int fd, n, len;
+
+    data = (struct history_data *) threadarg;
+    while (1) {
+	fd = accept(data->fd, NULL, NULL);
+	if (fd < 0) {
+	    if (errno == EINTR)
+		continue;
+	    fprintf(stderr, "history accept: %s\n", strerror(errno));
+	    break;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	len = 0;
+	while (len < MAXLINE - 1 && (n = read(fd, request + len, MAXLINE - 1 - len)) > 0) {
+	    len += n;
+	    if (memchr(request, '\n', len))
+		break;
+	}
+	request[len] = '\0';
+	if (meter_history_request(fd, request) && verbose)
+	    printf("history request failed: %s\n", request);
+	close(fd);
+    }
     return 0;
 }
 
 int main(int argc, char **argv) {
     pid_t pid;
-    int opt, foreground;
-    char device[MAX_STRING_LEN];
+    int i, opt, foreground, quiet, opened;
+    size_t history = HISTORY_KB * 1024;
+    const char *socket_path = NULL;
 
     struct edl21_data edl21_thread_data;
     struct snmp_data snmp_thread_data;
+    struct history_data history_thread_data;
 
     foreground = 0;
+    quiet = 0;
     snmp_thread_data.snmp_port = SNMP_PORT;
-    bzero(device, sizeof(device));
-    strcpy(device, "/dev/ttyUSB0");
+    snmp_thread_data.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (snmp_thread_data.workers > SNMP_WORKERS)
+	snmp_thread_data.workers = SNMP_WORKERS;
 
-    while ((opt = getopt(argc, argv, "p:i:fh?")) != -1) {
+    while ((opt = getopt(argc, argv, "p:i:c:H:s:w:fqh?")) != -1) {
 	switch (opt) {
 	case 'p':
 	    snmp_thread_data.snmp_port = strtoul(optarg, (char **)NULL, 10);
 	    break;
+	case 'w':
+	    snmp_thread_data.workers = strtoul(optarg, (char **)NULL, 10);
+	    break;
 	case 'f':
 	    foreground = 1;
 	    break;
+	case 'q':
+	    quiet = 1;
+	    break;
 	case 'i':
-	    if (strlen(optarg) < MAX_STRING_LEN) {
-		bzero(device, MAX_STRING_LEN);
-		strcpy(device, optarg);
-	    } else {
+	    if (strlen(optarg) >= MAX_STRING_LEN) {
 		fprintf(stderr, "device name to long\n");
 		exit(1);
 	    }
+	    if (!meter_add(optarg)) {
+		fprintf(stderr, "too many meters, max %d\n", METER_MAX);
+		exit(1);
+	    }
+	    break;
+	case 'c':
+	    if (obis_load(optarg))
+		exit(1);
+	    break;
+	case 'H':
+	    history = strtoul(optarg, (char **)NULL, 10) * 1024;
+	    break;
+	case 's':
+	    socket_path = optarg;
 	    break;
 	case 'h':
 	case '?':
@@ -302,39 +363,76 @@ int main(int argc, char **argv) {
 	    exit(1);
 	}
     }
-    verbose = foreground;
+    verbose = foreground && !quiet;
+    if (!meters_len)
+	meter_add("/dev/ttyUSB0");
+    if (meter_init(history)) {
+	fprintf(stderr, "out of memory\n");
+	exit(1);
+    }
 
     pthread_t thread_reader;
     pthread_t thread_snmp;
+    pthread_t thread_history;
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-    edl21_thread_data.fd = serial_port_open(device);
-    if (edl21_thread_data.fd > 0) {
-	if (!foreground) {
-	    pid = fork();
-	    if (pid < 0)
-		exit(EXIT_FAILURE);
-	    if (pid > 0)
-		exit(EXIT_SUCCESS);
-	}
-	if (pthread_create(&thread_reader, NULL, reader_thread, &edl21_thread_data)) {
-	    pthread_exit(NULL);
+    telegram_arena = sml_arena_init(SML_ARENA_SIZE);
+    if (!telegram_arena)
+	fprintf(stderr, "no memory for the telegram arena, parsing on the heap\n");
+
+    edl21_thread_data.epfd = epoll_create(METER_MAX);
+    if (edl21_thread_data.epfd < 0) {
+	fprintf(stderr, "epoll_create: %s\n", strerror(errno));
+	exit(1);
+    }
+    /* ports missing now are retried by the reader thread */
+    for (i = 0, opened = 0; i < meters_len; i++) {
+	if (!meter_open(&meters[i], edl21_thread_data.epfd))
+	    opened++;
+	else
+	    fprintf(stderr, "can't open %s\n", meters[i].device);
+    }
+    if (!opened)
+	exit(1);
+    history_thread_data.fd = -1;
+    if (socket_path) {
+	if (!history) {
+	    fprintf(stderr, "no history to serve with -H 0\n");
 	    exit(1);
 	}
-	if (pthread_create(&thread_snmp, NULL, snmp_agent, &snmp_thread_data)) {
-	    pthread_cancel(thread_reader);
-	    pthread_exit(NULL);
+	history_thread_data.fd = history_socket(socket_path);
+	if (history_thread_data.fd < 0)
 	    exit(1);
-	}
-	pthread_join(thread_reader, NULL);
+    }
+
+    if (!foreground) {
+	pid = fork();
+	if (pid < 0)
+	    exit(EXIT_FAILURE);
+	if (pid > 0)
+	    exit(EXIT_SUCCESS);
+    }
+    if (pthread_create(&thread_reader, NULL, reader_thread, &edl21_thread_data)) {
+	pthread_exit(NULL);
 	exit(1);
-	pthread_join(thread_snmp, NULL);
+    }
+    if (pthread_create(&thread_snmp, NULL, snmp_agent, &snmp_thread_data)) {
+	pthread_cancel(thread_reader);
+	pthread_exit(NULL);
 	exit(1);
-    } else {
-	fprintf(stderr, "can't open %s\n", device);
+    }
+    if (history_thread_data.fd >= 0 &&
+	pthread_create(&thread_history, NULL, history_thread, &history_thread_data)) {
+	pthread_cancel(thread_reader);
+	pthread_cancel(thread_snmp);
+	pthread_exit(NULL);
 	exit(1);
     }
+    pthread_join(thread_reader, NULL);
+    exit(1);
+    pthread_join(thread_snmp, NULL);
+    exit(1);
     return 0;
 }
@@ -3,9 +3,14 @@
 
 struct snmp_data{
    int snmp_port;
+   int workers;
 };
 
 struct edl21_data{
+   int epfd;
+};
+
+struct history_data{
    int fd;
 };
 
@@ -33,6 +33,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //  Date:               22.02.2011
 ////////////////////////////////////////////////////////////////////////
 
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -47,12 +48,19 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pthread.h>
 #include "snmp.h"
 #include "sml_server.h"
+#include "mib.h"
+#include "meter.h"
+
+#define SNMP_PACKET_SIZE	2048
+#define SNMP_BATCH		16
+#define BULK_MAX_VARBINDS	SNMP_MAX_VARBINDS
+
+struct snmp_worker {
+    int sock;
+    unsigned char (*recv_data)[SNMP_PACKET_SIZE];
+    unsigned char (*send_data)[SNMP_PACKET_SIZE];
+};
 
-extern pthread_mutex_t value_mutex;
-extern unsigned int counter_tarif0;
-extern unsigned int counter_tarif1;
-extern unsigned int counter_tarif2;
-extern unsigned int pmeter;
 
 extern int verbose;
 
@@ -60,22 +68,9 @@ char community_read[] = "public";
 char community_write[] = "private";
 time_t startup_time;
 
-char oid[30][30] = {
-    "1.3.6.1.2.1.1.1.0",
-    "1.3.6.1.2.1.1.3.0",
-    "1.3.6.1.4.1.39241.1.1.0",
-    "1.3.6.1.4.1.39241.1.2.0",
-    "1.3.6.1.4.1.39241.1.3.0",
-    "1.3.6.1.4.1.39241.1.8.0",
-    "1.3.6.1.4.1.39241.1.8.1",
-    "1.3.6.1.4.1.39241.1.8.2",
-    "1.3.6.1.4.1.39241.16.7.0"
-};
-
 char description[] = "volkszaehler.org / DAI Labor Berlin / Frauenhofer FOKUS";
 char MasterName[] = "libSML Masteragent";
 char MasterLocation[] = "Stromkasten";
-unsigned int NumberOfAgents = 1;
 
 void debugg(unsigned char *packet, int length) {
     int position = 0;
@@ -116,134 +111,316 @@ void debugg(unsigned char *packet, int length) {
     }
 }
 
-void process_varbind_list(struct varbind_list_rx *varbind_list) {
-    int i, timeticks;
-    time_t t;
-    pthread_mutex_lock(&value_mutex);
-    for (i = 0; i < varbind_list->varbind_idx; i++) {
+void get_string(void *arg, struct mib_value *value) {
+    value->type = PRIMV_OCTSTR;
+    value->string = arg;
+}
 
-	if (!strcmp((char *)&oid[0][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    update_varbind(varbind_list->varbind_list[i], 0x04, description);
-	}
-	if (!strcmp((char *)&oid[1][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    timeticks = (unsigned int)((time(&t) - startup_time) * 100);
-	    update_varbind(varbind_list->varbind_list[i], 0x043, &timeticks);
+void get_integer(void *arg, struct mib_value *value) {
+    value->type = PRIMV_INT;
+    value->integer = *(volatile unsigned int *)arg;
+}
+
+void get_uptime(void *arg, struct mib_value *value) {
+    value->type = PRIMV_TIMTICK;
+    value->integer = (unsigned int)((time(NULL) - startup_time) * 100);
+}
+
+void register_mib(void) {
+    mib_register("1.3.6.1.2.1.1.1.0", get_string, description);
+    mib_register("1.3.6.1.2.1.1.3.0", get_uptime, NULL);
+    mib_register("1.3.6.1.4.1.39241.1.1.0", get_string, MasterName);
+    mib_register("1.3.6.1.4.1.39241.1.2.0", get_string, MasterLocation);
+    mib_register("1.3.6.1.4.1.39241.1.3.0", get_integer, &meters_len);
+    meter_register_mib();
+}
+
+/*
+ * resolves the varbinds of a request into response, returns their number;
+ * GETNEXT and GETBULK walk the sorted MIB, repeaters stands for the number of
+ * varbinds of each GETBULK repetition; string values may point into values,
+ * which has to live as long as response
+ */
+int process_varbind_list(const struct snmp_request *req, struct ber_varbind *response, struct mib_value *values,
+			 int *repeaters, unsigned char *error_status, unsigned char *error_index) {
+    const struct mib_entry *entries[BULK_MAX_VARBINDS];
+    const struct ber_varbind *prev;
+    unsigned int sequence;
+    int i, r, n = 0, non_repeaters, done;
+
+    *repeaters = 0;
+    *error_status = 0;
+    *error_index = 0;
+
+    switch (req->pdu_type) {
+    case PDU_GET_NEXT_REQ:
+	for (i = 0; i < req->varbind_count; i++) {
+	    response[n] = req->varbinds[i];
+	    entries[n++] = mib_next(req->varbinds[i].oid, req->varbinds[i].oid_len);
 	}
-	if (!strcmp((char *)&oid[2][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    update_varbind(varbind_list->varbind_list[i], 0x04, MasterName);
+	break;
+    case PDU_GET_BULK_REQ:
+	non_repeaters = req->error_status;
+	if (non_repeaters < 0)
+	    non_repeaters = 0;
+	if (non_repeaters > req->varbind_count)
+	    non_repeaters = req->varbind_count;
+	for (i = 0; i < non_repeaters; i++) {
+	    response[n] = req->varbinds[i];
+	    entries[n++] = mib_next(req->varbinds[i].oid, req->varbinds[i].oid_len);
 	}
-	if (!strcmp((char *)&oid[3][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    update_varbind(varbind_list->varbind_list[i], 0x04, MasterLocation);
+	*repeaters = req->varbind_count - non_repeaters;
+	for (r = 0; r < req->error_index && *repeaters && n + *repeaters <= BULK_MAX_VARBINDS; r++) {
+	    done = 1;
+	    for (i = 0; i < *repeaters; i++) {
+		/* continue each column from the row before, ends stay ends */
+		if (r) {
+		    prev = &response[n - *repeaters];
+		    entries[n] = entries[n - *repeaters] ? mib_next(prev->oid, prev->oid_len) : NULL;
+		} else {
+		    prev = &req->varbinds[non_repeaters + i];
+		    entries[n] = mib_next(prev->oid, prev->oid_len);
+		}
+		response[n] = *prev;
+		if (entries[n]) {
+		    response[n].oid = entries[n]->oid;
+		    response[n].oid_len = entries[n]->oid_len;
+		    done = 0;
+		}
+		n++;
+	    }
+	    if (done)
+		break;
 	}
-	if (!strcmp((char *)&oid[4][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    update_varbind(varbind_list->varbind_list[i], 0x02, &NumberOfAgents);
+	break;
+    default:
+	/* GET, and SET answered like a GET as everything is read only */
+	for (i = 0; i < req->varbind_count; i++) {
+	    response[n] = req->varbinds[i];
+	    entries[n++] = mib_find(req->varbinds[i].oid, req->varbinds[i].oid_len);
 	}
+	break;
+    }
 
-	if (!strcmp((char *)&oid[5][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    if (verbose)
-		printf("SNMP Request Counter Tarif 0: %d\n", counter_tarif0);
-	    update_varbind(varbind_list->varbind_list[i], 0x02, &counter_tarif0);
+    /*
+     * server ids are copied inside the loop, so the ids of one request are
+     * consistent; each value checks its own lock
+     */
+    do {
+	sequence = seqlock_read_begin(&value_seqlock);
+	for (i = 0; i < n; i++) {
+	    if (entries[i])
+		entries[i]->get(entries[i]->arg, &values[i]);
 	}
-	if (!strcmp((char *)&oid[6][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    if (verbose)
-		printf("SNMP Request Counter Tarif 1: %d\n", counter_tarif1);
-	    update_varbind(varbind_list->varbind_list[i], 0x02, &counter_tarif1);
-	}
-	if (!strcmp((char *)&oid[7][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    if (verbose)
-		printf("SNMP Request Counter Tarif 2: %d\n", counter_tarif2);
-	    update_varbind(varbind_list->varbind_list[i], 0x02, &counter_tarif2);
+    } while (seqlock_read_retry(&value_seqlock, sequence));
+
+    for (i = 0; i < n; i++) {
+	if (!entries[i]) {
+	    if (req->version == SNMP_VERSION_1) {
+		/* SNMPv1 has no exceptions, the request comes back with an error */
+		*error_status = SNMP_ERR_NOSUCHNAME;
+		*error_index = i + 1;
+		*repeaters = 0;
+		memcpy(response, req->varbinds, req->varbind_count * sizeof(struct ber_varbind));
+		return req->varbind_count;
+	    }
+	    response[i].type = req->pdu_type == PDU_GET_REQ || req->pdu_type == PDU_SET_REQ ?
+		PRIMV_NOSUCHOBJECT : PRIMV_ENDOFMIBVIEW;
+	    response[i].value_len = 0;
+	    continue;
 	}
-	if (!strcmp((char *)&oid[8][0], (char *)varbind_list->varbind_list[i]->oid)) {
-	    if (verbose)
-		printf("SNMP Request Power Meter: %d\n", pmeter);
-	    update_varbind(varbind_list->varbind_list[i], 0x02, &pmeter);
+	if (verbose)
+	    printf("SNMP Request %s\n", entries[i]->name);
+	response[i].oid = entries[i]->oid;
+	response[i].oid_len = entries[i]->oid_len;
+	response[i].type = values[i].type;
+	response[i].integer = values[i].integer;
+	if (values[i].type == PRIMV_OCTSTR) {
+	    response[i].value = (const unsigned char *)values[i].string;
+	    response[i].value_len = strlen(values[i].string);
 	}
     }
-    pthread_mutex_unlock(&value_mutex);
+    return n;
 }
 
-void sendPacket(struct in_addr host, short port, int sock, struct snmp_message_tx *snmp_msg) {
-    int s;
-    struct sockaddr_in server_addr;
+/* decodes, answers and encodes one datagram, NULL if there is nothing to send */
+unsigned char *handle_request(unsigned char *data, int len, unsigned char *out, unsigned int *out_len) {
+    struct snmp_request request;
+    struct ber_varbind varbinds[BULK_MAX_VARBINDS];
+    struct mib_value values[BULK_MAX_VARBINDS];
+    unsigned char error_status, error_index, *response;
+    int n, repeaters;
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    server_addr.sin_addr = host;
-    bzero(&(server_addr.sin_zero), 8);
-    s = sendto(sock, snmp_msg->snmp_message, snmp_msg->snmp_message_len, 0, (struct sockaddr *)&server_addr, sizeof(struct sockaddr));
-    if (s != snmp_msg->snmp_message_len)
-	fprintf(stderr, "%s: error sending UDP data; %s\n", __func__, strerror(errno));
+    if (snmp_decode_request(data, len, &request)) {
+	if (verbose)
+	    printf("malformed SNMP request\n");
+	return NULL;
+    }
     if (verbose)
-	debugg(snmp_msg->snmp_message, snmp_msg->snmp_message_len);
+	disp_snmp_request(&request);
+    if (request.version != SNMP_VERSION_1 && request.version != SNMP_VERSION_2C) {
+	printf("wrong protocol version\n");
+	return NULL;
+    }
+    if (request.pdu_type != PDU_GET_REQ && request.pdu_type != PDU_GET_NEXT_REQ &&
+	request.pdu_type != PDU_SET_REQ &&
+	(request.pdu_type != PDU_GET_BULK_REQ || request.version == SNMP_VERSION_1)) {
+	printf("wrong pdu\n");
+	return NULL;
+    }
+
+    n = process_varbind_list(&request, varbinds, values, &repeaters, &error_status, &error_index);
+    response = snmp_encode_response(out, SNMP_PACKET_SIZE, &request, error_status, error_index, varbinds, n, out_len);
+    /* GETBULK answers are cut down to what fits, whole repetitions at a time */
+    while (!response && repeaters && n > repeaters) {
+	n -= repeaters;
+	response = snmp_encode_response(out, SNMP_PACKET_SIZE, &request, 0, 0, varbinds, n, out_len);
+    }
+    if (!response)
+	response = snmp_encode_response(out, SNMP_PACKET_SIZE, &request, SNMP_ERR_TOOBIG, 0,
+					request.varbinds, request.version == SNMP_VERSION_1 ? request.varbind_count : 0,
+					out_len);
+    if (response && verbose) {
+	debugg(response, *out_len);
+	fflush(stdout);
+    }
+    return response;
 }
 
-void *snmp_agent(void *threadarg) {
-    time(&startup_time);
-    int sock;
-    int bytes_read;
-    socklen_t addr_len;
-    char recv_data[2048];
-    struct sockaddr_in server_addr, client_addr;
-    struct snmp_data *data;
-    data = (struct snmp_data *) threadarg;
+/*
+ * every worker has its own socket bound to the same port with SO_REUSEPORT,
+ * the kernel spreads the clients; datagrams are received and sent in batches
+ */
+void *snmp_worker(void *threadarg) {
+    struct snmp_worker *w = (struct snmp_worker *)threadarg;
+    struct mmsghdr in[SNMP_BATCH], out[SNMP_BATCH];
+    struct iovec in_iov[SNMP_BATCH], out_iov[SNMP_BATCH];
+    struct sockaddr_in addr[SNMP_BATCH];
+    unsigned char *response;
+    unsigned int len;
+    int i, n, m, sent, ret;
+
+    memset(in, 0, sizeof(in));
+    memset(out, 0, sizeof(out));
+    for (i = 0; i < SNMP_BATCH; i++) {
+	in_iov[i].iov_base = w->recv_data[i];
+	in_iov[i].iov_len = SNMP_PACKET_SIZE;
+	in[i].msg_hdr.msg_iov = &in_iov[i];
+	in[i].msg_hdr.msg_iovlen = 1;
+	in[i].msg_hdr.msg_name = &addr[i];
+	out[i].msg_hdr.msg_iov = &out_iov[i];
+	out[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (1) {
+	for (i = 0; i < SNMP_BATCH; i++)
+	    in[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+	n = recvmmsg(w->sock, in, SNMP_BATCH, MSG_WAITFORONE, NULL);
+	if (n <= 0) {
+	    if (n < 0 && errno != EINTR)
+		fprintf(stderr, "%s: error receiving UDP data; %s\n", __func__, strerror(errno));
+	    continue;
+	}
+	for (i = 0, m = 0; i < n; i++) {
+	    response = handle_request(w->recv_data[i], in[i].msg_len, w->send_data[m], &len);
+	    if (!response)
+		continue;
+	    out_iov[m].iov_base = response;
+	    out_iov[m].iov_len = len;
+	    out[m].msg_hdr.msg_name = &addr[i];
+	    out[m].msg_hdr.msg_namelen = in[i].msg_hdr.msg_namelen;
+	    m++;
+	}
+	for (sent = 0; sent < m; sent += ret) {
+	    ret = sendmmsg(w->sock, out + sent, m - sent, 0);
+	    if (ret <= 0) {
+		fprintf(stderr, "%s: error sending UDP data; %s\n", __func__, strerror(errno));
+		break;
+	    }
+	}
+    }
+    return 0;
+}
+
+int snmp_socket(int port, int reuse) {
+    struct sockaddr_in server_addr;
+    int sock, one = 1;
 
     sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
 	fprintf(stderr, "creating SNMP socket error: %s\n", strerror(errno));
-	pthread_exit((void *) threadarg);
+	return -1;
     }
+#ifdef SO_REUSEPORT
+    if (reuse && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+	fprintf(stderr, "SNMP socket SO_REUSEPORT error: %s\n", strerror(errno));
+	close(sock);
+	return -1;
+    }
+#else
+    if (reuse) {
+	fprintf(stderr, "SNMP socket SO_REUSEPORT not supported\n");
+	close(sock);
+	return -1;
+    }
+#endif
 
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(data->snmp_port);
+    server_addr.sin_port = htons(port);
     server_addr.sin_addr.s_addr = INADDR_ANY;
     bzero(&(server_addr.sin_zero), 8);
     if (bind(sock, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) < 0) {
-	fprintf(stderr, "binding SNMP(%d) socket error: %s\n", ntohs(server_addr.sin_port), strerror(errno));
-	pthread_exit((void *) threadarg);
+	fprintf(stderr, "binding SNMP(%d) socket error: %s\n", port, strerror(errno));
+	close(sock);
+	return -1;
     }
+    return sock;
+}
 
-    addr_len = sizeof(struct sockaddr);
-    fflush(stdout);
-    while (1) {
-	bytes_read = recvfrom(sock, recv_data, 1024, 0, (struct sockaddr *)&client_addr, &addr_len);
-	recv_data[bytes_read] = '\0';
-	struct snmp_message_rx *snmp_msg = create_snmp_message_rx((unsigned char *)&recv_data[0]);
-	if (snmp_msg != NULL) {
-	    if (verbose)
-		disp_snmp_message_rx(snmp_msg);
-	    struct snmp_pdu_rx *snmp_pdu = create_snmp_pdu_rx(snmp_msg->snmp_pdu);
-	    if (snmp_pdu != NULL) {
-		if (verbose)
-		    disp_snmp_pdu_rx(snmp_pdu);
-		struct varbind_list_rx *varbind_list = create_varbind_list_rx(snmp_pdu->varbindings);
-		if (verbose)
-		    disp_varbind_list_rx(varbind_list);
-
-		unsigned int a = 5;	//testing
-		struct varbind *varbind = create_varbind(varbind_list->varbind_list[0]->oid, 0x02, &a);
-		if (verbose)
-		    disp_varbind(varbind);
-
-		process_varbind_list(varbind_list);
-		if (verbose)
-		    disp_varbind_list_rx(varbind_list);
-
-		struct varbind_list_tx *varbind_list_to_send = create_varbind_list_tx(varbind_list);
-		struct snmp_pdu_tx *snmp_pdu_tx = create_snmp_pdu_tx(0xa2, snmp_pdu->request_id, 0x00, 0x00, varbind_list_to_send);
-		struct snmp_message_tx *snmp_msg_tx = create_snmp_message_tx(snmp_msg->community, snmp_pdu_tx);
-
-		sendPacket(client_addr.sin_addr, ntohs(client_addr.sin_port), sock, snmp_msg_tx);
-		clr_snmp_message_tx(snmp_msg_tx);
-		clr_snmp_pdu_tx(snmp_pdu_tx);
-		clr_varbind_list_tx(varbind_list_to_send);
-		clr_varbind(varbind);
-		clr_varbind_list_rx(varbind_list);
-		clr_snmp_pdu_rx(snmp_pdu);
-	    }
-	    clr_snmp_message_rx(snmp_msg);
+void *snmp_agent(void *threadarg) {
+    struct snmp_data *data;
+    struct snmp_worker *workers;
+    pthread_t thread;
+    int i, count;
+
+    data = (struct snmp_data *) threadarg;
+    time(&startup_time);
+    register_mib();
+
+    count = data->workers > 0 ? data->workers : 1;
+    workers = calloc(count, sizeof(struct snmp_worker));
+    if (!workers)
+	pthread_exit((void *) threadarg);
+    for (i = 0; i < count; i++) {
+	workers[i].sock = snmp_socket(data->snmp_port, count > 1);
+	if (workers[i].sock < 0 && i == 0 && count > 1) {
+	    /* no SO_REUSEPORT, one socket is all there can be */
+	    workers[i].sock = snmp_socket(data->snmp_port, 0);
+	    count = 1;
+	}
+	if (workers[i].sock < 0) {
+	    if (i == 0)
+		pthread_exit((void *) threadarg);
+	    /* go on with the workers we have */
+	    count = i;
+	    break;
+	}
+	workers[i].recv_data = malloc(SNMP_BATCH * SNMP_PACKET_SIZE);
+	workers[i].send_data = malloc(SNMP_BATCH * SNMP_PACKET_SIZE);
+	if (!workers[i].recv_data || !workers[i].send_data) {
+	    fprintf(stderr, "SNMP worker: out of memory\n");
+	    pthread_exit((void *) threadarg);
 	}
-	fflush(stdout);
     }
-    return 0;
+    if (verbose)
+	printf("SNMP agent on port %d with %d worker(s)\n", data->snmp_port, count);
+    fflush(stdout);
+
+    for (i = 1; i < count; i++) {
+	if (pthread_create(&thread, NULL, snmp_worker, &workers[i]))
+	    fprintf(stderr, "can't start SNMP worker %d\n", i);
+	else
+	    pthread_detach(thread);
+    }
+    return snmp_worker(&workers[0]);
 }
@@ -804,3 +804,287 @@ void clr_snmp_message_tx(struct snmp_message_tx *snmp_msg)
     free(snmp_msg->snmp_message);
     free(snmp_msg);
 }
+
+/*
+ * single pass BER codec
+ *
+ * Requests are decoded in place: the varbinds point into the receive buffer,
+ * every length is checked against the enclosing element. Responses are
+ * written back to front into one caller supplied buffer, so the length of
+ * each element is known when its header is written and nothing has to be
+ * copied again. Neither direction allocates memory.
+ */
+
+static int ber_read_header(const unsigned char **p, const unsigned char *end, unsigned char *tag, unsigned int *len)
+{
+    const unsigned char *q = *p;
+    unsigned int l, n;
+
+    if (end - q < 2)
+	return -1;
+    *tag = *q++;
+    l = *q++;
+    if (l & 0x80) {
+	n = l & 0x7f;
+	if (n == 0 || n > 4 || end - q < n)
+	    return -1;
+	for (l = 0; n; n--)
+	    l = (l << 8) | *q++;
+    }
+    if (l > end - q)
+	return -1;
+    *len = l;
+    *p = q;
+    return 0;
+}
+
+static int ber_expect(const unsigned char **p, const unsigned char *end, unsigned char tag, unsigned int *len)
+{
+    unsigned char t;
+
+    if (ber_read_header(p, end, &t, len) || t != tag)
+	return -1;
+    return 0;
+}
+
+static int ber_read_integer(const unsigned char *p, unsigned int len, int *value)
+{
+    unsigned int i, v;
+
+    if (len == 0 || len > 4)
+	return -1;
+    v = (p[0] & 0x80) ? 0xffffffff : 0;
+    for (i = 0; i < len; i++)
+	v = (v << 8) | p[i];
+    *value = (int)v;
+    return 0;
+}
+
+int snmp_decode_request(const unsigned char *buf, unsigned int len, struct snmp_request *req)
+{
+    const unsigned char *p = buf, *end = buf + len, *vend;
+    struct ber_varbind *vb;
+    unsigned int l;
+    unsigned char tag;
+
+    req->varbind_count = 0;
+
+    /* message: version, community, PDU */
+    if (ber_expect(&p, end, 0x30, &l))
+	return -1;
+    end = p + l;
+    if (ber_expect(&p, end, PRIMV_INT, &l) || ber_read_integer(p, l, &req->version))
+	return -1;
+    p += l;
+    if (ber_expect(&p, end, PRIMV_OCTSTR, &l))
+	return -1;
+    req->community = p;
+    req->community_len = l;
+    p += l;
+    if (ber_read_header(&p, end, &tag, &l))
+	return -1;
+    req->pdu_type = tag;
+    end = p + l;
+
+    /* PDU: request id, error status, error index, varbind list */
+    if (ber_expect(&p, end, PRIMV_INT, &l) || l == 0 || l > 4)
+	return -1;
+    req->request_id = p;
+    req->request_id_len = l;
+    p += l;
+    if (ber_expect(&p, end, PRIMV_INT, &l) || ber_read_integer(p, l, &req->error_status))
+	return -1;
+    p += l;
+    if (ber_expect(&p, end, PRIMV_INT, &l) || ber_read_integer(p, l, &req->error_index))
+	return -1;
+    p += l;
+    if (ber_expect(&p, end, 0x30, &l))
+	return -1;
+    end = p + l;
+
+    while (p < end) {
+	if (req->varbind_count == SNMP_MAX_VARBINDS)
+	    return -1;
+	vb = &req->varbinds[req->varbind_count];
+	if (ber_expect(&p, end, 0x30, &l))
+	    return -1;
+	vend = p + l;
+	if (ber_expect(&p, vend, PRIMV_OBJID, &l) || l == 0)
+	    return -1;
+	vb->oid = p;
+	vb->oid_len = l;
+	p += l;
+	if (ber_read_header(&p, vend, &tag, &l))
+	    return -1;
+	vb->type = tag;
+	vb->value = p;
+	vb->value_len = l;
+	vb->integer = 0;
+	p += l;
+	if (p != vend)
+	    return -1;
+	req->varbind_count++;
+    }
+    return 0;
+}
+
+struct ber_writer {
+    unsigned char *start;
+    unsigned char *p;
+};
+
+static int ber_put(struct ber_writer *w, const void *data, unsigned int len)
+{
+    if (w->p - w->start < len)
+	return -1;
+    w->p -= len;
+    memcpy(w->p, data, len);
+    return 0;
+}
+
+static int ber_put_header(struct ber_writer *w, unsigned char tag, unsigned int len)
+{
+    unsigned char h[6];
+    int n = sizeof(h);
+
+    if (len < 0x80) {
+	h[--n] = len;
+    } else {
+	do {
+	    h[--n] = len;
+	    len >>= 8;
+	} while (len);
+	n--;
+	h[n] = 0x80 | (sizeof(h) - n - 1);
+    }
+    h[--n] = tag;
+    return ber_put(w, h + n, sizeof(h) - n);
+}
+
+static int ber_put_uint(struct ber_writer *w, unsigned char tag, unsigned int value)
+{
+    unsigned char b[5];
+    int n = sizeof(b);
+
+    do {
+	b[--n] = value;
+	value >>= 8;
+    } while (value);
+    /* keep it positive */
+    if (b[n] & 0x80)
+	b[--n] = 0;
+    if (ber_put(w, b + n, sizeof(b) - n))
+	return -1;
+    return ber_put_header(w, tag, sizeof(b) - n);
+}
+
+/* minimal two's complement, INTEGER is signed */
+static int ber_put_int(struct ber_writer *w, unsigned char tag, long long value)
+{
+    unsigned char b[8];
+    int n = sizeof(b);
+
+    /* done once the rest is just the sign of the last byte written */
+    do {
+	b[--n] = value;
+	value >>= 8;
+    } while (n > 0 && value != ((b[n] & 0x80) ? -1 : 0));
+    if (ber_put(w, b + n, sizeof(b) - n))
+	return -1;
+    return ber_put_header(w, tag, sizeof(b) - n);
+}
+
+static int ber_put_varbind(struct ber_writer *w, const struct ber_varbind *vb)
+{
+    unsigned char *mark = w->p;
+
+    switch (vb->type) {
+    case PRIMV_INT:
+	if (ber_put_int(w, vb->type, vb->integer))
+	    return -1;
+	break;
+    case PRIMV_COUNTR:
+    case PRIMV_GAUGE:
+    case PRIMV_TIMTICK:
+	if (ber_put_uint(w, vb->type, (unsigned int)vb->integer))
+	    return -1;
+	break;
+    default:
+	/* octet strings, OIDs, NULL and the SNMPv2 exceptions */
+	if (ber_put(w, vb->value, vb->value_len) || ber_put_header(w, vb->type, vb->value_len))
+	    return -1;
+	break;
+    }
+    if (ber_put(w, vb->oid, vb->oid_len) || ber_put_header(w, PRIMV_OBJID, vb->oid_len))
+	return -1;
+    return ber_put_header(w, 0x30, mark - w->p);
+}
+
+unsigned char *snmp_encode_response(unsigned char *buf, unsigned int size, const struct snmp_request *req,
+				    unsigned char error_status, unsigned char error_index,
+				    const struct ber_varbind *varbinds, unsigned int count, unsigned int *len)
+{
+    struct ber_writer w = { buf, buf + size };
+    unsigned char *end = w.p;
+    int i;
+
+    for (i = count - 1; i >= 0; i--) {
+	if (ber_put_varbind(&w, &varbinds[i]))
+	    return NULL;
+    }
+    if (ber_put_header(&w, 0x30, end - w.p) ||
+	ber_put_int(&w, PRIMV_INT, error_index) ||
+	ber_put_int(&w, PRIMV_INT, error_status) ||
+	ber_put(&w, req->request_id, req->request_id_len) ||
+	ber_put_header(&w, PRIMV_INT, req->request_id_len))
+	return NULL;
+    if (ber_put_header(&w, PDU_GET_RESP, end - w.p))
+	return NULL;
+    if (ber_put(&w, req->community, req->community_len) ||
+	ber_put_header(&w, PRIMV_OCTSTR, req->community_len) ||
+	ber_put_int(&w, PRIMV_INT, req->version) ||
+	ber_put_header(&w, 0x30, end - w.p))
+	return NULL;
+    *len = end - w.p;
+    return w.p;
+}
+
+int ber_oid_to_string(const unsigned char *oid, unsigned int len, char *buf, unsigned int size)
+{
+    unsigned int i, value = 0, n = 0, first = 1;
+
+    if (size)
+	buf[0] = '\0';
+    for (i = 0; i < len && n < size; i++) {
+	value = (value << 7) | (oid[i] & 0x7f);
+	if (oid[i] & 0x80)
+	    continue;
+	if (first) {
+	    n += snprintf(buf + n, size - n, "%u.%u", value < 80 ? value / 40 : 2, value < 80 ? value % 40 : value - 80);
+	    first = 0;
+	} else {
+	    n += snprintf(buf + n, size - n, ".%u", value);
+	}
+	value = 0;
+    }
+    return n < size ? (int)n : -1;
+}
+
+void disp_snmp_request(const struct snmp_request *req)
+{
+    unsigned char *pdu_type = return_pdu_type_string(req->pdu_type);
+    char oid[128];
+    unsigned int i;
+
+    printf("***SNMP REQUEST***\n");
+    printf("SNMP Version: %d\n", req->version + 1);
+    printf("Community String: %.*s\n", req->community_len, req->community);
+    printf("SNMP PDU Type: %d (%s)\n", req->pdu_type, pdu_type);
+    printf("Error: %d\n", req->error_status);
+    printf("Error Index: %d\n", req->error_index);
+    for (i = 0; i < req->varbind_count; i++) {
+	ber_oid_to_string(req->varbinds[i].oid, req->varbinds[i].oid_len, oid, sizeof(oid));
+	printf("OID: %s, Data Type: 0x%02x, Length: %u\n", oid, req->varbinds[i].type, req->varbinds[i].value_len);
+    }
+    free(pdu_type);
+}
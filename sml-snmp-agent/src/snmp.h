@@ -40,6 +40,16 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PDU_GET_RESP        0xA2
 #define PDU_SET_REQ         0xA3
 #define PDU_TRAP            0xA4
+#define PDU_GET_BULK_REQ    0xA5
+
+/* version field */
+#define SNMP_VERSION_1      0
+#define SNMP_VERSION_2C     1
+
+/* error status */
+#define SNMP_ERR_NOERROR    0
+#define SNMP_ERR_TOOBIG     1
+#define SNMP_ERR_NOSUCHNAME 2
 
 /* Primitive Types */
 #define PRIMV_INT           0x02
@@ -53,6 +63,11 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PRIMV_OPAQUE        0x44
 #define PRIMV_NSAPADDR      0x45
 
+/* SNMPv2 exceptions */
+#define PRIMV_NOSUCHOBJECT  0x80
+#define PRIMV_NOSUCHINSTANCE 0x81
+#define PRIMV_ENDOFMIBVIEW  0x82
+
 struct snmp_message_rx {
     unsigned int snmp_message_length;
     unsigned char version;
@@ -98,6 +113,41 @@ struct snmp_message_tx {
     unsigned char *snmp_message;
 };
 
+#define SNMP_MAX_VARBINDS   128
+
+/* decoded in place, pointers refer to the receive buffer */
+struct ber_varbind {
+    const unsigned char *oid;
+    unsigned int oid_len;
+    unsigned char type;
+    const unsigned char *value;
+    unsigned int value_len;
+    long long integer;		/* value of INTEGER like types when encoding */
+};
+
+struct snmp_request {
+    int version;
+    const unsigned char *community;
+    unsigned int community_len;
+    unsigned char pdu_type;
+    const unsigned char *request_id;
+    unsigned int request_id_len;
+    int error_status;
+    int error_index;
+    unsigned int varbind_count;
+    struct ber_varbind varbinds[SNMP_MAX_VARBINDS];
+};
+
+int snmp_decode_request(const unsigned char *, unsigned int, struct snmp_request *);
+
+unsigned char *snmp_encode_response(unsigned char *, unsigned int, const struct snmp_request *,
+				    unsigned char, unsigned char, const struct ber_varbind *, unsigned int,
+				    unsigned int *);
+
+int ber_oid_to_string(const unsigned char *, unsigned int, char *, unsigned int);
+
+void disp_snmp_request(const struct snmp_request *);
+
 int decode_integer(unsigned char *, unsigned int *);
 
 unsigned char *decode_string(unsigned char *, unsigned int *);
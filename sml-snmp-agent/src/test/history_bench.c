@@ -0,0 +1,291 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * value history benchmark
+ *
+ * records a day of 1 s readings of an energy counter and of the power,
+ * reports the memory taken against plain time/value pairs, checks the
+ * samples coming back from the ring, the binary dump and the SML
+ * GetProfileList.Res output and measures add and decode rates
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <sml/sml_file.h>
+#include <sml/sml_message.h>
+#include <sml/sml_transport.h>
+
+#include "../history.h"
+
+#define DAY		86400
+#define START		1000000	/* second index of the first sample */
+#define SMALL_KB	8
+#define PROFILE_SAMPLES	100
+
+/* plain time/value pair as a meter would send it */
+#define RAW_SAMPLE	(4 + 8)
+
+static const unsigned char obis_energy[] = { 0x01, 0x00, 0x01, 0x08, 0x00, 0xff };
+
+struct check {
+    const long long *expected;
+    unsigned int first;
+    unsigned int count;
+    unsigned int errors;
+};
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <loops>]\n", prg);
+    fprintf(stderr, "         -n <loops>          decode passes over the day - default 20\n\n");
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 0.1 Wh energy counter and W power of a household, with some spikes */
+void make_day(long long *energy, long long *power) {
+    double wh = 12345678.0, w;
+    int i;
+
+    srand(42);
+    for (i = 0; i < DAY; i++) {
+	w = 350 + 250 * sin(i * 2 * M_PI / DAY) + rand() % 40;
+	if (rand() % 600 == 0)
+	    w += 2000;
+	wh += w / 360.0;
+	energy[i] = (long long)wh;
+	power[i] = (long long)w;
+    }
+}
+
+int check_sample(void *arg, unsigned int time, long long value) {
+    struct check *c = (struct check *)arg;
+
+    if (time != START + c->first + c->count || value != c->expected[c->first + c->count])
+	c->errors++;
+    c->count++;
+    return 0;
+}
+
+int count_sample(void *arg, unsigned int time, long long value) {
+    (*(unsigned int *)arg)++;
+    return 0;
+}
+
+int fill(struct history *h, size_t bytes, const long long *values) {
+    int i;
+
+    if (history_init(h, bytes))
+	return -1;
+    for (i = 0; i < DAY; i++)
+	history_add(h, START + i, values[i], SML_TIME_SEC_INDEX);
+    return 0;
+}
+
+int day(const char *name, const long long *values, int loops) {
+    struct history h;
+    struct check c;
+    unsigned int samples;
+    double start, add, walk;
+    size_t bytes;
+    int i, errors = 0;
+
+    /* large enough for the whole day */
+    start = now();
+    fill(&h, 4 * 1024 * 1024, values);
+    add = now() - start;
+    bytes = history_bytes(&h);
+    samples = history_samples(&h);
+
+    start = now();
+    for (i = 0; i < loops; i++) {
+	memset(&c, 0, sizeof(c));
+	c.expected = values;
+	history_walk(&h, 0, ~0U, check_sample, &c);
+    }
+    walk = now() - start;
+    if (c.count != DAY || c.errors || samples != DAY) {
+	printf("%s: %u samples back, %u wrong\n", name, c.count, c.errors);
+	errors++;
+    }
+
+    printf("%-7s 24h of 1 s samples: %7zu bytes in %4u blocks (%7u bytes of memory), %.2f bytes/sample,"
+	   " %.1fx smaller than %d byte pairs\n", name, bytes, h.used, h.used * HISTORY_BLOCK,
+	   (double)bytes / samples, (double)samples * RAW_SAMPLE / bytes, RAW_SAMPLE);
+    printf("        add %.1f M samples/s, decode %.1f M samples/s\n", DAY / add / 1e6, loops * DAY / walk / 1e6);
+    history_free(&h);
+    return errors;
+}
+
+/* a small ring keeps the newest samples and answers time windows */
+int ring(const long long *values) {
+    struct history h, copy;
+    struct check c;
+    unsigned int count, samples;
+    int errors = 0;
+
+    fill(&h, SMALL_KB * 1024, values);
+    samples = history_samples(&h);
+    if (h.used != h.blocks_len || samples >= DAY) {
+	printf("ring: %u of %u blocks used, %u samples\n", h.used, h.blocks_len, samples);
+	errors++;
+    }
+    history_snapshot(&h, &copy);
+    memset(&c, 0, sizeof(c));
+    c.expected = values;
+    c.first = DAY - samples;
+    history_walk(&copy, 0, ~0U, check_sample, &c);
+    if (c.count != samples || c.errors) {
+	printf("ring: %u of %u samples back, %u wrong\n", c.count, samples, c.errors);
+	errors++;
+    }
+    count = 0;
+    history_walk(&copy, START + DAY - 600, START + DAY - 301, count_sample, &count);
+    if (count != 300) {
+	printf("ring: %u samples in a 300 s window\n", count);
+	errors++;
+    }
+    printf("ring of %d kB keeps the last %u s\n", SMALL_KB, samples);
+
+    /* a restarted second index starts over */
+    history_add(&h, 10, 1, SML_TIME_SEC_INDEX);
+    if (history_samples(&h) != 1) {
+	printf("ring: restarted clock not detected\n");
+	errors++;
+    }
+    history_free(&copy);
+    history_free(&h);
+    return errors;
+}
+
+int dump(const long long *values) {
+    struct history h;
+    struct check c;
+    unsigned char *data;
+    size_t len;
+    int errors = 0;
+
+    fill(&h, SMALL_KB * 1024, values);
+    data = history_dump(&h, obis_energy, -1, 30, &len);
+    memset(&c, 0, sizeof(c));
+    c.expected = values;
+    c.first = DAY - history_samples(&h);
+    if (history_dump_walk(data, len, check_sample, &c) || c.count != history_samples(&h) || c.errors) {
+	printf("dump: %u samples back, %u wrong\n", c.count, c.errors);
+	errors++;
+    }
+    if (history_dump_walk(data, len - 1, count_sample, &c.count) != -1) {
+	printf("dump: truncated dump accepted\n");
+	errors++;
+    }
+    printf("dump of %u samples: %zu bytes\n", history_samples(&h), len);
+    free(data);
+    history_free(&h);
+    return errors;
+}
+
+/* GetProfileList.Res messages parsed back with libsml */
+int profile(const long long *values) {
+    sml_transport_decoder *dec;
+    sml_get_profile_list_response *res;
+    sml_period_entry *entry;
+    unsigned char *data, *frame;
+    struct history h;
+    size_t len, frame_len;
+    sml_file *file;
+    long size;
+    FILE *f;
+    int i, n = 0, files = 0, errors = 0, first = DAY - 2 * PROFILE_SAMPLES;
+
+    fill(&h, SMALL_KB * 1024, values);
+    f = tmpfile();
+    if (!f || history_write_sml(fileno(f), &h, "0a01454d480000", obis_energy, -1, 30,
+				START + first, START + first + PROFILE_SAMPLES - 1)) {
+	printf("profile: write failed\n");
+	return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    data = malloc(size);
+    if (fread(data, 1, size, f) != size) {
+	printf("profile: read failed\n");
+	return 1;
+    }
+    fclose(f);
+
+    dec = sml_transport_decoder_init(16384);
+    sml_transport_decoder_feed(dec, data, size);
+    while (sml_transport_decoder_next(dec, &frame, &frame_len)) {
+	files++;
+	file = sml_file_parse(frame + 8, frame_len - 16);
+	for (i = 0; i < file->messages_len; i++, n++) {
+	    if (*file->messages[i]->message_body->tag != SML_MESSAGE_GET_PROFILE_LIST_RESPONSE) {
+		errors++;
+		continue;
+	    }
+	    res = (sml_get_profile_list_response *) file->messages[i]->message_body->data;
+	    entry = res->period_list->elems_len == 1 ? res->period_list->elems[0] : NULL;
+	    if (!entry || *res->val_time->data.timestamp != START + first + n ||
+		*entry->value->data.int64 != values[first + n] || *entry->scaler != -1 || *entry->unit != 30 ||
+		memcmp(entry->obj_name->str, obis_energy, sizeof(obis_energy)))
+		errors++;
+	}
+	sml_file_free(file);
+    }
+    len = size;
+    printf("profile of %d samples: %d SML files, %zu bytes, %d wrong\n", n, files, len, errors);
+    if (n != PROFILE_SAMPLES)
+	errors++;
+    sml_transport_decoder_free(dec);
+    free(data);
+    history_free(&h);
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    long long *energy, *power;
+    int opt, loops = 20, errors = 0;
+
+    while ((opt = getopt(argc, argv, "n:h?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    loops = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+
+    energy = malloc(DAY * sizeof(long long));
+    power = malloc(DAY * sizeof(long long));
+    make_day(energy, power);
+
+    errors += day("energy", energy, loops);
+    errors += day("power", power, loops);
+    errors += ring(energy);
+    errors += dump(energy);
+    errors += profile(energy);
+
+    free(energy);
+    free(power);
+    printf("%s\n", errors ? "FAILED" : "history checks passed");
+    return errors ? 1 : 0;
+}
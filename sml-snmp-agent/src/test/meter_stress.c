@@ -0,0 +1,366 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * multi meter stress test
+ *
+ * starts sml_server on a number of pseudo terminals and replays the recorded
+ * telegrams of test/edl21.dat into all of them at once; the telegram counters
+ * of all meters are read back over SNMP until every telegram is accounted for
+ * reports telegrams/s and the CPU time of the server per telegram
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "../snmp.h"
+
+#define STRESS_PORT	16163
+#define STRESS_METERS	32
+#define STRESS_LOOPS	20
+#define CAPTURE		"test/edl21.dat"
+#define CAPTURE_TELEGRAMS	47
+#define ENTERPRISE	"1.3.6.1.4.1.39241"
+
+struct pty {
+    int master;
+    int slave;
+    char name[64];
+    pthread_t thread;
+};
+
+unsigned char *capture;
+size_t capture_len;
+int loops = STRESS_LOOPS;
+
+/* what sml_snmp.c provides to the codec, only used for debug output */
+void debugg(unsigned char *packet, int length) {
+}
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <meters>] [-l <loops>] [-p <port>] [-s <server>]\n", prg);
+    fprintf(stderr, "         -n <meters>         pseudo terminals - default %d\n", STRESS_METERS);
+    fprintf(stderr, "         -l <loops>          replays of %s per terminal - default %d\n", CAPTURE, STRESS_LOOPS);
+    fprintf(stderr, "         -p <port>           SNMP port - default %d\n", STRESS_PORT);
+    fprintf(stderr, "         -s <server>         server binary - default ./sml_server\n\n");
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* user + system time of a process in seconds */
+double cpu_time(pid_t pid) {
+    char path[64], buf[1024], *p;
+    unsigned long utime, stime;
+    FILE *f;
+    int i;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    f = fopen(path, "r");
+    if (!f)
+	return 0;
+    if (!fgets(buf, sizeof(buf), f)) {
+	fclose(f);
+	return 0;
+    }
+    fclose(f);
+    /* the fields after the command name, utime and stime are 14 and 15 */
+    p = strrchr(buf, ')');
+    if (!p)
+	return 0;
+    for (i = 0; i < 11 && p; i++)
+	p = strchr(p + 1, ' ');
+    if (!p || sscanf(p, " %lu %lu", &utime, &stime) != 2)
+	return 0;
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+int open_pty(struct pty *pty) {
+    struct termios tio;
+
+    pty->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty->master < 0 || grantpt(pty->master) || unlockpt(pty->master) ||
+	ptsname_r(pty->master, pty->name, sizeof(pty->name)))
+	return -1;
+    /* the slave stays open here, so the line settings stick and no hangup is seen */
+    pty->slave = open(pty->name, O_RDWR | O_NOCTTY);
+    if (pty->slave < 0 || tcgetattr(pty->slave, &tio))
+	return -1;
+    cfmakeraw(&tio);
+    return tcsetattr(pty->slave, TCSANOW, &tio);
+}
+
+void *writer(void *arg) {
+    struct pty *pty = (struct pty *)arg;
+    size_t done;
+    ssize_t n;
+    int i;
+
+    for (i = 0; i < loops; i++) {
+	for (done = 0; done < capture_len; done += n) {
+	    n = write(pty->master, capture + done, capture_len - done);
+	    if (n < 0) {
+		if (errno == EINTR)
+		    n = 0;
+		else
+		    return NULL;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/* BER OID of string to oid, returns the length */
+int oid_from_string(const char *string, unsigned char *oid, int size) {
+    unsigned char *encoded = encode_oid((unsigned char *)string);
+    int len = encoded[1];
+
+    if (len > size)
+	len = -1;
+    else
+	memcpy(oid, encoded + 2, len);
+    free(encoded);
+    return len;
+}
+
+/* SNMPv1 GET of an integer, -1 on timeout or error */
+long snmp_get(int sock, const char *oid_string) {
+    static unsigned int id;
+    unsigned char request[128], response[512], oid[64];
+    struct snmp_request answer;
+    struct pollfd pfd;
+    unsigned long value;
+    int len, oid_len, n, i;
+
+    oid_len = oid_from_string(oid_string, oid, sizeof(oid));
+    if (oid_len < 0)
+	return -1;
+    id++;
+    len = 0;
+    request[len++] = 0x30;
+    request[len++] = 0;
+    memcpy(request + len, "\x02\x01\x00\x04\x06public", 11);
+    len += 11;
+    request[len++] = PDU_GET_REQ;
+    request[len++] = 0;
+    request[len++] = 0x02;
+    request[len++] = 0x04;
+    request[len++] = id >> 24;
+    request[len++] = id >> 16;
+    request[len++] = id >> 8;
+    request[len++] = id;
+    memcpy(request + len, "\x02\x01\x00\x02\x01\x00\x30\x00\x30\x00", 10);
+    len += 10;
+    request[len++] = PRIMV_OBJID;
+    request[len++] = oid_len;
+    memcpy(request + len, oid, oid_len);
+    len += oid_len;
+    request[len++] = PRIMV_NULL;
+    request[len++] = 0;
+    request[1] = len - 2;
+    request[14] = len - 15;
+    request[28] = len - 29;
+    request[30] = len - 31;
+
+    if (send(sock, request, len, 0) != len)
+	return -1;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, 500) > 0) {
+	n = recv(sock, response, sizeof(response), 0);
+	if (n <= 0)
+	    return -1;
+	if (snmp_decode_request(response, n, &answer) || answer.request_id_len != 4 ||
+	    memcmp(answer.request_id, request + 17, 4))
+	    continue;
+	if (answer.error_status || answer.varbind_count != 1 || answer.varbinds[0].value_len > 4)
+	    return -1;
+	/* INTEGER, Counter and Gauge, the values here are never negative */
+	for (i = 0, value = 0; i < answer.varbinds[0].value_len; i++)
+	    value = value << 8 | answer.varbinds[0].value[i];
+	return value;
+    }
+    return -1;
+}
+
+unsigned char *read_file(const char *name, size_t *len) {
+    unsigned char *data;
+    FILE *f;
+    long size;
+
+    f = fopen(name, "rb");
+    if (!f)
+	return NULL;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    data = malloc(size);
+    if (data && fread(data, 1, size, f) != (size_t)size) {
+	free(data);
+	data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+int main(int argc, char **argv) {
+    const char *server = "./sml_server";
+    struct sockaddr_in addr;
+    struct pty *ptys;
+    char **args, port_string[16], oid[128];
+    int opt, i, count = STRESS_METERS, port = STRESS_PORT, sock, errors = 0;
+    long telegrams, total, expected, last_total = -1, value;
+    double start, elapsed, last_change, cpu;
+    pid_t pid;
+
+    while ((opt = getopt(argc, argv, "n:l:p:s:h?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    count = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'l':
+	    loops = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'p':
+	    port = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 's':
+	    server = optarg;
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+    if (count <= 0 || count > 64 || loops <= 0) {
+	print_usage(argv[0]);
+	exit(1);
+    }
+    capture = read_file(CAPTURE, &capture_len);
+    if (!capture) {
+	fprintf(stderr, "can't read %s\n", CAPTURE);
+	exit(1);
+    }
+
+    ptys = calloc(count, sizeof(struct pty));
+    args = calloc(2 * count + 8, sizeof(char *));
+    snprintf(port_string, sizeof(port_string), "%d", port);
+    i = 0;
+    args[i++] = (char *)server;
+    args[i++] = "-f";
+    args[i++] = "-q";
+    args[i++] = "-w";
+    args[i++] = "1";
+    args[i++] = "-p";
+    args[i++] = port_string;
+    for (opt = 0; opt < count; opt++) {
+	if (open_pty(&ptys[opt])) {
+	    fprintf(stderr, "pty error: %s\n", strerror(errno));
+	    exit(1);
+	}
+	args[i++] = "-i";
+	args[i++] = ptys[opt].name;
+    }
+
+    pid = fork();
+    if (pid < 0)
+	exit(1);
+    if (pid == 0) {
+	execv(server, args);
+	fprintf(stderr, "can't start %s: %s\n", server, strerror(errno));
+	_exit(1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	fprintf(stderr, "socket error: %s\n", strerror(errno));
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	exit(1);
+    }
+    /* wait for the agent */
+    for (i = 0; i < 50 && snmp_get(sock, ENTERPRISE ".1.3.0") != count; i++)
+	usleep(100000);
+    if (i == 50) {
+	fprintf(stderr, "no answer from the server on port %d\n", port);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	exit(1);
+    }
+
+    expected = (long)count * loops * CAPTURE_TELEGRAMS;
+    cpu = cpu_time(pid);
+    start = now();
+    for (i = 0; i < count; i++)
+	pthread_create(&ptys[i].thread, NULL, writer, &ptys[i]);
+
+    /* sum the counters until all telegrams are in or nothing moves for 3 s */
+    last_change = start;
+    do {
+	usleep(50000);
+	total = 0;
+	for (i = 0; i < count; i++) {
+	    snprintf(oid, sizeof(oid), ENTERPRISE ".2.3.%d", i + 1);
+	    telegrams = snmp_get(sock, oid);
+	    if (telegrams > 0)
+		total += telegrams;
+	}
+	if (total != last_total) {
+	    last_total = total;
+	    last_change = now();
+	}
+    } while (total < expected && now() - last_change < 3);
+    elapsed = last_change - start;
+    cpu = cpu_time(pid) - cpu;
+
+    for (i = 0; i < count; i++)
+	pthread_join(ptys[i].thread, NULL);
+
+    /* every meter has the last reading of the capture */
+    for (i = 0; i < count; i++) {
+	snprintf(oid, sizeof(oid), ENTERPRISE ".3.%d.1.0.1.8.0.255", i + 1);
+	value = snmp_get(sock, oid);
+	if (value != snmp_get(sock, ENTERPRISE ".3.1.1.0.1.8.0.255") || value <= 0) {
+	    fprintf(stderr, "meter %d: 1.0.1.8.0 is %ld\n", i + 1, value);
+	    errors++;
+	}
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    printf("%d meters, %ld of %ld telegrams in %.2f s, %.0f telegrams/s\n", count, total, expected, elapsed,
+	   total / elapsed);
+    printf("server CPU %.2f s, %.1f us per telegram\n", cpu, total ? cpu * 1e6 / total : 0);
+    if (total != expected)
+	errors++;
+    printf("%s\n", errors ? "FAILED" : "stress test passed");
+    return errors ? 1 : 0;
+}
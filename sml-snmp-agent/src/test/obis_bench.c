@@ -0,0 +1,288 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * OBIS registry benchmark
+ *
+ * checks the OBIS code parser, then feeds the parsed telegrams of a capture
+ * file through meter_update() with the 4 default codes and with 200
+ * configured codes and reports list entries/s; the bare lookup is compared
+ * against a memcmp() over all configured codes, as the agent used to do
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sml/sml_file.h>
+#include <sml/sml_message.h>
+
+#include "../meter.h"
+
+#define MAX_TELEGRAMS	256
+#define MANY_CODES	200
+
+static const unsigned char start_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01 };
+static const unsigned char end_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x1a };
+
+struct telegram {
+    unsigned char *data;
+    size_t len;
+};
+
+volatile int sink;
+
+/* what sml_snmp.c provides to the codec, only used for debug output */
+void debugg(unsigned char *packet, int length) {
+}
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <loops>] [capture file]\n", prg);
+    fprintf(stderr, "         -n <loops>          passes over the file - default 10000\n");
+    fprintf(stderr, "         capture file        default test/edl21.dat\n\n");
+}
+
+unsigned char *read_file(const char *name, size_t *len) {
+    unsigned char *data;
+    FILE *f;
+    long size;
+
+    f = fopen(name, "rb");
+    if (!f) {
+	perror(name);
+	return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size);
+    if (data && fread(data, 1, size, f) != size) {
+	free(data);
+	data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+/* escape sequences are 4 byte aligned relative to the start sequence */
+int split_telegrams(unsigned char *data, size_t len, struct telegram *t, int max) {
+    size_t pos = 0, end;
+    int n = 0;
+
+    while (n < max && pos + sizeof(start_seq) <= len) {
+	if (memcmp(data + pos, start_seq, sizeof(start_seq))) {
+	    pos++;
+	    continue;
+	}
+	for (end = pos + 8; end + 8 <= len; end += 4) {
+	    if (!memcmp(data + end, end_seq, sizeof(end_seq)))
+		break;
+	}
+	if (end + 8 > len)
+	    break;
+	t[n].data = data + pos;
+	t[n].len = end + 8 - pos;
+	n++;
+	pos = end + 8;
+    }
+    return n;
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int parse_test(void) {
+    static const struct {
+	const char *text;
+	unsigned char code[OBIS_LEN];
+	int ret;
+    } cases[] = {
+	{ "1-0:1.8.0*255", { 1, 0, 1, 8, 0, 255 }, 0 },
+	{ "1-0:16.7.0", { 1, 0, 16, 7, 0, 255 }, 0 },
+	{ "1.0.96.50.1.1", { 1, 0, 96, 50, 1, 1 }, 0 },
+	{ "129-129:199.130.3*255", { 129, 129, 199, 130, 3, 255 }, 0 },
+	{ "1-0:1.8", { 0 }, -1 },
+	{ "1-0:1.8.0*256", { 0 }, -1 },
+	{ "1-0:1.8.0 x", { 0 }, -1 },
+	{ "energy", { 0 }, -1 },
+    };
+    unsigned char code[OBIS_LEN];
+    int i, ret, errors = 0;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+	memset(code, 0, sizeof(code));
+	ret = obis_parse(cases[i].text, code);
+	if (ret != cases[i].ret || (!ret && memcmp(code, cases[i].code, OBIS_LEN))) {
+	    printf("obis_parse(\"%s\") failed\n", cases[i].text);
+	    errors++;
+	}
+    }
+    return errors;
+}
+
+/* the defaults, every code of the capture and made up ones up to count */
+void configure(sml_file **files, int n, int count) {
+    unsigned char code[OBIS_LEN] = { 1, 0, 0, 0, 0, 255 };
+    sml_get_list_response *body;
+    sml_list *entry;
+    int i, j;
+
+    obis_clear();
+    obis_defaults();
+    for (i = 0; i < n && obis_len < count; i++) {
+	for (j = 0; j < files[i]->messages_len; j++) {
+	    if (*files[i]->messages[j]->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+		continue;
+	    body = (sml_get_list_response *) files[i]->messages[j]->message_body->data;
+	    for (entry = body->val_list; entry && obis_len < count; entry = entry->next) {
+		if (entry->obj_name && entry->obj_name->len == OBIS_LEN)
+		    obis_add(entry->obj_name->str);
+	    }
+	}
+    }
+    for (i = 0; obis_len < count; i++) {
+	code[2] = 21 + i % 60;
+	code[3] = 7 + i / 60 % 2;
+	code[4] = i / 120;
+	obis_add(code);
+    }
+}
+
+int run(sml_file **files, int n, int loops, int count) {
+    sml_get_list_response *body;
+    sml_list *entry;
+    struct meter *meter = &meters[0];
+    unsigned long entries = 0;
+    double start, update, hash, linear;
+    int i, j, k, l, index;
+
+    configure(files, n, count);
+    free(meter->values);
+    meter_init(0);
+
+    for (i = 0; i < n; i++) {
+	for (j = 0; j < files[i]->messages_len; j++) {
+	    if (*files[i]->messages[j]->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+		continue;
+	    body = (sml_get_list_response *) files[i]->messages[j]->message_body->data;
+	    for (entry = body->val_list; entry; entry = entry->next)
+		entries++;
+	}
+    }
+    entries *= loops;
+
+    start = now();
+    for (l = 0; l < loops; l++) {
+	for (i = 0; i < n; i++)
+	    meter_update(meter, files[i], 0);
+    }
+    update = now() - start;
+
+    /* the lookup alone, hashed and by comparing every configured code */
+    start = now();
+    for (l = 0; l < loops; l++) {
+	for (i = 0; i < n; i++) {
+	    for (j = 0; j < files[i]->messages_len; j++) {
+		if (*files[i]->messages[j]->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+		    continue;
+		body = (sml_get_list_response *) files[i]->messages[j]->message_body->data;
+		for (entry = body->val_list; entry; entry = entry->next) {
+		    if (entry->obj_name && entry->obj_name->len == OBIS_LEN)
+			sink += obis_lookup(entry->obj_name->str);
+		}
+	    }
+	}
+    }
+    hash = now() - start;
+    start = now();
+    for (l = 0; l < loops; l++) {
+	for (i = 0; i < n; i++) {
+	    for (j = 0; j < files[i]->messages_len; j++) {
+		if (*files[i]->messages[j]->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE)
+		    continue;
+		body = (sml_get_list_response *) files[i]->messages[j]->message_body->data;
+		for (entry = body->val_list; entry; entry = entry->next) {
+		    if (!entry->obj_name || entry->obj_name->len != OBIS_LEN)
+			continue;
+		    index = -1;
+		    for (k = 0; k < obis_len; k++) {
+			if (!memcmp(obis_codes[k], entry->obj_name->str, OBIS_LEN)) {
+			    index = k;
+			    break;
+			}
+		    }
+		    sink += index;
+		}
+	    }
+	}
+    }
+    linear = now() - start;
+
+    printf("%3d codes: update %10.0f entries/s   lookup hash %10.0f/s   memcmp %10.0f/s\n", count,
+	   entries / update, entries / hash, entries / linear);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct telegram telegrams[MAX_TELEGRAMS];
+    sml_file *files[MAX_TELEGRAMS];
+    const char *name = "test/edl21.dat";
+    unsigned char *data;
+    long long value;
+    size_t len;
+    int opt, i, n, loops = 10000, errors;
+
+    while ((opt = getopt(argc, argv, "n:h?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    loops = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	name = argv[optind];
+
+    errors = parse_test();
+
+    data = read_file(name, &len);
+    if (!data)
+	exit(1);
+    n = split_telegrams(data, len, telegrams, MAX_TELEGRAMS);
+    printf("%s: %d telegrams, %d loops\n", name, n, loops);
+    if (!n)
+	exit(1);
+    for (i = 0; i < n; i++)
+	files[i] = sml_file_parse(telegrams[i].data + 8, telegrams[i].len - 16);
+
+    meter_add("bench");
+    run(files, n, loops, 4);
+    /* the reading of 1.8.0 after the capture, to compare with many codes */
+    value = meter_value_get(&meters[0].values[0], NULL);
+    run(files, n, loops, MANY_CODES);
+    if (obis_len != MANY_CODES || meter_value_get(&meters[0].values[0], NULL) != value || value <= 0) {
+	printf("1-0:1.8.0 differs with %d codes\n", MANY_CODES);
+	errors++;
+    }
+
+    for (i = 0; i < n; i++)
+	sml_file_free(files[i]);
+    free(data);
+    printf("%s\n", errors ? "FAILED" : "OBIS registry checks passed");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,448 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * libsml benchmark
+ *
+ * parser: parses every telegram of a capture file over and over, once
+ *         with the heap and once with a per telegram arena
+ * -t:     replays the capture through a pipe into sml_transport_read(),
+ *         at full speed or paced to a baud rate
+ * -c:     CRC16 test vectors and throughput of the sliced implementation
+ *         against a plain byte at a time table lookup
+ *
+ * linked with -Wl,--wrap=... to count allocations and syscalls
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+#include <sml/sml_file.h>
+#include <sml/sml_arena.h>
+#include <sml/sml_transport.h>
+#include <sml/sml_crc16.h>
+#include <sml/sml_message.h>
+
+#define MAX_TELEGRAMS	256
+
+static const unsigned char start_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01 };
+static const unsigned char end_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x1a };
+
+static unsigned long allocations;
+static unsigned long syscalls;
+static int fail_malloc;		/* the malloc this many calls ahead fails, 0 none */
+
+void *__real_malloc(size_t size);
+void *__real_realloc(void *p, size_t size);
+ssize_t __real_read(int fd, void *buf, size_t count);
+int __real_select(int nfds, fd_set *r, fd_set *w, fd_set *e, struct timeval *t);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    if (fail_malloc && !--fail_malloc)
+	return NULL;
+    return __real_malloc(size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    allocations++;
+    return __real_realloc(p, size);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count) {
+    syscalls++;
+    return __real_read(fd, buf, count);
+}
+
+int __wrap_select(int nfds, fd_set *r, fd_set *w, fd_set *e, struct timeval *t) {
+    syscalls++;
+    return __real_select(nfds, r, w, e, t);
+}
+
+struct telegram {
+    unsigned char *data;
+    size_t len;
+};
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <loops>] [-t [-b <baud>]] [-c] [capture file]\n", prg);
+    fprintf(stderr, "         -n <loops>          passes over the file - default 1000\n");
+    fprintf(stderr, "         -t                  transport benchmark through a pipe\n");
+    fprintf(stderr, "         -b <baud>           pace the transport benchmark like a serial line\n");
+    fprintf(stderr, "         -c                  CRC16 test vectors and benchmark\n");
+    fprintf(stderr, "         capture file        default test/edl21.dat\n\n");
+}
+
+unsigned char *read_file(const char *name, size_t *len) {
+    unsigned char *data;
+    FILE *f;
+    long size;
+
+    f = fopen(name, "rb");
+    if (!f) {
+	perror(name);
+	return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size);
+    if (data && fread(data, 1, size, f) != size) {
+	free(data);
+	data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+/* escape sequences are 4 byte aligned relative to the start sequence */
+int split_telegrams(unsigned char *data, size_t len, struct telegram *t, int max) {
+    size_t pos = 0, end;
+    int n = 0;
+
+    while (n < max && pos + sizeof(start_seq) <= len) {
+	if (memcmp(data + pos, start_seq, sizeof(start_seq))) {
+	    pos++;
+	    continue;
+	}
+	for (end = pos + 8; end + 8 <= len; end += 4) {
+	    if (!memcmp(data + end, end_seq, sizeof(end_seq)))
+		break;
+	}
+	if (end + 8 > len)
+	    break;
+	t[n].data = data + pos;
+	t[n].len = end + 8 - pos;
+	n++;
+	pos = end + 8;
+    }
+    return n;
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void run(const char *name, struct telegram *t, int n, int loops, sml_arena *arena) {
+    unsigned long allocs_before = allocations;
+    double start, elapsed;
+    sml_file *file;
+    int i, j;
+
+    start = now();
+    for (i = 0; i < loops; i++) {
+	for (j = 0; j < n; j++) {
+	    /* strip the transport escape sequences like the server does */
+	    if (arena)
+		file = sml_file_parse_arena(arena, t[j].data + 8, t[j].len - 16);
+	    else
+		file = sml_file_parse(t[j].data + 8, t[j].len - 16);
+	    sml_file_free(file);
+	}
+    }
+    elapsed = now() - start;
+    printf("%-6s %10.0f telegrams/s  %8.2f allocations/telegram\n", name,
+	   loops * n / elapsed, (double)(allocations - allocs_before) / (loops * n));
+}
+
+double cpu_time(void) {
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* writer side: whole file at once, or 10 ms worth of bytes per 10 ms */
+void replay(int fd, unsigned char *data, size_t len, int loops, int baud) {
+    struct timespec tick = { 0, 10000000 };
+    size_t pos, chunk;
+    int i;
+
+    chunk = baud ? baud / 10 / 100 : len;
+    if (!chunk)
+	chunk = 1;
+    for (i = 0; i < loops; i++) {
+	for (pos = 0; pos < len; pos += chunk) {
+	    if (write(fd, data + pos, pos + chunk > len ? len - pos : chunk) < 0)
+		return;
+	    if (baud)
+		nanosleep(&tick, NULL);
+	}
+    }
+}
+
+void run_transport(unsigned char *data, size_t len, int loops, int baud) {
+    unsigned char buffer[8096];
+    unsigned long calls_before, telegrams = 0;
+    double start, cpu, elapsed;
+    int fds[2];
+    pid_t pid;
+
+    if (pipe(fds) < 0) {
+	perror("pipe");
+	return;
+    }
+    pid = fork();
+    if (pid == 0) {
+	close(fds[0]);
+	replay(fds[1], data, len, loops, baud);
+	exit(0);
+    }
+    close(fds[1]);
+
+    calls_before = syscalls;
+    cpu = cpu_time();
+    start = now();
+    while (sml_transport_read(fds[0], buffer, sizeof(buffer)) > 0)
+	telegrams++;
+    elapsed = now() - start;
+    cpu = cpu_time() - cpu;
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    if (!telegrams) {
+	printf("no telegrams received\n");
+	return;
+    }
+    if (baud)
+	printf("transport @%d baud:", baud);
+    else
+	printf("transport max speed:");
+    printf(" %lu telegrams, %.0f telegrams/s, %.1f syscalls/telegram, %.1f us CPU/telegram\n",
+	   telegrams, telegrams / elapsed, (double)(syscalls - calls_before) / telegrams, cpu * 1e6 / telegrams);
+}
+
+/* bit by bit reference, X.25 / SML flavour */
+unsigned short crc16_bitwise(const unsigned char *p, int len) {
+    unsigned short crc = 0xffff;
+    int i;
+
+    while (len--) {
+	crc ^= *p++;
+	for (i = 0; i < 8; i++)
+	    crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+    crc ^= 0xffff;
+    return (crc << 8) | (crc >> 8);
+}
+
+static unsigned short bytetab[256];
+
+unsigned short crc16_bytewise(const unsigned char *p, int len) {
+    unsigned short crc = 0xffff;
+
+    while (len--)
+	crc = (crc >> 8) ^ bytetab[(crc ^ *p++) & 0xff];
+    crc ^= 0xffff;
+    return (crc << 8) | (crc >> 8);
+}
+
+int check_crc(const char *what, unsigned short got, unsigned short expected) {
+    if (got == expected)
+	return 0;
+    printf("CRC mismatch %s: 0x%04x, expected 0x%04x\n", what, got, expected);
+    return 1;
+}
+
+/* count the messages libsml accepts, with message CRC checking enabled */
+int count_messages(unsigned char *data, size_t len) {
+    sml_file *file;
+    int n;
+
+    file = sml_file_parse(data + 8, len - 16);
+    n = file->messages_len;
+    sml_file_free(file);
+    return n;
+}
+
+/* an arena that can't be set up is 0, parsing without one uses the heap */
+int check_no_arena(struct telegram *t) {
+    sml_arena *arena;
+    sml_file *file;
+    int i, errors = 0;
+
+    for (i = 1; i <= 2; i++) {
+	fail_malloc = i;
+	arena = sml_arena_init(4096);
+	fail_malloc = 0;
+	if (arena) {
+	    printf("sml_arena_init() with malloc %d failing returned an arena\n", i);
+	    sml_arena_free(arena);
+	    errors++;
+	}
+    }
+    file = sml_file_parse_arena(NULL, t->data + 8, t->len - 16);
+    if (file->arena || file->messages_len != count_messages(t->data, t->len)) {
+	printf("parsing without an arena: %d messages\n", file->messages_len);
+	errors++;
+    }
+    sml_file_free(file);
+    return errors;
+}
+
+int run_crc(struct telegram *t, int n, int loops) {
+    static const struct {
+	const char *data;
+	unsigned short crc;
+    } vectors[] = {
+	{ "", 0x0000 },
+	{ "123456789", 0x6e90 },	/* X.25 check value 0x906e, byte swapped */
+    };
+    static const int sizes[] = { 8, 64, 300, 4096 };
+    unsigned char buf[4096 + 8], *copy;
+    int i, j, k, errors = 0, messages, rejected;
+    unsigned short crc;
+    char what[64];
+    double start, slow, fast;
+    volatile unsigned short sink = 0;
+
+    for (i = 0; i < 256; i++) {
+	crc = i;
+	for (j = 0; j < 8; j++)
+	    crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	bytetab[i] = crc;
+    }
+
+    /* fixed vectors */
+    for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+	snprintf(what, sizeof(what), "vector %d", i);
+	errors += check_crc(what, sml_crc16_calculate((unsigned char *)vectors[i].data, strlen(vectors[i].data)),
+			    vectors[i].crc);
+    }
+
+    /* every length and alignment against the bitwise reference */
+    srand(42);
+    for (i = 0; i < sizeof(buf); i++)
+	buf[i] = rand();
+    for (k = 0; k < 8; k++) {
+	for (i = 0; i <= 1024; i++) {
+	    snprintf(what, sizeof(what), "offset %d length %d", k, i);
+	    errors += check_crc(what, sml_crc16_calculate(buf + k, i), crc16_bitwise(buf + k, i));
+	}
+    }
+
+    /* incremental updates in odd pieces */
+    crc = 0xffff;
+    for (i = 0; i < 4096; i += k) {
+	k = 1 + (i % 13);
+	if (i + k > 4096)
+	    k = 4096 - i;
+	crc = sml_crc16_update(crc, buf + i, k);
+    }
+    crc ^= 0xffff;
+    errors += check_crc("incremental", (crc << 8) | (crc >> 8), crc16_bitwise(buf, 4096));
+
+    /* transport frames carry the CRC in the last two bytes */
+    for (i = 0; i < n; i++) {
+	snprintf(what, sizeof(what), "telegram %d", i);
+	errors += check_crc(what, sml_crc16_calculate(t[i].data, t[i].len - 2),
+			    (t[i].data[t[i].len - 2] << 8) | t[i].data[t[i].len - 1]);
+    }
+
+    /* message CRCs: a flipped bit in the last message must be rejected */
+    messages = rejected = 0;
+    for (i = 0; i < n; i++) {
+	k = count_messages(t[i].data, t[i].len);
+	messages += k;
+	copy = malloc(t[i].len);
+	memcpy(copy, t[i].data, t[i].len);
+	copy[t[i].len - 16] ^= 0x01;
+	if (count_messages(copy, t[i].len) < k)
+	    rejected++;
+	free(copy);
+    }
+    printf("%d telegrams, %d messages, %d/%d corrupted telegrams rejected\n", n, messages, rejected, n);
+    if (rejected != n)
+	errors++;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+	k = loops * 4096 / sizes[i] * 10;
+	start = now();
+	for (j = 0; j < k; j++)
+	    sink += crc16_bytewise(buf + (j & 7), sizes[i]);
+	slow = now() - start;
+	start = now();
+	for (j = 0; j < k; j++)
+	    sink += sml_crc16_calculate(buf + (j & 7), sizes[i]);
+	fast = now() - start;
+	printf("%5d bytes   bytewise %8.1f MB/s   sliced %8.1f MB/s   %5.2fx\n", sizes[i],
+	       (double)k * sizes[i] / slow / 1e6, (double)k * sizes[i] / fast / 1e6, slow / fast);
+    }
+
+    printf("%s\n", errors ? "FAILED" : "all CRC checks passed");
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    struct telegram telegrams[MAX_TELEGRAMS];
+    const char *name = "test/edl21.dat";
+    unsigned char *data;
+    sml_arena *arena;
+    size_t len;
+    int opt, n, loops = 1000, transport = 0, baud = 0, crc = 0;
+
+    while ((opt = getopt(argc, argv, "n:tb:ch?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    loops = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 't':
+	    transport = 1;
+	    break;
+	case 'b':
+	    baud = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'c':
+	    crc = 1;
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	name = argv[optind];
+
+    data = read_file(name, &len);
+    if (!data)
+	exit(1);
+    if (transport) {
+	run_transport(data, len, baud ? 1 : loops, baud);
+	free(data);
+	return 0;
+    }
+    n = split_telegrams(data, len, telegrams, MAX_TELEGRAMS);
+    printf("%s: %d telegrams, %zu bytes, %d loops\n", name, n, len, loops);
+    if (!n)
+	exit(1);
+    if (crc) {
+	n = run_crc(telegrams, n, loops);
+	free(data);
+	return n;
+    }
+
+    run("heap", telegrams, n, loops, NULL);
+    arena = sml_arena_init(4096);
+    run("arena", telegrams, n, loops, arena);
+    sml_arena_free(arena);
+    n = check_no_arena(telegrams);
+
+    free(data);
+    return n;
+}
@@ -0,0 +1,840 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * libsml fuzzing harness and parser throughput per message type
+ *
+ * LLVMFuzzerTestOneInput() hands the input to sml_file_parse() with the
+ * message CRCs ignored, so mutations reach the message parsers, and to the
+ * transport decoder in uneven pieces; the frames the decoder lets through
+ * are parsed in an arena like the server does.
+ *
+ * The corpus is built with the sml_*_write() encoders, one telegram per
+ * message type, wrapped in an open and a close response, plus the
+ * telegrams of the capture file.
+ *
+ *   make sml_fuzz                      host build with its own main()
+ *   make sml_fuzz_libfuzzer            clang, -fsanitize=fuzzer,address
+ *     ./sml_fuzz -g corpus && ./sml_fuzz_libfuzzer corpus
+ *   make -C sml clean all CC=afl-clang-fast && make sml_fuzz CC=afl-clang-fast
+ *     ./sml_fuzz -g corpus && afl-fuzz -i corpus -o findings -- ./sml_fuzz @@
+ *
+ * sml_fuzz without files checks that every generated telegram parses
+ * back to its message types, runs random mutations of them through the
+ * entry point and reports MB/s and telegrams/s per message type; -w
+ * saves the rates, -r fails if one dropped below 3/4 of the saved ones.
+ * With files it runs each of them through the entry point, to replay
+ * crashes found by the fuzzer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <sml/sml_file.h>
+#include <sml/sml_arena.h>
+#include <sml/sml_message.h>
+#include <sml/sml_transport.h>
+
+#define MAX_TELEGRAMS	256
+#define MAX_FRAME	16384
+#define LIST_ENTRIES	8
+#define ARENA_SIZE	4096
+/* rate below this part of the saved one is a regression */
+#define REGRESSION	0.75
+
+static const unsigned char start_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01 };
+static const unsigned char end_seq[] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x1a };
+
+static unsigned char server_id[] = { 0x0a, 0x01, 0x45, 0x4d, 0x48, 0x00, 0x00, 0x7a, 0xc5, 0x38 };
+static unsigned char obis_energy[] = { 0x01, 0x00, 0x01, 0x08, 0x00, 0xff };
+
+struct telegram {
+    char name[32];
+    u32 tags[3];
+    int tags_len;
+    unsigned char *data;
+    size_t len;
+};
+
+static unsigned int transaction;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const size_t pieces[] = { 1, 7, 64, 4096 };
+    static sml_transport_decoder *dec;
+    static sml_arena *arena;
+    unsigned char *copy, *frame;
+    size_t pos, n, frame_len;
+    sml_file *file;
+    int i;
+
+    if (!dec) {
+	dec = sml_transport_decoder_init(MAX_FRAME);
+	arena = sml_arena_init(ARENA_SIZE);
+    }
+
+    /* an exact copy, so reads past the end are caught by the sanitizer */
+    copy = malloc(size ? size : 1);
+    memcpy(copy, data, size);
+    sml_message_check_crc = 0;
+    if (size >= 16 && !memcmp(copy, start_seq, sizeof(start_seq)))
+	file = sml_file_parse(copy + 8, size - 16);
+    else
+	file = sml_file_parse(copy, size);
+    sml_file_free(file);
+    sml_message_check_crc = 1;
+    free(copy);
+
+    sml_transport_decoder_reset(dec);
+    for (pos = 0, i = size; pos < size; pos += n, i++) {
+	n = pieces[i % 4];
+	if (n > size - pos)
+	    n = size - pos;
+	n = sml_transport_decoder_feed(dec, data + pos, n);
+	while (sml_transport_decoder_next(dec, &frame, &frame_len)) {
+	    file = sml_file_parse_arena(arena, frame + 8, frame_len - 16);
+	    sml_file_free(file);
+	}
+    }
+    return 0;
+}
+
+#ifndef SML_LIBFUZZER
+
+/* encoder side */
+
+octet_string *bytes(const char *s)
+{
+    return sml_octet_string_init((unsigned char *)s, strlen(s));
+}
+
+sml_time *make_time(u8 tag, u32 value)
+{
+    sml_time *t = sml_time_init();
+
+    t->tag = sml_u8_init(tag);
+    t->data.timestamp = sml_u32_init(value);
+    return t;
+}
+
+sml_value *make_value(long long v)
+{
+    sml_value *value = sml_value_init();
+
+    value->type = SML_TYPE_INTEGER | SML_TYPE_NUMBER_64;
+    value->data.int64 = sml_i64_init(v);
+    return value;
+}
+
+sml_tree_path *make_path(void)
+{
+    sml_tree_path *path = sml_tree_path_init();
+
+    sml_tree_path_add_path_entry(path, sml_octet_string_init(obis_energy, sizeof(obis_energy)));
+    return path;
+}
+
+sml_period_entry *make_period_entry(long long v)
+{
+    sml_period_entry *entry = sml_period_entry_init();
+
+    entry->obj_name = sml_octet_string_init(obis_energy, sizeof(obis_energy));
+    entry->unit = sml_unit_init(30);
+    entry->scaler = sml_i8_init(-1);
+    entry->value = make_value(v);
+    return entry;
+}
+
+sml_tupel_entry *make_tupel_entry(void)
+{
+    sml_tupel_entry *t = sml_tupel_entry_init();
+
+    t->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+    t->sec_index = make_time(SML_TIME_SEC_INDEX, 1000000);
+    t->status = sml_u64_init(0x0102);
+    t->unit_pA = sml_unit_init(30);
+    t->scaler_pA = sml_i8_init(-1);
+    t->value_pA = sml_i64_init(123456789);
+    t->unit_R1 = sml_unit_init(30);
+    t->scaler_R1 = sml_i8_init(-1);
+    t->value_R1 = sml_i64_init(1);
+    t->unit_R4 = sml_unit_init(30);
+    t->scaler_R4 = sml_i8_init(-1);
+    t->value_R4 = sml_i64_init(4);
+    t->signature_pA_R1_R4 = bytes("sig");
+    t->unit_mA = sml_unit_init(30);
+    t->scaler_mA = sml_i8_init(-1);
+    t->value_mA = sml_i64_init(-987654321);
+    t->unit_R2 = sml_unit_init(30);
+    t->scaler_R2 = sml_i8_init(-1);
+    t->value_R2 = sml_i64_init(2);
+    t->unit_R3 = sml_unit_init(30);
+    t->scaler_R3 = sml_i8_init(-1);
+    t->value_R3 = sml_i64_init(3);
+    t->signature_mA_R2_R3 = bytes("sig");
+    return t;
+}
+
+sml_tree *make_leaf(const char *name, u8 tag)
+{
+    sml_tree *tree = sml_tree_init();
+    sml_proc_par_value *ppv = sml_proc_par_value_init();
+
+    tree->parameter_name = bytes(name);
+    ppv->tag = sml_u8_init(tag);
+    switch (tag) {
+    case SML_PROC_PAR_VALUE_TAG_VALUE:
+	ppv->data.value = make_value(42);
+	break;
+    case SML_PROC_PAR_VALUE_TAG_PERIOD_ENTRY:
+	ppv->data.period_entry = make_period_entry(12345678);
+	break;
+    case SML_PROC_PAR_VALUE_TAG_TUPEL_ENTRY:
+	ppv->data.tupel_entry = make_tupel_entry();
+	break;
+    case SML_PROC_PAR_VALUE_TAG_TIME:
+	ppv->data.time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+	break;
+    }
+    tree->parameter_value = ppv;
+    return tree;
+}
+
+/* a value, a time, a period and a tupel entry below a root */
+sml_tree *make_tree(void)
+{
+    sml_tree *tree = make_leaf("root", SML_PROC_PAR_VALUE_TAG_VALUE);
+
+    sml_tree_add_tree(tree, make_leaf("time", SML_PROC_PAR_VALUE_TAG_TIME));
+    sml_tree_add_tree(tree, make_leaf("period", SML_PROC_PAR_VALUE_TAG_PERIOD_ENTRY));
+    sml_tree_add_tree(tree, make_leaf("tupel", SML_PROC_PAR_VALUE_TAG_TUPEL_ENTRY));
+    return tree;
+}
+
+sml_list *make_list(int n)
+{
+    unsigned char name[6];
+    sml_list *first = NULL, *last = NULL, *entry;
+    int i;
+
+    memcpy(name, obis_energy, sizeof(name));
+    for (i = 0; i < n; i++) {
+	entry = sml_list_init();
+	name[4] = i;
+	entry->obj_name = sml_octet_string_init(name, sizeof(name));
+	if (i == 0) {
+	    entry->status = sml_status_init();
+	    entry->status->type = SML_TYPE_UNSIGNED | SML_TYPE_NUMBER_32;
+	    entry->status->data.status32 = sml_u32_init(0x00010182);
+	    entry->val_time = make_time(SML_TIME_SEC_INDEX, 1000000);
+	}
+	entry->unit = sml_unit_init(30);
+	entry->scaler = sml_i8_init(-1);
+	entry->value = make_value(100000LL * (i + 1));
+	if (last)
+	    sml_list_add(last, entry);
+	else
+	    first = entry;
+	last = entry;
+    }
+    return first;
+}
+
+sml_get_profile_pack_request *make_profile_request(void)
+{
+    sml_get_profile_pack_request *req = sml_get_profile_pack_request_init();
+    sml_obj_req_entry_list *l;
+    int i;
+
+    req->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+    req->with_rawdata = sml_boolean_init(0);
+    req->begin_time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+    req->end_time = make_time(SML_TIME_TIMESTAMP, 1500086400);
+    req->parameter_tree_path = make_path();
+    for (i = 0; i < 2; i++) {
+	l = sml_malloc(sizeof(sml_obj_req_entry_list));
+	l->object_list_entry = sml_octet_string_init(obis_energy, sizeof(obis_energy));
+	l->next = req->object_list;
+	req->object_list = l;
+    }
+    return req;
+}
+
+void *make_body(u32 tag)
+{
+    sml_open_request *open_req;
+    sml_open_response *open_res;
+    sml_get_list_request *list_req;
+    sml_get_list_response *list_res;
+    sml_get_profile_pack_response *pack;
+    sml_prof_obj_header_entry *header;
+    sml_prof_obj_period_entry *period;
+    sml_value_entry *value;
+    sml_get_profile_list_response *profile;
+    sml_get_proc_parameter_request *get_proc;
+    sml_get_proc_parameter_response *proc;
+    sml_set_proc_parameter_request *set_proc;
+    sml_attention_response *attention;
+    unsigned char number[] = { 0x81, 0x81, 0xc7, 0xc7, 0xfe, 0x00 };
+    int i;
+
+    switch (tag) {
+    case SML_MESSAGE_OPEN_REQUEST:
+	open_req = sml_open_request_init();
+	open_req->client_id = bytes("client");
+	open_req->req_file_id = bytes("file01");
+	open_req->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	open_req->username = bytes("user");
+	open_req->password = bytes("secret");
+	open_req->sml_version = sml_u8_init(1);
+	return open_req;
+    case SML_MESSAGE_OPEN_RESPONSE:
+	open_res = sml_open_response_init();
+	open_res->req_file_id = bytes("file01");
+	open_res->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	open_res->ref_time = make_time(SML_TIME_SEC_INDEX, 1000000);
+	open_res->sml_version = sml_u8_init(1);
+	return open_res;
+    case SML_MESSAGE_CLOSE_REQUEST:
+	return sml_close_request_init();
+    case SML_MESSAGE_CLOSE_RESPONSE:
+	return sml_close_response_init();
+    case SML_MESSAGE_GET_LIST_REQUEST:
+	list_req = sml_get_list_request_init();
+	list_req->client_id = bytes("client");
+	list_req->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	list_req->list_name = bytes("list");
+	return list_req;
+    case SML_MESSAGE_GET_LIST_RESPONSE:
+	list_res = sml_get_list_response_init();
+	list_res->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	list_res->act_sensor_time = make_time(SML_TIME_SEC_INDEX, 1000000);
+	list_res->val_list = make_list(LIST_ENTRIES);
+	list_res->act_gateway_time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+	return list_res;
+    case SML_MESSAGE_GET_PROFILE_PACK_REQUEST:
+    case SML_MESSAGE_GET_PROFILE_LIST_REQUEST:
+	return make_profile_request();
+    case SML_MESSAGE_GET_PROFILE_PACK_RESPONSE:
+	pack = sml_get_profile_pack_response_init();
+	pack->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	pack->act_time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+	pack->reg_period = sml_u32_init(900);
+	pack->parameter_tree_path = make_path();
+	pack->header_list = sml_sequence_init((void (*)(void *))&sml_prof_obj_header_entry_free);
+	header = sml_prof_obj_header_entry_init();
+	header->obj_name = sml_octet_string_init(obis_energy, sizeof(obis_energy));
+	header->unit = sml_unit_init(30);
+	header->scaler = sml_i8_init(-1);
+	sml_sequence_add(pack->header_list, header);
+	pack->period_list = sml_sequence_init((void (*)(void *))&sml_prof_obj_period_entry_free);
+	for (i = 0; i < 4; i++) {
+	    period = sml_prof_obj_period_entry_init();
+	    period->val_time = make_time(SML_TIME_TIMESTAMP, 1500000000 + 900 * i);
+	    period->status = sml_u64_init(0);
+	    period->value_list = sml_sequence_init((void (*)(void *))&sml_value_entry_free);
+	    value = sml_value_entry_init();
+	    value->value = make_value(12345678 + 2500 * i);
+	    sml_sequence_add(period->value_list, value);
+	    sml_sequence_add(pack->period_list, period);
+	}
+	return pack;
+    case SML_MESSAGE_GET_PROFILE_LIST_RESPONSE:
+	profile = sml_get_profile_list_response_init();
+	profile->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	profile->act_time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+	profile->reg_period = sml_u32_init(900);
+	profile->parameter_tree_path = make_path();
+	profile->val_time = make_time(SML_TIME_TIMESTAMP, 1500000000);
+	profile->status = sml_u64_init(0);
+	profile->period_list = sml_sequence_init((void (*)(void *))&sml_period_entry_free);
+	sml_sequence_add(profile->period_list, make_period_entry(12345678));
+	return profile;
+    case SML_MESSAGE_GET_PROC_PARAMETER_REQUEST:
+	get_proc = sml_get_proc_parameter_request_init();
+	get_proc->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	get_proc->parameter_tree_path = make_path();
+	return get_proc;
+    case SML_MESSAGE_GET_PROC_PARAMETER_RESPONSE:
+	proc = sml_get_proc_parameter_response_init();
+	proc->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	proc->parameter_tree_path = make_path();
+	proc->parameter_tree = make_tree();
+	return proc;
+    case SML_MESSAGE_SET_PROC_PARAMETER_REQUEST:
+	set_proc = sml_set_proc_parameter_request_init();
+	set_proc->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	set_proc->parameter_tree_path = make_path();
+	set_proc->parameter_tree = make_tree();
+	return set_proc;
+    case SML_MESSAGE_ATTENTION_RESPONSE:
+	attention = sml_attention_response_init();
+	attention->server_id = sml_octet_string_init(server_id, sizeof(server_id));
+	attention->attention_number = sml_octet_string_init(number, sizeof(number));
+	attention->attention_message = bytes("ok");
+	attention->attention_details = make_tree();
+	return attention;
+    }
+    return NULL;
+}
+
+/* a counter does for the transaction id, see history.c */
+sml_message *make_message(u32 tag)
+{
+    sml_message *msg = sml_malloc(sizeof(sml_message));
+    unsigned char id[4];
+
+    memset(msg, 0, sizeof(sml_message));
+    transaction++;
+    memcpy(id, &transaction, sizeof(id));
+    msg->transaction_id = sml_octet_string_init(id, sizeof(id));
+    msg->group_id = sml_u8_init(0);
+    msg->abort_on_error = sml_u8_init(0);
+    msg->message_body = sml_message_body_init(tag, make_body(tag));
+    return msg;
+}
+
+/* the transport framing comes from sml_transport_write(), through a file */
+int encode(struct telegram *t, const char *name, const u32 *tags, int n)
+{
+    sml_file *file;
+    FILE *f;
+    long size;
+    int i;
+
+    file = sml_file_init();
+    sml_buffer_free(file->buf);
+    file->buf = sml_buffer_init(MAX_FRAME);
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    for (i = 0; i < n; i++) {
+	sml_file_add_message(file, make_message(tags[i]));
+	t->tags[i] = tags[i];
+    }
+    t->tags_len = n;
+
+    f = tmpfile();
+    if (!f || !sml_transport_write(fileno(f), file)) {
+	printf("%s: encoding failed\n", name);
+	return -1;
+    }
+    sml_file_free(file);
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    t->data = malloc(size);
+    t->len = size;
+    if (fread(t->data, 1, size, f) != size) {
+	fclose(f);
+	return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int generate(struct telegram *t)
+{
+    static const struct {
+	const char *name;
+	u32 tag;
+    } types[] = {
+	{ "open_request", SML_MESSAGE_OPEN_REQUEST },
+	{ "open_response", SML_MESSAGE_OPEN_RESPONSE },
+	{ "close_request", SML_MESSAGE_CLOSE_REQUEST },
+	{ "close_response", SML_MESSAGE_CLOSE_RESPONSE },
+	{ "get_list_request", SML_MESSAGE_GET_LIST_REQUEST },
+	{ "get_list_response", SML_MESSAGE_GET_LIST_RESPONSE },
+	{ "get_profile_pack_request", SML_MESSAGE_GET_PROFILE_PACK_REQUEST },
+	{ "get_profile_pack_response", SML_MESSAGE_GET_PROFILE_PACK_RESPONSE },
+	{ "get_profile_list_request", SML_MESSAGE_GET_PROFILE_LIST_REQUEST },
+	{ "get_profile_list_response", SML_MESSAGE_GET_PROFILE_LIST_RESPONSE },
+	{ "get_proc_param_request", SML_MESSAGE_GET_PROC_PARAMETER_REQUEST },
+	{ "get_proc_param_response", SML_MESSAGE_GET_PROC_PARAMETER_RESPONSE },
+	{ "set_proc_param_request", SML_MESSAGE_SET_PROC_PARAMETER_REQUEST },
+	{ "attention_response", SML_MESSAGE_ATTENTION_RESPONSE },
+    };
+    u32 tags[3];
+    int i;
+
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+	if (types[i].tag <= SML_MESSAGE_CLOSE_RESPONSE) {
+	    if (encode(&t[i], types[i].name, &types[i].tag, 1))
+		return -1;
+	    continue;
+	}
+	/* wrapped like a meter sends it */
+	tags[0] = SML_MESSAGE_OPEN_RESPONSE;
+	tags[1] = types[i].tag;
+	tags[2] = SML_MESSAGE_CLOSE_RESPONSE;
+	if (encode(&t[i], types[i].name, tags, 3))
+	    return -1;
+    }
+    return i;
+}
+
+/* capture side, as in sml_bench.c */
+
+unsigned char *read_file(const char *name, size_t *len) {
+    unsigned char *data;
+    FILE *f;
+    long size;
+
+    f = fopen(name, "rb");
+    if (!f) {
+	perror(name);
+	return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size ? size : 1);
+    if (data && fread(data, 1, size, f) != size) {
+	free(data);
+	data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+int split_telegrams(unsigned char *data, size_t len, struct telegram *t, int max) {
+    size_t pos = 0, end;
+    int n = 0;
+
+    while (n < max && pos + sizeof(start_seq) <= len) {
+	if (memcmp(data + pos, start_seq, sizeof(start_seq))) {
+	    pos++;
+	    continue;
+	}
+	for (end = pos + 8; end + 8 <= len; end += 4) {
+	    if (!memcmp(data + end, end_seq, sizeof(end_seq)))
+		break;
+	}
+	if (end + 8 > len)
+	    break;
+	snprintf(t[n].name, sizeof(t[n].name), "capture_%03d", n);
+	t[n].data = data + pos;
+	t[n].len = end + 8 - pos;
+	t[n].tags_len = 0;
+	n++;
+	pos = end + 8;
+    }
+    return n;
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <loops>] [-m <mutations>] [-c <capture>] [-g <dir>] [-w|-r <rates>] [files]\n", prg);
+    fprintf(stderr, "         -n <loops>          parser passes per message type - default 20000\n");
+    fprintf(stderr, "         -m <mutations>      mutated inputs per telegram - default 2000\n");
+    fprintf(stderr, "         -c <capture>        default test/edl21.dat\n");
+    fprintf(stderr, "         -g <dir>            write the corpus to dir and exit\n");
+    fprintf(stderr, "         -w <rates>          save the telegrams/s per message type\n");
+    fprintf(stderr, "         -r <rates>          fail if a rate dropped below %.0f%% of the saved one\n",
+	    REGRESSION * 100);
+    fprintf(stderr, "         files               run each file through the fuzzer entry point\n\n");
+}
+
+int write_corpus(const char *dir, struct telegram *t, int n)
+{
+    char name[256];
+    FILE *f;
+    int i;
+
+    mkdir(dir, 0755);
+    for (i = 0; i < n; i++) {
+	snprintf(name, sizeof(name), "%s/%s", dir, t[i].name);
+	f = fopen(name, "wb");
+	if (!f || fwrite(t[i].data, 1, t[i].len, f) != t[i].len) {
+	    perror(name);
+	    return -1;
+	}
+	fclose(f);
+    }
+    printf("%d files written to %s\n", n, dir);
+    return 0;
+}
+
+/* both the decoder and the parser must give back what was encoded */
+int round_trip(struct telegram *t)
+{
+    sml_transport_decoder *dec;
+    unsigned char *frame;
+    size_t frame_len;
+    sml_file *file;
+    int i, errors = 0;
+
+    dec = sml_transport_decoder_init(MAX_FRAME);
+    sml_transport_decoder_feed(dec, t->data, t->len);
+    if (!sml_transport_decoder_next(dec, &frame, &frame_len) || frame_len != t->len) {
+	printf("%s: no frame from the decoder\n", t->name);
+	errors++;
+    }
+    sml_transport_decoder_free(dec);
+
+    file = sml_file_parse(t->data + 8, t->len - 16);
+    if (file->messages_len != t->tags_len) {
+	printf("%s: %d of %d messages parsed\n", t->name, file->messages_len, t->tags_len);
+	errors++;
+    }
+    for (i = 0; i < file->messages_len && i < t->tags_len; i++) {
+	if (*file->messages[i]->message_body->tag != t->tags[i]) {
+	    printf("%s: message %d has tag 0x%x\n", t->name, i, *file->messages[i]->message_body->tag);
+	    errors++;
+	}
+    }
+    sml_file_free(file);
+    return errors;
+}
+
+/* bit flips, interesting bytes, cuts and duplicated pieces */
+size_t mutate(unsigned char *out, const unsigned char *in, size_t len, size_t max)
+{
+    static const unsigned char interesting[] = { 0x00, 0x01, 0x0f, 0x1b, 0x70, 0x7f, 0x80, 0x8f, 0xff };
+    size_t pos, from, n;
+    int i, count = 1 + rand() % 4;
+
+    memcpy(out, in, len);
+    for (i = 0; i < count && len; i++) {
+	pos = rand() % len;
+	switch (rand() % 5) {
+	case 0:
+	    out[pos] ^= 1 << (rand() % 8);
+	    break;
+	case 1:
+	    out[pos] = interesting[rand() % sizeof(interesting)];
+	    break;
+	case 2:
+	    out[pos] = rand();
+	    break;
+	case 3:
+	    len = pos;
+	    break;
+	case 4:
+	    from = rand() % len;
+	    n = 1 + rand() % 16;
+	    if (from + n > len)
+		n = len - from;
+	    if (len + n > max)
+		break;
+	    memmove(out + pos + n, out + pos, len - pos);
+	    memmove(out + pos, out + (from >= pos ? from + n : from), n);
+	    len += n;
+	    break;
+	}
+    }
+    return len;
+}
+
+void fuzz(struct telegram *t, int n, int mutations)
+{
+    unsigned char *buf = malloc(MAX_FRAME);
+    unsigned long inputs = 0, bytes = 0;
+    double start = now(), elapsed;
+    size_t len;
+    int i, j, out, null;
+
+    /* libsml reports every parse error on stdout */
+    fflush(stdout);
+    out = dup(1);
+    null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+
+    srand(42);
+    for (i = 0; i < n; i++) {
+	if (t[i].len * 2 > MAX_FRAME)
+	    continue;
+	for (j = 0; j < mutations; j++) {
+	    len = mutate(buf, t[i].data, t[i].len, MAX_FRAME);
+	    LLVMFuzzerTestOneInput(buf, len);
+	    inputs++;
+	    bytes += len;
+	}
+    }
+    elapsed = now() - start;
+    fflush(stdout);
+    dup2(out, 1);
+    close(out);
+    close(null);
+    printf("%lu mutated inputs survived, %.0f inputs/s\n", inputs, inputs / elapsed);
+    free(buf);
+}
+
+struct rate {
+    char name[32];
+    double telegrams;
+};
+
+/* parse in the arena like the server, the decoder gets the framed bytes */
+int throughput(struct telegram *t, int n, int loops, struct rate *rates)
+{
+    sml_transport_decoder *dec;
+    sml_arena *arena;
+    unsigned char *frame;
+    size_t frame_len;
+    double start, parse, decode;
+    sml_file *file;
+    int i, j;
+
+    arena = sml_arena_init(ARENA_SIZE);
+    dec = sml_transport_decoder_init(MAX_FRAME);
+    printf("%-26s %6s %12s %10s %14s\n", "message type", "bytes", "telegrams/s", "MB/s", "decoder MB/s");
+    for (i = 0; i < n; i++) {
+	start = now();
+	for (j = 0; j < loops; j++) {
+	    file = sml_file_parse_arena(arena, t[i].data + 8, t[i].len - 16);
+	    sml_file_free(file);
+	}
+	parse = now() - start;
+
+	start = now();
+	for (j = 0; j < loops; j++) {
+	    sml_transport_decoder_feed(dec, t[i].data, t[i].len);
+	    while (sml_transport_decoder_next(dec, &frame, &frame_len)) ;
+	}
+	decode = now() - start;
+
+	/* the capture telegrams all look alike, one stands for them */
+	strcpy(rates[i].name, t[i].tags_len ? t[i].name : "capture");
+	rates[i].telegrams = loops / parse;
+	printf("%-26s %6zu %12.0f %10.1f %14.1f\n", rates[i].name, t[i].len, loops / parse,
+	       loops * t[i].len / parse / 1e6, loops * t[i].len / decode / 1e6);
+    }
+    sml_transport_decoder_free(dec);
+    sml_arena_free(arena);
+    return n;
+}
+
+int save_rates(const char *name, struct rate *rates, int n)
+{
+    FILE *f = fopen(name, "w");
+    int i;
+
+    if (!f) {
+	perror(name);
+	return -1;
+    }
+    for (i = 0; i < n; i++)
+	fprintf(f, "%s %.0f\n", rates[i].name, rates[i].telegrams);
+    fclose(f);
+    return 0;
+}
+
+int check_rates(const char *name, struct rate *rates, int n)
+{
+    char type[32];
+    double saved;
+    FILE *f = fopen(name, "r");
+    int i, errors = 0;
+
+    if (!f) {
+	perror(name);
+	return 1;
+    }
+    while (fscanf(f, "%31s %lf", type, &saved) == 2) {
+	for (i = 0; i < n; i++) {
+	    if (strcmp(rates[i].name, type))
+		continue;
+	    if (rates[i].telegrams < saved * REGRESSION) {
+		printf("%s: %.0f telegrams/s, %.0f saved\n", type, rates[i].telegrams, saved);
+		errors++;
+	    }
+	}
+    }
+    fclose(f);
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    struct telegram telegrams[MAX_TELEGRAMS];
+    struct rate rates[MAX_TELEGRAMS];
+    const char *capture = "test/edl21.dat", *corpus = NULL, *save = NULL, *check = NULL;
+    unsigned char *data, *cap;
+    size_t len, cap_len;
+    int opt, i, n, generated, loops = 20000, mutations = 2000, errors = 0;
+
+    while ((opt = getopt(argc, argv, "n:m:c:g:w:r:h?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    loops = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'm':
+	    mutations = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'c':
+	    capture = optarg;
+	    break;
+	case 'g':
+	    corpus = optarg;
+	    break;
+	case 'w':
+	    save = optarg;
+	    break;
+	case 'r':
+	    check = optarg;
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+
+    /* crash reproduction and AFL */
+    if (optind < argc) {
+	for (i = optind; i < argc; i++) {
+	    data = read_file(argv[i], &len);
+	    if (!data)
+		exit(1);
+	    LLVMFuzzerTestOneInput(data, len);
+	    free(data);
+	}
+	return 0;
+    }
+
+    generated = generate(telegrams);
+    if (generated < 0)
+	exit(1);
+    n = generated;
+    cap = read_file(capture, &cap_len);
+    if (cap)
+	n += split_telegrams(cap, cap_len, telegrams + n, MAX_TELEGRAMS - n);
+
+    if (corpus)
+	return write_corpus(corpus, telegrams, n) ? 1 : 0;
+
+    for (i = 0; i < generated; i++)
+	errors += round_trip(&telegrams[i]);
+    printf("%d message types encoded and parsed back, %d capture telegrams\n", generated, n - generated);
+
+    fuzz(telegrams, n, mutations);
+    throughput(telegrams, generated + (n > generated), loops, rates);
+    if (save && save_rates(save, rates, generated + (n > generated)))
+	errors++;
+    if (check)
+	errors += check_rates(check, rates, generated + (n > generated));
+
+    for (i = 0; i < generated; i++)
+	free(telegrams[i].data);
+    free(cap);
+    printf("%s\n", errors ? "FAILED" : "libsml fuzz checks passed");
+    return errors ? 1 : 0;
+}
+
+#endif
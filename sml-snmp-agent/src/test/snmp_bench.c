@@ -0,0 +1,536 @@
+/* ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <info@gerhard-bertelsmann.de> wrote this file. As long as you retain this
+ * notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return
+ * Gerhard Bertelsmann
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+ * SNMP agent benchmark
+ *
+ * sends GET requests one at a time over UDP and reports requests/s and the
+ * latency distribution; without -s the agent runs in this process on the
+ * loopback interface, with the meter values changing in the background
+ * -w:  walks a subtree instead, with GETNEXT or with GETBULK (-b), and reports
+ *      the time per walk
+ * -j:  number of clients sending in parallel, each from its own socket
+ * -c:  BER codec test, every truncation and random corruptions of a request
+ *      must be rejected or decoded without touching memory outside of it
+ *
+ * linked with -Wl,--wrap=... to count heap allocations while requests are
+ * served, the request path is expected to do none
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "../snmp.h"
+#include "../sml_server.h"
+#include "../mib.h"
+#include "../meter.h"
+
+#define BENCH_PORT	16161
+#define WALK_MAX_OID	64
+
+/* what sml_server.c provides to the agent */
+int verbose = 0;
+
+extern void *snmp_agent(void *);
+extern void get_integer(void *arg, struct mib_value *value);
+
+struct client {
+    int sock;
+    int count;
+    unsigned int id;
+    unsigned char oid[WALK_MAX_OID];
+    int oid_len;
+    int bulk;
+    double *latency;
+    int answered;
+    int timeouts;
+    unsigned long round_trips;
+    unsigned long varbinds;
+};
+
+static volatile unsigned long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    __sync_fetch_and_add(&allocations, 1);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    __sync_fetch_and_add(&allocations, 1);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    __sync_fetch_and_add(&allocations, 1);
+    return __real_realloc(p, size);
+}
+
+void print_usage(char *prg) {
+    fprintf(stderr, "\nUsage: %s [-n <count>] [-s <host>] [-p <port>] [-o <oid>] [-w [-b <n>]] [-j <clients>] [-c]\n", prg);
+    fprintf(stderr, "         -n <count>          GET requests or walks per client - default 100000 / 1000\n");
+    fprintf(stderr, "         -s <host>           external agent - default in process agent\n");
+    fprintf(stderr, "         -p <port>           agent port - default %d\n", BENCH_PORT);
+    fprintf(stderr, "         -o <oid>            OID to request or walk - default 1.3.6.1.4.1.39241.1.8.0\n");
+    fprintf(stderr, "                             or 1.3.6.1.4.1.39241\n");
+    fprintf(stderr, "         -w                  walk the subtree\n");
+    fprintf(stderr, "         -b <n>              walk with SNMPv2c GETBULK, max-repetitions n\n");
+    fprintf(stderr, "         -j <clients>        parallel clients - default 1\n");
+    fprintf(stderr, "         -W <workers>        worker threads of the in process agent - default 1\n");
+    fprintf(stderr, "         -m <entries>        additional MIB entries below the walked subtree - default 0\n");
+    fprintf(stderr, "         -c                  BER codec test\n\n");
+}
+
+int oid_from_string(const char *string, unsigned char *oid) {
+    unsigned char *encoded = encode_oid((unsigned char *)string);
+    int len = encoded[1];
+
+    if (len > WALK_MAX_OID) {
+	free(encoded);
+	return -1;
+    }
+    memcpy(oid, encoded + 2, len);
+    free(encoded);
+    return len;
+}
+
+/*
+ * single varbind request, community public, request id at offset 17, error
+ * status / non-repeaters at 23 and error index / max-repetitions at 26
+ */
+int build_request(unsigned char *buf, int version, unsigned char pdu_type, const unsigned char *oid, int oid_len,
+		  int non_repeaters, int max_repetitions) {
+    static const unsigned char head[] = {
+	0x30, 0x00, 0x02, 0x01, 0x00, 0x04, 0x06, 'p', 'u', 'b', 'l', 'i', 'c',
+	0x00, 0x00, 0x02, 0x04, 0x00, 0x00, 0x00, 0x00,
+	0x02, 0x01, 0x00, 0x02, 0x01, 0x00, 0x30, 0x00, 0x30, 0x00
+    };
+    int len = sizeof(head);
+
+    memcpy(buf, head, len);
+    buf[4] = version;
+    buf[13] = pdu_type;
+    buf[23] = non_repeaters;
+    buf[26] = max_repetitions;
+    buf[len++] = PRIMV_OBJID;
+    buf[len++] = oid_len;
+    memcpy(buf + len, oid, oid_len);
+    len += oid_len;
+    buf[len++] = PRIMV_NULL;
+    buf[len++] = 0x00;
+
+    buf[1] = len - 2;
+    buf[14] = len - 15;
+    buf[28] = len - 29;
+    buf[30] = len - 31;
+    return len;
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* decodes a copy of exactly len bytes, so any overread shows up with ASAN */
+int decode_copy(const unsigned char *data, int len, unsigned char *response, int *response_len) {
+    struct snmp_request req;
+    unsigned char *copy, *p;
+    unsigned int n;
+    int ret;
+
+    copy = __real_malloc(len ? len : 1);
+    memcpy(copy, data, len);
+    ret = snmp_decode_request(copy, len, &req);
+    if (!ret) {
+	p = snmp_encode_response(response, 1024, &req, 0, 0, req.varbinds, req.varbind_count, &n);
+	if (!p)
+	    ret = 1;
+	else if (response_len) {
+	    memmove(response, p, n);
+	    *response_len = n;
+	}
+    }
+    free(copy);
+    return ret;
+}
+
+/* the value octets of one varbind, PRIMV_INT is signed */
+int integer_test(void) {
+    static const struct {
+	unsigned char type;
+	long long value;
+	unsigned char len;
+	unsigned char octets[5];
+    } cases[] = {
+	{ PRIMV_INT, 0, 1, { 0x00 } },
+	{ PRIMV_INT, 127, 1, { 0x7f } },
+	{ PRIMV_INT, 128, 2, { 0x00, 0x80 } },
+	{ PRIMV_INT, -1, 1, { 0xff } },
+	{ PRIMV_INT, -100, 1, { 0x9c } },
+	{ PRIMV_INT, -128, 1, { 0x80 } },
+	{ PRIMV_INT, -129, 2, { 0xff, 0x7f } },
+	{ PRIMV_INT, -2147483648LL, 4, { 0x80, 0x00, 0x00, 0x00 } },
+	{ PRIMV_INT, 2147483647LL, 4, { 0x7f, 0xff, 0xff, 0xff } },
+	{ PRIMV_COUNTR, 4294967295LL, 5, { 0x00, 0xff, 0xff, 0xff, 0xff } },
+	{ PRIMV_GAUGE, 128, 2, { 0x00, 0x80 } },
+    };
+    unsigned char request[128], buf[256], encoded[WALK_MAX_OID], *p;
+    struct snmp_request req;
+    struct ber_varbind vb;
+    unsigned int i, n;
+    int len, errors = 0;
+
+    len = oid_from_string("1.3.6.1.4.1.39241.1.8.0", encoded);
+    len = build_request(request, SNMP_VERSION_1, PDU_GET_REQ, encoded, len, 0, 0);
+    if (snmp_decode_request(request, len, &req))
+	return 1;
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+	vb = req.varbinds[0];
+	vb.type = cases[i].type;
+	vb.integer = cases[i].value;
+	p = snmp_encode_response(buf, sizeof(buf), &req, 0, 0, &vb, 1, &n);
+	/* the value is the last TLV of the datagram */
+	if (!p || p[n - cases[i].len - 2] != cases[i].type || p[n - cases[i].len - 1] != cases[i].len ||
+	    memcmp(p + n - cases[i].len, cases[i].octets, cases[i].len)) {
+	    printf("integer %lld of type 0x%02x encoded wrong\n", cases[i].value, cases[i].type);
+	    errors++;
+	}
+    }
+    return errors;
+}
+
+int codec_test(const char *oid) {
+    unsigned char request[128], response[1024], mutated[128], encoded[WALK_MAX_OID];
+    unsigned long allocs_before;
+    int i, j, len, response_len, errors = 0, accepted = 0;
+
+    len = oid_from_string(oid, encoded);
+    if (len < 0)
+	return 1;
+    len = build_request(request, SNMP_VERSION_1, PDU_GET_REQ, encoded, len, 0, 0);
+    allocs_before = allocations;
+
+    /* a response echoing the request varbinds equals the request but for the PDU tag */
+    if (decode_copy(request, len, response, &response_len) || response_len != len ||
+	response[13] != PDU_GET_RESP || memcmp(response, request, 13) || memcmp(response + 14, request + 14, len - 14)) {
+	printf("round trip failed\n");
+	errors++;
+    }
+    for (i = 0; i < len; i++) {
+	if (!decode_copy(request, i, response, NULL)) {
+	    printf("truncated request of %d bytes accepted\n", i);
+	    errors++;
+	}
+    }
+    srand(1);
+    for (i = 0; i < 1000000; i++) {
+	memcpy(mutated, request, len);
+	for (j = 1 + rand() % 3; j; j--)
+	    mutated[rand() % len] = rand();
+	if (!decode_copy(mutated, len, response, NULL))
+	    accepted++;
+    }
+    /* the copies made by decode_copy() bypass the counter */
+    printf("codec: %d truncations rejected, %d of 1000000 corrupted requests still valid, %lu allocations\n",
+	   len, accepted, allocations - allocs_before);
+    if (allocations != allocs_before)
+	errors++;
+    errors += integer_test();
+    printf("%s\n", errors ? "FAILED" : "codec test passed");
+    return errors ? 1 : 0;
+}
+
+void *meter_thread(void *arg) {
+    struct meter *meter = (struct meter *)arg;
+    struct timespec ts = { 0, 100000 };
+
+    while (1) {
+	seqlock_write_begin(&meter->values[0].seqlock);
+	meter->values[0].raw++;
+	seqlock_write_end(&meter->values[0].seqlock);
+	seqlock_write_begin(&meter->values[1].seqlock);
+	meter->values[1].raw += 2;
+	seqlock_write_end(&meter->values[1].seqlock);
+	seqlock_write_begin(&meter->values[3].seqlock);
+	meter->values[3].raw = meter->values[0].raw & 0xfff;
+	seqlock_write_end(&meter->values[3].seqlock);
+	meter->telegrams++;
+	nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/* sends a request with the next request id and decodes the answer into answer */
+int transact(struct client *c, unsigned char *request, int len, unsigned char *response, int size,
+	     struct snmp_request *answer) {
+    struct pollfd pfd;
+    int n;
+
+    c->id++;
+    request[17] = c->id >> 24;
+    request[18] = c->id >> 16;
+    request[19] = c->id >> 8;
+    request[20] = c->id;
+    if (send(c->sock, request, len, 0) != len) {
+	fprintf(stderr, "send error: %s\n", strerror(errno));
+	exit(1);
+    }
+    c->round_trips++;
+    pfd.fd = c->sock;
+    pfd.events = POLLIN;
+    /* drop late answers of requests which timed out before */
+    while (1) {
+	if (poll(&pfd, 1, 1000) <= 0)
+	    return -1;
+	n = recv(c->sock, response, size, 0);
+	if (n <= 0)
+	    return -1;
+	if (!snmp_decode_request(response, n, answer) && answer->request_id_len == 4 &&
+	    !memcmp(answer->request_id, request + 17, 4))
+	    return n;
+    }
+}
+
+void *get_client(void *arg) {
+    struct client *c = (struct client *)arg;
+    unsigned char request[128], response[2048];
+    struct snmp_request answer;
+    int i, len;
+    double t;
+
+    len = build_request(request, SNMP_VERSION_1, PDU_GET_REQ, c->oid, c->oid_len, 0, 0);
+    for (i = 0; i < c->count; i++) {
+	t = now();
+	if (transact(c, request, len, response, sizeof(response), &answer) < 0) {
+	    c->timeouts++;
+	    continue;
+	}
+	c->latency[c->answered++] = now() - t;
+	c->varbinds++;
+    }
+    return NULL;
+}
+
+/* GETNEXT or GETBULK from the subtree root until the answers leave the subtree */
+void *walk_client(void *arg) {
+    struct client *c = (struct client *)arg;
+    unsigned char request[128], response[2048], oid[WALK_MAX_OID];
+    struct snmp_request answer;
+    struct ber_varbind *vb;
+    int i, j, len, oid_len, done;
+    double t;
+
+    for (i = 0; i < c->count; i++) {
+	memcpy(oid, c->oid, c->oid_len);
+	oid_len = c->oid_len;
+	t = now();
+	done = 0;
+	while (!done) {
+	    if (c->bulk)
+		len = build_request(request, SNMP_VERSION_2C, PDU_GET_BULK_REQ, oid, oid_len, 0, c->bulk);
+	    else
+		len = build_request(request, SNMP_VERSION_1, PDU_GET_NEXT_REQ, oid, oid_len, 0, 0);
+	    if (transact(c, request, len, response, sizeof(response), &answer) < 0)
+		break;
+	    if (answer.error_status || !answer.varbind_count)
+		done = 1;
+	    for (j = 0; j < answer.varbind_count && !done; j++) {
+		vb = &answer.varbinds[j];
+		if (vb->type == PRIMV_ENDOFMIBVIEW || vb->oid_len <= c->oid_len || vb->oid_len > WALK_MAX_OID ||
+		    memcmp(vb->oid, c->oid, c->oid_len)) {
+		    done = 1;
+		    break;
+		}
+		c->varbinds++;
+		memcpy(oid, vb->oid, vb->oid_len);
+		oid_len = vb->oid_len;
+	    }
+	}
+	if (!done) {
+	    c->timeouts++;
+	    continue;
+	}
+	c->latency[c->answered++] = now() - t;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    struct snmp_data snmp_thread_data;
+    struct sockaddr_in addr;
+    struct client *clients;
+    struct meter *bench_meter;
+    const char *host = NULL, *oid = NULL;
+    char name[64];
+    pthread_t thread_snmp, thread_meter, *threads;
+    int opt, i, count = 0, port = BENCH_PORT, codec = 0, walk = 0, bulk = 0, jobs = 1, workers = 1, extra = 0;
+    int answered = 0, timeouts = 0;
+    unsigned long allocs_before, round_trips = 0, varbinds = 0;
+    double start, elapsed, *latency;
+    static unsigned int extra_value = 42;
+
+    while ((opt = getopt(argc, argv, "n:s:p:o:wb:j:W:m:ch?")) != -1) {
+	switch (opt) {
+	case 'n':
+	    count = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 's':
+	    host = optarg;
+	    break;
+	case 'p':
+	    port = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'o':
+	    oid = optarg;
+	    break;
+	case 'w':
+	    walk = 1;
+	    break;
+	case 'b':
+	    bulk = strtoul(optarg, (char **)NULL, 10);
+	    if (bulk > 127)
+		bulk = 127;
+	    break;
+	case 'j':
+	    jobs = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'W':
+	    workers = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'm':
+	    extra = strtoul(optarg, (char **)NULL, 10);
+	    break;
+	case 'c':
+	    codec = 1;
+	    break;
+	default:
+	    print_usage(argv[0]);
+	    exit(1);
+	}
+    }
+    if (!oid)
+	oid = walk ? "1.3.6.1.4.1.39241" : "1.3.6.1.4.1.39241.1.8.0";
+    if (!count)
+	count = walk ? 1000 : 100000;
+    if (count <= 0 || jobs <= 0) {
+	print_usage(argv[0]);
+	exit(1);
+    }
+    if (codec)
+	return codec_test(oid);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host ? host : "127.0.0.1", &addr.sin_addr) != 1) {
+	fprintf(stderr, "invalid address %s\n", host);
+	exit(1);
+    }
+
+    if (!host) {
+	/* a larger table, in the walked subtree when walking */
+	for (i = 0; i < extra; i++) {
+	    snprintf(name, sizeof(name), "%s.99.%d.0", walk ? oid : "1.3.6.1.4.1.39241", i + 1);
+	    mib_register(strdup(name), get_integer, &extra_value);
+	}
+	bench_meter = meter_add("bench");
+	meter_init(0);
+	snmp_thread_data.snmp_port = port;
+	snmp_thread_data.workers = workers;
+	if (pthread_create(&thread_snmp, NULL, snmp_agent, &snmp_thread_data) ||
+	    pthread_create(&thread_meter, NULL, meter_thread, bench_meter)) {
+	    fprintf(stderr, "can't start agent\n");
+	    exit(1);
+	}
+	usleep(100000);
+    }
+
+    clients = calloc(jobs, sizeof(struct client));
+    threads = calloc(jobs, sizeof(pthread_t));
+    latency = calloc((size_t)jobs * count, sizeof(double));
+    for (i = 0; i < jobs; i++) {
+	clients[i].sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (clients[i].sock < 0 || connect(clients[i].sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	    fprintf(stderr, "socket error: %s\n", strerror(errno));
+	    exit(1);
+	}
+	clients[i].count = count;
+	clients[i].oid_len = oid_from_string(oid, clients[i].oid);
+	if (clients[i].oid_len < 0) {
+	    fprintf(stderr, "OID %s too long\n", oid);
+	    exit(1);
+	}
+	clients[i].bulk = bulk;
+	clients[i].latency = latency + (size_t)i * count;
+    }
+
+    allocs_before = allocations;
+    start = now();
+    for (i = 0; i < jobs; i++) {
+	if (pthread_create(&threads[i], NULL, walk ? walk_client : get_client, &clients[i])) {
+	    fprintf(stderr, "can't start client\n");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < jobs; i++)
+	pthread_join(threads[i], NULL);
+    elapsed = now() - start;
+    allocs_before = allocations - allocs_before;
+
+    /* pack the latencies of all clients together */
+    for (i = 0; i < jobs; i++) {
+	memmove(latency + answered, clients[i].latency, clients[i].answered * sizeof(double));
+	answered += clients[i].answered;
+	timeouts += clients[i].timeouts;
+	round_trips += clients[i].round_trips;
+	varbinds += clients[i].varbinds;
+	close(clients[i].sock);
+    }
+    if (!answered) {
+	fprintf(stderr, "no answers from %s:%d\n", host ? host : "127.0.0.1", port);
+	exit(1);
+    }
+    qsort(latency, answered, sizeof(double), cmp_double);
+    if (walk) {
+	printf("%d walks of %s with %s, %d clients, %d timeouts, %.0f walks/s\n", jobs * count, oid,
+	       bulk ? "GETBULK" : "GETNEXT", jobs, timeouts, answered / elapsed);
+	printf("%.1f varbinds and %.1f round trips per walk, %.0f requests/s\n", (double)varbinds / answered,
+	       (double)round_trips / (jobs * count), round_trips / elapsed);
+    } else {
+	printf("%d requests, %d clients, %d timeouts, %.0f requests/s\n", jobs * count, jobs, timeouts,
+	       answered / elapsed);
+    }
+    printf("latency us: min %.1f  p50 %.1f  p99 %.1f  max %.1f\n", latency[0] * 1e6,
+	   latency[answered / 2] * 1e6, latency[(int)(answered * 0.99)] * 1e6, latency[answered - 1] * 1e6);
+    if (!host)
+	printf("heap allocations: %.2f per request\n", (double)allocs_before / round_trips);
+    free(latency);
+    free(clients);
+    free(threads);
+    return timeouts ? 2 : 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * byteSpeed.c:
+ *	Measure how many bytes/sec digitalWriteByte and digitalReadByte
+ *	move over the 8 pins of wiringPi pins 0-7, e.g. for an HD44780 in
+ *	8-bit mode or a latched DAC.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define	COUNT		1000000
+#define	PASSES		      5
+
+static void report (int sum)
+{
+  printf (". Av: %6dmS", sum / PASSES) ;
+  if (sum == 0)
+    sum = 1 ;
+  printf (": %9d bytes/sec\n", (int)((double)COUNT / ((double)sum / (double)PASSES) * 1000.0)) ;
+}
+
+static void writeTest (void)
+{
+  int count, sum, i ;
+  unsigned int start, end ;
+
+  sum = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < COUNT ; ++count)
+      digitalWriteByte (count) ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  digitalWriteByte (0) ;
+  report (sum) ;
+}
+
+static void readTest (void)
+{
+  int count, sum, i ;
+  unsigned int start, end, data ;
+
+  sum  = 0 ;
+  data = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < COUNT ; ++count)
+      data += digitalReadByte () ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  report (sum) ;
+  if (data == 1)	// Keep the reads
+    printf ("\n") ;
+}
+
+int main (void)
+{
+  unsigned int value ;
+
+  printf ("wiringPi digitalWriteByte/digitalReadByte speed test program\n") ;
+  printf ("=============================================================\n") ;
+
+  wiringPiSetup () ;
+
+// Check the pins follow the bytes written, with nothing connected to them
+
+  for (value = 0 ; value < 256 ; ++value)
+  {
+    digitalWriteByte (value) ;
+    if (digitalReadByte () != value)
+    {
+      printf ("Wrote 0x%02X, read back 0x%02X - are pins 0-7 free?\n", value, digitalReadByte ()) ;
+      break ;
+    }
+  }
+
+  printf ("\ndigitalWriteByte: (%8d bytes)\n", COUNT) ;
+  writeTest () ;
+
+  printf ("\ndigitalReadByte: (%8d bytes)\n", COUNT) ;
+  readTest () ;
+
+  return 0 ;
+}
@@ -0,0 +1,180 @@
+/*
+ * isrLoop.c:
+ *	Measure the interrupt latency and the highest edge rate wiringPi
+ *	keeps up with, using the GPIO character device events. Connect
+ *	wiringPi pin 0 (output) to pin 1 (input).
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define	OUT_PIN		0
+#define	IN_PIN		1
+
+#define	SAMPLES		1000
+#define	EDGES		20000
+
+static volatile unsigned int edges ;
+
+static long long nowNs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec ;
+}
+
+static int compareLong (const void *a, const void *b)
+{
+  long long x = *(const long long *)a ;
+  long long y = *(const long long *)b ;
+
+  return (x < y) ? -1 : (x > y) ;
+}
+
+static void countEdges (const struct wpiEvent *events, int count)
+{
+  edges += count ;
+}
+
+static void drain (void)
+{
+  struct wpiEvent events [64] ;
+
+  while (wiringPiEventRead (events, 64, 0) > 0)
+    ;
+}
+
+
+/*
+ * latencyTest:
+ *	From the write to the kernel's timestamp, and from that to the
+ *	edge coming out of wiringPiEventRead.
+ *********************************************************************************
+ */
+
+static void latencyTest (wpiPinHandle out)
+{
+  static long long kernel [SAMPLES], user [SAMPLES] ;
+  struct wpiEvent event ;
+  long long start ;
+  int i, n = 0 ;
+
+  for (i = 0 ; i < SAMPLES ; ++i)
+  {
+    drain () ;
+    start = nowNs () ;
+    wpiPinToggle (out) ;
+    if (wiringPiEventRead (&event, 1, 100) != 1)
+      continue ;
+    user   [n] = nowNs () - event.timestamp ;
+    kernel [n] = event.timestamp - start ;
+    ++n ;
+    delay (1) ;
+  }
+
+  if (n == 0)
+  {
+    printf ("No edges - is pin %d connected to pin %d?\n", OUT_PIN, IN_PIN) ;
+    exit (1) ;
+  }
+
+  qsort (kernel, n, sizeof (long long), compareLong) ;
+  qsort (user,   n, sizeof (long long), compareLong) ;
+
+  printf ("Latency over %d edges (uS):   median      99%%      max\n", n) ;
+  printf ("  write to kernel timestamp %8lld %8lld %8lld\n",
+	kernel [n / 2] / 1000, kernel [n - 1 - n / 100] / 1000, kernel [n - 1] / 1000) ;
+  printf ("  timestamp to read         %8lld %8lld %8lld\n",
+	user [n / 2] / 1000, user [n - 1 - n / 100] / 1000, user [n - 1] / 1000) ;
+}
+
+
+/*
+ * rateTest:
+ *	Toggle at a fixed rate and count the edges that arrive.
+ *********************************************************************************
+ */
+
+static int rateTest (wpiPinHandle out, int interval)
+{
+  struct wpiEventStats before, after ;
+  unsigned int start ;
+  long long next ;
+  int i ;
+
+  wiringPiEventStats (&before) ;
+  start = edges ;
+
+  next = nowNs () ;
+  for (i = 0 ; i < EDGES ; ++i)
+  {
+    next += interval * 1000LL ;
+    while (nowNs () < next)
+      ;
+    wpiPinToggle (out) ;
+  }
+  delay (100) ;
+  drain () ;
+
+  wiringPiEventStats (&after) ;
+  printf ("%8d %10d %8d %10llu %8llu\n", interval, 1000000 / interval, (int)(edges - start),
+	after.kernelLost - before.kernelLost, after.batches - before.batches) ;
+
+  return (int)(edges - start) == EDGES ;
+}
+
+
+int main (void)
+{
+  static const int intervals [] = { 1000, 500, 200, 100, 50, 20, 10, 5, 2, 1, 0 } ;
+  wpiPinHandle out ;
+  int i, best = 0 ;
+
+  printf ("wiringPi interrupt loopback test program\n") ;
+  printf ("========================================\n\n") ;
+
+  wiringPiSetup () ;
+  pinMode (OUT_PIN, OUTPUT) ;
+  digitalWrite (OUT_PIN, LOW) ;
+  out = wpiGetPin (OUT_PIN) ;
+
+  wiringPiISREvents  (IN_PIN, INT_EDGE_BOTH, countEdges) ;
+  wiringPiEventQueue (IN_PIN, INT_EDGE_BOTH) ;
+
+  latencyTest (out) ;
+
+  printf ("\nEdge rate, %d edges each:\n", EDGES) ;
+  printf ("interval    edges/s      got kernelLost  batches\n") ;
+  for (i = 0 ; intervals [i] != 0 ; ++i)
+  {
+    if (!rateTest (out, intervals [i]))
+      break ;
+    best = 1000000 / intervals [i] ;
+  }
+  printf ("\nHighest rate without a lost edge: %d edges/s\n", best) ;
+
+  return 0 ;
+}
@@ -0,0 +1,159 @@
+/*
+ * softJitter.c:
+ *	Measure the CPU usage and the jitter of the software PWM for 1, 8
+ *	and 32 channels. The channels drive the pins of a dummy node which
+ *	timestamps every rising edge, so nothing needs to be connected.
+ *	Run it as root, so the timing thread gets its real-time priority.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <softPwm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define	PIN_BASE	100
+#define	MAX_CHANNELS	32
+#define	RANGE		100		// 100 x 100uS: 10mS, 100Hz
+#define	PERIOD		10000
+#define	RUN_TIME	5		// Seconds
+#define	MAX_PERIODS	(RUN_TIME * 100 + 100)
+
+static long long lastRise [MAX_CHANNELS] ;
+static int       devs     [MAX_CHANNELS][MAX_PERIODS] ;
+static int       periods  [MAX_CHANNELS] ;
+static int       levels   [MAX_CHANNELS] ;
+static int       allDevs  [MAX_CHANNELS * MAX_PERIODS] ;
+
+static long long nowUs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 ;
+}
+
+static double cpuTime (void)
+{
+  struct rusage usage ;
+
+  getrusage (RUSAGE_SELF, &usage) ;
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	 usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6 ;
+}
+
+
+/*
+ * jitterWrite:
+ *	The digitalWrite of the dummy node: how far the rising edges are
+ *	from one period apart.
+ *********************************************************************************
+ */
+
+static void jitterWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  int channel = pin - node->pinBase ;
+  long long now, dev ;
+
+  if ((value == HIGH) && (levels [channel] == LOW))
+  {
+    now = nowUs () ;
+    if (lastRise [channel] != 0)
+    {
+      dev = now - lastRise [channel] - PERIOD ;
+      if (dev < 0)
+	dev = -dev ;
+      if (periods [channel] < MAX_PERIODS)
+	devs [channel][periods [channel]++] = (int)dev ;
+    }
+    lastRise [channel] = now ;
+  }
+  levels [channel] = value ;
+}
+
+static int compareInt (const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b ;
+}
+
+static void jitterTest (int base, int channels)
+{
+  struct wiringPiNodeStruct *node ;
+  double cpu, wall ;
+  int i, j, n ;
+
+  node = wiringPiNewNode (base, channels) ;
+  node->digitalWrite = jitterWrite ;
+
+  for (i = 0 ; i < channels ; ++i)
+  {
+    lastRise [i] = 0 ;
+    periods  [i] = levels [i] = 0 ;
+  }
+
+  cpu  = cpuTime () ;
+  wall = nowUs () ;
+  for (i = 0 ; i < channels ; ++i)
+    softPwmCreate (base + i, 10 + (i * 80) / channels, RANGE) ;
+
+  delay (RUN_TIME * 1000) ;
+
+  for (i = 0 ; i < channels ; ++i)
+    softPwmStop (base + i) ;
+  cpu  = cpuTime () - cpu ;
+  wall = (nowUs () - wall) / 1e6 ;
+
+  n = 0 ;
+  for (i = 0 ; i < channels ; ++i)
+    for (j = 0 ; j < periods [i] ; ++j)
+      allDevs [n++] = devs [i][j] ;
+  if (n == 0)
+  {
+    printf ("%8d: no output\n", channels) ;
+    return ;
+  }
+  qsort (allDevs, n, sizeof (int), compareInt) ;
+
+  printf ("%8d %9.1f%% %8d %8d %8d %9d\n", channels, cpu / wall * 100.0,
+	allDevs [n / 2], allDevs [n - 1 - n / 100], allDevs [n - 1], n) ;
+}
+
+
+int main (void)
+{
+  int base = PIN_BASE ;
+
+  printf ("wiringPi softPwm jitter test program\n") ;
+  printf ("====================================\n\n") ;
+  printf ("%d Hz, %d seconds per run\n\n", 1000000 / PERIOD, RUN_TIME) ;
+  printf ("                      jitter of the period (uS)\n") ;
+  printf ("channels  CPU used   median      99%%      max   periods\n") ;
+
+  jitterTest (base, 1) ;  base += MAX_CHANNELS ;
+  jitterTest (base, 8) ;  base += MAX_CHANNELS ;
+  jitterTest (base, 32) ;
+
+  return 0 ;
+}
@@ -33,9 +33,18 @@
 #define	SLOW_COUNT	 1000000
 #define	PASSES		       5
 
+static void report (int maxCount, int sum)
+{
+  int perSec ;
+
+  printf (". Av: %6dmS", sum / PASSES) ;
+  perSec = (int)(double)maxCount / (double)((double)sum / (double)PASSES) * 1000.0 ;
+  printf (": %9d toggles/sec\n", perSec) ;
+}
+
 void speedTest (int pin, int maxCount)
 {
-  int count, sum, perSec, i ;
+  int count, sum, i ;
   unsigned int start, end ;
 
   sum = 0 ;
@@ -44,7 +53,7 @@ void speedTest (int pin, int maxCount)
   {
     start = millis () ;
     for (count = 0 ; count < maxCount ; ++count)
-      digitalWrite (pin, 1) ;
+      digitalWrite (pin, count & 1) ;
     end = millis () ;
     printf (" %6d", end - start) ;
     fflush (stdout) ;
@@ -52,9 +61,39 @@ void speedTest (int pin, int maxCount)
   }
 
   digitalWrite (pin, 0) ;
-  printf (". Av: %6dmS", sum / PASSES) ;
-  perSec = (int)(double)maxCount / (double)((double)sum / (double)PASSES) * 1000.0 ;
-  printf (": %7d/sec\n", perSec) ;
+  report (maxCount, sum) ;
+}
+
+// The same with a pin handle: wpiGetPin once, then inline toggles
+
+void handleTest (int pin, int maxCount)
+{
+  wpiPinHandle h ;
+  int count, sum, i ;
+  unsigned int start, end ;
+
+  h = wpiGetPin (pin) ;
+  if (h.dat == NULL)
+  {
+    printf (" no pin handle for pin %d\n", pin) ;
+    return ;
+  }
+
+  sum = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < maxCount ; ++count)
+      wpiPinToggle (h) ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  wpiPinClear (h) ;
+  report (maxCount, sum) ;
 }
 
 
@@ -70,6 +109,9 @@ int main (void)
   pinMode (7, OUTPUT) ;
   speedTest (7, FAST_COUNT) ;
 
+  printf ("\nPin handle method: (%8d iterations)\n", FAST_COUNT) ;
+  handleTest (7, FAST_COUNT) ;
+
 // GPIO
 
   printf ("\nNative GPIO method: (%8d iterations)\n", FAST_COUNT) ;
@@ -23,10 +23,15 @@
  */
 
 #include <stdio.h>
-#include <pthread.h>
 
 #include "wiringPi.h"
 #include "softPwm.h"
+#include "softSched.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
 
 // MAX_PINS:
 //	This is more than the number of Pi pins because we can actually softPwm
@@ -42,9 +47,12 @@
 //	which is a frequency of 100Hz.
 //
 //	It's possible to get a higher frequency by lowering the pulse time,
-//	however CPU uage will skyrocket as wiringPi uses a hard-loop to time
-//	periods under 100µS - this is because the Linux timer calls are just
-//	accurate at all, and have an overhead.
+//	however CPU uage will go up as the one thread timing all the soft
+//	outputs (softSched.c) wakes up for every edge. It doesn't spin for
+//	softPwm edges, so they are as late as the wake up from a sleep - tens
+//	of µS, more on a loaded system - which an LED doesn't show; spinning
+//	for them took several times the CPU of the old thread per pin.
+//	Pins with the same range switch on together, in one write.
 //
 //	Another way to increase the frequency is to reduce the range - however
 //	that reduces the overall output accuracy...
@@ -53,42 +61,7 @@
 
 static int marks         [MAX_PINS] ;
 static int range         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
-
-int newPin = -1 ;
-
-
-/*
- * softPwmThread:
- *	Thread to do the actual PWM output
- *********************************************************************************
- */
-
-static PI_THREAD (softPwmThread)
-{
-  int pin, mark, space ;
-
-  pin    = newPin ;
-  newPin = -1 ;
-
-  piHiPri (50) ;
-
-  for (;;)
-  {
-    mark  = marks [pin] ;
-    space = range [pin] - mark ;
-
-    if (mark != 0)
-      digitalWrite (pin, HIGH) ;
-    delayMicroseconds (mark * 100) ;
-
-    if (space != 0)
-      digitalWrite (pin, LOW) ;
-    delayMicroseconds (space * 100) ;
-  }
-
-  return NULL ;
-}
+static int channels      [MAX_PINS] ;
 
 
 /*
@@ -107,24 +80,26 @@ void softPwmWrite (int pin, int value)
     value = range [pin] ;
 
   marks [pin] = value ;
+
+  if (range [pin] != 0)
+    softSchedSet (channels [pin], range [pin] * PULSE_TIME, value * PULSE_TIME) ;
 }
 
 
 /*
  * softPwmCreate:
- *	Create a new softPWM thread.
+ *	Create a new softPWM channel.
  *********************************************************************************
  */
 
 int softPwmCreate (int pin, int initialValue, int pwmRange)
 {
-  int res ;
-  pthread_t myThread ;
+  int channel ;
 
   if (range [pin] != 0)	// Already running on this pin
     return -1 ;
 
-  if (range <= 0)
+  if (pwmRange <= 0)
     return -1 ;
 
   pinMode      (pin, OUTPUT) ;
@@ -133,21 +108,22 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
   marks [pin] = initialValue ;
   range [pin] = pwmRange ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softPwmThread, NULL) ;
-
-  while (newPin != -1)
-    delay (1) ;
+  channel = softSchedAdd (pin, pwmRange * PULSE_TIME, initialValue * PULSE_TIME, FALSE) ;
+  if (channel < 0)
+  {
+    range [pin] = 0 ;
+    return -1 ;
+  }
 
-  threads [pin] = myThread ;
+  channels [pin] = channel ;
 
-  return res ;
+  return 0 ;
 }
 
 
 /*
  * softPwmStop:
- *	Stop an existing softPWM thread
+ *	Stop an existing softPWM channel
  *********************************************************************************
  */
 
@@ -155,9 +131,8 @@ void softPwmStop (int pin)
 {
   if (range [pin] != 0)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
+    softSchedRemove (channels [pin]) ;
     range [pin] = 0 ;
     digitalWrite (pin, LOW) ;
-}
+  }
 }
@@ -0,0 +1,464 @@
+/*
+ * softSched.c:
+ *	The one thread that times the softPwm, softServo and softTone
+ *	outputs.
+ *	Copyright (c) 2012 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "softSched.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
+
+// Every output is a channel: a pin going HIGH at the start of each period
+//	and LOW again after the mark. The next edges of all the channels are
+//	kept in a heap, and one thread sleeps until the earliest, then writes
+//	all the edges that are due together - with one write per GPIO bank for
+//	the on-board pins. For a precise channel it wakes a little early and
+//	spins for the rest of the way.
+//
+//	Periods start on a grid from the time the first channel was added, so
+//	channels of the same period - a row of LEDs, the servos - switch on in
+//	the same write.
+
+#define	MAX_CHANNELS	128
+
+// SPIN_TIME:
+//	The wake up from a sleep is late by tens of uS, so before the edge of
+//	a precise channel the thread sleeps until a little before it and spins
+//	for the rest. It starts with this, and follows how late the wake ups
+//	are, between MIN_SPIN and MAX_SPIN. Spinning costs CPU for every edge,
+//	so channels without a tight timing just take the late wake up.
+// GROUP_TIME:
+//	Edges this close to the one being written go out in the same write.
+// IDLE_TIME:
+//	How often a channel with a period of 0 is looked at.
+// MAX_SLEEP:
+//	The longest sleep, so a new channel doesn't wait for a long period.
+
+#define	SPIN_TIME	  20000LL		// nS
+#define	MIN_SPIN	  10000LL
+#define	MAX_SPIN	  50000LL
+#define	GROUP_TIME	   5000LL
+#define	IDLE_TIME	1000000LL
+#define	MAX_SLEEP	10000000LL
+
+struct softChannel
+{
+  int          pin ;
+  int          used ;
+  wpiPinHandle handle ;		// dat is NULL: use digitalWrite
+  long long    period ;		// nS
+  long long    mark ;
+  long long    when ;		// The next edge
+  long long    periodEnd ;
+  int          inMark ;		// The next edge ends the mark
+  int          level ;		// -1: not written yet
+  int          precise ;	// Spin up to the edge
+  int          slot ;		// In the heap
+} ;
+
+struct softPort
+{
+  wpiPinHandle handle ;
+  unsigned int mask ;
+  unsigned int value ;
+} ;
+
+static struct softChannel channels [MAX_CHANNELS] ;
+
+static int heap [MAX_CHANNELS] ;	// Channels by their next edge
+static int heapSize ;
+
+static long long epoch ;
+static int       running = FALSE ;
+
+static pthread_mutex_t schedLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  schedCond = PTHREAD_COND_INITIALIZER ;
+
+
+static long long nowNs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec ;
+}
+
+
+/*
+ * firstEdge:
+ *	The next start of a period on the grid of the period.
+ *********************************************************************************
+ */
+
+static long long firstEdge (long long period, long long now)
+{
+  if (period == 0)
+    return now ;
+
+  return epoch + ((now - epoch) / period + 1) * period ;
+}
+
+
+/*
+ * heapUp: heapDown: heapFix:
+ *	Keep the heap in order after the edge of the channel in slot i moved.
+ *********************************************************************************
+ */
+
+static void heapSwap (int i, int j)
+{
+  int tmp ;
+
+  tmp = heap [i] ; heap [i] = heap [j] ; heap [j] = tmp ;
+  channels [heap [i]].slot = i ;
+  channels [heap [j]].slot = j ;
+}
+
+static int heapUp (int i)
+{
+  while ((i > 0) && (channels [heap [i]].when < channels [heap [(i - 1) / 2]].when))
+  {
+    heapSwap (i, (i - 1) / 2) ;
+    i = (i - 1) / 2 ;
+  }
+  return i ;
+}
+
+static void heapDown (int i)
+{
+  int child ;
+
+  for (;;)
+  {
+    child = 2 * i + 1 ;
+    if (child >= heapSize)
+      return ;
+    if ((child + 1 < heapSize) && (channels [heap [child + 1]].when < channels [heap [child]].when))
+      ++child ;
+    if (channels [heap [child]].when >= channels [heap [i]].when)
+      return ;
+    heapSwap (i, child) ;
+    i = child ;
+  }
+}
+
+static void heapFix (int i)
+{
+  heapDown (heapUp (i)) ;
+}
+
+
+/*
+ * channelEdge:
+ *	Move a channel over its due edge, returning the level to write.
+ *********************************************************************************
+ */
+
+static int channelEdge (struct softChannel *c, long long now)
+{
+  long long start ;
+
+  if (c->inMark)
+  {
+    c->inMark = FALSE ;
+    c->when   = c->periodEnd ;
+    return LOW ;
+  }
+
+  if (c->period == 0)
+  {
+    c->when = now + IDLE_TIME ;
+    return LOW ;
+  }
+
+// Skip the periods missed, if any
+
+  start = c->when ;
+  if (now - start >= c->period)
+    start += ((now - start) / c->period) * c->period ;
+  c->periodEnd = start + c->period ;
+
+  if (c->mark == 0)
+  {
+    c->when = c->periodEnd ;
+    return LOW ;
+  }
+  if (c->mark >= c->period)
+  {
+    c->when = c->periodEnd ;
+    return HIGH ;
+  }
+
+  c->inMark = TRUE ;
+  c->when   = start + c->mark ;
+  return HIGH ;
+}
+
+
+/*
+ * channelOutput:
+ *	Add the level of a channel to the write of its bank, or write it
+ *	now for pins without a handle.
+ *********************************************************************************
+ */
+
+static void channelOutput (struct softChannel *c, int level, struct softPort *ports, int *nPorts)
+{
+  int port ;
+
+  if (level == c->level)
+    return ;
+  c->level = level ;
+
+  if (c->handle.dat == NULL)
+  {
+    digitalWrite (c->pin, level) ;
+    return ;
+  }
+
+  for (port = 0 ; port < *nPorts ; ++port)
+    if (ports [port].handle.dat == c->handle.dat)
+      break ;
+  if (port == *nPorts)
+  {
+    ports [port].handle = c->handle ;
+    ports [port].mask   = 0 ;
+    ports [port].value  = 0 ;
+    ++*nPorts ;
+  }
+
+  ports [port].mask |= c->handle.mask ;
+  if (level == HIGH)
+    ports [port].value |=  c->handle.mask ;
+  else
+    ports [port].value &= ~c->handle.mask ;
+}
+
+
+/*
+ * softSchedThread:
+ *	Thread to do the actual output of all the channels
+ *********************************************************************************
+ */
+
+static PI_THREAD (softSchedThread)
+{
+  struct softPort ports [MAX_CHANNELS] ;
+  struct timespec ts ;
+  long long next, now, wake, late, early ;
+  long long spin = SPIN_TIME ;
+  int channel, nPorts, port ;
+
+  piHiPri (50) ;
+
+  pthread_mutex_lock (&schedLock) ;
+  for (;;)
+  {
+    if (heapSize == 0)
+    {
+      pthread_cond_wait (&schedCond, &schedLock) ;
+      continue ;
+    }
+    next  = channels [heap [0]].when ;
+    early = channels [heap [0]].precise ? spin : 0 ;
+    pthread_mutex_unlock (&schedLock) ;
+
+// Sleep until the edge, or just before it for a precise channel - then
+//	look again, a new channel may have an earlier one - and spin for the
+//	rest
+
+    now = nowNs () ;
+    if (next - now > early)
+    {
+      wake = next - early ;
+      if (wake - now > MAX_SLEEP)
+	wake = now + MAX_SLEEP ;
+      ts.tv_sec  = wake / 1000000000LL ;
+      ts.tv_nsec = wake % 1000000000LL ;
+      clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ;
+
+// Spin at least as long as the worst recent wake up, dropping slowly
+
+      late = nowNs () - wake ;
+      if (late > spin)
+	spin = late ;
+      else
+	spin -= (spin - late) / 64 ;
+      if (spin < MIN_SPIN)
+	spin = MIN_SPIN ;
+      else if (spin > MAX_SPIN)
+	spin = MAX_SPIN ;
+
+      pthread_mutex_lock (&schedLock) ;
+      continue ;
+    }
+    while (now < next)
+      now = nowNs () ;
+
+    pthread_mutex_lock (&schedLock) ;
+    nPorts = 0 ;
+    while ((heapSize > 0) && (channels [heap [0]].when <= now + GROUP_TIME))
+    {
+      channel = heap [0] ;
+      channelOutput (&channels [channel], channelEdge (&channels [channel], now), ports, &nPorts) ;
+      heapDown (0) ;
+    }
+    for (port = 0 ; port < nPorts ; ++port)
+      wpiPortWrite (ports [port].handle, ports [port].mask, ports [port].value) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * softSchedAdd:
+ *	Start a new channel, starting the thread with the first one.
+ *	A precise channel has the thread spin before its edges.
+ *	Returns the channel or -1.
+ *********************************************************************************
+ */
+
+int softSchedAdd (int pin, unsigned int period, unsigned int mark, int precise)
+{
+  struct softChannel *c ;
+  pthread_t myThread ;
+  int channel ;
+
+  pthread_mutex_lock (&schedLock) ;
+
+  for (channel = 0 ; channel < MAX_CHANNELS ; ++channel)
+    if (!channels [channel].used)
+      break ;
+  if (channel == MAX_CHANNELS)
+  {
+    pthread_mutex_unlock (&schedLock) ;
+    return -1 ;
+  }
+
+  if (!running)
+  {
+    epoch = nowNs () ;
+    if (pthread_create (&myThread, NULL, softSchedThread, NULL) != 0)
+    {
+      pthread_mutex_unlock (&schedLock) ;
+      return -1 ;
+    }
+    running = TRUE ;
+  }
+
+  c = &channels [channel] ;
+  c->pin    = pin ;
+  c->used   = TRUE ;
+  c->handle = wpiGetPin (pin) ;
+  c->period = period * 1000LL ;
+  c->mark   = mark   * 1000LL ;
+  c->inMark = FALSE ;
+  c->level  = -1 ;
+  c->precise = precise ;
+  c->when   = firstEdge (c->period, nowNs ()) ;
+
+  c->slot = heapSize ;
+  heap [heapSize++] = channel ;
+  heapUp (c->slot) ;
+
+  pthread_cond_signal   (&schedCond) ;
+  pthread_mutex_unlock (&schedLock) ;
+
+  return channel ;
+}
+
+
+/*
+ * softSchedSet:
+ *	Change the period and mark of a channel. The mark takes effect
+ *	with the next period, a new period starts on its own grid.
+ *********************************************************************************
+ */
+
+void softSchedSet (int channel, unsigned int period, unsigned int mark)
+{
+  struct softChannel *c ;
+  long long newPeriod = period * 1000LL ;
+
+  if ((channel < 0) || (channel >= MAX_CHANNELS))
+    return ;
+  c = &channels [channel] ;
+
+  pthread_mutex_lock (&schedLock) ;
+  if (c->used)
+  {
+    if (newPeriod != c->period)
+    {
+      c->period = newPeriod ;
+      if (c->inMark)
+	c->periodEnd = firstEdge (newPeriod, nowNs ()) ;
+      else
+      {
+	c->when = firstEdge (newPeriod, nowNs ()) ;
+	heapFix (c->slot) ;
+      }
+    }
+    c->mark = mark * 1000LL ;
+  }
+  pthread_mutex_unlock (&schedLock) ;
+}
+
+
+/*
+ * softSchedRemove:
+ *	Stop a channel. The pin is left as it is.
+ *********************************************************************************
+ */
+
+void softSchedRemove (int channel)
+{
+  struct softChannel *c ;
+  int slot ;
+
+  if ((channel < 0) || (channel >= MAX_CHANNELS))
+    return ;
+  c = &channels [channel] ;
+
+  pthread_mutex_lock (&schedLock) ;
+  if (c->used)
+  {
+    slot = c->slot ;
+    --heapSize ;
+    if (slot < heapSize)
+    {
+      heap [slot] = heap [heapSize] ;
+      channels [heap [slot]].slot = slot ;
+      heapFix (slot) ;
+    }
+    c->used = FALSE ;
+  }
+  pthread_mutex_unlock (&schedLock) ;
+}
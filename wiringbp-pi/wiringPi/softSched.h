@@ -0,0 +1,40 @@
+/*
+ * softSched.h:
+ *	The one thread that times the softPwm, softServo and softTone
+ *	outputs.
+ *	Copyright (c) 2012 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A channel is a pin going HIGH at the start of every period for mark
+//	uS. A period of 0 keeps the pin LOW. The edges of a precise channel
+//	are spun for, the others come as late as the thread wakes up.
+
+extern int  softSchedAdd    (int pin, unsigned int period, unsigned int mark, int precise) ;
+extern void softSchedSet    (int channel, unsigned int period, unsigned int mark) ;
+extern void softSchedRemove (int channel) ;
+
+#ifdef __cplusplus
+}
+#endif
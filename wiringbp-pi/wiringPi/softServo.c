@@ -24,13 +24,15 @@
  */
 
 //#include <stdio.h>
-#include <string.h>
-#include <time.h>
-#include <sys/time.h>
-#include <pthread.h>
 
 #include "wiringPi.h"
 #include "softServo.h"
+#include "softSched.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
 
 // RC Servo motors are a bit of an oddity - designed in the days when 
 //	radio control was experimental and people were tryin to make
@@ -63,94 +65,19 @@
 //
 //	If you want servo control for the Pi, then use the servoblaster kernel
 //	module.
+//
+// The pulses are timed by the thread of the soft outputs (softSched.c): all
+//	the servos go HIGH together at the start of each 20mS frame and LOW
+//	again after their pulse width. The pulse width is the position, so the
+//	servos are precise channels and the thread spins before their edges.
 
 #define	MAX_SERVOS	8
 
+#define	SERVO_FRAME	20000	// microseconds
+
 static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
 static int pulseWidth [MAX_SERVOS] ;	// microseconds
-
-
-/*
- * softServoThread:
- *	Thread to do the actual Servo PWM output
- *********************************************************************************
- */
-
-static PI_THREAD (softServoThread)
-{
-  register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
-
-  int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
-
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
-
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
-
-  piHiPri (50) ;
-
-  for (;;)
-  {
-    gettimeofday (&tStart, NULL) ;
-
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
-
-// Sort the delays (& pins), shortest first
-
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
-	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
-	}
-
-// All on
-
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
-    }
-
-// Now loop, turning them all off as required
-
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
-    }
-
-// Wait until the end of an 8mS time-slot
-
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
-  }
-
-  return NULL ;
-}
+static int channels   [MAX_SERVOS] ;
 
 
 /*
@@ -172,7 +99,10 @@ void softServoWrite (int servoPin, int value)
 
   for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
     if (pinMap [servo] == servoPin)
+    {
       pulseWidth [servo] = value + 1000 ; // uS
+      softSchedSet (channels [servo], SERVO_FRAME, pulseWidth [servo]) ;
+    }
 }
 
 
@@ -205,7 +135,14 @@ int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int
   pinMap [7] = p7 ;
 
   for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
     pulseWidth [servo] = 1500 ;		// Mid point
-  
-  return piThreadCreate (softServoThread) ;
+    channels   [servo] = -1 ;
+    if (pinMap [servo] == -1)
+      continue ;
+    if ((channels [servo] = softSchedAdd (pinMap [servo], SERVO_FRAME, pulseWidth [servo], TRUE)) < 0)
+      return -1 ;
+  }
+
+  return 0 ;
 }
@@ -27,54 +27,21 @@
  */
 
 #include <stdio.h>
-#include <pthread.h>
 
 #include "wiringPi.h"
 #include "softTone.h"
+#include "softSched.h"
 
-#define	MAX_PINS	64
-
-#define	PULSE_TIME	100
-
-static int freqs [MAX_PINS] ;
-
-static int newPin = -1 ;
-
-
-/*
- * softToneThread:
- *	Thread to do the actual PWM output
- *********************************************************************************
- */
-
-static PI_THREAD (softToneThread)
-{
-  int pin, freq, halfPeriod ;
-
-  pin    = newPin ;
-  newPin = -1 ;
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
 
-  piHiPri (50) ;
-
-  for (;;)
-  {
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
-    {
-      halfPeriod = 500000 / freq ;
-
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
-
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
-    }
-  }
+#define	MAX_PINS	64
 
-  return NULL ;
-}
+static int freqs    [MAX_PINS] ;
+static int channels [MAX_PINS] ;
+static int running  [MAX_PINS] ;
 
 
 /*
@@ -85,6 +52,8 @@ static PI_THREAD (softToneThread)
 
 void softToneWrite (int pin, int freq)
 {
+  int halfPeriod ;
+
   pin &= 63 ;
 
   /**/ if (freq < 0)
@@ -93,29 +62,41 @@ void softToneWrite (int pin, int freq)
     freq = 5000 ;
 
   freqs [pin] = freq ;
+
+  if (running [pin])
+  {
+    halfPeriod = (freq == 0) ? 0 : 500000 / freq ;
+    softSchedSet (channels [pin], halfPeriod * 2, halfPeriod) ;
+  }
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Create a new tone channel.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
+  int channel, index = pin & 63 ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  freqs [pin] = 0 ;
+  freqs [index] = 0 ;
+
+  if (running [index])	// Already running on this pin, silence it
+  {
+    softSchedSet (channels [index], 0, 0) ;
+    return 0 ;
+  }
 
-  newPin = pin ;
-  res = piThreadCreate (softToneThread) ;
+  if ((channel = softSchedAdd (pin, 0, 0, FALSE)) < 0)
+    return -1 ;
 
-  while (newPin != -1)
-    delay (1) ;
+  channels [index] = channel ;
+  running  [index] = TRUE ;
 
-  return res ;
+  return 0 ;
 }
@@ -71,9 +71,23 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#if defined (__has_include)
+#  if __has_include (<linux/gpio.h>)
+#    include <linux/gpio.h>
+#  endif
+#endif
 
 #include "wiringPi.h"
 
+// The GPIO character device line API v2 (Linux 5.10 on) for wiringPiISR
+
+#ifdef	GPIO_V2_GET_LINE_IOCTL
+#  define	WPI_GPIO_CDEV
+#endif
+
 
 #ifndef	TRUE
 #define	TRUE	(1==1)
@@ -84,6 +98,7 @@
 
 #define	ENV_DEBUG	"WIRINGPI_DEBUG"
 #define	ENV_CODES	"WIRINGPI_CODES"
+#define	ENV_GPIOCHIP	"WIRINGPI_GPIOCHIP"
 
 
 // Mask for the bottom 64 pins which belong to the Banana Pi
@@ -1871,6 +1886,73 @@ void digitalWrite (int pin, int value)
 		  }
 	 }
 }
+/*
+ * wpiGetPin:
+ *	Look an on-board pin up once for the inline wpiPin* functions: the
+ *	mapped register of its bank and its bit. The handle stays valid
+ *	until the mode is changed by another wiringPiSetup* call.
+ *	sunxi_dataReg is the mapped data register of the bank of an A20 pin.
+ *********************************************************************************
+ */
+
+static volatile uint32_t *sunxi_dataReg (int pin)
+{
+  return gpio + (((SUNXI_GPIO_BASE + ((pin >> 5) * 36) + 0x10) & MAP_MASK) >> 2) ;
+}
+
+wpiPinHandle wpiGetPin (int pin)
+{
+  wpiPinHandle h = { NULL, NULL, NULL, 0 } ;
+  int bank ;
+
+  if (((pin & PI_GPIO_MASK) != 0) || (gpio == NULL))
+    return h ;
+
+  if (version == 3)
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio_BP [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio_BP [pin] ;
+    else if (wiringPiMode == WPI_MODE_GPIO)
+      pin = pinTobcm_BP [pin] ;
+    else
+      return h ;
+
+    if (pin == -1)
+      return h ;
+    bank = pin >> 5 ;
+    if (BP_PIN_MASK [bank][pin & 31] == -1)
+      return h ;
+
+    h.dat  = sunxi_dataReg (pin) ;
+    h.mask = 1 << (pin & 31) ;
+  }
+  else
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return h ;
+
+    if (pin == -1)
+      return h ;
+
+    h.dat  = gpio + gpioToGPLEV [pin] ;
+    h.set  = gpio + gpioToGPSET [pin] ;
+    h.clr  = gpio + gpioToGPCLR [pin] ;
+    h.mask = 1 << (pin & 31) ;
+  }
+
+  if (wiringPiDebug)
+    printf ("wpiGetPin: register %p mask 0x%08X\n", (void *)h.dat, h.mask) ;
+
+  return h ;
+}
+
+
 /*
  * pwmWrite:
  *	Set an output PWM value
@@ -1998,53 +2080,95 @@ void analogWrite (int pin, int value)
  *	However it still needs 2 operations to set the bits, so any external
  *	hardware must not rely on seeing a change as there will be a change 
  *	to set the outputs bits to zero, then another change to set the 1's
+ *	On the A20 it is one read-modify-write of each bank the pins are in.
  *********************************************************************************
  */
-static int head2win[8]={11,12,13,15,16,18,22,7};
+// The 8 pins of digitalWriteByte/digitalReadByte on the A20:
+//	They are wiringPi pins 0-7 in every mode, spread over the PH and PI
+//	banks. bytePortSetup works out once per mode the banks, their data
+//	registers and, for every byte value, the bits of each bank. The pins
+//	are made outputs by the first digitalWriteByte of the mode.
+
+#define	BYTE_BANKS	8
+
+static int byteMode = WPI_MODE_UNINITIALISED ;
+static int byteOutputs ;
+static int byteBanks ;
+
+static volatile uint32_t *byteReg   [BYTE_BANKS] ;
+static uint32_t           byteMask  [BYTE_BANKS] ;
+static uint32_t           byteBits  [BYTE_BANKS][256] ;
+static int                byteBank  [8] ;
+static int                byteShift [8] ;
+
+static void bytePortSetup (void)
+{
+  volatile uint32_t *reg ;
+  int bit, bank, pin, value ;
+
+  byteBanks = 0 ;
+  memset (byteBits, 0, sizeof (byteBits)) ;
+
+  for (bit = 0 ; bit < 8 ; ++bit)
+  {
+    pin = pinToGpio_BP [bit] ;
+    reg = sunxi_dataReg (pin) ;
+
+    for (bank = 0 ; (bank < byteBanks) && (byteReg [bank] != reg) ; ++bank)
+      ;
+    if (bank == byteBanks)
+    {
+      byteReg  [bank] = reg ;
+      byteMask [bank] = 0 ;
+      ++byteBanks ;
+    }
+
+    byteBank  [bit]   = bank ;
+    byteShift [bit]   = pin & 31 ;
+    byteMask  [bank] |= 1 << (pin & 31) ;
+    for (value = 0 ; value < 256 ; ++value)
+      if ((value & (1 << bit)) != 0)
+	byteBits [bank][value] |= 1 << (pin & 31) ;
+  }
+
+  byteMode    = wiringPiMode ;
+  byteOutputs = FALSE ;
+}
+
 void digitalWriteByte (int value)
 {
   uint32_t pinSet = 0 ;
   uint32_t pinClr = 0 ;
   int mask = 1 ;
-  int pin ;
+  int pin, bank ;
 	if(version==3)
 	{
-		
-		if (wiringPiMode == WPI_MODE_GPIO_SYS||wiringPiMode == WPI_MODE_GPIO)
+		if (wiringPiMode == WPI_MODE_GPIO_SYS)
 		{
-			
 			for (pin = 0 ; pin < 8 ; ++pin)
 			{
-				
-				pinMode(pin,OUTPUT);
-				delay(1);
 			  digitalWrite (pinToGpio [pin], value & mask) ;
 			  mask <<= 1 ;
 			}
-			
-		}
-		else if(wiringPiMode == WPI_MODE_PINS)
-		{
-			
-			for (pin = 0 ; pin < 8 ; ++pin)
-			{
-				
-				pinMode(pin,OUTPUT);
-				delay(1);
-			  digitalWrite (pin, value & mask) ;
-			  mask <<= 1 ;
-			}
+			return ;
 		}
-		else
+		if ((wiringPiMode != WPI_MODE_PINS) && (wiringPiMode != WPI_MODE_PHYS) && (wiringPiMode != WPI_MODE_GPIO))
+			return ;
+
+		if (byteMode != wiringPiMode)
+			bytePortSetup () ;
+		if (!byteOutputs)
 		{
 			for (pin = 0 ; pin < 8 ; ++pin)
-			{
-				pinMode(head2win[pin],OUTPUT);
-				delay(1);
-			  digitalWrite (head2win[pin], value & mask) ;
-			  mask <<= 1 ;
-			}
+			  sunxi_set_gpio_mode (pinToGpio_BP [pin], OUTPUT) ;
+			byteOutputs = TRUE ;
 		}
+
+// One read-modify-write per bank
+
+		value &= 0xFF ;
+		for (bank = 0 ; bank < byteBanks ; ++bank)
+		  *byteReg [bank] = (*byteReg [bank] & ~byteMask [bank]) | byteBits [bank][value] ;
 		return ;
 	}
 	else
@@ -2053,7 +2177,7 @@ void digitalWriteByte (int value)
 	  {
 		for (pin = 0 ; pin < 8 ; ++pin)
 		{
-		  digitalWrite (pin, value & mask) ;
+		  digitalWrite (pinToGpio [pin], value & mask) ;
 		  mask <<= 1 ;
 		}
 		return ;
@@ -2075,6 +2199,61 @@ void digitalWriteByte (int value)
 	  }
   }
 }
+
+/*
+ * digitalReadByte:
+ *	Read the 8 pins of digitalWriteByte, wiringPi pin 0 is bit 0.
+ *	Each bank is read once.
+ *********************************************************************************
+ */
+
+unsigned int digitalReadByte (void)
+{
+  uint32_t reg [BYTE_BANKS] ;
+  uint32_t raw ;
+  unsigned int data = 0 ;
+  int pin, bank ;
+
+  if (version == 3)
+  {
+
+// The sys mode numbers are BCM ones on the BananaPi too, see syspin [] - and
+//	wiringPiSetupSys points pinToGpio at the BCM table
+
+    if (wiringPiMode == WPI_MODE_GPIO_SYS)
+    {
+      for (pin = 7 ; pin >= 0 ; --pin)
+	data = (data << 1) | (digitalRead (pinToGpio [pin]) & 1) ;
+      return data ;
+    }
+    if ((wiringPiMode != WPI_MODE_PINS) && (wiringPiMode != WPI_MODE_PHYS) && (wiringPiMode != WPI_MODE_GPIO))
+      return 0 ;
+
+    if (byteMode != wiringPiMode)
+      bytePortSetup () ;
+
+    for (bank = 0 ; bank < byteBanks ; ++bank)
+      reg [bank] = *byteReg [bank] ;
+    for (pin = 0 ; pin < 8 ; ++pin)
+      data |= ((reg [byteBank [pin]] >> byteShift [pin]) & 1) << pin ;
+    return data ;
+  }
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 7 ; pin >= 0 ; --pin)
+      data = (data << 1) | (digitalRead (pinToGpio [pin]) & 1) ;
+  }
+  else
+  {
+    raw = *(gpio + gpioToGPLEV [0]) ;
+    for (pin = 0 ; pin < 8 ; ++pin)
+      if ((raw & (1 << pinToGpio [pin])) != 0)
+	data |= 1 << pin ;
+  }
+  return data ;
+}
+
 /*
  * waitForInterrupt:
  *	Pi Specific.
@@ -2142,11 +2321,374 @@ static void *interruptHandler (void *arg)
 }
 
 
+#ifdef	WPI_GPIO_CDEV
+/*
+ * GPIO character device events:
+ *	Each wiringPiISR pin is a line requested from the GPIO chip with its
+ *	edge detection on. One dispatcher thread waits on all of them with
+ *	epoll, reads whatever each has buffered in one go and hands the batch
+ *	to the pin's handlers - the plain wiringPiISR function once per edge,
+ *	the wiringPiISREvents function with the whole batch, and/or the
+ *	queue of wiringPiEventRead.
+ *
+ *	The queue has one writer (the dispatcher) and one reader, so it
+ *	needs no lock: the head and tail are only written by their owner.
+ *	A reader about to sleep says so in eventWaiting and is woken with
+ *	the eventfd.
+ *********************************************************************************
+ */
+
+#define	EVENT_BATCH	64
+#define	EVENT_READY	16
+#define	EVENT_KERNEL	1024		// Edges the kernel buffers per pin
+#define	EVENT_QUEUE	4096		// Power of 2
+
+struct wpiLine
+{
+  int          used ;
+  int          fd ;
+  int          mode ;
+  int          queued ;
+  unsigned int lastSeqno ;
+  void       (*function)(void) ;
+  void       (*batchFunction)(const struct wpiEvent *events, int count) ;
+} ;
+
+static struct wpiLine eventLines [64] ;
+
+static int eventChip  = -1 ;
+static int eventEpoll = -1 ;
+static int eventFd    = -1 ;
+
+static struct wpiEvent eventQueue [EVENT_QUEUE] ;
+static unsigned int    eventHead, eventTail ;
+static int             eventWaiting ;
+
+static struct wpiEventStats eventStats ;
+
+
+/*
+ * eventLineOffset:
+ *	The line of a pin on the GPIO chip: the sunxi pin number on the A20,
+ *	the BCM GPIO on the Pi.
+ *********************************************************************************
+ */
+
+static int eventLineOffset (int pin)
+{
+  if (version == 3)
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      return pinToGpio_BP [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      return physToGpio_BP [pin] ;
+    else
+      return pinTobcm_BP [pin] ;
+  }
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    return pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    return physToGpio [pin] ;
+  else
+    return pin ;
+}
+
+static uint64_t eventEdgeFlags (int mode)
+{
+  /**/ if (mode == INT_EDGE_FALLING)
+    return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+  else if (mode == INT_EDGE_RISING)
+    return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING ;
+  else	// INT_EDGE_BOTH
+    return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+}
+
+
+/*
+ * eventPush:
+ *	Add a batch to the queue, dropping what doesn't fit.
+ *********************************************************************************
+ */
+
+static void eventPush (const struct wpiEvent *events, int count)
+{
+  unsigned int head, tail ;
+  uint64_t one = 1 ;
+  int i ;
+
+  head = eventHead ;
+  tail = __atomic_load_n (&eventTail, __ATOMIC_ACQUIRE) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (head - tail == EVENT_QUEUE)
+    {
+      __atomic_store_n (&eventStats.queueLost, eventStats.queueLost + count - i, __ATOMIC_RELAXED) ;
+      break ;
+    }
+    eventQueue [head++ & (EVENT_QUEUE - 1)] = events [i] ;
+  }
+
+  __atomic_store_n (&eventHead, head, __ATOMIC_RELEASE) ;
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (&eventWaiting, __ATOMIC_RELAXED))
+    (void)write (eventFd, &one, sizeof (one)) ;
+}
+
+
+/*
+ * eventDispatcher:
+ *	The thread reading the edges of all the pins.
+ *********************************************************************************
+ */
+
+static void *eventDispatcher (void *arg)
+{
+  struct epoll_event        ready  [EVENT_READY] ;
+  struct gpio_v2_line_event raw    [EVENT_BATCH] ;
+  struct wpiEvent           events [EVENT_BATCH] ;
+  struct wpiLine *line ;
+  void (*function)(void) ;
+  void (*batchFunction)(const struct wpiEvent *events, int count) ;
+  unsigned long long lost ;
+  int i, j, n, pin, count ;
+  ssize_t len ;
+
+  (void)piHiPri (55) ;	// Only effective if we run as root
+
+  for (;;)
+  {
+    if ((n = epoll_wait (eventEpoll, ready, EVENT_READY, -1)) < 0)
+      continue ;	// EINTR
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      pin  = ready [i].data.u32 ;
+      line = &eventLines [pin] ;
+
+      if ((len = read (line->fd, raw, sizeof (raw))) <= 0)
+	continue ;
+      count = len / sizeof (raw [0]) ;
+
+      lost = 0 ;
+      for (j = 0 ; j < count ; ++j)
+      {
+	events [j].timestamp = raw [j].timestamp_ns ;
+	events [j].pin       = pin ;
+	events [j].edge      = (raw [j].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? INT_EDGE_RISING : INT_EDGE_FALLING ;
+	events [j].seqno     = raw [j].line_seqno ;
+	if (raw [j].line_seqno - line->lastSeqno > 1)
+	  lost += raw [j].line_seqno - line->lastSeqno - 1 ;
+	line->lastSeqno = raw [j].line_seqno ;
+      }
+
+      __atomic_store_n (&eventStats.events,     eventStats.events + count,    __ATOMIC_RELAXED) ;
+      __atomic_store_n (&eventStats.batches,    eventStats.batches + 1,       __ATOMIC_RELAXED) ;
+      __atomic_store_n (&eventStats.kernelLost, eventStats.kernelLost + lost, __ATOMIC_RELAXED) ;
+
+      batchFunction = __atomic_load_n (&line->batchFunction, __ATOMIC_ACQUIRE) ;
+      function      = __atomic_load_n (&line->function,      __ATOMIC_ACQUIRE) ;
+      if (batchFunction != NULL)
+	batchFunction (events, count) ;
+      if (function != NULL)
+	for (j = 0 ; j < count ; ++j)
+	  function () ;
+      if (__atomic_load_n (&line->queued, __ATOMIC_ACQUIRE))
+	eventPush (events, count) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * eventStart:
+ *	Set up epoll and the eventfd and start the dispatcher, once.
+ *	Returns 0, or -1 when that isn't possible.
+ *********************************************************************************
+ */
+
+static int eventStart (void)
+{
+  pthread_t threadId ;
+
+  if (eventEpoll != -1)
+    return 0 ;
+
+  if ((eventFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+    return -1 ;
+
+  if ((eventEpoll = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+  {
+    close (eventFd) ;
+    eventFd = -1 ;
+    return -1 ;
+  }
+
+  if (pthread_create (&threadId, NULL, eventDispatcher, NULL) != 0)
+  {
+    close (eventEpoll) ;
+    close (eventFd) ;
+    eventEpoll = eventFd = -1 ;
+    return -1 ;
+  }
+  pthread_detach (threadId) ;
+
+  return 0 ;
+}
+
+
+/*
+ * eventHandlers:
+ *	Add the handlers of a pin, the dispatcher may be reading them.
+ *********************************************************************************
+ */
+
+static void eventHandlers (struct wpiLine *line, void (*function)(void),
+			   void (*batchFunction)(const struct wpiEvent *events, int count), int queued)
+{
+  if (function != NULL)
+    __atomic_store_n (&line->function, function, __ATOMIC_RELEASE) ;
+  if (batchFunction != NULL)
+    __atomic_store_n (&line->batchFunction, batchFunction, __ATOMIC_RELEASE) ;
+  if (queued)
+    __atomic_store_n (&line->queued, TRUE, __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * eventAddLine:
+ *	Hand the requested line of a pin to the dispatcher.
+ *********************************************************************************
+ */
+
+static int eventAddLine (int pin, int fd, int mode)
+{
+  struct epoll_event ev ;
+  struct wpiLine *line = &eventLines [pin] ;
+
+  line->fd        = fd ;
+  line->mode      = mode ;
+  line->lastSeqno = 0 ;
+  line->used      = TRUE ;
+
+  memset (&ev, 0, sizeof (ev)) ;
+  ev.events   = EPOLLIN ;
+  ev.data.u32 = pin ;
+
+  if (epoll_ctl (eventEpoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    line->used = FALSE ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * eventRegister:
+ *	Request the line of a pin with the edges of mode, or change the
+ *	edges of a line we already have, and add the handlers.
+ *	INT_EDGE_SETUP means an edge set up outside through /sys/class/gpio,
+ *	which the character device knows nothing about, so it is refused.
+ *	Returns 0, or -1 when the character device can't be used.
+ *********************************************************************************
+ */
+
+static int eventRegister (int pin, int mode, void (*function)(void),
+			  void (*batchFunction)(const struct wpiEvent *events, int count), int queued)
+{
+  struct gpio_v2_line_request req ;
+  struct gpio_v2_line_config  config ;
+  struct wpiLine *line = &eventLines [pin] ;
+  const char *chip ;
+  int offset, res = 0 ;
+
+  if ((mode != INT_EDGE_FALLING) && (mode != INT_EDGE_RISING) && (mode != INT_EDGE_BOTH))
+    return -1 ;
+
+  pthread_mutex_lock (&pinMutex) ;
+
+  if (eventStart () < 0)
+    res = -1 ;
+
+  if ((res == 0) && (eventChip == -1))
+  {
+    if ((chip = getenv (ENV_GPIOCHIP)) == NULL)
+      chip = "/dev/gpiochip0" ;
+    if ((eventChip = open (chip, O_RDWR | O_CLOEXEC)) < 0)
+      res = -1 ;
+  }
+
+  if ((res == 0) && !line->used)
+  {
+    if ((offset = eventLineOffset (pin)) < 0)
+      res = -1 ;
+    else
+    {
+      memset (&req, 0, sizeof (req)) ;
+      req.offsets [0]       = offset ;
+      req.num_lines         = 1 ;
+      req.event_buffer_size = EVENT_KERNEL ;
+      req.config.flags      = eventEdgeFlags (mode) ;
+      strcpy (req.consumer, "wiringPi") ;
+
+      if (ioctl (eventChip, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+	res = -1 ;
+      else
+      {
+
+// The handlers go in before the line does: its first edges may come at once
+
+	eventHandlers (line, function, batchFunction, queued) ;
+	if (eventAddLine (pin, req.fd, mode) < 0)
+	{
+	  close (req.fd) ;
+	  line->function      = NULL ;
+	  line->batchFunction = NULL ;
+	  line->queued        = FALSE ;
+	  res = -1 ;
+	}
+      }
+    }
+  }
+  else if (res == 0)
+  {
+    if (line->mode != mode)
+    {
+      memset (&config, 0, sizeof (config)) ;
+      config.flags = eventEdgeFlags (mode) ;
+      if (ioctl (line->fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+	res = -1 ;
+      else
+	line->mode = mode ;
+    }
+    if (res == 0)
+      eventHandlers (line, function, batchFunction, queued) ;
+  }
+
+  pthread_mutex_unlock (&pinMutex) ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: pin %d events from the GPIO character device: %s\n", pin, (res == 0) ? "yes" : "no") ;
+
+  return res ;
+}
+#endif
+
+
 /*
  * wiringPiISR:
  *	Pi Specific.
  *	Take the details and create an interrupt handler that will do a call-
  *	back to the user supplied function.
+ *	With the GPIO character device the edges come from the one event
+ *	dispatcher, otherwise from a thread per pin on /sys/class/gpio.
+ *	INT_EDGE_SETUP keeps the edge already set up in /sys/class/gpio,
+ *	so it always takes the sysfs path.
  *********************************************************************************
  */
 
@@ -2172,6 +2714,12 @@ int wiringPiISR (int pin, int mode, void (*function)(void))
     bcmGpioPin = physToGpio [pin] ;
   else
     bcmGpioPin = pin ;
+
+#ifdef	WPI_GPIO_CDEV
+  if (eventRegister (pin, mode, function, NULL, FALSE) == 0)
+    return 0 ;
+#endif
+
 	if(version==3)
 	{
 		if(edge[bcmGpioPin]==-1)
@@ -2235,6 +2783,145 @@ int wiringPiISR (int pin, int mode, void (*function)(void))
 }
 
 
+/*
+ * wiringPiISREvents:
+ *	Like wiringPiISR, but the function gets the edges with their
+ *	timestamps, all those read at once in one call.
+ *	Needs the GPIO character device and a mode other than INT_EDGE_SETUP.
+ *********************************************************************************
+ */
+
+int wiringPiISREvents (int pin, int mode, void (*function)(const struct wpiEvent *events, int count))
+{
+  if ((pin < 0) || (pin > 63))
+    return wiringPiFailure (WPI_FATAL, "wiringPiISREvents: pin must be 0-63 (%d)\n", pin) ;
+
+  if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return wiringPiFailure (WPI_FATAL, "wiringPiISREvents: wiringPi has not been initialised. Unable to continue.\n") ;
+
+#ifdef	WPI_GPIO_CDEV
+  if (eventRegister (pin, mode, NULL, function, FALSE) == 0)
+    return 0 ;
+#endif
+
+  return wiringPiFailure (WPI_FATAL, "wiringPiISREvents: unable to get pin %d from the GPIO character device\n", pin) ;
+}
+
+
+/*
+ * wiringPiEventQueue:
+ *	Queue the edges of a pin for wiringPiEventRead.
+ *	Needs the GPIO character device and a mode other than INT_EDGE_SETUP.
+ *********************************************************************************
+ */
+
+int wiringPiEventQueue (int pin, int mode)
+{
+  if ((pin < 0) || (pin > 63))
+    return wiringPiFailure (WPI_FATAL, "wiringPiEventQueue: pin must be 0-63 (%d)\n", pin) ;
+
+  if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return wiringPiFailure (WPI_FATAL, "wiringPiEventQueue: wiringPi has not been initialised. Unable to continue.\n") ;
+
+#ifdef	WPI_GPIO_CDEV
+  if (eventRegister (pin, mode, NULL, NULL, TRUE) == 0)
+    return 0 ;
+#endif
+
+  return wiringPiFailure (WPI_FATAL, "wiringPiEventQueue: unable to get pin %d from the GPIO character device\n", pin) ;
+}
+
+
+/*
+ * wiringPiEventRead:
+ *	Take up to max queued edges, waiting up to mS for one (-1 forever,
+ *	0 not at all). Only one thread may read.
+ *	Returns the number of edges, or -1 without the character device.
+ *********************************************************************************
+ */
+
+int wiringPiEventRead (struct wpiEvent *events, int max, int mS)
+{
+#ifdef	WPI_GPIO_CDEV
+  struct pollfd polls ;
+  struct timespec ts ;
+  unsigned int head, tail ;
+  uint64_t counter ;
+  long long now, deadline = 0 ;
+  int i, n, wait = mS ;
+
+  if (eventFd == -1)
+    return -1 ;
+
+  if (mS > 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    deadline = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + mS ;
+  }
+
+  tail = eventTail ;
+  for (;;)
+  {
+    head = __atomic_load_n (&eventHead, __ATOMIC_ACQUIRE) ;
+    if ((head != tail) || (wait == 0) || (max <= 0))
+      break ;
+
+// Nothing there: say we're waiting, look again and sleep on the eventfd.
+//	A wake up can be left over from edges already read, so go round
+//	until there are some or the time is up
+
+    __atomic_store_n (&eventWaiting, TRUE, __ATOMIC_RELAXED) ;
+    __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+    if (__atomic_load_n (&eventHead, __ATOMIC_ACQUIRE) == tail)
+    {
+      polls.fd     = eventFd ;
+      polls.events = POLLIN ;
+      (void)poll (&polls, 1, wait) ;
+    }
+    (void)read (eventFd, &counter, sizeof (counter)) ;
+    __atomic_store_n (&eventWaiting, FALSE, __ATOMIC_RELAXED) ;
+
+    if (mS > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &ts) ;
+      now  = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 ;
+      wait = (now < deadline) ? (int)(deadline - now) : 0 ;
+    }
+  }
+
+  n = head - tail ;
+  if (n > max)
+    n = max ;
+  for (i = 0 ; i < n ; ++i)
+    events [i] = eventQueue [tail++ & (EVENT_QUEUE - 1)] ;
+  __atomic_store_n (&eventTail, tail, __ATOMIC_RELEASE) ;
+
+  return n ;
+#else
+  return -1 ;
+#endif
+}
+
+
+/*
+ * wiringPiEventStats:
+ *	The totals of the edges read and lost.
+ *********************************************************************************
+ */
+
+void wiringPiEventStats (struct wpiEventStats *stats)
+{
+#ifdef	WPI_GPIO_CDEV
+  stats->events     = __atomic_load_n (&eventStats.events,     __ATOMIC_RELAXED) ;
+  stats->batches    = __atomic_load_n (&eventStats.batches,    __ATOMIC_RELAXED) ;
+  stats->kernelLost = __atomic_load_n (&eventStats.kernelLost, __ATOMIC_RELAXED) ;
+  stats->queueLost  = __atomic_load_n (&eventStats.queueLost,  __ATOMIC_RELAXED) ;
+#else
+  memset (stats, 0, sizeof (*stats)) ;
+#endif
+}
+
+
 /*
  * initialiseEpoch:
  *	Initialise our start-of-time variable to be the current unix
@@ -108,6 +108,49 @@ struct wiringPiNodeStruct
 extern struct wiringPiNodeStruct *wiringPiNodes ;
 
 
+// wpiPinHandle:
+//	An on-board pin looked up once by wpiGetPin (): the mapped data
+//	register of its bank and its bit, so a tight loop can drive the pin
+//	without the mode dispatch and pin table lookups of digitalWrite.
+//	The Raspberry Pi has separate set and clear registers, the A20 has
+//	only the data register and set is NULL.
+//	dat is NULL when the pin isn't an on-board pin of the current mode.
+
+typedef struct
+{
+  volatile unsigned int *dat ;
+  volatile unsigned int *set ;
+  volatile unsigned int *clr ;
+  unsigned int           mask ;
+} wpiPinHandle ;
+
+// wpiEvent:
+//	An edge of a wiringPiISR pin, read from the GPIO character device
+//	(Linux 5.10 on) with the time the kernel saw it.
+//	seqno counts the edges of the pin, so a gap means lost edges.
+
+struct wpiEvent
+{
+  unsigned long long timestamp ;	// nS, CLOCK_MONOTONIC
+  int                pin ;
+  int                edge ;		// INT_EDGE_RISING or INT_EDGE_FALLING
+  unsigned int       seqno ;
+} ;
+
+// wpiEventStats:
+//	Totals over all the pins. kernelLost are edges the kernel dropped
+//	as its buffer was full, queueLost those dropped by a full
+//	wiringPiEventRead queue.
+
+struct wpiEventStats
+{
+  unsigned long long events ;
+  unsigned long long batches ;
+  unsigned long long kernelLost ;
+  unsigned long long queueLost ;
+} ;
+
+
 // Function prototypes
 //	c++ wrappers thanks to a comment by Nick Lott
 //	(and others on the Raspberry Pi forums)
@@ -139,6 +182,10 @@ extern void pwmWrite            (int pin, int value) ;
 extern int  analogRead          (int pin) ;
 extern void analogWrite         (int pin, int value) ;
 
+// Pin handles
+
+extern wpiPinHandle wpiGetPin   (int pin) ;
+
 // PiFace specifics 
 //	(Deprecated)
 
@@ -153,6 +200,7 @@ extern int  physPinToGpio       (int physPin) ;
 extern void setPadDrive         (int group, int value) ;
 extern int  getAlt              (int pin) ;
 extern void digitalWriteByte    (int value) ;
+extern unsigned int digitalReadByte (void) ;
 extern void pwmSetMode          (int mode) ;
 extern void pwmSetRange         (unsigned int range) ;
 extern void pwmSetClock         (int divisor) ;
@@ -163,6 +211,10 @@ extern void gpioClockSet        (int pin, int freq) ;
 
 extern int  waitForInterrupt    (int pin, int mS) ;
 extern int  wiringPiISR         (int pin, int mode, void (*function)(void)) ;
+extern int  wiringPiISREvents   (int pin, int mode, void (*function)(const struct wpiEvent *events, int count)) ;
+extern int  wiringPiEventQueue  (int pin, int mode) ;
+extern int  wiringPiEventRead   (struct wpiEvent *events, int max, int mS) ;
+extern void wiringPiEventStats  (struct wpiEventStats *stats) ;
 
 // Threads
 
@@ -185,4 +237,56 @@ extern unsigned int micros            (void) ;
 }
 #endif
 
+// The pin handle operations:
+//	Inline, so a write is a single load/store on the register. The pin
+//	must already be an output (pinMode) and the handle valid.
+//	wpiPortWrite sets the bits of mask to those of value for all the
+//	pins of the bank at once - mask is the OR of the handle masks of
+//	pins with the same dat, one store on the A20.
+
+static inline void wpiPinSet (wpiPinHandle h)
+{
+  if (h.set)
+    *h.set = h.mask ;
+  else
+    *h.dat |= h.mask ;
+}
+
+static inline void wpiPinClear (wpiPinHandle h)
+{
+  if (h.set)
+    *h.clr = h.mask ;
+  else
+    *h.dat &= ~h.mask ;
+}
+
+static inline void wpiPinToggle (wpiPinHandle h)
+{
+  if (h.set)
+  {
+    if (*h.dat & h.mask)
+      *h.clr = h.mask ;
+    else
+      *h.set = h.mask ;
+  }
+  else
+    *h.dat ^= h.mask ;
+}
+
+static inline int wpiPinRead (wpiPinHandle h)
+{
+  return (*h.dat & h.mask) != 0 ;
+}
+
+static inline void wpiPortWrite (wpiPinHandle h, unsigned int mask, unsigned int value)
+{
+  if (h.set)
+  {
+    *h.set =  value & mask ;
+    *h.clr = ~value & mask ;
+  }
+  else
+    *h.dat = (*h.dat & ~mask) | (value & mask) ;
+}
+
 #endif